@@ -315,6 +315,70 @@ core.register_chatcommand("bench_bulk_get_node_vm", {
 	end,
 })
 
+local function get_bench_vm()
+	local vm = VoxelManip()
+	local emin, emax = vm:initialize(vector.new(0, 0, 0), vector.new(79, 79, 79),
+		{name = "air"})
+	return vm, VoxelArea(emin, emax)
+end
+
+local c_stone = core.CONTENT_UNKNOWN
+local c_air = core.CONTENT_AIR
+
+register_benchmark("vmanip_fill", function(fill)
+	local vm, va = get_bench_vm()
+	for _ = 1, 5 do
+		fill(vm, va)
+	end
+end, {
+	["table"] = function(vm, va)
+		local data = vm:get_data()
+		for i in va:iterp(va.MinEdge, va.MaxEdge) do
+			data[i] = c_stone
+		end
+		vm:set_data(data)
+	end,
+	["buffer get/set"] = function(vm, va)
+		local buf = vm:get_buffer()
+		for i = 1, #buf do
+			buf:set(i, c_stone)
+		end
+	end,
+	["buffer fill"] = function(vm, va)
+		vm:get_buffer():fill(c_stone)
+	end,
+})
+
+register_benchmark("vmanip_replace", function(replace)
+	local vm, va = get_bench_vm()
+	vm:get_buffer():fill(c_stone, va.MinEdge, va.MaxEdge:offset(0, -40, 0))
+	for _ = 1, 5 do
+		replace(vm, va, c_stone, c_air)
+		replace(vm, va, c_air, c_stone)
+	end
+end, {
+	["table"] = function(vm, va, from, to)
+		local data = vm:get_data()
+		for i = 1, #data do
+			if data[i] == from then
+				data[i] = to
+			end
+		end
+		vm:set_data(data)
+	end,
+	["buffer get/set"] = function(vm, va, from, to)
+		local buf = vm:get_buffer()
+		for i = 1, #buf do
+			if buf:get(i) == from then
+				buf:set(i, to)
+			end
+		end
+	end,
+	["buffer replace"] = function(vm, va, from, to)
+		vm:get_buffer():replace(from, to)
+	end,
+})
+
 core.register_chatcommand("bench_bulk_swap_node", {
 	params = "",
 	description = "Benchmark: Bulk-swap 99×99×99 stone nodes",
@@ -408,3 +408,136 @@ local function test_str_pack_unpack()
 	assert(a == 42.3 and b == -384)
 end
 unittests.register("test_str_pack_unpack", test_str_pack_unpack)
+
+local function test_voxel_buffer()
+	local vm = VoxelManip()
+	local c_air = core.CONTENT_AIR
+	local c_dirt = core.get_content_id("basenodes:dirt")
+	local c_stone = core.get_content_id("basenodes:stone")
+	local emin, emax = vm:initialize(vector.new(0, 0, 0), vector.new(0, 0, 0),
+		{name = "air"})
+	local va = VoxelArea(emin, emax)
+
+	local content = vm:get_buffer()
+	local param2 = vm:get_buffer("param2")
+	assert(#content == va:getVolume() and content:get_size() == #content)
+
+	-- get/set go straight to the VoxelManip
+	content:set(va:index(1, 2, 3), c_dirt)
+	assert(vm:get_data()[va:index(1, 2, 3)] == c_dirt)
+	assert(content:get(va:index(1, 2, 3)) == c_dirt)
+	assert(not pcall(content.get, content, 0))
+	assert(not pcall(content.get, content, #content + 1))
+
+	content:fill(c_stone, vector.new(0, 0, 0), vector.new(3, 3, 3))
+	assert(content:get(va:index(3, 3, 3)) == c_stone)
+	assert(content:get(va:index(4, 3, 3)) == c_air)
+	assert(content:replace(c_stone, c_dirt) == 4 * 4 * 4)
+	assert(content:get(va:index(0, 0, 0)) == c_dirt)
+
+	param2:fill(7)
+	assert(vm:get_param2_data()[va:index(5, 5, 5)] == 7)
+
+	-- copy_from works by position
+	local vm2 = VoxelManip()
+	vm2:initialize(vector.new(0, 0, 0), vector.new(16, 0, 0), {name = "air"})
+	local va2 = VoxelArea(vm2:get_emerged_area())
+	local content2 = vm2:get_buffer()
+	content2:fill(c_stone)
+	content2:copy_from(content)
+	assert(content2:get(va2:index(0, 0, 0)) == c_dirt)
+	assert(content2:get(va2:index(15, 0, 0)) == c_air)
+	assert(content2:get(va2:index(16, 0, 0)) == c_stone)
+	assert(not pcall(content.copy_from, content, param2))
+end
+unittests.register("test_voxel_buffer", test_voxel_buffer)
+
+local function test_find_nodes(_, pos)
+	local minp, maxp = pos:offset(-20, -20, -20), pos:offset(20, 20, 20)
+	local changes = {
+		{pos:offset(1, 0, 0), "basenodes:dirt"},
+		{pos:offset(1, 1, 0), "air"},
+		{pos:offset(-3, 2, 4), "basenodes:sand"},
+		{pos:offset(-3, 3, 4), "air"},
+		{pos:offset(2, -1, -2), "basenodes:sand"},
+		{pos:offset(2, 0, -2), "basenodes:dirt"},
+	}
+	local old = {}
+	for i, change in ipairs(changes) do
+		old[i] = core.get_node(change[1])
+		core.swap_node(change[1], {name = change[2]})
+	end
+
+	local function key(p)
+		return core.hash_node_position(p)
+	end
+	-- The same lookups done by hand
+	local function brute_force(names)
+		local found, under_air = {}, {}
+		local count = 0
+		for z = minp.z, maxp.z do
+		for y = minp.y, maxp.y do
+		for x = minp.x, maxp.x do
+			local p = vector.new(x, y, z)
+			local name = core.get_node(p).name
+			if table.indexof(names, name) > 0 then
+				found[key(p)] = true
+				count = count + 1
+				if name ~= "air" and core.get_node(p:offset(0, 1, 0)).name == "air" then
+					under_air[key(p)] = true
+				end
+			end
+		end
+		end
+		end
+		return found, count, under_air
+	end
+	local function check(list, expect, count)
+		assert(#list == count)
+		for _, p in ipairs(list) do
+			assert(expect[key(p)])
+		end
+	end
+
+	for _, names in ipairs({
+		{"basenodes:dirt", "basenodes:sand"},
+		{"basenodes:lava_source"},
+		{"ignore"},
+		{"air", "basenodes:dirt"},
+	}) do
+		local expect, count, expect_under_air = brute_force(names)
+
+		local list, counts = core.find_nodes_in_area(minp, maxp, names)
+		check(list, expect, count)
+		local total = 0
+		for _, n in pairs(counts) do
+			total = total + n
+		end
+		assert(total == count)
+
+		local n_grouped = 0
+		for _, group in pairs(core.find_nodes_in_area(minp, maxp, names, true)) do
+			check(group, expect, #group)
+			n_grouped = n_grouped + #group
+		end
+		assert(n_grouped == count)
+
+		local under_air = core.find_nodes_in_area_under_air(minp, maxp, names)
+		local n_under_air = 0
+		for _ in pairs(expect_under_air) do
+			n_under_air = n_under_air + 1
+		end
+		check(under_air, expect_under_air, n_under_air)
+
+		local near = core.find_node_near(pos, 20, names, true)
+		assert((near ~= nil) == (count > 0))
+		if near then
+			assert(expect[key(near)])
+		end
+	end
+
+	for i, change in ipairs(changes) do
+		core.swap_node(change[1], old[i])
+	end
+end
+unittests.register("test_find_nodes", test_find_nodes, {map=true})
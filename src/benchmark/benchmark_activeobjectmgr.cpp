@@ -38,22 +38,28 @@ inline v3f randpos()
 		myrand_range(-POS_RANGE, POS_RANGE));
 }
 
-inline void fill(server::ActiveObjectMgr &mgr, size_t n)
+inline std::vector<u16> fill(server::ActiveObjectMgr &mgr, size_t n)
 {
+	std::vector<u16> ids;
 	mgr.clear();
 	for (size_t i = 0; i < n; i++) {
 		auto obj = std::make_unique<TestObject>(randpos());
+		auto *ptr = obj.get();
 		bool ok = mgr.registerObject(std::move(obj));
 		REQUIRE(ok);
+		ids.push_back(ptr->getId());
 	}
+	return ids;
 }
 
+using SpatialIndexType = server::ActiveObjectMgr::SpatialIndexType;
+
 }
 
-template <size_t N>
+template <SpatialIndexType T, size_t N>
 void benchGetObjectsInsideRadius(Catch::Benchmark::Chronometer &meter)
 {
-	server::ActiveObjectMgr mgr;
+	server::ActiveObjectMgr mgr(T);
 	size_t x;
 	std::vector<ServerActiveObject*> result;
 
@@ -72,10 +78,10 @@ void benchGetObjectsInsideRadius(Catch::Benchmark::Chronometer &meter)
 	mgr.clear(); // implementation expects this
 }
 
-template <size_t N>
+template <SpatialIndexType T, size_t N>
 void benchGetObjectsInArea(Catch::Benchmark::Chronometer &meter)
 {
-	server::ActiveObjectMgr mgr;
+	server::ActiveObjectMgr mgr(T);
 	size_t x;
 	std::vector<ServerActiveObject*> result;
 
@@ -97,22 +103,69 @@ void benchGetObjectsInArea(Catch::Benchmark::Chronometer &meter)
 	mgr.clear(); // implementation expects this
 }
 
-#define BENCH_INSIDE_RADIUS(_count) \
-	BENCHMARK_ADVANCED("inside_radius_" #_count)(Catch::Benchmark::Chronometer meter) \
-	{ benchGetObjectsInsideRadius<_count>(meter); };
-
-#define BENCH_IN_AREA(_count) \
-	BENCHMARK_ADVANCED("in_area_" #_count)(Catch::Benchmark::Chronometer meter) \
-	{ benchGetObjectsInArea<_count>(meter); };
+// One server step of a mob-heavy server: every object moves a little,
+// then every player looks for the objects around it.
+template <SpatialIndexType T, size_t N>
+void benchChurn(Catch::Benchmark::Chronometer &meter)
+{
+	server::ActiveObjectMgr mgr(T);
+	size_t x;
+	std::vector<ServerActiveObject*> result;
 
-TEST_CASE("ActiveObjectMgr") {
-	BENCH_INSIDE_RADIUS(200)
-	BENCH_INSIDE_RADIUS(1450)
-	BENCH_INSIDE_RADIUS(10000)
+	auto cb = [&x] (ServerActiveObject *obj) -> bool {
+		x += obj->m_static_exists ? 0 : 1;
+		return false;
+	};
+	const auto ids = fill(mgr, N);
+	meter.measure([&] {
+		x = 0;
+		for (u16 id : ids) {
+			ServerActiveObject *obj = mgr.getActiveObject(id);
+			v3f pos = obj->getBasePosition() + v3f(myrand_range(-BS, BS),
+				myrand_range(-BS, BS) * 0.1f, myrand_range(-BS, BS));
+			obj->setBasePosition(pos);
+			mgr.updateObjectPos(id, pos); // no environment to do this
+		}
+		for (int i = 0; i < 20; i++)
+			mgr.getObjectsInsideRadius(randpos(), 30.0f, result, cb);
+		return x;
+	});
+	REQUIRE(result.empty());
 
-	BENCH_IN_AREA(200)
-	BENCH_IN_AREA(1450)
-	BENCH_IN_AREA(10000)
+	mgr.clear(); // implementation expects this
 }
 
-// TODO benchmark active object manager update costs
+#define BENCH_INSIDE_RADIUS(_type, _count) \
+	BENCHMARK_ADVANCED("inside_radius_" #_type "_" #_count)(Catch::Benchmark::Chronometer meter) \
+	{ benchGetObjectsInsideRadius<SpatialIndexType::_type, _count>(meter); };
+
+#define BENCH_IN_AREA(_type, _count) \
+	BENCHMARK_ADVANCED("in_area_" #_type "_" #_count)(Catch::Benchmark::Chronometer meter) \
+	{ benchGetObjectsInArea<SpatialIndexType::_type, _count>(meter); };
+
+#define BENCH_CHURN(_type, _count) \
+	BENCHMARK_ADVANCED("churn_" #_type "_" #_count)(Catch::Benchmark::Chronometer meter) \
+	{ benchChurn<SpatialIndexType::_type, _count>(meter); };
+
+TEST_CASE("ActiveObjectMgr") {
+	BENCH_INSIDE_RADIUS(KdTree, 200)
+	BENCH_INSIDE_RADIUS(KdTree, 1450)
+	BENCH_INSIDE_RADIUS(KdTree, 10000)
+	BENCH_INSIDE_RADIUS(HashGrid, 200)
+	BENCH_INSIDE_RADIUS(HashGrid, 1450)
+	BENCH_INSIDE_RADIUS(HashGrid, 10000)
+
+	BENCH_IN_AREA(KdTree, 200)
+	BENCH_IN_AREA(KdTree, 1450)
+	BENCH_IN_AREA(KdTree, 10000)
+	BENCH_IN_AREA(HashGrid, 200)
+	BENCH_IN_AREA(HashGrid, 1450)
+	BENCH_IN_AREA(HashGrid, 10000)
+
+	BENCH_CHURN(KdTree, 200)
+	BENCH_CHURN(KdTree, 1450)
+	BENCH_CHURN(KdTree, 10000)
+	BENCH_CHURN(HashGrid, 200)
+	BENCH_CHURN(HashGrid, 1450)
+	BENCH_CHURN(HashGrid, 10000)
+}
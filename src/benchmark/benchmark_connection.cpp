@@ -0,0 +1,205 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "catch.h"
+#include "exceptions.h"
+#include "network/address.h"
+#include "network/peerhandler.h"
+#include "network/connection.h"
+#include "network/mtp/internal.h"
+#include "network/networkpacket.h"
+#include "porting.h"
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr u16 PORT = 30011;
+constexpr u32 PACKETS_PER_PEER = 100;
+constexpr u16 CMD_UNRELIABLE = 0x70, CMD_RELIABLE = 0x71;
+
+struct PeerList : public con::PeerHandler
+{
+	void peerAdded(con::IPeer *peer) override { ids.push_back(peer->id); }
+	void deletingPeer(con::IPeer *peer, bool timeout) override {}
+
+	std::vector<session_t> ids;
+};
+
+// A server with clients on the loopback interface. A background thread
+// receives everything the clients get.
+class LoopbackNet
+{
+public:
+	LoopbackNet(u32 client_count)
+	{
+		const Address address(127, 0, 0, 1, PORT);
+		server.reset(con::createMTP(30.0f, false, &server_peers));
+		server->Serve(address);
+
+		client_peers.resize(client_count);
+		for (auto &handler : client_peers) {
+			clients.emplace_back(con::createMTP(30.0f, false, &handler));
+			clients.back()->Connect(address);
+		}
+
+		// Handshake, which needs Receive() calls on both sides
+		const u64 t_end = porting::getTimeMs() + 10000;
+		NetworkPacket pkt;
+		while (!connected()) {
+			if (porting::getTimeMs() > t_end)
+				throw BaseException("LoopbackNet: connecting timed out");
+			for (auto &client : clients)
+				client->TryReceive(&pkt);
+			server->ReceiveTimeoutMs(&pkt, 10);
+		}
+
+		drain_thread = std::thread([this] () { drain(); });
+	}
+
+	~LoopbackNet()
+	{
+		stop = true;
+		drain_thread.join();
+		clients.clear();
+		server.reset();
+	}
+
+	const std::vector<session_t> &peers() const { return server_peers.ids; }
+
+	PeerList server_peers;
+	std::unique_ptr<con::IConnection> server;
+	std::vector<PeerList> client_peers;
+	std::vector<std::unique_ptr<con::IConnection>> clients;
+
+	std::atomic<u64> received_reliable = 0;
+
+private:
+	bool connected()
+	{
+		if (server_peers.ids.size() < clients.size())
+			return false;
+		for (auto &client : clients) {
+			if (!client->Connected())
+				return false;
+		}
+		return true;
+	}
+
+	void drain()
+	{
+		NetworkPacket pkt;
+		while (!stop) {
+			bool idle = true;
+			for (auto &client : clients) {
+				while (client->TryReceive(&pkt)) {
+					idle = false;
+					if (pkt.getCommand() == CMD_RELIABLE)
+						received_reliable++;
+				}
+			}
+			if (idle)
+				std::this_thread::yield();
+		}
+	}
+
+	std::atomic<bool> stop = false;
+	std::thread drain_thread;
+};
+
+void send_all(LoopbackNet &net, u16 command, bool reliable)
+{
+	for (u32 i = 0; i < PACKETS_PER_PEER; i++) {
+		for (session_t peer_id : net.peers()) {
+			NetworkPacket pkt(command, 64);
+			pkt.putRawString(std::string(64, 'x'));
+			net.server->Send(peer_id, reliable ? 0 : 1, &pkt, reliable);
+		}
+	}
+}
+
+// Sends `packets` reliables through a full send window, like the send thread
+// does: lost packets are acknowledged only after being re-sent.
+void stream_reliables(const std::vector<con::BufferedPacketPtr> &packets,
+	u32 window, float loss)
+{
+	std::mt19937 rng(42);
+	std::bernoulli_distribution lost(loss);
+	con::ReliablePacketBuffer buf;
+	std::vector<u32> in_flight, still_in_flight;
+	size_t next = 0;
+
+	while (next < packets.size() || !in_flight.empty()) {
+		while (next < packets.size() && buf.size() < window) {
+			con::BufferedPacketPtr p = packets[next];
+			// same as ConnectionSendThread::sendAsPacketReliable()
+			const u16 outgoing_seqnum = p->getSeqnum() + 1;
+			buf.insert(p, (outgoing_seqnum - MAX_RELIABLE_WINDOW_SIZE) %
+				(MAX_RELIABLE_WINDOW_SIZE + 1));
+			in_flight.push_back(next++);
+		}
+
+		buf.incrementTimeouts(0.05f);
+		buf.getResend(0.1f, window);
+
+		still_in_flight.clear();
+		for (u32 i : in_flight) {
+			if (lost(rng))
+				still_in_flight.push_back(i);
+			else
+				buf.popSeqnum(packets[i]->getSeqnum());
+		}
+		in_flight.swap(still_in_flight);
+	}
+}
+
+}
+
+TEST_CASE("benchmark_reliable_buffer")
+{
+	constexpr u32 window = MAX_RELIABLE_WINDOW_SIZE_SEND;
+
+	std::vector<con::BufferedPacketPtr> packets;
+	SharedBuffer<u8> data(64);
+	for (u32 i = 0; i < 16 * window; i++) {
+		packets.push_back(con::makePacket(Address(127, 0, 0, 1, PORT),
+			con::makeReliablePacket(data, SEQNUM_INITIAL + 1 + i), PROTOCOL_ID, 1, 0));
+	}
+
+	for (int loss : {1, 5, 10}) {
+		BENCHMARK("stream_" + std::to_string(packets.size()) + "_loss" +
+				std::to_string(loss) + "pct", i) {
+			stream_reliables(packets, window, loss / 100.0f);
+			return i;
+		};
+	}
+}
+
+TEST_CASE("benchmark_connection")
+{
+	for (u32 client_count : {8, 32}) {
+		LoopbackNet net(client_count);
+		const std::string suffix = "_" + std::to_string(client_count) + "peers";
+
+		// Cost for the sending (server) thread while the connection threads
+		// are busy with what was sent before
+		BENCHMARK("send_unreliable" + suffix, i) {
+			send_all(net, CMD_UNRELIABLE, false);
+			return i;
+		};
+
+		// Until everything was acknowledged and received
+		BENCHMARK("send_reliable_delivered" + suffix, i) {
+			const u64 target = net.received_reliable +
+				PACKETS_PER_PEER * net.peers().size();
+			send_all(net, CMD_RELIABLE, true);
+			while (net.received_reliable < target)
+				std::this_thread::yield();
+			return i;
+		};
+	}
+}
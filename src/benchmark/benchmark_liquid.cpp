@@ -0,0 +1,116 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "catch.h"
+#include "liquidtransform.h"
+#include "nodedef.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "threading/thread_pool.h"
+#include <memory>
+#include <vector>
+
+// 128x32x128 nodes: a stone floor with a grid of water sources on top
+static const v3s16 bpmin(-4, -1, -4), bpmax(3, 0, 3);
+static const u32 steps = 8;
+
+struct LiquidScene {
+	std::unique_ptr<DummyMap> map;
+	UniqueQueue<v3s16> queue;
+
+	LiquidScene(IGameDef *gamedef, content_t c_stone, content_t c_source)
+	{
+		map = std::make_unique<DummyMap>(gamedef, bpmin, bpmax);
+		map->fill(bpmin, v3s16(bpmax.X, -1, bpmax.Z), MapNode(c_stone));
+		map->fill(v3s16(bpmin.X, 0, bpmin.Z), bpmax, MapNode(CONTENT_AIR));
+		for (s16 z = bpmin.Z * MAP_BLOCKSIZE; z < (bpmax.Z + 1) * MAP_BLOCKSIZE; z += 8)
+		for (s16 x = bpmin.X * MAP_BLOCKSIZE; x < (bpmax.X + 1) * MAP_BLOCKSIZE; x += 8) {
+			map->setNode(v3s16(x, 0, z), MapNode(c_source));
+			queue.push_back(v3s16(x, 0, z));
+		}
+	}
+};
+
+static void step_serial(LiquidScene &scene)
+{
+	LiquidTransformResult result;
+	LiquidTransform transform(scene.map.get(), &scene.queue, &result);
+	for (size_t n = scene.queue.size(); n > 0; n--) {
+		v3s16 p = scene.queue.front();
+		scene.queue.pop_front();
+		transform.transformNode(p);
+	}
+	for (v3s16 p : result.must_reflow)
+		scene.queue.push_back(p);
+}
+
+static void step_parallel(LiquidScene &scene, ThreadPool &pool)
+{
+	std::vector<v3s16> nodes;
+	while (!scene.queue.empty()) {
+		nodes.push_back(scene.queue.front());
+		scene.queue.pop_front();
+	}
+	LiquidTransformResult result;
+	std::vector<v3s16> deferred;
+	LiquidTransform::transformParallel(scene.map.get(), &pool, nodes,
+		scene.queue, deferred, result);
+	for (v3s16 p : result.must_reflow)
+		scene.queue.push_back(p);
+}
+
+TEST_CASE("benchmark_liquid")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t c_stone;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, std::move(f));
+	}
+
+	content_t c_source = CONTENT_IGNORE, c_flowing = CONTENT_IGNORE;
+	const auto add_water = [&] (const std::string &name, LiquidType type) {
+		ContentFeatures f;
+		f.name = name;
+		f.walkable = false;
+		f.liquid_type = type;
+		f.liquid_alternative_source_id = c_source;
+		f.liquid_alternative_flowing_id = c_flowing;
+		return ndef->set(f.name, std::move(f));
+	};
+	// twice so that the alternative ids are known
+	for (int i = 0; i < 2; i++) {
+		c_source = add_water("water_source", LIQUID_SOURCE);
+		c_flowing = add_water("water_flowing", LIQUID_FLOWING);
+	}
+
+	const auto make_scenes = [&] (int count) {
+		std::vector<std::unique_ptr<LiquidScene>> scenes;
+		for (int i = 0; i < count; i++)
+			scenes.emplace_back(std::make_unique<LiquidScene>(&gamedef, c_stone, c_source));
+		return scenes;
+	};
+
+	BENCHMARK_ADVANCED("transform_serial")(Catch::Benchmark::Chronometer meter) {
+		auto scenes = make_scenes(meter.runs());
+		meter.measure([&] (int i) {
+			for (u32 n = 0; n < steps; n++)
+				step_serial(*scenes[i]);
+		});
+	};
+
+	for (u32 threads : {1, 2, 4}) {
+		ThreadPool pool("Liquid", threads - 1);
+		BENCHMARK_ADVANCED("transform_parallel_" + std::to_string(threads))(Catch::Benchmark::Chronometer meter) {
+			auto scenes = make_scenes(meter.runs());
+			meter.measure([&] (int i) {
+				for (u32 n = 0; n < steps; n++)
+					step_parallel(*scenes[i], pool);
+			});
+		};
+	}
+}
@@ -90,31 +90,24 @@ static u32 workOnBoth(const MBContainer &vec)
 {
 	int foo = 0;
 	for (MapBlock *block : vec) {
-		block->contents.clear();
-
-		bool want_contents_cached = block->contents.empty() && !block->do_not_cache_contents;
+		const auto &counts = block->getContentCounts();
+		if (counts.empty())
+			continue;
+		u32 remaining = counts.front().second;
 
 		v3s16 p0;
-		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
-		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
-		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
+		for(p0.X=0; p0.X<MAP_BLOCKSIZE && remaining > 0; p0.X++)
+		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE && remaining > 0; p0.Y++)
+		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE && remaining > 0; p0.Z++)
 		{
 			MapNode n = block->getNodeNoCheck(p0);
-			content_t c = n.getContent();
-
-			if (want_contents_cached && !CONTAINS(block->contents, c)) {
-				if (block->contents.size() >= 10) {
-					want_contents_cached = false;
-					block->do_not_cache_contents = true;
-					block->contents.clear();
-					block->contents.shrink_to_fit();
-				} else {
-					block->contents.push_back(c);
-				}
+			if (n.getContent() == counts.front().first) {
+				foo += p0.X;
+				remaining--;
 			}
 		}
 
-		foo += block->contents.size();
+		foo += counts.size();
 	}
 	return foo;
 }
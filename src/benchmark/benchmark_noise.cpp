@@ -0,0 +1,97 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "catch.h"
+#include "noise.h"
+#include "mapgen/mapgen_carpathian.h"
+#include "mapgen/mapgen_v7.h"
+#include "mapgen/mapgen_valleys.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Noise maps for one mapchunk (default chunksize), like the mapgens create them
+struct MapgenNoises {
+	std::vector<std::unique_ptr<Noise>> maps_2d, maps_3d;
+
+	void add2D(const NoiseParams &np)
+	{
+		maps_2d.emplace_back(std::make_unique<Noise>(&np, 1234, 80, 80));
+	}
+
+	void add3D(const NoiseParams &np)
+	{
+		maps_3d.emplace_back(std::make_unique<Noise>(&np, 1234, 80, 82, 80));
+	}
+
+	void run(s32 chunk)
+	{
+		float x = chunk * 80, y = -32, z = chunk * -80;
+		for (auto &noise : maps_2d)
+			noise->noiseMap2D(x, z);
+		for (auto &noise : maps_3d)
+			noise->noiseMap3D(x, y, z);
+	}
+};
+
+static void benchmarkMapgen(const std::string &name, MapgenNoises &noises)
+{
+	const std::pair<NoiseKernelSet, const char *> sets[] = {
+		{NoiseKernelSet::Scalar, "scalar"},
+		{NoiseKernelSet::SSE2, "sse2"},
+		{NoiseKernelSet::AVX2, "avx2"},
+	};
+	for (auto &it : sets) {
+		if (!setNoiseKernelSet(it.first))
+			continue;
+
+		BENCHMARK_ADVANCED(name + "_" + it.second)(Catch::Benchmark::Chronometer meter) {
+			meter.measure([&] (int i) {
+				noises.run(i);
+			});
+		};
+	}
+	setNoiseKernelSet(NoiseKernelSet::Auto);
+}
+
+TEST_CASE("benchmark_noise")
+{
+	{
+		MapgenV7Params p;
+		MapgenNoises noises;
+		for (auto *np : {&p.np_terrain_base, &p.np_terrain_alt, &p.np_terrain_persist,
+				&p.np_height_select, &p.np_filler_depth, &p.np_mount_height,
+				&p.np_ridge_uwater})
+			noises.add2D(*np);
+		for (auto *np : {&p.np_mountain, &p.np_ridge, &p.np_cave1, &p.np_cave2,
+				&p.np_cavern})
+			noises.add3D(*np);
+		benchmarkMapgen("mapgen_v7", noises);
+	}
+
+	{
+		MapgenValleysParams p;
+		MapgenNoises noises;
+		for (auto *np : {&p.np_filler_depth, &p.np_inter_valley_slope, &p.np_rivers,
+				&p.np_terrain_height, &p.np_valley_depth, &p.np_valley_profile})
+			noises.add2D(*np);
+		for (auto *np : {&p.np_inter_valley_fill, &p.np_cave1, &p.np_cave2,
+				&p.np_cavern})
+			noises.add3D(*np);
+		benchmarkMapgen("mapgen_valleys", noises);
+	}
+
+	{
+		MapgenCarpathianParams p;
+		MapgenNoises noises;
+		for (auto *np : {&p.np_filler_depth, &p.np_height1, &p.np_height2,
+				&p.np_height3, &p.np_height4, &p.np_hills_terrain,
+				&p.np_ridge_terrain, &p.np_step_terrain, &p.np_hills,
+				&p.np_ridge_mnt, &p.np_step_mnt, &p.np_rivers})
+			noises.add2D(*np);
+		for (auto *np : {&p.np_mnt_var, &p.np_cave1, &p.np_cave2, &p.np_cavern})
+			noises.add3D(*np);
+		benchmarkMapgen("mapgen_carpathian", noises);
+	}
+}
@@ -0,0 +1,143 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "catch.h"
+#include "mapgen/mg_schematic.h"
+#include "nodedef.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+
+namespace {
+class BenchSchematic : public Schematic {
+public:
+	BenchSchematic(const NodeDefManager *ndef, v3s16 size)
+	{
+		m_ndef = ndef;
+		this->size = size;
+		schemdata = new MapNode[size.X * size.Y * size.Z];
+		slice_probs = new u8[size.Y];
+		for (s16 y = 0; y != size.Y; y++)
+			slice_probs[y] = MTSCHEM_PROB_ALWAYS;
+	}
+
+	MapNode &at(s16 x, s16 y, s16 z)
+	{
+		return schemdata[(z * size.Y + y) * size.X + x];
+	}
+};
+}
+
+// A trunk with a ball of leaves, as placed by tree decorations
+static void make_tree(BenchSchematic &schem, content_t c_trunk, content_t c_leaves)
+{
+	const v3s16 size = schem.size;
+	const v3s16 center = size / 2;
+	for (s16 z = 0; z != size.Z; z++)
+	for (s16 y = 0; y != size.Y; y++)
+	for (s16 x = 0; x != size.X; x++) {
+		MapNode &n = schem.at(x, y, z);
+		if (x == center.X && z == center.Z && y < size.Y - 1) {
+			n = MapNode(c_trunk, MTSCHEM_PROB_ALWAYS | MTSCHEM_FORCE_PLACE, 0);
+		} else if (y >= 3) {
+			bool corner = (x == 0 || x == size.X - 1) && (z == 0 || z == size.Z - 1);
+			n = MapNode(c_leaves, corner ? 0x40 : MTSCHEM_PROB_ALWAYS, 0);
+		} else {
+			n = MapNode(CONTENT_AIR, MTSCHEM_PROB_NEVER, 0);
+		}
+	}
+}
+
+// Walls, floors and air inside, as placed by structure mods
+static void make_building(BenchSchematic &schem, content_t c_wall, content_t c_stairs)
+{
+	const v3s16 size = schem.size;
+	for (s16 z = 0; z != size.Z; z++)
+	for (s16 y = 0; y != size.Y; y++)
+	for (s16 x = 0; x != size.X; x++) {
+		bool wall = x == 0 || x == size.X - 1 || z == 0 || z == size.Z - 1 ||
+			y % 5 == 0;
+		content_t c = wall ? c_wall : CONTENT_AIR;
+		if (!wall && x == 2 && z == y % 5 + 1)
+			c = c_stairs;
+		schem.at(x, y, z) = MapNode(c, MTSCHEM_PROB_ALWAYS | MTSCHEM_FORCE_PLACE, 1);
+	}
+}
+
+TEST_CASE("benchmark_schematic")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t c_stone, c_trunk, c_leaves, c_stairs;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, std::move(f));
+	}
+	{
+		ContentFeatures f;
+		f.name = "trunk";
+		f.param_type_2 = CPT2_FACEDIR;
+		c_trunk = ndef->set(f.name, std::move(f));
+	}
+	{
+		ContentFeatures f;
+		f.name = "leaves";
+		c_leaves = ndef->set(f.name, std::move(f));
+	}
+	{
+		ContentFeatures f;
+		f.name = "stairs";
+		f.param_type_2 = CPT2_FACEDIR;
+		c_stairs = ndef->set(f.name, std::move(f));
+	}
+
+	const v3s16 bpmin(-2, -2, -2), bpmax(1, 1, 1);
+	DummyMap map(&gamedef, bpmin, bpmax);
+
+	// One 80x80x80 mapchunk, the lower half stone
+	MMVManip vm(&map);
+	const VoxelArea area(v3s16(-40), v3s16(39));
+	vm.addArea(area);
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+		u32 vi = area.index(area.MinEdge.X, y, z);
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++, vi++)
+			vm.m_data[vi] = MapNode(y < 0 ? c_stone : CONTENT_AIR);
+	}
+
+	BenchSchematic tree(ndef, v3s16(5, 7, 5));
+	make_tree(tree, c_trunk, c_leaves);
+	BenchSchematic large_tree(ndef, v3s16(9, 14, 9));
+	make_tree(large_tree, c_trunk, c_leaves);
+	BenchSchematic building(ndef, v3s16(16, 16, 16));
+	make_building(building, c_stone, c_stairs);
+
+	// 64 placements spread over the chunk, in all rotations
+	const auto place_all = [&] (Schematic &schem, bool force_place) {
+		for (s16 z = -32; z < 32; z += 8)
+		for (s16 x = -32; x < 32; x += 8) {
+			Rotation rot = (Rotation)((x / 8 + z / 8) & 3);
+			schem.blitToVManip(&vm, v3s16(x, 0, z), rot, force_place);
+		}
+	};
+
+	BENCHMARK("place_tree_5x7x5") {
+		place_all(tree, false);
+	};
+
+	BENCHMARK("place_tree_9x14x9") {
+		place_all(large_tree, false);
+	};
+
+	BENCHMARK("place_building_16x16x16") {
+		place_all(building, true);
+	};
+
+	BENCHMARK("place_building_16x16x16_clipped") {
+		// Mostly outside of the voxel area
+		for (s16 i = -48; i < 48; i += 4)
+			building.blitToVManip(&vm, v3s16(i, 30, 33), ROTATE_90, true);
+	};
+}
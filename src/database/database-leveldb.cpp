@@ -19,6 +19,7 @@
 #include "util/string.h"
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 
 #define ENSURE_STATUS_OK(s) \
@@ -84,6 +85,41 @@ void Database_LevelDB::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	ENSURE_STATUS_OK(it->status());  // Check for any errors found during the scan
 }
 
+bool Database_LevelDB::saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks)
+{
+	leveldb::WriteBatch batch;
+	for (auto &it : blocks) {
+		batch.Put(i64tos(getBlockAsInteger(it.first)),
+			leveldb::Slice(it.second.data(), it.second.size()));
+	}
+
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &batch);
+	if (!status.ok()) {
+		warningstream << "saveBlocks: LevelDB error saving "
+			<< blocks.size() << " blocks: " << status.ToString() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void Database_LevelDB::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	blocks.resize(pos.size());
+
+	// Read all blocks from the same consistent view
+	leveldb::ReadOptions options;
+	options.snapshot = m_database->GetSnapshot();
+	for (size_t i = 0; i < pos.size(); i++) {
+		leveldb::Status status = m_database->Get(options,
+			i64tos(getBlockAsInteger(pos[i])), &blocks[i]);
+		if (!status.ok())
+			blocks[i].clear();
+	}
+	m_database->ReleaseSnapshot(options.snapshot);
+}
+
 PlayerDatabaseLevelDB::PlayerDatabaseLevelDB(const std::string &savedir)
 {
 	leveldb::Options options;
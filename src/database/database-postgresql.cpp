@@ -20,6 +20,7 @@
 #include "remoteplayer.h"
 #include "server/player_sao.h"
 #include <cstdlib>
+#include <cstring>
 
 Database_PostgreSQL::Database_PostgreSQL(const std::string &connect_string,
 	const char *type) :
@@ -201,6 +202,31 @@ void MapDatabasePostgreSQL::initStatements()
 				"UPDATE SET data = $4::bytea");
 	}
 
+	// Batched variants handling BATCH_SIZE blocks per statement
+	std::string read_batch = "SELECT posX::int4, posY::int4, posZ::int4, data "
+		"FROM blocks WHERE (posX, posY, posZ) IN (";
+	std::string write_batch = "INSERT INTO blocks (posX, posY, posZ, data) VALUES ";
+	auto arg = [] (int n, const char *type) {
+		return "$" + itos(n) + "::" + type;
+	};
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		read_batch.append(i == 0 ? "(" : ", (")
+			.append(arg(i * 3 + 1, "int4")).append(", ")
+			.append(arg(i * 3 + 2, "int4")).append(", ")
+			.append(arg(i * 3 + 3, "int4")).append(")");
+		write_batch.append(i == 0 ? "(" : ", (")
+			.append(arg(i * 4 + 1, "int4")).append(", ")
+			.append(arg(i * 4 + 2, "int4")).append(", ")
+			.append(arg(i * 4 + 3, "int4")).append(", ")
+			.append(arg(i * 4 + 4, "bytea")).append(")");
+	}
+	read_batch.append(")");
+	write_batch.append(" ON CONFLICT ON CONSTRAINT blocks_pkey DO "
+		"UPDATE SET data = EXCLUDED.data");
+	prepareStatement("read_blocks", read_batch);
+	if (getPGVersion() >= 90500)
+		prepareStatement("write_blocks", write_batch);
+
 	prepareStatement("delete_block", "DELETE FROM blocks WHERE "
 		"posX = $1::int4 AND posY = $2::int4 AND posZ = $3::int4");
 
@@ -297,6 +323,109 @@ void MapDatabasePostgreSQL::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	PQclear(results);
 }
 
+bool MapDatabasePostgreSQL::saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks)
+{
+	// Old servers can't upsert more than one row per statement
+	if (getPGVersion() < 90500)
+		return MapDatabase::saveBlocks(blocks);
+
+	verifyDatabase();
+
+	s32 coords[BATCH_SIZE * 3];
+	const void *args[BATCH_SIZE * 4];
+	int argLen[BATCH_SIZE * 4];
+	int argFmt[BATCH_SIZE * 4];
+
+	bool ret = true;
+	size_t i = 0;
+	for (; i + BATCH_SIZE <= blocks.size(); i += BATCH_SIZE) {
+		bool ok = true;
+		for (int j = 0; j < BATCH_SIZE; j++) {
+			const auto &it = blocks[i + j];
+			if (it.second.size() > INT_MAX) {
+				ok = false;
+				break;
+			}
+			coords[j * 3]     = htonl(it.first.X);
+			coords[j * 3 + 1] = htonl(it.first.Y);
+			coords[j * 3 + 2] = htonl(it.first.Z);
+			for (int k = 0; k < 3; k++) {
+				args[j * 4 + k] = &coords[j * 3 + k];
+				argLen[j * 4 + k] = sizeof(s32);
+				argFmt[j * 4 + k] = 1;
+			}
+			args[j * 4 + 3] = it.second.data();
+			argLen[j * 4 + 3] = (int)it.second.size();
+			argFmt[j * 4 + 3] = 1;
+		}
+
+		if (ok) {
+			execPrepared("write_blocks", BATCH_SIZE * 4, args, argLen, argFmt);
+		} else {
+			// let saveBlock() report the oversized block
+			for (int j = 0; j < BATCH_SIZE; j++)
+				ret &= saveBlock(blocks[i + j].first, blocks[i + j].second);
+		}
+	}
+
+	// Remainder that doesn't fill a whole batch
+	for (; i < blocks.size(); i++)
+		ret &= saveBlock(blocks[i].first, blocks[i].second);
+
+	return ret;
+}
+
+void MapDatabasePostgreSQL::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	verifyDatabase();
+
+	blocks.resize(pos.size());
+
+	s32 coords[BATCH_SIZE * 3];
+	const void *args[BATCH_SIZE * 3];
+	int argLen[BATCH_SIZE * 3];
+	int argFmt[BATCH_SIZE * 3];
+
+	size_t i = 0;
+	for (; i + BATCH_SIZE <= pos.size(); i += BATCH_SIZE) {
+		for (int j = 0; j < BATCH_SIZE; j++) {
+			coords[j * 3]     = htonl(pos[i + j].X);
+			coords[j * 3 + 1] = htonl(pos[i + j].Y);
+			coords[j * 3 + 2] = htonl(pos[i + j].Z);
+			blocks[i + j].clear();
+		}
+		for (int k = 0; k < BATCH_SIZE * 3; k++) {
+			args[k] = &coords[k];
+			argLen[k] = sizeof(s32);
+			argFmt[k] = 1;
+		}
+
+		PGresult *results = execPrepared("read_blocks", BATCH_SIZE * 3, args,
+			argLen, argFmt, false);
+
+		// Rows come back in arbitrary order (and in binary), match them up
+		auto read_coord = [&] (int row, int col) -> s16 {
+			u32 v;
+			memcpy(&v, PQgetvalue(results, row, col), sizeof(v));
+			return (s16)(s32)ntohl(v);
+		};
+		int numrows = PQntuples(results);
+		for (int row = 0; row < numrows; ++row) {
+			v3s16 p(read_coord(row, 0), read_coord(row, 1), read_coord(row, 2));
+			for (int j = 0; j < BATCH_SIZE; j++) {
+				if (pos[i + j] == p)
+					blocks[i + j] = pg_to_string(results, row, 3);
+			}
+		}
+
+		PQclear(results);
+	}
+
+	for (; i < pos.size(); i++)
+		loadBlock(pos[i], &blocks[i]);
+}
+
 /*
  * Player Database
  */
@@ -114,11 +114,18 @@ class MapDatabasePostgreSQL : private Database_PostgreSQL, public MapDatabase
 	bool deleteBlock(const v3s16 &pos);
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
+	bool saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks);
+	void loadBlocks(const std::vector<v3s16> &pos, std::vector<std::string> &blocks);
+
 	PARENT_CLASS_FUNCS
 
 protected:
 	virtual void createDatabase();
 	virtual void initStatements();
+
+private:
+	/// Number of blocks handled by a single batched statement
+	static constexpr int BATCH_SIZE = 16;
 };
 
 class PlayerDatabasePostgreSQL : private Database_PostgreSQL, public PlayerDatabase
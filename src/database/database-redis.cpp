@@ -15,6 +15,7 @@
 #include "util/string.h"
 
 #include <hiredis.h>
+#include <algorithm>
 #include <cassert>
 
 /*
@@ -195,5 +196,102 @@ void Database_Redis::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	freeReplyObject(reply);
 }
 
+bool Database_Redis::saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks)
+{
+	std::vector<std::string> keys;
+	std::vector<const char *> argv;
+	std::vector<size_t> argvlen;
+	keys.reserve(blocks.size());
+	for (auto &it : blocks)
+		keys.push_back(i64tos(getBlockAsInteger(it.first)));
+
+	// Queue up all commands first, then collect the replies
+	size_t ncommands = 0;
+	for (size_t i = 0; i < blocks.size(); i += BATCH_SIZE) {
+		const size_t end = std::min(i + BATCH_SIZE, blocks.size());
+		argv = { "HMSET", hash.c_str() };
+		argvlen = { 5, hash.size() };
+		for (size_t j = i; j < end; j++) {
+			argv.push_back(keys[j].c_str());
+			argvlen.push_back(keys[j].size());
+			argv.push_back(blocks[j].second.data());
+			argvlen.push_back(blocks[j].second.size());
+		}
+		if (redisAppendCommandArgv(ctx, argv.size(), argv.data(),
+				argvlen.data()) != REDIS_OK) {
+			throw DatabaseException(std::string(
+				"Redis command 'HMSET' failed: ") + ctx->errstr);
+		}
+		ncommands++;
+	}
+
+	bool ret = true;
+	for (size_t i = 0; i < ncommands; i++) {
+		redisReply *reply;
+		if (redisGetReply(ctx, reinterpret_cast<void **>(&reply)) != REDIS_OK) {
+			throw DatabaseException(std::string(
+				"Redis command 'HMSET' failed: ") + ctx->errstr);
+		}
+		if (reply->type == REDIS_REPLY_ERROR) {
+			warningstream << "saveBlocks: saving blocks failed: "
+				<< std::string(reply->str, reply->len) << std::endl;
+			ret = false;
+		}
+		freeReplyObject(reply);
+	}
+	return ret;
+}
+
+void Database_Redis::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	blocks.resize(pos.size());
+
+	std::vector<std::string> keys;
+	std::vector<const char *> argv;
+	std::vector<size_t> argvlen;
+	keys.reserve(pos.size());
+	for (v3s16 p : pos)
+		keys.push_back(i64tos(getBlockAsInteger(p)));
+
+	for (size_t i = 0; i < pos.size(); i += BATCH_SIZE) {
+		const size_t end = std::min(i + BATCH_SIZE, pos.size());
+		argv = { "HMGET", hash.c_str() };
+		argvlen = { 5, hash.size() };
+		for (size_t j = i; j < end; j++) {
+			argv.push_back(keys[j].c_str());
+			argvlen.push_back(keys[j].size());
+		}
+		if (redisAppendCommandArgv(ctx, argv.size(), argv.data(),
+				argvlen.data()) != REDIS_OK) {
+			throw DatabaseException(std::string(
+				"Redis command 'HMGET' failed: ") + ctx->errstr);
+		}
+	}
+
+	for (size_t i = 0; i < pos.size(); i += BATCH_SIZE) {
+		redisReply *reply;
+		if (redisGetReply(ctx, reinterpret_cast<void **>(&reply)) != REDIS_OK) {
+			throw DatabaseException(std::string(
+				"Redis command 'HMGET' failed: ") + ctx->errstr);
+		}
+		if (reply->type != REDIS_REPLY_ARRAY) {
+			std::string errstr = reply->type == REDIS_REPLY_ERROR ?
+				std::string(reply->str, reply->len) : "invalid reply type";
+			freeReplyObject(reply);
+			throw DatabaseException(std::string(
+				"Redis command 'HMGET' errored: ") + errstr);
+		}
+		for (size_t j = 0; j < reply->elements; j++) {
+			redisReply *elem = reply->element[j];
+			if (elem->type == REDIS_REPLY_STRING)
+				blocks[i + j].assign(elem->str, elem->len);
+			else
+				blocks[i + j].clear();
+		}
+		freeReplyObject(reply);
+	}
+}
+
 #endif // USE_REDIS
 
@@ -28,7 +28,13 @@ class Database_Redis : public MapDatabase
 	bool deleteBlock(const v3s16 &pos);
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
+	bool saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks);
+	void loadBlocks(const std::vector<v3s16> &pos, std::vector<std::string> &blocks);
+
 private:
+	/// Number of blocks sent in one pipelined command
+	static constexpr size_t BATCH_SIZE = 64;
+
 	redisContext *ctx = nullptr;
 	std::string hash = "";
 };
@@ -218,6 +218,8 @@ MapDatabaseSQLite3::~MapDatabaseSQLite3()
 {
 	FINALIZE_STATEMENT(read)
 	FINALIZE_STATEMENT(write)
+	FINALIZE_STATEMENT(read_batch)
+	FINALIZE_STATEMENT(write_batch)
 	FINALIZE_STATEMENT(list)
 	FINALIZE_STATEMENT(delete)
 }
@@ -265,6 +267,27 @@ void MapDatabaseSQLite3::initStatements()
 		PREPARE_STATEMENT(delete, "DELETE FROM `blocks` WHERE `pos` = ?");
 		PREPARE_STATEMENT(list, "SELECT `pos` FROM `blocks`");
 	}
+
+	// Batched variants handling BATCH_SIZE blocks per statement
+	std::string read_batch, write_batch;
+	if (m_new_format) {
+		read_batch = "SELECT `x`, `y`, `z`, `data` FROM `blocks` WHERE ";
+		write_batch = "REPLACE INTO `blocks` (`x`, `y`, `z`, `data`) VALUES ";
+	} else {
+		read_batch = "SELECT `pos`, `data` FROM `blocks` WHERE `pos` IN (";
+		write_batch = "REPLACE INTO `blocks` (`pos`, `data`) VALUES ";
+	}
+	for (size_t i = 0; i < BATCH_SIZE; i++) {
+		const char *sep = i == 0 ? "" : (m_new_format ? " OR " : ", ");
+		read_batch.append(sep).append(m_new_format ?
+			"(`x` = ? AND `y` = ? AND `z` = ?)" : "?");
+		write_batch.append(i == 0 ? "" : ", ").append(m_new_format ?
+			"(?, ?, ?, ?)" : "(?, ?)");
+	}
+	if (!m_new_format)
+		read_batch.append(")");
+	PREPARE_STATEMENT(read_batch, read_batch.c_str());
+	PREPARE_STATEMENT(write_batch, write_batch.c_str());
 }
 
 inline int MapDatabaseSQLite3::bindPos(sqlite3_stmt *stmt, v3s16 pos, int index)
@@ -280,6 +303,19 @@ inline int MapDatabaseSQLite3::bindPos(sqlite3_stmt *stmt, v3s16 pos, int index)
 	}
 }
 
+inline int MapDatabaseSQLite3::readPos(sqlite3_stmt *stmt, v3s16 &pos, int index)
+{
+	if (m_new_format) {
+		pos.X = sqlite_to_int(stmt, index);
+		pos.Y = sqlite_to_int(stmt, index + 1);
+		pos.Z = sqlite_to_int(stmt, index + 2);
+		return index + 3;
+	} else {
+		pos = getIntegerAsBlock(sqlite_to_int64(stmt, index));
+		return index + 1;
+	}
+}
+
 bool MapDatabaseSQLite3::deleteBlock(const v3s16 &pos)
 {
 	verifyDatabase();
@@ -334,19 +370,69 @@ void MapDatabaseSQLite3::listAllLoadableBlocks(std::vector<v3s16> &dst)
 
 	v3s16 p;
 	while (sqlite3_step(m_stmt_list) == SQLITE_ROW) {
-		if (m_new_format) {
-			p.X = sqlite_to_int(m_stmt_list, 0);
-			p.Y = sqlite_to_int(m_stmt_list, 1);
-			p.Z = sqlite_to_int(m_stmt_list, 2);
-		} else {
-			p = getIntegerAsBlock(sqlite_to_int64(m_stmt_list, 0));
-		}
+		readPos(m_stmt_list, p);
 		dst.push_back(p);
 	}
 
 	sqlite3_reset(m_stmt_list);
 }
 
+bool MapDatabaseSQLite3::saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks)
+{
+	verifyDatabase();
+
+	size_t i = 0;
+	for (; i + BATCH_SIZE <= blocks.size(); i += BATCH_SIZE) {
+		int col = 1;
+		for (size_t j = i; j < i + BATCH_SIZE; j++) {
+			col = bindPos(m_stmt_write_batch, blocks[j].first, col);
+			blob_to_sqlite(m_stmt_write_batch, col++, blocks[j].second);
+		}
+
+		SQLRES(sqlite3_step(m_stmt_write_batch), SQLITE_DONE, "Failed to save blocks")
+		sqlite3_reset(m_stmt_write_batch);
+	}
+
+	// Remainder that doesn't fill a whole batch
+	bool ok = true;
+	for (; i < blocks.size(); i++)
+		ok &= saveBlock(blocks[i].first, blocks[i].second);
+
+	return ok;
+}
+
+void MapDatabaseSQLite3::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	verifyDatabase();
+
+	blocks.resize(pos.size());
+
+	size_t i = 0;
+	for (; i + BATCH_SIZE <= pos.size(); i += BATCH_SIZE) {
+		int col = 1;
+		for (size_t j = i; j < i + BATCH_SIZE; j++) {
+			col = bindPos(m_stmt_read_batch, pos[j], col);
+			blocks[j].clear();
+		}
+
+		// Rows come back in arbitrary order, match them to the requests
+		v3s16 p;
+		while (sqlite3_step(m_stmt_read_batch) == SQLITE_ROW) {
+			int data_col = readPos(m_stmt_read_batch, p);
+			for (size_t j = i; j < i + BATCH_SIZE; j++) {
+				if (pos[j] == p)
+					blocks[j].assign(sqlite_to_blob(m_stmt_read_batch, data_col));
+			}
+		}
+
+		sqlite3_reset(m_stmt_read_batch);
+	}
+
+	for (; i < pos.size(); i++)
+		loadBlock(pos[i], &blocks[i]);
+}
+
 /*
  * Player Database
  */
@@ -177,6 +177,9 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 	bool deleteBlock(const v3s16 &pos);
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
+	bool saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks);
+	void loadBlocks(const std::vector<v3s16> &pos, std::vector<std::string> &blocks);
+
 	PARENT_CLASS_FUNCS
 
 protected:
@@ -184,14 +187,23 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 	virtual void initStatements();
 
 private:
+	/// Number of blocks handled by a single batched statement
+	static constexpr size_t BATCH_SIZE = 16;
+
 	/// @brief Bind block position into statement at column index
 	/// @return index of next column after position
 	int bindPos(sqlite3_stmt *stmt, v3s16 pos, int index = 1);
 
+	/// @brief Read block position from result row at column index
+	/// @return index of next column after position
+	int readPos(sqlite3_stmt *stmt, v3s16 &pos, int index = 0);
+
 	bool m_new_format = false;
 
 	sqlite3_stmt *m_stmt_read = nullptr;
 	sqlite3_stmt *m_stmt_write = nullptr;
+	sqlite3_stmt *m_stmt_read_batch = nullptr;
+	sqlite3_stmt *m_stmt_write_batch = nullptr;
 	sqlite3_stmt *m_stmt_list = nullptr;
 	sqlite3_stmt *m_stmt_delete = nullptr;
 };
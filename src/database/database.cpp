@@ -6,6 +6,23 @@
 #include "irrlichttypes.h"
 
 
+bool MapDatabase::saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks)
+{
+	bool ret = true;
+	for (auto &it : blocks)
+		ret &= saveBlock(it.first, it.second);
+	return ret;
+}
+
+void MapDatabase::loadBlocks(const std::vector<v3s16> &pos,
+	std::vector<std::string> &blocks)
+{
+	blocks.resize(pos.size());
+	for (size_t i = 0; i < pos.size(); i++)
+		loadBlock(pos[i], &blocks[i]);
+}
+
+
 /****************
  * The position encoding is a bit messed up because negative
  * values were not taken into account.
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
@@ -33,6 +34,16 @@ class MapDatabase : public Database
 	virtual void loadBlock(const v3s16 &pos, std::string *block) = 0;
 	virtual bool deleteBlock(const v3s16 &pos) = 0;
 
+	/// Save multiple blocks at once. Positions must be unique.
+	/// The default implementation calls saveBlock() for each entry.
+	/// @return false if any of the blocks failed to save
+	virtual bool saveBlocks(const std::vector<std::pair<v3s16, std::string>> &blocks);
+	/// Load multiple blocks at once. `blocks` is resized to match `pos` and
+	/// each entry is left empty if the block does not exist.
+	/// The default implementation calls loadBlock() for each entry.
+	virtual void loadBlocks(const std::vector<v3s16> &pos,
+		std::vector<std::string> &blocks);
+
 	static s64 getBlockAsInteger(const v3s16 &pos);
 	static v3s16 getIntegerAsBlock(s64 i);
 
@@ -6,6 +6,7 @@
 
 #include "emerge_internal.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include "config.h"
@@ -49,7 +50,8 @@ EmergeParams::EmergeParams(EmergeManager *parent, const BiomeGen *biomegen,
 	gen_notify_on_deco_ids(&parent->gen_notify_on_deco_ids),
 	gen_notify_on_custom(&parent->gen_notify_on_custom),
 	biomemgr(biomemgr->clone()), oremgr(oremgr->clone()),
-	decomgr(decomgr->clone()), schemmgr(schemmgr->clone())
+	decomgr(decomgr->clone()), schemmgr(schemmgr->clone()),
+	mapgen_pool(parent->getMapgenPool())
 {
 	this->biomegen = biomegen->clone(this->biomemgr);
 }
@@ -88,6 +90,14 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 			{{"status", emergeActionStrs[i]}}
 		);
 	}
+	m_dropped_emerge_counter = mb->addCounter("minetest_emerge_dropped",
+		"Number of queued emerges dropped because the player no longer needs them");
+	const std::vector<double> wait_buckets{0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+	m_queue_wait_histogram[0] = mb->addHistogram("minetest_emerge_queue_wait_seconds",
+		"Time blocks spent in the emerge queue", wait_buckets, {{"type", "load"}});
+	m_queue_wait_histogram[1] = mb->addHistogram("minetest_emerge_queue_wait_seconds",
+		"Time blocks spent in the emerge queue", wait_buckets, {{"type", "generate"}});
+	m_start_time = porting::getTimeMs();
 
 	m_qlimit_total = g_settings->getU32("emergequeue_limit_total");
 	m_qlimit_diskonly = g_settings->getU32("emergequeue_limit_diskonly");
@@ -126,6 +136,12 @@ EmergeManager::~EmergeManager()
 }
 
 
+ThreadPool *EmergeManager::getMapgenPool() const
+{
+	return m_server ? m_server->getWorkerPool() : nullptr;
+}
+
+
 BiomeManager *EmergeManager::getWritableBiomeManager()
 {
 	FATAL_ERROR_IF(!m_mapgens.empty(),
@@ -190,6 +206,7 @@ void EmergeManager::initMapgens(MapgenParams *params)
 	v3s16 csize = params->chunksize * MAP_BLOCKSIZE;
 	biomegen = biomemgr->createBiomeGen(BIOMEGEN_ORIGINAL, params->bparams, csize);
 
+
 	for (u32 i = 0; i != m_threads.size(); i++) {
 		EmergeParams *p = new EmergeParams(this, biomegen,
 			biomemgr, oremgr, decomgr, schemmgr);
@@ -308,8 +325,10 @@ bool EmergeManager::enqueueBlockEmergeEx(
 		if (entry_already_exists)
 			return true;
 
+		double priority;
+		getBlockPriority(blockpos, m_blocks_enqueued[blockpos], &priority);
 		thread = getOptimalThread();
-		thread->pushBlock(blockpos);
+		thread->pushBlock(blockpos, priority);
 	}
 
 	thread->signal();
@@ -331,6 +350,37 @@ bool EmergeManager::isBlockInQueue(v3s16 pos)
 }
 
 
+static bool observers_differ(const std::vector<EmergeObserver> &a,
+	const std::vector<EmergeObserver> &b)
+{
+	// Moving less than this (in blocks) or turning less than ~15 degrees
+	// hardly changes the order of the queue
+	constexpr float MOVE_THRESHOLD = 0.25f;
+	constexpr float TURN_THRESHOLD = 0.966f;
+
+	if (a.size() != b.size())
+		return true;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].peer_id != b[i].peer_id || a[i].range != b[i].range ||
+				a[i].pos.getDistanceFromSQ(b[i].pos) > MOVE_THRESHOLD * MOVE_THRESHOLD ||
+				a[i].dir.dotProduct(b[i].dir) < TURN_THRESHOLD)
+			return true;
+	}
+	return false;
+}
+
+void EmergeManager::updateObservers(std::vector<EmergeObserver> &&observers)
+{
+	MutexAutoLock queuelock(m_queue_mutex);
+	// Keep the old ones otherwise, so that small movements can't add up
+	if (!observers_differ(m_observers, observers))
+		return;
+	m_observers = std::move(observers);
+	// the threads update their queues when they look at them next
+	m_observers_version++;
+}
+
+
 //
 // Mapgen-related helper functions
 //
@@ -403,6 +453,7 @@ bool EmergeManager::pushBlockEmergeData(
 	} else {
 		bedata.flags = flags;
 		bedata.peer_requested = peer_requested;
+		bedata.queued_time = porting::getTimeMs();
 
 		count_peer++;
 	}
@@ -434,6 +485,48 @@ bool EmergeManager::popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata)
 }
 
 
+bool EmergeManager::getBlockPriority(v3s16 pos, const BlockEmergeData &bedata,
+	double *priority) const
+{
+	// How many blocks closer a block counts as per second it has waited,
+	// so that blocks far away are not postponed forever
+	constexpr double AGING_PER_SECOND = 2.0;
+	// Give players that move some slack before dropping their blocks
+	constexpr s16 DROP_MARGIN = 2;
+
+	const v3f center = intToFloat(pos, 1) + v3f(0.5f);
+	const bool from_peer = bedata.peer_requested != PEER_ID_INEXISTENT;
+
+	// Distance to the closest interested observer, weighted so that blocks
+	// in front of the camera go before those behind it
+	float best = -1.0f;
+	for (const EmergeObserver &observer : m_observers) {
+		if (from_peer && observer.peer_id != bedata.peer_requested)
+			continue;
+
+		v3f diff = center - observer.pos;
+		float d = diff.getLength();
+		// (the range is along each axis)
+		if (from_peer && d > observer.range * 1.75f + DROP_MARGIN)
+			break;
+		float facing = d > 0.0f ? observer.dir.dotProduct(diff) / d : 1.0f;
+		float weighted = d * (1.0f - 0.4f * facing);
+		if (best < 0.0f || weighted < best)
+			best = weighted;
+	}
+
+	// (double, as this grows with the uptime)
+	const double waited_since = (s64)(bedata.queued_time - m_start_time) / 1000.0;
+	*priority = std::max(best, 0.0f) + waited_since * AGING_PER_SECOND;
+
+	if (best >= 0.0f || !from_peer)
+		return true;
+	// Out of range or the player left. Requests with callbacks or forced
+	// ones still have to be processed.
+	return !bedata.callbacks.empty() || (bedata.flags & BLOCK_EMERGE_FORCE_QUEUE);
+}
+
+
 EmergeThread *EmergeManager::getOptimalThread()
 {
 	size_t nthreads = m_threads.size();
@@ -484,9 +577,10 @@ void EmergeThread::signal()
 }
 
 
-bool EmergeThread::pushBlock(v3s16 pos)
+bool EmergeThread::pushBlock(v3s16 pos, double priority)
 {
-	m_block_queue.push(pos);
+	m_block_queue.push_back({priority, m_block_queue_seq++, pos});
+	std::push_heap(m_block_queue.begin(), m_block_queue.end());
 	return true;
 }
 
@@ -499,8 +593,8 @@ void EmergeThread::cancelPendingItems()
 		BlockEmergeData bedata;
 		v3s16 pos;
 
-		pos = m_block_queue.front();
-		m_block_queue.pop();
+		pos = m_block_queue.back().pos;
+		m_block_queue.pop_back();
 
 		m_emerge->popBlockEmergeData(pos, &bedata);
 
@@ -526,22 +620,100 @@ void EmergeThread::runCompletionCallbacks(v3s16 pos, EmergeAction action,
 }
 
 
+void EmergeThread::updateQueuePriorities()
+{
+	m_observers_version = m_emerge->m_observers_version;
+
+	size_t n_dropped = 0;
+	for (size_t i = 0; i < m_block_queue.size();) {
+		QueuedBlock &queued = m_block_queue[i];
+		auto it = m_emerge->m_blocks_enqueued.find(queued.pos);
+		if (it != m_emerge->m_blocks_enqueued.end() &&
+				m_emerge->getBlockPriority(queued.pos, it->second, &queued.priority)) {
+			i++;
+			continue;
+		}
+
+		// Nobody wants it anymore. There are no callbacks to run.
+		BlockEmergeData bedata;
+		m_emerge->popBlockEmergeData(queued.pos, &bedata);
+		queued = m_block_queue.back();
+		m_block_queue.pop_back();
+		n_dropped++;
+	}
+
+	std::make_heap(m_block_queue.begin(), m_block_queue.end());
+	if (n_dropped > 0)
+		m_emerge->m_dropped_emerge_counter->increment(n_dropped);
+}
+
+
 bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
+	if (m_observers_version != m_emerge->m_observers_version)
+		updateQueuePriorities();
+
 	if (m_block_queue.empty())
 		return false;
 
-	*pos = m_block_queue.front();
-	m_block_queue.pop();
+	std::pop_heap(m_block_queue.begin(), m_block_queue.end());
+	*pos = m_block_queue.back().pos;
+	m_block_queue.pop_back();
 
 	m_emerge->popBlockEmergeData(*pos, bedata);
 
+	bool generate = bedata->flags & BLOCK_EMERGE_ALLOW_GEN;
+	m_emerge->m_queue_wait_histogram[generate]->observe(
+		(porting::getTimeMs() - bedata->queued_time) / 1000.0);
+
 	return true;
 }
 
 
+void EmergeThread::loadBlockData(v3s16 pos, std::string &data)
+{
+	auto &m_db = *m_emerge->m_db;
+	if (porting::getTimeMs() - m_prefetch_time > PREFETCH_MAX_AGE ||
+			m_db.write_count != m_prefetch_write_count)
+		m_prefetched.clear();
+
+	auto it = m_prefetched.find(pos);
+	if (it != m_prefetched.end()) {
+		data = std::move(it->second);
+		m_prefetched.erase(it);
+		return;
+	}
+
+	std::vector<v3s16> batch{pos};
+	{
+		MutexAutoLock queuelock(m_emerge->m_queue_mutex);
+		// The top of the heap is roughly what comes next
+		for (const QueuedBlock &queued : m_block_queue) {
+			if (batch.size() >= PREFETCH_SIZE)
+				break;
+			if (m_prefetched.find(queued.pos) == m_prefetched.end())
+				batch.push_back(queued.pos);
+		}
+	}
+
+	std::vector<std::string> results;
+	// Read before loading: a save racing with us must invalidate the data
+	u64 write_count = m_db.write_count;
+	// Note: this can throw an exception, but there isn't really
+	// a good, safe way to handle it.
+	m_db.loadBlocks(batch, results);
+	g_profiler->avg("EmergeThread: blocks per load batch", batch.size());
+
+	data = std::move(results[0]);
+	for (size_t i = 1; i < batch.size(); i++)
+		m_prefetched[batch[i]] = std::move(results[i]);
+	m_prefetch_time = porting::getTimeMs();
+	m_prefetch_write_count = write_count;
+}
+
+
 EmergeAction EmergeThread::getBlockOrStartGen(const v3s16 pos, bool allow_gen,
 	 const std::string *from_db, MapBlock **block, BlockMakeData *bmdata)
 {
@@ -696,6 +868,7 @@ void *EmergeThread::run()
 		porting::TriggerMemoryTrim();
 
 		if (!popBlockEmerge(&pos, &bedata)) {
+			m_prefetched.clear();
 			m_queue_event.wait();
 			continue;
 		}
@@ -712,13 +885,9 @@ void *EmergeThread::run()
 
 		/* Try to load it */
 		if (action == EMERGE_FROM_DISK) {
-			auto &m_db = *m_emerge->m_db;
 			{
 				ScopeProfiler sp(g_profiler, "EmergeThread: load block - async (sum)");
-				MutexAutoLock dblock(m_db.mutex);
-				// Note: this can throw an exception, but there isn't really
-				// a good, safe way to handle it.
-				m_db.loadBlock(pos, databuf);
+				loadBlockData(pos, databuf);
 			}
 			// actually load it, then decide again
 			action = getBlockOrStartGen(pos, allow_gen, &databuf, &block, &bmdata);
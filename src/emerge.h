@@ -5,6 +5,7 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include "network/networkprotocol.h"
 #include "irr_v3d.h"
@@ -79,6 +80,20 @@ struct BlockEmergeData {
 	u16 peer_requested;
 	u16 flags;
 	EmergeCallbackList callbacks;
+	// When the block was first queued (ms, porting::getTimeMs())
+	u64 queued_time;
+};
+
+// Where a player is looking from, used to decide which blocks to emerge first
+struct EmergeObserver {
+	session_t peer_id;
+	// Camera position in blocks
+	v3f pos;
+	// Normalized camera direction
+	v3f dir;
+	// Blocks further away than this along any axis (in blocks) are not
+	// needed by the player
+	s16 range;
 };
 
 class EmergeParams {
@@ -101,6 +116,8 @@ class EmergeParams {
 	DecorationManager *decomgr;
 	SchematicManager *schemmgr;
 
+	ThreadPool *mapgen_pool; // shared, may be NULL
+
 	inline GenerateNotifier createNotifier() const {
 		return GenerateNotifier(gen_notify_on, gen_notify_on_deco_ids,
 			gen_notify_on_custom);
@@ -145,6 +162,8 @@ class EmergeManager {
 	DISABLE_CLASS_COPY(EmergeManager);
 
 	const BiomeGen *getBiomeGen() const { return biomegen; }
+	// Helps the emerge threads with the heavy parts of map generation
+	ThreadPool *getMapgenPool() const;
 
 	// no usage restrictions
 	const BiomeManager *getBiomeManager() const { return biomemgr; }
@@ -182,6 +201,14 @@ class EmergeManager {
 	size_t getQueueSize();
 	bool isBlockInQueue(v3s16 pos);
 
+	/**
+	 * Replaces the players used to prioritize the queued blocks, unless
+	 * none of them moved, turned or changed their range noticeably.
+	 * Blocks requested by a player that are out of its range, or by a
+	 * player that is gone, are dropped from the queue.
+	 */
+	void updateObservers(std::vector<EmergeObserver> &&observers);
+
 	Mapgen *getCurrentMapgen();
 
 	// Mapgen helpers methods
@@ -211,8 +238,18 @@ class EmergeManager {
 	u32 m_qlimit_diskonly;
 	u32 m_qlimit_generate;
 
+	// Players the queue is currently prioritized for
+	std::vector<EmergeObserver> m_observers;
+	// Incremented whenever m_observers changes, which updateObservers()
+	// only does when they moved or turned noticeably
+	u32 m_observers_version = 0;
+	u64 m_start_time;
+
 	// Emerge metrics
 	MetricCounterPtr m_completed_emerge_counter[5];
+	MetricCounterPtr m_dropped_emerge_counter;
+	// Time blocks spent in the queue, for loading and generating
+	MetricHistogramPtr m_queue_wait_histogram[2];
 
 	// Managers of various map generation-related components
 	// Note that each Mapgen gets a copy(!) of these to work with
@@ -235,7 +272,16 @@ class EmergeManager {
 
 	bool popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata);
 
+	/**
+	 * Computes the queue priority of a block, lower values go first.
+	 * Requires m_queue_mutex held.
+	 * @return false if the block is no longer wanted by whoever requested it
+	 */
+	bool getBlockPriority(v3s16 pos, const BlockEmergeData &bedata,
+		double *priority) const;
+
 	void reportCompletedEmerge(EmergeAction action);
 
 	friend class EmergeThread;
+	friend class TestEmerge;
 };
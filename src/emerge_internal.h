@@ -10,7 +10,8 @@
 
 #include "emerge.h"
 
-#include <queue>
+#include <unordered_map>
+#include <vector>
 
 #include "util/thread.h"
 #include "threading/event.h"
@@ -34,7 +35,7 @@ class EmergeThread : public Thread {
 	void signal();
 
 	// Requires queue mutex held
-	bool pushBlock(v3s16 pos);
+	bool pushBlock(v3s16 pos, double priority);
 
 	void cancelPendingItems();
 
@@ -57,13 +58,58 @@ class EmergeThread : public Thread {
 	// read from scripting:
 	UniqueQueue<v3s16> *m_trans_liquid; //< non-null only when generating a mapblock
 
+	struct QueuedBlock {
+		double priority;
+		// Keeps blocks of equal priority in the order they were queued
+		u32 seq;
+		v3s16 pos;
+
+		// std::*_heap put the greatest element first, we want the lowest priority
+		bool operator<(const QueuedBlock &other) const
+		{
+			if (priority != other.priority)
+				return priority > other.priority;
+			return seq > other.seq;
+		}
+	};
+
 	Event m_queue_event;
-	std::queue<v3s16> m_block_queue;
+	// Binary heap, requires queue mutex held
+	std::vector<QueuedBlock> m_block_queue;
+	u32 m_block_queue_seq = 0;
+	// Observers the priorities in m_block_queue were computed for
+	u32 m_observers_version = 0;
+
+	// Number of queued blocks read from the database together
+	static constexpr size_t PREFETCH_SIZE = 16;
+	// Prefetched data older than this (in ms) is discarded
+	static constexpr u64 PREFETCH_MAX_AGE = 1000;
+
+	// Serialized data of upcoming queue entries, read ahead from the database
+	std::unordered_map<v3s16, std::string> m_prefetched;
+	u64 m_prefetch_time = 0;
+	// MapDatabaseAccessor::write_count when m_prefetched was read, any
+	// block saved since then may be newer than the prefetched copy
+	u64 m_prefetch_write_count = 0;
 
 	bool initScripting();
 
+	// Recomputes the priorities after the observers changed and drops the
+	// blocks that are no longer wanted. Requires queue mutex held.
+	void updateQueuePriorities();
+
 	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
 
+	/**
+	 * Read the serialized data of a block from the database.
+	 * The next few queued blocks are read in the same batch and kept
+	 * around for the following calls.
+	 *
+	 * @param pos block position
+	 * @param data output, empty if the block is not in the database
+	 */
+	void loadBlockData(v3s16 pos, std::string &data);
+
 	/**
 	 * Try to get a block from memory and decide what to do.
 	 *
@@ -84,6 +130,7 @@ class EmergeThread : public Thread {
 	friend class EmergeManager;
 	friend class EmergeScripting;
 	friend class ModApiMapgen;
+	friend class TestEmerge;
 };
 
 // Scoped helper to set Server::m_ignore_map_edit_events_area
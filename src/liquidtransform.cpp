@@ -0,0 +1,495 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+#include "liquidtransform.h"
+#include <memory>
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "log.h"
+#include "threading/thread_pool.h"
+
+#define WATER_DROP_BOOST 4
+
+const static v3s16 liquid_6dirs[6] = {
+	// order: upper before same level before lower
+	v3s16( 0, 1, 0),
+	v3s16( 0, 0, 1),
+	v3s16( 1, 0, 0),
+	v3s16( 0, 0,-1),
+	v3s16(-1, 0, 0),
+	v3s16( 0,-1, 0)
+};
+
+enum NeighborType : u8 {
+	NEIGHBOR_UPPER,
+	NEIGHBOR_SAME_LEVEL,
+	NEIGHBOR_LOWER
+};
+
+struct NodeNeighbor {
+	MapNode n;
+	NeighborType t;
+	v3s16 p;
+
+	NodeNeighbor()
+		: n(CONTENT_AIR), t(NEIGHBOR_SAME_LEVEL)
+	{ }
+
+	NodeNeighbor(const MapNode &node, NeighborType n_type, const v3s16 &pos)
+		: n(node),
+		  t(n_type),
+		  p(pos)
+	{ }
+};
+
+static s8 get_max_liquid_level(NodeNeighbor nb, s8 current_max_node_level)
+{
+	s8 max_node_level = current_max_node_level;
+	u8 nb_liquid_level = (nb.n.param2 & LIQUID_LEVEL_MASK);
+	switch (nb.t) {
+		case NEIGHBOR_UPPER:
+			if (nb_liquid_level + WATER_DROP_BOOST > current_max_node_level) {
+				max_node_level = LIQUID_LEVEL_MAX;
+				if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+					max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+			} else if (nb_liquid_level > current_max_node_level) {
+				max_node_level = nb_liquid_level;
+			}
+			break;
+		case NEIGHBOR_LOWER:
+			break;
+		case NEIGHBOR_SAME_LEVEL:
+			if ((nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+					nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+				max_node_level = nb_liquid_level - 1;
+			break;
+	}
+	return max_node_level;
+}
+
+LiquidTransform::LiquidTransform(Map *map, UniqueQueue<v3s16> *queue,
+		LiquidTransformResult *result) :
+	m_map(map),
+	m_ndef(map->getNodeDefManager()),
+	m_queue(queue),
+	m_result(result)
+{
+}
+
+MapNode LiquidTransform::getNode(v3s16 p)
+{
+	return m_map->getNode(p);
+}
+
+void LiquidTransform::setNode(v3s16 p, MapNode n)
+{
+	m_map->setNode(p, n);
+}
+
+MapBlock *LiquidTransform::getBlock(v3s16 blockpos)
+{
+	return m_map->getBlockNoCreateNoEx(blockpos);
+}
+
+bool LiquidTransform::transformNode(v3s16 p0)
+{
+	MapNode n0 = getNode(p0);
+
+	/*
+		Collect information about current node
+	 */
+	s8 liquid_level = -1;
+	// The liquid node which will be placed there if
+	// the liquid flows into this node.
+	content_t liquid_kind = CONTENT_IGNORE;
+	// The node which will be placed there if liquid
+	// can't flow into this node.
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = m_ndef->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = cf.liquid_alternative_flowing_id;
+			break;
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise, continue with the next node.
+			if (!cf.floodable)
+				return true;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			// flooding this node may need on_flood()
+			if (floodable_node != CONTENT_AIR && !canRunCallbacks())
+				return false;
+			break;
+		case LiquidType_END:
+			break;
+	}
+
+	/*
+		Collect information about the environment
+	 */
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	bool ignored_sources = false;
+	bool floating_node_above = false;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 0:
+				nt = NEIGHBOR_UPPER;
+				break;
+			case 5:
+				nt = NEIGHBOR_LOWER;
+				break;
+			default:
+				break;
+		}
+		v3s16 npos = p0 + liquid_6dirs[i];
+		NodeNeighbor nb(getNode(npos), nt, npos);
+		const ContentFeatures &cfnb = m_ndef->get(nb.n);
+		if (nt == NEIGHBOR_UPPER && cfnb.floats)
+			floating_node_above = true;
+		switch (cfnb.liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueued for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						queueNode(npos);
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					if (nb.n.getContent() == CONTENT_IGNORE) {
+						// If node below is ignore prevent water from
+						// spreading outwards and otherwise prevent from
+						// flowing away as ignore node might be the source
+						if (nb.t == NEIGHBOR_LOWER)
+							flowing_down = true;
+						else
+							ignored_sources = true;
+					}
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = cfnb.liquid_alternative_flowing_id;
+				if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(nt != NEIGHBOR_LOWER)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				if (nb.t != NEIGHBOR_SAME_LEVEL ||
+					(nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK) {
+					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+					// but exclude falling liquids on the same level, they cannot flow here anyway
+
+					// used to determine if the neighbor can even flow into this node
+					s8 max_level_from_neighbor = get_max_liquid_level(nb, -1);
+					u8 range = m_ndef->get(cfnb.liquid_alternative_flowing_id).liquid_range;
+
+					if (liquid_kind == CONTENT_AIR &&
+							max_level_from_neighbor >= (LIQUID_LEVEL_MAX + 1 - range))
+						liquid_kind = cfnb.liquid_alternative_flowing_id;
+				}
+				if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+			case LiquidType_END:
+				break;
+		}
+	}
+
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = m_ndef->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && m_ndef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = m_ndef->get(liquid_kind).liquid_alternative_source_id;
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else if (ignored_sources && liquid_level >= 0) {
+		// Maybe there are neighboring sources that aren't loaded yet
+		// so prevent flowing away.
+		new_node_level = liquid_level;
+		new_node_content = liquid_kind;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			max_node_level = get_max_liquid_level(flows[i], max_node_level);
+		}
+
+		u8 viscosity = m_ndef->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				m_result->must_reflow.push_back(p0);
+		} else {
+			new_node_level = max_node_level;
+		}
+
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+
+	}
+
+	/*
+		check if anything has changed. if not, just continue with the next node.
+	 */
+	if (new_node_content == n0.getContent() &&
+			(m_ndef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return true;
+
+	/*
+		check if there is a floating node above that needs to be updated.
+	 */
+	if (floating_node_above && new_node_content == CONTENT_AIR)
+		m_result->check_for_falling.push_back(p0);
+
+	/*
+		update the current node
+	 */
+	MapNode n00 = n0;
+	//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
+	if (m_ndef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
+	} else {
+		// set the liquid level and flow bits to 0
+		n0.param2 &= ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+	}
+
+	// change the node.
+	n0.setContent(new_node_content);
+
+	// on_flood() the node
+	if (floodable_node != CONTENT_AIR) {
+		if (onFlood(p0, n00, n0))
+			return true;
+	}
+
+	// Ignore light (because calling voxalgo::update_lighting_nodes)
+	ContentLightingFlags f0 = m_ndef->getLightingFlags(n0);
+	n0.setLight(LIGHTBANK_DAY, 0, f0);
+	n0.setLight(LIGHTBANK_NIGHT, 0, f0);
+
+	setNode(p0, n0);
+
+	v3s16 blockpos = getNodeBlockPos(p0);
+	MapBlock *block = getBlock(blockpos);
+	if (block != NULL) {
+		m_result->modified_blocks[blockpos] =  block;
+		m_result->changed_nodes.emplace_back(p0, n00);
+	}
+
+	/*
+		enqueue neighbors for update if necessary
+	 */
+	switch (m_ndef->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			for (u16 i = 0; i < num_flows; i++)
+				if (flows[i].t != NEIGHBOR_UPPER)
+					queueNode(flows[i].p);
+			for (u16 i = 0; i < num_airs; i++)
+				if (airs[i].t != NEIGHBOR_UPPER)
+					queueNode(airs[i].p);
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			for (u16 i = 0; i < num_flows; i++)
+				queueNode(flows[i].p);
+			break;
+		case LiquidType_END:
+			break;
+	}
+	return true;
+}
+
+namespace {
+
+// Transforms the nodes of one region, with the blocks looked up beforehand
+// so that the map itself is not accessed from the worker threads
+class RegionLiquidTransform : public LiquidTransform
+{
+public:
+	// the region plus one block around it
+	static constexpr s16 LOOKUP_SIZE = REGION_SIZE + 2;
+
+	RegionLiquidTransform(Map *map, v3s16 region) :
+		LiquidTransform(map, &queue, &result),
+		m_lookup_base(region * REGION_SIZE - v3s16(1, 1, 1))
+	{
+		v3s16 p;
+		for (p.Z = 0; p.Z < LOOKUP_SIZE; p.Z++)
+		for (p.Y = 0; p.Y < LOOKUP_SIZE; p.Y++)
+		for (p.X = 0; p.X < LOOKUP_SIZE; p.X++)
+			m_lookup[lookupIndex(p)] = map->getBlockNoCreateNoEx(m_lookup_base + p);
+	}
+
+	void run()
+	{
+		for (v3s16 p : nodes) {
+			if (!transformNode(p))
+				deferred.push_back(p);
+		}
+	}
+
+	std::vector<v3s16> nodes, deferred;
+	UniqueQueue<v3s16> queue;
+	LiquidTransformResult result;
+
+protected:
+	MapNode getNode(v3s16 p) override
+	{
+		MapBlock *block = getBlock(getNodeBlockPos(p));
+		if (!block)
+			return {CONTENT_IGNORE};
+		return block->getNodeNoCheck(p - block->getPosRelative());
+	}
+
+	void setNode(v3s16 p, MapNode n) override
+	{
+		MapBlock *block = getBlock(getNodeBlockPos(p));
+		if (!block)
+			throw InvalidPositionException();
+		// same as Map::setNode()
+		if (n.getContent() == CONTENT_IGNORE) {
+			errorstream << "Not allowing to place CONTENT_IGNORE at "
+				<< p << std::endl;
+			return;
+		}
+		block->setNodeNoCheck(p - block->getPosRelative(), n);
+	}
+
+	MapBlock *getBlock(v3s16 blockpos) override
+	{
+		// nodes are read at most one node outside of the region
+		v3s16 p = blockpos - m_lookup_base;
+		assert(p.X >= 0 && p.X < LOOKUP_SIZE && p.Y >= 0 && p.Y < LOOKUP_SIZE &&
+			p.Z >= 0 && p.Z < LOOKUP_SIZE);
+		return m_lookup[lookupIndex(p)];
+	}
+
+	bool canRunCallbacks() const override { return false; }
+
+private:
+	static inline u32 lookupIndex(v3s16 p)
+	{
+		return (p.Z * LOOKUP_SIZE + p.Y) * LOOKUP_SIZE + p.X;
+	}
+
+	v3s16 m_lookup_base;
+	MapBlock *m_lookup[LOOKUP_SIZE * LOOKUP_SIZE * LOOKUP_SIZE];
+};
+
+}
+
+void LiquidTransform::transformParallel(Map *map, ThreadPool *pool,
+		const std::vector<v3s16> &nodes, UniqueQueue<v3s16> &queue,
+		std::vector<v3s16> &deferred, LiquidTransformResult &result)
+{
+	// Sort the nodes into regions, keeping their order
+	std::map<v3s16, std::unique_ptr<RegionLiquidTransform>> regions;
+	for (v3s16 p : nodes) {
+		v3s16 blockpos = getNodeBlockPos(p);
+		v3s16 region(getContainerPos(blockpos.X, REGION_SIZE),
+			getContainerPos(blockpos.Y, REGION_SIZE),
+			getContainerPos(blockpos.Z, REGION_SIZE));
+		auto &r = regions[region];
+		if (!r)
+			r = std::make_unique<RegionLiquidTransform>(map, region);
+		r->nodes.push_back(p);
+	}
+
+	// Regions with the same parity of their coordinates don't touch each
+	// other, so a region never sees nodes changing while it is processed.
+	std::vector<RegionLiquidTransform*> pass;
+	for (u8 parity = 0; parity < 8; parity++) {
+		pass.clear();
+		for (auto &it : regions) {
+			const v3s16 &r = it.first;
+			if (((r.X & 1) | (r.Y & 1) << 1 | (r.Z & 1) << 2) == parity)
+				pass.push_back(it.second.get());
+		}
+		pool->runShared(pass.size(), [&] (size_t i) {
+			pass[i]->run();
+		});
+	}
+
+	// Merge in region order
+	for (auto &it : regions) {
+		RegionLiquidTransform &r = *it.second;
+		while (!r.queue.empty()) {
+			queue.push_back(r.queue.front());
+			r.queue.pop_front();
+		}
+		deferred.insert(deferred.end(), r.deferred.begin(), r.deferred.end());
+		auto &res = r.result;
+		result.must_reflow.insert(result.must_reflow.end(),
+			res.must_reflow.begin(), res.must_reflow.end());
+		result.changed_nodes.insert(result.changed_nodes.end(),
+			res.changed_nodes.begin(), res.changed_nodes.end());
+		result.check_for_falling.insert(result.check_for_falling.end(),
+			res.check_for_falling.begin(), res.check_for_falling.end());
+		result.modified_blocks.insert(res.modified_blocks.begin(),
+			res.modified_blocks.end());
+	}
+}
@@ -0,0 +1,81 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+#pragma once
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "irr_v3d.h"
+#include "mapnode.h"
+#include "util/container.h"
+
+class NodeDefManager;
+class Map;
+class MapBlock;
+class ThreadPool;
+
+struct LiquidTransformResult {
+	// nodes that due to viscosity have not reached their max level height
+	std::vector<v3s16> must_reflow;
+	// changed nodes with their previous value
+	std::vector<std::pair<v3s16, MapNode>> changed_nodes;
+	// nodes that turned into air below a node that floats on liquids
+	std::vector<v3s16> check_for_falling;
+	std::map<v3s16, MapBlock*> modified_blocks;
+};
+
+/*
+	Updates liquid nodes according to their neighbors and queues the nodes
+	that are affected in turn, see ServerMap::transformLiquids().
+
+	By default nodes are read from and written to the map directly, subclasses
+	can change this (and have to provide the on_flood callback).
+*/
+class LiquidTransform
+{
+public:
+	LiquidTransform(Map *map, UniqueQueue<v3s16> *queue, LiquidTransformResult *result);
+	virtual ~LiquidTransform() = default;
+
+	/**
+	 * Updates the node at p0.
+	 * @return false if the node has to be processed where callbacks can run
+	 *         (see canRunCallbacks()), nothing was changed in that case
+	 */
+	bool transformNode(v3s16 p0);
+
+	/**
+	 * Transforms `nodes` (each of them once) on a thread pool.
+	 * The map is split into regions of REGION_SIZE^3 blocks, regions that
+	 * don't touch each other are processed at the same time. The outcome
+	 * does not depend on the number of threads.
+	 * Nodes queued in turn are appended to `queue`, nodes that need callbacks
+	 * to `deferred`.
+	 * @note Nothing else may access the map meanwhile.
+	 */
+	static void transformParallel(Map *map, ThreadPool *pool,
+		const std::vector<v3s16> &nodes, UniqueQueue<v3s16> &queue,
+		std::vector<v3s16> &deferred, LiquidTransformResult &result);
+
+	// in mapblocks
+	static constexpr s16 REGION_SIZE = 2;
+
+protected:
+	virtual MapNode getNode(v3s16 p);
+	virtual void setNode(v3s16 p, MapNode n);
+	virtual MapBlock *getBlock(v3s16 blockpos);
+	virtual void queueNode(v3s16 p) { m_queue->push_back(p); }
+
+	/// Whether onFlood() can be called, nodes that would need it are not processed otherwise
+	virtual bool canRunCallbacks() const { return true; }
+	/// Called before a floodable node is replaced
+	/// @return true to keep the node
+	virtual bool onFlood(v3s16 p, MapNode oldnode, MapNode newnode) { return false; }
+
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+	UniqueQueue<v3s16> *m_queue;
+	LiquidTransformResult *m_result;
+};
@@ -109,6 +109,22 @@ MapBlock *Map::getBlockNoCreate(v3s16 p3d)
 	return block;
 }
 
+bool Map::blockMayContain(MapBlock *block,
+	const std::vector<content_t> &contents, bool count)
+{
+	if (contents.empty())
+		return false;
+	if (!block)
+		return CONTAINS(contents, CONTENT_IGNORE);
+	if (!count && !block->hasContentCounts())
+		return true;
+	for (const auto &it : block->getContentCounts()) {
+		if (CONTAINS(contents, it.first))
+			return true;
+	}
+	return false;
+}
+
 bool Map::isValidPosition(v3s16 p)
 {
 	v3s16 blockpos = getNodeBlockPos(p);
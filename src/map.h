@@ -243,6 +243,15 @@ class Map /*: public NodeContainer*/
 	// as its second. If it returns false, forEachNodeInArea returns early.
 	template<typename F>
 	void forEachNodeInArea(v3s16 minp, v3s16 maxp, F func)
+	{
+		forEachNodeInArea(minp, maxp, nullptr, func);
+	}
+
+	// Like the above, but if contents is given, blocks that contain none of
+	// them are skipped. The order of the remaining nodes does not change.
+	template<typename F>
+	void forEachNodeInArea(v3s16 minp, v3s16 maxp,
+		const std::vector<content_t> *contents, F func)
 	{
 		v3s16 bpmin = getNodeBlockPos(minp);
 		v3s16 bpmax = getNodeBlockPos(maxp);
@@ -259,6 +268,15 @@ class Map /*: public NodeContainer*/
 			s16 maxx_block = rangelim(maxp.X - basep.X, 0, MAP_BLOCKSIZE - 1);
 			s16 maxy_block = rangelim(maxp.Y - basep.Y, 0, MAP_BLOCKSIZE - 1);
 			s16 maxz_block = rangelim(maxp.Z - basep.Z, 0, MAP_BLOCKSIZE - 1);
+			if (contents) {
+				// Counting the contents only pays off if much of the block
+				// is visited
+				u32 volume = (u32)(maxx_block - minx_block + 1) *
+					(maxy_block - miny_block + 1) * (maxz_block - minz_block + 1);
+				bool count = volume >= MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE / 4;
+				if (!blockMayContain(block, *contents, count))
+					continue;
+			}
 			for (s16 z_block = minz_block; z_block <= maxz_block; z_block++)
 			for (s16 y_block = miny_block; y_block <= maxy_block; y_block++)
 			for (s16 x_block = minx_block; x_block <= maxx_block; x_block++) {
@@ -272,6 +290,16 @@ class Map /*: public NodeContainer*/
 		}
 	}
 
+	/**
+	 * Tells whether a block may contain any of the given contents, using the
+	 * content counts of the block. A block that is not loaded (nullptr)
+	 * contains only CONTENT_IGNORE.
+	 * @param count count the contents if that was not done yet, otherwise
+	 *        such blocks are assumed to contain anything
+	 */
+	static bool blockMayContain(MapBlock *block,
+		const std::vector<content_t> &contents, bool count);
+
 	bool isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes)
 	{
 		return isBlockOccluded(block->getPosRelative(), cam_pos_nodes);
@@ -4,6 +4,8 @@
 
 #include "mapblock.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <sstream>
 #include "map.h"
@@ -120,7 +122,7 @@ MapBlock::~MapBlock()
 #endif
 
 	delete[] data;
-	if (!m_is_mono_block)
+	if (data && !m_is_mono_block)
 		porting::TrackFreedMemory(sizeof(MapNode) * nodecount);
 }
 
@@ -210,12 +212,30 @@ std::string MapBlock::getModifiedReasonString()
 	return reason;
 }
 
+u64 MapBlock::getChangeId()
+{
+	// blocks are created on several threads
+	static std::atomic<u64> next_id{1};
+
+	if (m_change_id == 0)
+		m_change_id = next_id.fetch_add(1, std::memory_order_relaxed);
+	return m_change_id;
+}
+
 
 void MapBlock::copyTo(VoxelManipulator &dst)
 {
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	if (m_packed) {
+		MapNode nodes[nodecount];
+		m_packed->decode(nodes);
+		dst.copyFrom(nodes, false, data_area, v3s16(0,0,0),
+				getPosRelative(), data_size);
+		return;
+	}
+
 	// Copy from data to VoxelManipulator
 	dst.copyFrom(data, m_is_mono_block, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
@@ -226,6 +246,7 @@ void MapBlock::copyFrom(const VoxelManipulator &src)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	m_content_counts_valid = false;
 	expandNodesIfNeeded();
 	// Copy from VoxelManipulator to data
 	src.copyTo(data, data_area, v3s16(0,0,0),
@@ -233,6 +254,66 @@ void MapBlock::copyFrom(const VoxelManipulator &src)
 	tryShrinkNodes();
 }
 
+const MapBlock::ContentCounts &MapBlock::getContentCounts()
+{
+	if (m_content_counts_valid)
+		return m_content_counts;
+
+	m_content_counts.clear();
+	if (m_is_mono_block) {
+		m_content_counts.emplace_back(data[0].getContent(), (u16)nodecount);
+	} else {
+		// consecutive nodes mostly have the same content
+		content_t last_c = getNodeNoCheck(0, 0, 0).getContent();
+		u16 run = 0;
+		const auto add = [this] (content_t c, u16 count) {
+			auto it = std::lower_bound(m_content_counts.begin(), m_content_counts.end(),
+				std::make_pair(c, (u16)0));
+			if (it != m_content_counts.end() && it->first == c)
+				it->second += count;
+			else
+				m_content_counts.emplace(it, c, count);
+		};
+		for (u32 i = 0; i < nodecount; i++) {
+			content_t c = m_packed ? m_packed->get(i).getContent() : data[i].getContent();
+			if (c != last_c) {
+				add(last_c, run);
+				last_c = c;
+				run = 0;
+			}
+			run++;
+		}
+		add(last_c, run);
+	}
+
+	m_content_counts_valid = true;
+	return m_content_counts;
+}
+
+void MapBlock::updateContentCounts(content_t old_c, content_t new_c)
+{
+	if (old_c == new_c)
+		return;
+
+	auto it = std::lower_bound(m_content_counts.begin(), m_content_counts.end(),
+		std::make_pair(old_c, (u16)0));
+	if (it == m_content_counts.end() || it->first != old_c) {
+		// The counts are stale, which is a bug. Count again when needed
+		// instead of damaging them further.
+		m_content_counts_valid = false;
+		return;
+	}
+	if (--it->second == 0)
+		m_content_counts.erase(it);
+
+	it = std::lower_bound(m_content_counts.begin(), m_content_counts.end(),
+		std::make_pair(new_c, (u16)0));
+	if (it != m_content_counts.end() && it->first == new_c)
+		it->second++;
+	else
+		m_content_counts.emplace(it, new_c, 1);
+}
+
 void MapBlock::reallocate(u32 count, MapNode n)
 {
 	assert(count == 1 || count == nodecount);
@@ -243,6 +324,7 @@ void MapBlock::reallocate(u32 count, MapNode n)
 	delete[] data;
 	if (data && !m_is_mono_block && count == 1)
 		porting::TrackFreedMemory(sizeof(MapNode) * nodecount);
+	m_packed.reset();
 
 	data = new MapNode[count];
 	std::fill_n(data, count, n);
@@ -260,6 +342,19 @@ void MapBlock::tryShrinkNodes()
 	if (m_is_mono_block)
 		return;
 
+	if (m_packed) {
+		// may have become uniform through setNode()
+		const MapNode n = m_packed->get(0);
+		for (u32 i = 1; i < nodecount; i++) {
+			if (n != m_packed->get(i))
+				return;
+		}
+		reallocate(1, n);
+		m_is_air = n.getContent() == CONTENT_AIR;
+		m_is_air_expired = false;
+		return;
+	}
+
 	MapNode n = data[0];
 	bool is_mono_block = true;
 	for (u32 i=1; i<nodecount; i++) {
@@ -273,12 +368,24 @@ void MapBlock::tryShrinkNodes()
 		reallocate(1, n);
 		m_is_air = n.getContent() == CONTENT_AIR;
 		m_is_air_expired = false;
+		return;
+	}
+
+	m_packed = PalettedNodes::create(data);
+	if (m_packed) {
+		delete[] data;
+		data = nullptr;
+		porting::TrackFreedMemory(sizeof(MapNode) * nodecount);
 	}
 }
 
 void MapBlock::expandNodesIfNeeded()
 {
-	if (m_is_mono_block) {
+	if (m_packed) {
+		data = new MapNode[nodecount];
+		m_packed->decode(data);
+		m_packed.reset();
+	} else if (m_is_mono_block) {
 		reallocate(nodecount, data[0]);
 	}
 }
@@ -292,6 +399,27 @@ void MapBlock::actuallyUpdateIsAir()
 		m_is_air = data[0].getContent() == CONTENT_AIR;
 		return;
 	}
+	if (m_packed) {
+		bool only_air = true;
+		for (content_t c : m_packed->getPalette()) {
+			if (c != CONTENT_AIR) {
+				only_air = false;
+				break;
+			}
+		}
+		if (!only_air) {
+			// the palette can contain contents that have been overwritten
+			only_air = true;
+			for (u32 i = 0; i < nodecount; i++) {
+				if (m_packed->get(i).getContent() != CONTENT_AIR) {
+					only_air = false;
+					break;
+				}
+			}
+		}
+		m_is_air = only_air;
+		return;
+	}
 	bool only_air = true;
 	for (u32 i = 0; i < nodecount; i++) {
 		MapNode &n = data[i];
@@ -390,9 +518,26 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 	if (!ser_ver_supported_write(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
-	std::ostringstream os_raw(std::ios_base::binary);
-	std::ostream &os = version >= 29 ? os_raw : os_compressed;
+	if (version >= 29) {
+		std::ostringstream os_raw(std::ios_base::binary);
+		serializeBody(os_raw, version, disk, compression_level);
+		// now compress the whole thing
+		compress(os_raw.str(), os_compressed, version, compression_level);
+	} else {
+		serializeBody(os_compressed, version, disk, compression_level);
+	}
+}
 
+void MapBlock::serializeUncompressed(std::ostream &os, u8 version, bool disk)
+{
+	if (!ser_ver_supported_write(version) || version < 29)
+		throw VersionMismatchException("ERROR: MapBlock format not supported");
+
+	serializeBody(os, version, disk, -1);
+}
+
+void MapBlock::serializeBody(std::ostream &os, u8 version, bool disk, int compression_level)
+{
 	// First byte
 	u8 flags = 0;
 	if(is_underground)
@@ -418,11 +563,23 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 	Buffer<u8> buf;
 	const u8 content_width = 2;
 	const u8 params_width = 2;
+	std::unique_ptr<MapNode[]> unpacked;
+	const MapNode *nodes = data;
+	if (m_packed) {
+		unpacked.reset(new MapNode[nodecount]);
+		m_packed->decode(unpacked.get());
+		nodes = unpacked.get();
+	}
 	if(disk)
 	{
 		const size_t size = m_is_mono_block ? 1 : nodecount;
-		std::unique_ptr<MapNode[]> tmp_nodes(new MapNode[size]);
-		std::copy_n(data, size, tmp_nodes.get());
+		std::unique_ptr<MapNode[]> tmp_nodes;
+		if (unpacked) {
+			tmp_nodes = std::move(unpacked);
+		} else {
+			tmp_nodes.reset(new MapNode[size]);
+			std::copy_n(data, size, tmp_nodes.get());
+		}
 		getBlockNodeIdMapping(&nimap, tmp_nodes.get(), size, m_gamedef->ndef());
 
 		buf = MapNode::serializeBulk(version, tmp_nodes.get(), nodecount,
@@ -437,7 +594,7 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 	}
 	else
 	{
-		buf = MapNode::serializeBulk(version, data, nodecount,
+		buf = MapNode::serializeBulk(version, nodes, nodecount,
 				content_width, params_width, m_is_mono_block);
 	}
 
@@ -456,7 +613,7 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 	if (version >= 29) {
 		m_node_metadata.serialize(os, version, disk);
 	} else {
-		// use os_raw from above to avoid allocating another stream object
+		std::ostringstream os_raw(std::ios_base::binary);
 		m_node_metadata.serialize(os_raw, version, disk);
 		// prior to 29 node data was compressed individually
 		compress(os_raw.str(), os, version, compression_level);
@@ -487,11 +644,6 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 			m_node_timers.serialize(os, version);
 		}
 	}
-
-	if (version >= 29) {
-		// now compress the whole thing
-		compress(os_raw.str(), os_compressed, version, compression_level);
-	}
 }
 
 void MapBlock::serializeNetworkSpecific(std::ostream &os)
@@ -507,6 +659,8 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()<<std::endl);
 
 	m_is_air_expired = true;
+	m_change_id = 0;
+	m_content_counts_valid = false;
 	expandNodesIfNeeded();
 
 	if(version <= 21)
@@ -636,9 +790,9 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 			m_node_timers.deSerialize(is, version);
 		}
 
-		if (nimap.size() == 1) {
-			tryShrinkNodes();
+		tryShrinkNodes();
 
+		if (nimap.size() == 1) {
 			u16 dummy;
 			m_is_air = nimap.getId("air", dummy);
 			m_is_air_expired = false;
@@ -11,6 +11,7 @@
 #include "constants.h"
 #include "staticobject.h"
 #include "nodemetadata.h" // NodeMetadataList
+#include "nodepalette.h"
 #include "nodetimer.h"
 #include "modifiedstate.h"
 #include "util/numeric.h" // getContainerPos
@@ -86,8 +87,7 @@ class MapBlock
 		} else if (mod == m_modified) {
 			m_modified_reason |= reason;
 		}
-		if (mod == MOD_STATE_WRITE_NEEDED)
-			contents.clear();
+		m_change_id = 0;
 	}
 
 	inline u32 getModified()
@@ -102,6 +102,10 @@ class MapBlock
 
 	std::string getModifiedReasonString();
 
+	// Returns an id that stays the same as long as the block is not modified.
+	// No two blocks (even after one is freed) ever share an id.
+	u64 getChangeId();
+
 	inline void resetModified()
 	{
 		m_modified = MOD_STATE_CLEAN;
@@ -226,7 +230,7 @@ class MapBlock
 		if (!*valid_position)
 			return {CONTENT_IGNORE};
 
-		return data[m_is_mono_block ? 0 : z * zstride + y * ystride + x];
+		return getNodeNoCheck(x, y, z);
 	}
 
 	inline MapNode getNode(v3s16 p, bool *valid_position)
@@ -245,9 +249,7 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
-		expandNodesIfNeeded();
-		data[z * zstride + y * ystride + x] = n;
-		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
+		setNodeNoCheck(x, y, z, n);
 	}
 
 	inline void setNode(v3s16 p, MapNode n)
@@ -261,7 +263,10 @@ class MapBlock
 
 	inline MapNode getNodeNoCheck(s16 x, s16 y, s16 z)
 	{
-		return data[m_is_mono_block ? 0 : z * zstride + y * ystride + x];
+		const u32 i = z * zstride + y * ystride + x;
+		if (m_packed)
+			return m_packed->get(i);
+		return data[m_is_mono_block ? 0 : i];
 	}
 
 	inline MapNode getNodeNoCheck(v3s16 p)
@@ -271,8 +276,13 @@ class MapBlock
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode n)
 	{
-		expandNodesIfNeeded();
-		data[z * zstride + y * ystride + x] = n;
+		const u32 i = z * zstride + y * ystride + x;
+		if (m_content_counts_valid)
+			updateContentCounts(getNodeNoCheck(x, y, z).getContent(), n.getContent());
+		if (!m_packed || !m_packed->set(i, n)) {
+			expandNodesIfNeeded();
+			data[i] = n;
+		}
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -281,6 +291,15 @@ class MapBlock
 		setNodeNoCheck(p.X, p.Y, p.Z, n);
 	}
 
+	// (content, number of nodes) for all contents in the block, sorted by content
+	typedef std::vector<std::pair<content_t, u16>> ContentCounts;
+
+	// Counts the contents on first use, afterwards the result is kept up to
+	// date by setNode() until the nodes are replaced in bulk.
+	const ContentCounts &getContentCounts();
+
+	bool hasContentCounts() const { return m_content_counts_valid; }
+
 	// Copies data to VoxelManipulator to getPosRelative()
 	void copyTo(VoxelManipulator &dst);
 
@@ -408,6 +427,10 @@ class MapBlock
 	// Set disk to true for on-disk format, false for over-the-network format
 	// Precondition: version >= SER_FMT_VER_LOWEST_WRITE
 	void serialize(std::ostream &result, u8 version, bool disk, int compression_level);
+	// Same as serialize() but leaves out the final compression step, which
+	// can then be done separately using compress() (e.g. on another thread).
+	// Precondition: version >= 29
+	void serializeUncompressed(std::ostream &os, u8 version, bool disk);
 	// If disk == true: In addition to doing other things, will add
 	// unknown blocks from id-name mapping to wndef
 	void deSerialize(std::istream &is, u8 version, bool disk);
@@ -436,11 +459,16 @@ class MapBlock
 	*/
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
-	// check if all nodes are identical, if so convert to monoblock
+	// writes everything serialize() does, except for the compression of
+	// the whole block in version >= 29
+	void serializeBody(std::ostream &os, u8 version, bool disk, int compression_level);
+	// check if all nodes are identical, if so convert to monoblock,
+	// otherwise try to convert to palette storage (server only)
 	void tryShrinkNodes();
-	// if a monoblock, expand storage back to the full array
+	// if a monoblock or paletted, expand storage back to the full array
 	void expandNodesIfNeeded();
 	void reallocate(u32 count, MapNode n);
+	void updateContentCounts(content_t old_c, content_t new_c);
 
 	static void getBlockNodeIdMapping(NameIdMapping *nimap, MapNode *nodes,
 		u32 count, const NodeDefManager *nodedef);
@@ -486,6 +514,9 @@ class MapBlock
 	 */
 	MapNode *data = nullptr;
 
+	// If set, the nodes are stored here instead and data is nullptr.
+	std::unique_ptr<PalettedNodes> m_packed;
+
 	// provides the item and node definitions
 	IGameDef *m_gamedef;
 
@@ -500,17 +531,14 @@ class MapBlock
 	 * (For reduced memory usage)
 	 */
 	bool m_is_mono_block;
-public:
+
+	// Whether m_content_counts is up to date
+	bool m_content_counts_valid = false;
+
 	//// ABM optimizations ////
-	// True if we never want to cache content types for this block
-	bool do_not_cache_contents = false;
-	// Cache of content types
-	// This is actually a set but for the small sizes we have a vector should be
-	// more efficient.
-	// Can be empty, in which case nothing was cached yet.
-	std::vector<content_t> contents;
+	// see getContentCounts()
+	ContentCounts m_content_counts;
 
-private:
 	// Whether day and night lighting differs
 	bool m_is_air = false;
 	bool m_is_air_expired = true;
@@ -522,6 +550,8 @@ class MapBlock
 	*/
 	u16 m_modified = MOD_STATE_CLEAN;
 	u32 m_modified_reason = 0;
+	// 0 = needs a new one (see getChangeId())
+	u64 m_change_id = 0;
 
 	/*
 		When block is removed from active blocks, this is set to gametime.
@@ -17,6 +17,7 @@
 #include "voxelalgorithms.h"
 #include "profiler.h"
 #include "settings.h"
+#include "threading/thread_pool.h"
 #include "treegen.h"
 #include "util/numeric.h"
 #include "util/directiontables.h"
@@ -114,6 +115,7 @@ Mapgen::Mapgen(int mapgenid, MapgenParams *params, EmergeParams *emerge) :
 
 	m_emerge  = emerge;
 	ndef      = emerge->ndef;
+	pool      = emerge->mapgen_pool;
 }
 
 Mapgen::~Mapgen()
@@ -411,6 +413,40 @@ void Mapgen::updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nm
 }
 
 
+void Mapgen::parallelFor(size_t count, const std::function<void(size_t)> &func)
+{
+	if (pool) {
+		pool->runShared(count, func);
+		return;
+	}
+	for (size_t i = 0; i < count; i++)
+		func(i);
+}
+
+
+void Mapgen::parallelForSlabs(s16 zmin, s16 zmax,
+	const std::function<void(s16, s16)> &func)
+{
+	// Small enough for a few slabs per thread in a default mapchunk
+	constexpr s16 SLAB_SIZE = 8;
+	if (zmax < zmin)
+		return;
+	const size_t count = (zmax - zmin) / SLAB_SIZE + 1;
+	parallelFor(count, [&] (size_t i) {
+		s16 z0 = zmin + i * SLAB_SIZE;
+		func(z0, MYMIN(zmax, z0 + SLAB_SIZE - 1));
+	});
+}
+
+
+void Mapgen::parallelInvoke(const std::vector<std::function<void()>> &funcs)
+{
+	parallelFor(funcs.size(), [&] (size_t i) {
+		funcs[i]();
+	});
+}
+
+
 void Mapgen::setLighting(u8 light, v3s16 nmin, v3s16 nmax)
 {
 	ScopeProfiler sp(g_profiler, "EmergeThread: update lighting", SPT_AVG);
@@ -627,142 +663,146 @@ void MapgenBasic::generateBiomes()
 	assert(biomemap);
 
 	const v3s32 &em = vm->m_area.getExtent();
-	u32 index = 0;
 
 	noise_filler_depth->noiseMap2D(node_min.X, node_min.Z);
 
-	for (s16 z = node_min.Z; z <= node_max.Z; z++)
-	for (s16 x = node_min.X; x <= node_max.X; x++, index++) {
-		Biome *biome = NULL;
-		biome_t water_biome_index = 0;
-		u16 depth_top = 0;
-		u16 base_filler = 0;
-		u16 depth_water_top = 0;
-		u16 depth_riverbed = 0;
-		u32 vi = vm->m_area.index(x, node_max.Y, z);
-
-		s16 biome_y_next = biomegen->getNextTransitionY(node_max.Y);
-
-		// Check node at base of mapchunk above, either a node of a previously
-		// generated mapchunk or if not, a node of overgenerated base terrain.
-		content_t c_above = vm->m_data[vi + em.X].getContent();
-		bool air_above = c_above == CONTENT_AIR;
-		bool river_water_above = c_above == c_river_water_source;
-		bool water_above = c_above == c_water_source || river_water_above;
-
-		biomemap[index] = BIOME_NONE;
-
-		// If there is air or water above enable top/filler placement, otherwise force
-		// nplaced to stone level by setting a number exceeding any possible filler depth.
-		u16 nplaced = (air_above || water_above) ? 0 : U16_MAX;
-
-		for (s16 y = node_max.Y; y >= node_min.Y; y--) {
-			content_t c = vm->m_data[vi].getContent();
-			const bool biome_outdated = !biome || y <= biome_y_next;
-			// Biome is (re)calculated:
-			// 1. At the surface of stone below air or water.
-			// 2. At the surface of water below air.
-			// 3. When stone or water is detected but biome has not yet been calculated.
-			// 4. When stone or water is detected just below a biome's lower limit.
-			bool is_stone_surface = (c == c_stone) &&
-				(air_above || water_above || biome_outdated); // 1, 3, 4
-
-			bool is_water_surface =
-				(c == c_water_source || c == c_river_water_source) &&
-				(air_above || biome_outdated); // 2, 3, 4
-
-			if (is_stone_surface || is_water_surface) {
-				if (biome_outdated) {
-					// (Re)calculate biome
-					biome = biomegen->getBiomeAtIndex(index, v3s16(x, y, z));
-					biome_y_next = biomegen->getNextTransitionY(y);
-
-					if (x == node_min.X && z == node_min.Z && false) {
-						dstream << "biomegen: biome at " << y << " is " << biome->name
-							<< ", next at " << biome_y_next << std::endl;
+	// Columns are independent of each other
+	parallelForSlabs(node_min.Z, node_max.Z, [&] (s16 z0, s16 z1) {
+		u32 index = (z0 - node_min.Z) * csize.X;
+
+		for (s16 z = z0; z <= z1; z++)
+		for (s16 x = node_min.X; x <= node_max.X; x++, index++) {
+			Biome *biome = NULL;
+			biome_t water_biome_index = 0;
+			u16 depth_top = 0;
+			u16 base_filler = 0;
+			u16 depth_water_top = 0;
+			u16 depth_riverbed = 0;
+			u32 vi = vm->m_area.index(x, node_max.Y, z);
+
+			s16 biome_y_next = biomegen->getNextTransitionY(node_max.Y);
+
+			// Check node at base of mapchunk above, either a node of a previously
+			// generated mapchunk or if not, a node of overgenerated base terrain.
+			content_t c_above = vm->m_data[vi + em.X].getContent();
+			bool air_above = c_above == CONTENT_AIR;
+			bool river_water_above = c_above == c_river_water_source;
+			bool water_above = c_above == c_water_source || river_water_above;
+
+			biomemap[index] = BIOME_NONE;
+
+			// If there is air or water above enable top/filler placement, otherwise force
+			// nplaced to stone level by setting a number exceeding any possible filler depth.
+			u16 nplaced = (air_above || water_above) ? 0 : U16_MAX;
+
+			for (s16 y = node_max.Y; y >= node_min.Y; y--) {
+				content_t c = vm->m_data[vi].getContent();
+				const bool biome_outdated = !biome || y <= biome_y_next;
+				// Biome is (re)calculated:
+				// 1. At the surface of stone below air or water.
+				// 2. At the surface of water below air.
+				// 3. When stone or water is detected but biome has not yet been calculated.
+				// 4. When stone or water is detected just below a biome's lower limit.
+				bool is_stone_surface = (c == c_stone) &&
+					(air_above || water_above || biome_outdated); // 1, 3, 4
+
+				bool is_water_surface =
+					(c == c_water_source || c == c_river_water_source) &&
+					(air_above || biome_outdated); // 2, 3, 4
+
+				if (is_stone_surface || is_water_surface) {
+					if (biome_outdated) {
+						// (Re)calculate biome
+						biome = biomegen->getBiomeAtIndex(index, v3s16(x, y, z));
+						biome_y_next = biomegen->getNextTransitionY(y);
+
+						if (x == node_min.X && z == node_min.Z && false) {
+							dstream << "biomegen: biome at " << y << " is " << biome->name
+								<< ", next at " << biome_y_next << std::endl;
+						}
 					}
-				}
 
-				// Add biome to biomemap at first stone surface detected
-				if (biomemap[index] == BIOME_NONE && is_stone_surface)
-					biomemap[index] = biome->index;
-
-				// Store biome of first water surface detected, as a fallback
-				// entry for the biomemap.
-				if (water_biome_index == 0 && is_water_surface)
-					water_biome_index = biome->index;
-
-				depth_top = biome->depth_top;
-				base_filler = MYMAX(depth_top +
-					biome->depth_filler +
-					noise_filler_depth->result[index], 0.0f);
-				depth_water_top = biome->depth_water_top;
-				depth_riverbed = biome->depth_riverbed;
-			}
+					// Add biome to biomemap at first stone surface detected
+					if (biomemap[index] == BIOME_NONE && is_stone_surface)
+						biomemap[index] = biome->index;
+
+					// Store biome of first water surface detected, as a fallback
+					// entry for the biomemap.
+					if (water_biome_index == 0 && is_water_surface)
+						water_biome_index = biome->index;
+
+					depth_top = biome->depth_top;
+					base_filler = MYMAX(depth_top +
+						biome->depth_filler +
+						noise_filler_depth->result[index], 0.0f);
+					depth_water_top = biome->depth_water_top;
+					depth_riverbed = biome->depth_riverbed;
+				}
 
-			if (c == c_stone) {
-				content_t c_below = vm->m_data[vi - em.X].getContent();
-
-				// If the node below isn't solid, make this node stone, so that
-				// any top/filler nodes above are structurally supported.
-				// This is done by aborting the cycle of top/filler placement
-				// immediately by forcing nplaced to stone level.
-				if (c_below == CONTENT_AIR
-						|| c_below == c_water_source
-						|| c_below == c_river_water_source)
-					nplaced = U16_MAX;
-
-				if (river_water_above) {
-					if (nplaced < depth_riverbed) {
-						vm->m_data[vi] = MapNode(biome->c_riverbed);
+				if (c == c_stone) {
+					content_t c_below = vm->m_data[vi - em.X].getContent();
+
+					// If the node below isn't solid, make this node stone, so that
+					// any top/filler nodes above are structurally supported.
+					// This is done by aborting the cycle of top/filler placement
+					// immediately by forcing nplaced to stone level.
+					if (c_below == CONTENT_AIR
+							|| c_below == c_water_source
+							|| c_below == c_river_water_source)
+						nplaced = U16_MAX;
+
+					if (river_water_above) {
+						if (nplaced < depth_riverbed) {
+							vm->m_data[vi] = MapNode(biome->c_riverbed);
+							nplaced++;
+						} else {
+							nplaced = U16_MAX;  // Disable top/filler placement
+							river_water_above = false;
+						}
+					} else if (nplaced < depth_top) {
+						vm->m_data[vi] = MapNode(biome->c_top);
+						nplaced++;
+					} else if (nplaced < base_filler) {
+						vm->m_data[vi] = MapNode(biome->c_filler);
 						nplaced++;
 					} else {
+						vm->m_data[vi] = MapNode(biome->c_stone);
 						nplaced = U16_MAX;  // Disable top/filler placement
-						river_water_above = false;
 					}
-				} else if (nplaced < depth_top) {
-					vm->m_data[vi] = MapNode(biome->c_top);
-					nplaced++;
-				} else if (nplaced < base_filler) {
-					vm->m_data[vi] = MapNode(biome->c_filler);
-					nplaced++;
-				} else {
-					vm->m_data[vi] = MapNode(biome->c_stone);
+
+					air_above = false;
+					water_above = false;
+				} else if (c == c_water_source) {
+					vm->m_data[vi] = MapNode((y > (s32)(water_level - depth_water_top))
+							? biome->c_water_top : biome->c_water);
+					nplaced = 0;  // Enable top/filler placement for next surface
+					air_above = false;
+					water_above = true;
+				} else if (c == c_river_water_source) {
+					vm->m_data[vi] = MapNode(biome->c_river_water);
+					nplaced = 0;  // Enable riverbed placement for next surface
+					air_above = false;
+					water_above = true;
+					river_water_above = true;
+				} else if (c == CONTENT_AIR) {
+					nplaced = 0;  // Enable top/filler placement for next surface
+					air_above = true;
+					water_above = false;
+				} else {  // Possible various nodes overgenerated from neighboring mapchunks
 					nplaced = U16_MAX;  // Disable top/filler placement
+					air_above = false;
+					water_above = false;
 				}
 
-				air_above = false;
-				water_above = false;
-			} else if (c == c_water_source) {
-				vm->m_data[vi] = MapNode((y > (s32)(water_level - depth_water_top))
-						? biome->c_water_top : biome->c_water);
-				nplaced = 0;  // Enable top/filler placement for next surface
-				air_above = false;
-				water_above = true;
-			} else if (c == c_river_water_source) {
-				vm->m_data[vi] = MapNode(biome->c_river_water);
-				nplaced = 0;  // Enable riverbed placement for next surface
-				air_above = false;
-				water_above = true;
-				river_water_above = true;
-			} else if (c == CONTENT_AIR) {
-				nplaced = 0;  // Enable top/filler placement for next surface
-				air_above = true;
-				water_above = false;
-			} else {  // Possible various nodes overgenerated from neighboring mapchunks
-				nplaced = U16_MAX;  // Disable top/filler placement
-				air_above = false;
-				water_above = false;
+				VoxelArea::add_y(em, vi, -1);
 			}
-
-			VoxelArea::add_y(em, vi, -1);
+			// If no stone surface detected in mapchunk column and a water surface
+			// biome fallback exists, add it to the biomemap. This avoids water
+			// surface decorations failing in deep water.
+			if (biomemap[index] == BIOME_NONE && water_biome_index != 0)
+				biomemap[index] = water_biome_index;
 		}
-		// If no stone surface detected in mapchunk column and a water surface
-		// biome fallback exists, add it to the biomemap. This avoids water
-		// surface decorations failing in deep water.
-		if (biomemap[index] == BIOME_NONE && water_biome_index != 0)
-			biomemap[index] = water_biome_index;
-	}
+	});
 }
 
 
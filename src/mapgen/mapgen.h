@@ -11,6 +11,7 @@
 #include "nodedef.h"
 #include "util/string.h"
 #include "util/container.h"
+#include <functional>
 #include <utility>
 #include <set>
 
@@ -38,6 +39,7 @@ class BiomeGen;
 struct BiomeParams;
 class BiomeManager;
 class EmergeParams;
+class ThreadPool;
 struct BlockMakeData;
 class VoxelArea;
 
@@ -169,6 +171,8 @@ class Mapgen {
 
 	BiomeGen *biomegen = nullptr;
 	GenerateNotifier gennotify;
+	// Shared with the other mapgens, may be NULL. See parallelFor().
+	ThreadPool *pool = nullptr;
 
 	Mapgen() = default;
 	Mapgen(int mapgenid, MapgenParams *params, EmergeParams *emerge);
@@ -187,6 +191,22 @@ class Mapgen {
 
 	void updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nmax);
 
+	/**
+	 * Calls `func(i)` for every i in [0, count), spread over the thread pool
+	 * if it is not busy with another mapgen. Calls may run concurrently, so
+	 * they must not write to anything the others use.
+	 */
+	void parallelFor(size_t count, const std::function<void(size_t)> &func);
+	/**
+	 * Like parallelFor(), but calls `func(z0, z1)` for slabs of nodes with
+	 * z0 <= Z <= z1 that together cover [zmin, zmax] once. For loops over
+	 * columns of a mapchunk that are independent of each other.
+	 */
+	void parallelForSlabs(s16 zmin, s16 zmax,
+		const std::function<void(s16, s16)> &func);
+	/// Calls all of `funcs` like parallelFor(), e.g. to compute noise maps.
+	void parallelInvoke(const std::vector<std::function<void()>> &funcs);
+
 	/**
 	 * Set light in entire area to fixed value.
 	 * @param light Light value (contains both banks)
@@ -5,6 +5,7 @@
 
 
 #include <cmath>
+#include <mutex>
 #include "mapgen.h"
 #include "voxel.h"
 #include "noise.h"
@@ -267,7 +268,7 @@ void MapgenCarpathian::makeChunk(BlockMakeData *data)
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
-		biomegen->calcBiomeNoise(node_min);
+		biomegen->calcBiomeNoise(node_min, pool);
 		generateBiomes();
 	}
 
@@ -428,129 +429,142 @@ int MapgenCarpathian::generateTerrain()
 	MapNode mn_water(c_water_source);
 
 	// Calculate noise for terrain generation
-	noise_height1->noiseMap2D(node_min.X, node_min.Z);
-	noise_height2->noiseMap2D(node_min.X, node_min.Z);
-	noise_height3->noiseMap2D(node_min.X, node_min.Z);
-	noise_height4->noiseMap2D(node_min.X, node_min.Z);
-	noise_hills_terrain->noiseMap2D(node_min.X, node_min.Z);
-	noise_ridge_terrain->noiseMap2D(node_min.X, node_min.Z);
-	noise_step_terrain->noiseMap2D(node_min.X, node_min.Z);
-	noise_hills->noiseMap2D(node_min.X, node_min.Z);
-	noise_ridge_mnt->noiseMap2D(node_min.X, node_min.Z);
-	noise_step_mnt->noiseMap2D(node_min.X, node_min.Z);
-	noise_mnt_var->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	std::vector<std::function<void()>> noises;
+	for (Noise *noise : {noise_height1, noise_height2, noise_height3,
+			noise_height4, noise_hills_terrain, noise_ridge_terrain,
+			noise_step_terrain, noise_hills, noise_ridge_mnt, noise_step_mnt}) {
+		noises.emplace_back([&, noise] {
+			noise->noiseMap2D(node_min.X, node_min.Z);
+		});
+	}
+	noises.emplace_back([&] {
+		noise_mnt_var->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	});
 
-	if (spflags & MGCARPATHIAN_RIVERS)
-		noise_rivers->noiseMap2D(node_min.X, node_min.Z);
+	if (spflags & MGCARPATHIAN_RIVERS) {
+		noises.emplace_back([&] {
+			noise_rivers->noiseMap2D(node_min.X, node_min.Z);
+		});
+	}
+
+	parallelInvoke(noises);
 
 	//// Place nodes
 	const v3s32 &em = vm->m_area.getExtent();
 	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
-	u32 index2d = 0;
-
-	for (s16 z = node_min.Z; z <= node_max.Z; z++)
-	for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
-		// Hill/Mountain height (hilliness)
-		float height1 = noise_height1->result[index2d];
-		float height2 = noise_height2->result[index2d];
-		float height3 = noise_height3->result[index2d];
-		float height4 = noise_height4->result[index2d];
-
-		// Rolling hills
-		float hterabs = std::fabs(noise_hills_terrain->result[index2d]);
-		float n_hills = noise_hills->result[index2d];
-		float hill_mnt = hterabs * hterabs * hterabs * n_hills * n_hills;
-
-		// Ridged mountains
-		float rterabs = std::fabs(noise_ridge_terrain->result[index2d]);
-		float n_ridge_mnt = noise_ridge_mnt->result[index2d];
-		float ridge_mnt = rterabs * rterabs * rterabs *
-			(1.0f - std::fabs(n_ridge_mnt));
-
-		// Step (terraced) mountains
-		float sterabs = std::fabs(noise_step_terrain->result[index2d]);
-		float n_step_mnt = noise_step_mnt->result[index2d];
-		float step_mnt = sterabs * sterabs * sterabs * getSteps(n_step_mnt);
-
-		// Rivers
-		float valley = 1.0f;
-		float river = 0.0f;
-
-		if ((spflags & MGCARPATHIAN_RIVERS) && node_max.Y >= water_level - 16) {
-			river = std::fabs(noise_rivers->result[index2d]) - river_width;
-			if (river <= valley_width) {
-				// Within river valley
-				if (river < 0.0f) {
-					// River channel
-					valley = river;
-				} else {
-					// Valley slopes.
-					// 0 at river edge, 1 at valley edge.
-					float riversc = river / valley_width;
-					// Smoothstep
-					valley = riversc * riversc * (3.0f - 2.0f * riversc);
-				}
-			}
-		}
-
-		// Initialise 3D noise index and voxelmanip index to column base
-		u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
-		u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
-
-		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1;
-				y++,
-				index3d += ystride,
-				VoxelArea::add_y(em, vi, 1)) {
-			if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
-				continue;
-
-			// Combine height noises and apply 3D variation
-			float mnt_var = noise_mnt_var->result[index3d];
-			float hill1 = getLerp(height1, height2, mnt_var);
-			float hill2 = getLerp(height3, height4, mnt_var);
-			float hill3 = getLerp(height3, height2, mnt_var);
-			float hill4 = getLerp(height1, height4, mnt_var);
-
-			// 'hilliness' determines whether hills/mountains are
-			// small or large
-			float hilliness =
-				std::fmax(std::fmin(hill1, hill2), std::fmin(hill3, hill4));
-			float hills = hill_mnt * hilliness;
-			float ridged_mountains = ridge_mnt * hilliness;
-			float step_mountains = step_mnt * hilliness;
-
-			// Gradient & shallow seabed
-			s32 grad = (y < water_level) ? grad_wl + (water_level - y) * 3 :
-				1 - y;
-
-			// Final terrain level
-			float mountains = hills + ridged_mountains + step_mountains;
-			float surface_level = base_level + mountains + grad;
+	std::mutex max_y_mutex;
+
+	parallelForSlabs(node_min.Z, node_max.Z, [&] (s16 z0, s16 z1) {
+		s16 slab_max_y = -MAX_MAP_GENERATION_LIMIT;
+		u32 index2d = (z0 - node_min.Z) * csize.X;
+
+		for (s16 z = z0; z <= z1; z++)
+		for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
+			// Hill/Mountain height (hilliness)
+			float height1 = noise_height1->result[index2d];
+			float height2 = noise_height2->result[index2d];
+			float height3 = noise_height3->result[index2d];
+			float height4 = noise_height4->result[index2d];
+
+			// Rolling hills
+			float hterabs = std::fabs(noise_hills_terrain->result[index2d]);
+			float n_hills = noise_hills->result[index2d];
+			float hill_mnt = hterabs * hterabs * hterabs * n_hills * n_hills;
+
+			// Ridged mountains
+			float rterabs = std::fabs(noise_ridge_terrain->result[index2d]);
+			float n_ridge_mnt = noise_ridge_mnt->result[index2d];
+			float ridge_mnt = rterabs * rterabs * rterabs *
+				(1.0f - std::fabs(n_ridge_mnt));
+
+			// Step (terraced) mountains
+			float sterabs = std::fabs(noise_step_terrain->result[index2d]);
+			float n_step_mnt = noise_step_mnt->result[index2d];
+			float step_mnt = sterabs * sterabs * sterabs * getSteps(n_step_mnt);
 
 			// Rivers
-			if ((spflags & MGCARPATHIAN_RIVERS) && node_max.Y >= water_level - 16 &&
-					river <= valley_width) {
-				if (valley < 0.0f) {
-					// River channel
-					surface_level = std::fmin(surface_level,
-						water_level - std::sqrt(-valley) * river_depth);
-				} else if (surface_level > water_level) {
-					// Valley slopes
-					surface_level = water_level + (surface_level - water_level) * valley;
+			float valley = 1.0f;
+			float river = 0.0f;
+
+			if ((spflags & MGCARPATHIAN_RIVERS) && node_max.Y >= water_level - 16) {
+				river = std::fabs(noise_rivers->result[index2d]) - river_width;
+				if (river <= valley_width) {
+					// Within river valley
+					if (river < 0.0f) {
+						// River channel
+						valley = river;
+					} else {
+						// Valley slopes.
+						// 0 at river edge, 1 at valley edge.
+						float riversc = river / valley_width;
+						// Smoothstep
+						valley = riversc * riversc * (3.0f - 2.0f * riversc);
+					}
 				}
 			}
 
-			if (y < surface_level) { //TODO '<='
-				vm->m_data[vi] = mn_stone; // Stone
-				if (y > stone_surface_max_y)
-					stone_surface_max_y = y;
-			} else if (y <= water_level) {
-				vm->m_data[vi] = mn_water; // Sea water
-			} else {
-				vm->m_data[vi] = mn_air; // Air
+			// Initialise 3D noise index and voxelmanip index to column base
+			u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
+			u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
+
+			for (s16 y = node_min.Y - 1; y <= node_max.Y + 1;
+					y++,
+					index3d += ystride,
+					VoxelArea::add_y(em, vi, 1)) {
+				if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
+					continue;
+
+				// Combine height noises and apply 3D variation
+				float mnt_var = noise_mnt_var->result[index3d];
+				float hill1 = getLerp(height1, height2, mnt_var);
+				float hill2 = getLerp(height3, height4, mnt_var);
+				float hill3 = getLerp(height3, height2, mnt_var);
+				float hill4 = getLerp(height1, height4, mnt_var);
+
+				// 'hilliness' determines whether hills/mountains are
+				// small or large
+				float hilliness =
+					std::fmax(std::fmin(hill1, hill2), std::fmin(hill3, hill4));
+				float hills = hill_mnt * hilliness;
+				float ridged_mountains = ridge_mnt * hilliness;
+				float step_mountains = step_mnt * hilliness;
+
+				// Gradient & shallow seabed
+				s32 grad = (y < water_level) ? grad_wl + (water_level - y) * 3 :
+					1 - y;
+
+				// Final terrain level
+				float mountains = hills + ridged_mountains + step_mountains;
+				float surface_level = base_level + mountains + grad;
+
+				// Rivers
+				if ((spflags & MGCARPATHIAN_RIVERS) && node_max.Y >= water_level - 16 &&
+						river <= valley_width) {
+					if (valley < 0.0f) {
+						// River channel
+						surface_level = std::fmin(surface_level,
+							water_level - std::sqrt(-valley) * river_depth);
+					} else if (surface_level > water_level) {
+						// Valley slopes
+						surface_level = water_level + (surface_level - water_level) * valley;
+					}
+				}
+
+				if (y < surface_level) { //TODO '<='
+					vm->m_data[vi] = mn_stone; // Stone
+					if (y > slab_max_y)
+						slab_max_y = y;
+				} else if (y <= water_level) {
+					vm->m_data[vi] = mn_water; // Sea water
+				} else {
+					vm->m_data[vi] = mn_air; // Air
+				}
 			}
 		}
-	}
+
+		std::lock_guard lock(max_y_mutex);
+		stone_surface_max_y = MYMAX(stone_surface_max_y, slab_max_y);
+	});
 
 	return stone_surface_max_y;
 }
@@ -216,7 +216,7 @@ void MapgenFlat::makeChunk(BlockMakeData *data)
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
-		biomegen->calcBiomeNoise(node_min);
+		biomegen->calcBiomeNoise(node_min, pool);
 		generateBiomes();
 	}
 
@@ -227,7 +227,7 @@ void MapgenFractal::makeChunk(BlockMakeData *data)
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
-		biomegen->calcBiomeNoise(node_min);
+		biomegen->calcBiomeNoise(node_min, pool);
 		generateBiomes();
 	}
 
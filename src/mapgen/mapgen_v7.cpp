@@ -6,6 +6,7 @@
 
 #include "mapgen.h"
 #include <cmath>
+#include <mutex>
 #include "voxel.h"
 #include "noise.h"
 #include "mapnode.h"
@@ -325,7 +326,7 @@ void MapgenV7::makeChunk(BlockMakeData *data)
 
 	// Init biome generator, place biome-specific nodes, and build biomemap
 	if (flags & MG_BIOMES) {
-		biomegen->calcBiomeNoise(node_min);
+		biomegen->calcBiomeNoise(node_min, pool);
 		generateBiomes();
 	}
 
@@ -471,23 +472,31 @@ int MapgenV7::generateTerrain()
 	MapNode n_water(c_water_source);
 
 	//// Calculate noise for terrain generation
-	noise_terrain_persist->noiseMap2D(node_min.X, node_min.Z);
-	float *persistmap = noise_terrain_persist->result;
-
-	noise_terrain_base->noiseMap2D(node_min.X, node_min.Z, persistmap);
-	noise_terrain_alt->noiseMap2D(node_min.X, node_min.Z, persistmap);
-	noise_height_select->noiseMap2D(node_min.X, node_min.Z);
+	std::vector<std::function<void()>> noises;
+	noises.emplace_back([&] {
+		noise_terrain_persist->noiseMap2D(node_min.X, node_min.Z);
+		float *persistmap = noise_terrain_persist->result;
+
+		noise_terrain_base->noiseMap2D(node_min.X, node_min.Z, persistmap);
+		noise_terrain_alt->noiseMap2D(node_min.X, node_min.Z, persistmap);
+	});
+	noises.emplace_back([&] {
+		noise_height_select->noiseMap2D(node_min.X, node_min.Z);
+	});
 
 	if (spflags & MGV7_MOUNTAINS) {
-		noise_mount_height->noiseMap2D(node_min.X, node_min.Z);
-		noise_mountain->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+		noises.emplace_back([&] {
+			noise_mount_height->noiseMap2D(node_min.X, node_min.Z);
+		});
+		noises.emplace_back([&] {
+			noise_mountain->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+		});
 	}
 
 	//// Floatlands
 	// 'Generate floatlands in this mapchunk' bool for
 	// simplification of condition checks in y-loop.
 	bool gen_floatlands = false;
-	u8 cache_index = 0;
 	// Y values where floatland tapering starts
 	s16 float_taper_ymax = floatland_ymax - floatland_taper;
 	s16 float_taper_ymin = floatland_ymin + floatland_taper;
@@ -496,9 +505,12 @@ int MapgenV7::generateTerrain()
 			node_max.Y >= floatland_ymin && node_min.Y <= floatland_ymax) {
 		gen_floatlands = true;
 		// Calculate noise for floatland generation
-		noise_floatland->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+		noises.emplace_back([&] {
+			noise_floatland->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+		});
 
 		// Cache floatland noise offset values, for floatland tapering
+		u8 cache_index = 0;
 		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++, cache_index++) {
 			float float_offset = 0.0f;
 			if (y > float_taper_ymax) {
@@ -517,58 +529,72 @@ int MapgenV7::generateTerrain()
 	bool gen_rivers = (spflags & MGV7_RIDGES) && node_max.Y >= water_level - 16 &&
 		!gen_floatlands;
 	if (gen_rivers) {
-		noise_ridge->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-		noise_ridge_uwater->noiseMap2D(node_min.X, node_min.Z);
+		noises.emplace_back([&] {
+			noise_ridge->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+		});
+		noises.emplace_back([&] {
+			noise_ridge_uwater->noiseMap2D(node_min.X, node_min.Z);
+		});
 	}
 
+	parallelInvoke(noises);
+
 	//// Place nodes
 	const v3s32 &em = vm->m_area.getExtent();
 	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
-	u32 index2d = 0;
-
-	for (s16 z = node_min.Z; z <= node_max.Z; z++)
-	for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
-		s16 surface_y = baseTerrainLevelFromMap(index2d);
-		if (surface_y > stone_surface_max_y)
-			stone_surface_max_y = surface_y;
-
-		cache_index = 0;
-		u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
-		u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
-
-		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1;
-				y++,
-				index3d += ystride,
-				VoxelArea::add_y(em, vi, 1),
-				cache_index++) {
-			if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
-				continue;
-
-			bool is_river_channel = gen_rivers &&
-				getRiverChannelFromMap(index3d, index2d, y);
-			if (y <= surface_y && !is_river_channel) {
-				vm->m_data[vi] = n_stone; // Base terrain
-			} else if ((spflags & MGV7_MOUNTAINS) &&
-					getMountainTerrainFromMap(index3d, index2d, y) &&
-					!is_river_channel) {
-				vm->m_data[vi] = n_stone; // Mountain terrain
-				if (y > stone_surface_max_y)
-					stone_surface_max_y = y;
-			} else if (gen_floatlands &&
-					getFloatlandTerrainFromMap(index3d,
-					float_offset_cache[cache_index])) {
-				vm->m_data[vi] = n_stone; // Floatland terrain
-				if (y > stone_surface_max_y)
-					stone_surface_max_y = y;
-			} else if (y <= water_level) { // Surface water
-				vm->m_data[vi] = n_water;
-			} else if (gen_floatlands && y >= float_taper_ymax && y <= floatland_ywater) {
-				vm->m_data[vi] = n_water; // Water for solid floatland layer only
-			} else {
-				vm->m_data[vi] = n_air; // Air
+	std::mutex max_y_mutex;
+
+	parallelForSlabs(node_min.Z, node_max.Z, [&] (s16 z0, s16 z1) {
+		s16 slab_max_y = -MAX_MAP_GENERATION_LIMIT;
+		u32 index2d = (z0 - node_min.Z) * csize.X;
+
+		for (s16 z = z0; z <= z1; z++)
+		for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
+			s16 surface_y = baseTerrainLevelFromMap(index2d);
+			if (surface_y > slab_max_y)
+				slab_max_y = surface_y;
+
+			u8 cache_index = 0;
+			u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
+			u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
+
+			for (s16 y = node_min.Y - 1; y <= node_max.Y + 1;
+					y++,
+					index3d += ystride,
+					VoxelArea::add_y(em, vi, 1),
+					cache_index++) {
+				if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
+					continue;
+
+				bool is_river_channel = gen_rivers &&
+					getRiverChannelFromMap(index3d, index2d, y);
+				if (y <= surface_y && !is_river_channel) {
+					vm->m_data[vi] = n_stone; // Base terrain
+				} else if ((spflags & MGV7_MOUNTAINS) &&
+						getMountainTerrainFromMap(index3d, index2d, y) &&
+						!is_river_channel) {
+					vm->m_data[vi] = n_stone; // Mountain terrain
+					if (y > slab_max_y)
+						slab_max_y = y;
+				} else if (gen_floatlands &&
+						getFloatlandTerrainFromMap(index3d,
+						float_offset_cache[cache_index])) {
+					vm->m_data[vi] = n_stone; // Floatland terrain
+					if (y > slab_max_y)
+						slab_max_y = y;
+				} else if (y <= water_level) { // Surface water
+					vm->m_data[vi] = n_water;
+				} else if (gen_floatlands && y >= float_taper_ymax && y <= floatland_ywater) {
+					vm->m_data[vi] = n_water; // Water for solid floatland layer only
+				} else {
+					vm->m_data[vi] = n_air; // Air
+				}
 			}
 		}
-	}
+
+		std::lock_guard lock(max_y_mutex);
+		stone_surface_max_y = MYMAX(stone_surface_max_y, slab_max_y);
+	});
 
 	return stone_surface_max_y;
 }
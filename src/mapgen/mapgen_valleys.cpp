@@ -29,6 +29,7 @@ Licensing changed by permission of Gael de Sailly.
 #include "mapgen_valleys.h"
 #include "cavegen.h"
 #include <cmath>
+#include <mutex>
 
 
 const FlagDesc flagdesc_mapgen_valleys[] = {
@@ -216,7 +217,7 @@ void MapgenValleys::makeChunk(BlockMakeData *data)
 	// Generate biome noises. Note this must be executed strictly before
 	// generateTerrain, because generateTerrain depends on intermediate
 	// biome-related noises.
-	m_bgen->calcBiomeNoise(node_min);
+	m_bgen->calcBiomeNoise(node_min, pool);
 
 	// Generate terrain
 	s16 stone_surface_max_y = generateTerrain();
@@ -335,135 +336,144 @@ int MapgenValleys::generateTerrain()
 	MapNode n_stone(c_stone);
 	MapNode n_water(c_water_source);
 
-	noise_inter_valley_slope->noiseMap2D(node_min.X, node_min.Z);
-	noise_rivers->noiseMap2D(node_min.X, node_min.Z);
-	noise_terrain_height->noiseMap2D(node_min.X, node_min.Z);
-	noise_valley_depth->noiseMap2D(node_min.X, node_min.Z);
-	noise_valley_profile->noiseMap2D(node_min.X, node_min.Z);
-
-	noise_inter_valley_fill->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	parallelInvoke({
+		[&] { noise_inter_valley_slope->noiseMap2D(node_min.X, node_min.Z); },
+		[&] { noise_rivers->noiseMap2D(node_min.X, node_min.Z); },
+		[&] { noise_terrain_height->noiseMap2D(node_min.X, node_min.Z); },
+		[&] { noise_valley_depth->noiseMap2D(node_min.X, node_min.Z); },
+		[&] { noise_valley_profile->noiseMap2D(node_min.X, node_min.Z); },
+		[&] { noise_inter_valley_fill->noiseMap3D(node_min.X, node_min.Y - 1, node_min.Z); },
+	});
 
 	const v3s32 &em = vm->m_area.getExtent();
 	s16 surface_max_y = -MAX_MAP_GENERATION_LIMIT;
-	u32 index_2d = 0;
-
-	for (s16 z = node_min.Z; z <= node_max.Z; z++)
-	for (s16 x = node_min.X; x <= node_max.X; x++, index_2d++) {
-		float n_slope          = noise_inter_valley_slope->result[index_2d];
-		float n_rivers         = noise_rivers->result[index_2d];
-		float n_terrain_height = noise_terrain_height->result[index_2d];
-		float n_valley         = noise_valley_depth->result[index_2d];
-		float n_valley_profile = noise_valley_profile->result[index_2d];
-
-		float valley_d = n_valley * n_valley;
-		// 'base' represents the level of the river banks
-		float base = n_terrain_height + valley_d;
-		// 'river' represents the distance from the river edge
-		float river = std::fabs(n_rivers) - river_size_factor;
-		// Use the curve of the function 1-exp(-(x/a)^2) to model valleys.
-		// 'valley_h' represents the height of the terrain, from the rivers.
-		float tv = std::fmax(river / n_valley_profile, 0.0f);
-		float valley_h = valley_d * (1.0f - std::exp(-tv * tv));
-		// Approximate height of the terrain
-		float surface_y = base + valley_h;
-		float slope = n_slope * valley_h;
-		// River water surface is 1 node below river banks
-		float river_y = base - 1.0f;
-
-		// Rivers are placed where 'river' is negative
-		if (river < 0.0f) {
-			// Use the function -sqrt(1-x^2) which models a circle
-			float tr = river / river_size_factor + 1.0f;
-			float depth = (river_depth_bed *
-				std::sqrt(std::fmax(0.0f, 1.0f - tr * tr)));
-			// There is no logical equivalent to this using rangelim
-			surface_y = std::fmin(
-				std::fmax(base - depth, (float)(water_level - 3)),
-				surface_y);
-			slope = 0.0f;
-		}
+	std::mutex max_y_mutex;
+
+	parallelForSlabs(node_min.Z, node_max.Z, [&] (s16 z0, s16 z1) {
+		s16 slab_max_y = -MAX_MAP_GENERATION_LIMIT;
+		u32 index_2d = (z0 - node_min.Z) * csize.X;
+
+		for (s16 z = z0; z <= z1; z++)
+		for (s16 x = node_min.X; x <= node_max.X; x++, index_2d++) {
+			float n_slope          = noise_inter_valley_slope->result[index_2d];
+			float n_rivers         = noise_rivers->result[index_2d];
+			float n_terrain_height = noise_terrain_height->result[index_2d];
+			float n_valley         = noise_valley_depth->result[index_2d];
+			float n_valley_profile = noise_valley_profile->result[index_2d];
+
+			float valley_d = n_valley * n_valley;
+			// 'base' represents the level of the river banks
+			float base = n_terrain_height + valley_d;
+			// 'river' represents the distance from the river edge
+			float river = std::fabs(n_rivers) - river_size_factor;
+			// Use the curve of the function 1-exp(-(x/a)^2) to model valleys.
+			// 'valley_h' represents the height of the terrain, from the rivers.
+			float tv = std::fmax(river / n_valley_profile, 0.0f);
+			float valley_h = valley_d * (1.0f - std::exp(-tv * tv));
+			// Approximate height of the terrain
+			float surface_y = base + valley_h;
+			float slope = n_slope * valley_h;
+			// River water surface is 1 node below river banks
+			float river_y = base - 1.0f;
+
+			// Rivers are placed where 'river' is negative
+			if (river < 0.0f) {
+				// Use the function -sqrt(1-x^2) which models a circle
+				float tr = river / river_size_factor + 1.0f;
+				float depth = (river_depth_bed *
+					std::sqrt(std::fmax(0.0f, 1.0f - tr * tr)));
+				// There is no logical equivalent to this using rangelim
+				surface_y = std::fmin(
+					std::fmax(base - depth, (float)(water_level - 3)),
+					surface_y);
+				slope = 0.0f;
+			}
 
-		// Optionally vary river depth according to heat and humidity
-		if (spflags & MGVALLEYS_VARY_RIVER_DEPTH) {
-			float t_heat = m_bgen->heatmap[index_2d];
-			float heat = (spflags & MGVALLEYS_ALT_CHILL) ?
-				// Match heat value calculated below in
-				// 'Optionally decrease heat with altitude'.
-				// In rivers, 'ground height ignoring riverbeds' is 'base'.
-				// As this only affects river water we can assume y > water_level.
-				t_heat + 5.0f - (base - water_level) * 20.0f / altitude_chill :
-				t_heat;
-			float delta = m_bgen->humidmap[index_2d] - 50.0f;
-			if (delta < 0.0f) {
-				float t_evap = (heat - 32.0f) / 300.0f;
-				river_y += delta * std::fmax(t_evap, 0.08f);
+			// Optionally vary river depth according to heat and humidity
+			if (spflags & MGVALLEYS_VARY_RIVER_DEPTH) {
+				float t_heat = m_bgen->heatmap[index_2d];
+				float heat = (spflags & MGVALLEYS_ALT_CHILL) ?
+					// Match heat value calculated below in
+					// 'Optionally decrease heat with altitude'.
+					// In rivers, 'ground height ignoring riverbeds' is 'base'.
+					// As this only affects river water we can assume y > water_level.
+					t_heat + 5.0f - (base - water_level) * 20.0f / altitude_chill :
+					t_heat;
+				float delta = m_bgen->humidmap[index_2d] - 50.0f;
+				if (delta < 0.0f) {
+					float t_evap = (heat - 32.0f) / 300.0f;
+					river_y += delta * std::fmax(t_evap, 0.08f);
+				}
 			}
-		}
 
-		// Highest solid node in column
-		s16 column_max_y = surface_y;
-		u32 index_3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
-		u32 index_data = vm->m_area.index(x, node_min.Y - 1, z);
-
-		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++) {
-			if (vm->m_data[index_data].getContent() == CONTENT_IGNORE) {
-				float n_fill = noise_inter_valley_fill->result[index_3d];
-				float surface_delta = (float)y - surface_y;
-				// Density = density noise + density gradient
-				float density = slope * n_fill - surface_delta;
-
-				if (density > 0.0f) {
-					vm->m_data[index_data] = n_stone; // Stone
-					if (y > surface_max_y)
-						surface_max_y = y;
-					if (y > column_max_y)
-						column_max_y = y;
-				} else if (y <= water_level) {
-					vm->m_data[index_data] = n_water; // Water
-				} else if (y <= (s16)river_y) {
-					vm->m_data[index_data] = n_river_water; // River water
-				} else {
-					vm->m_data[index_data] = n_air; // Air
+			// Highest solid node in column
+			s16 column_max_y = surface_y;
+			u32 index_3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
+			u32 index_data = vm->m_area.index(x, node_min.Y - 1, z);
+
+			for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++) {
+				if (vm->m_data[index_data].getContent() == CONTENT_IGNORE) {
+					float n_fill = noise_inter_valley_fill->result[index_3d];
+					float surface_delta = (float)y - surface_y;
+					// Density = density noise + density gradient
+					float density = slope * n_fill - surface_delta;
+
+					if (density > 0.0f) {
+						vm->m_data[index_data] = n_stone; // Stone
+						if (y > slab_max_y)
+							slab_max_y = y;
+						if (y > column_max_y)
+							column_max_y = y;
+					} else if (y <= water_level) {
+						vm->m_data[index_data] = n_water; // Water
+					} else if (y <= (s16)river_y) {
+						vm->m_data[index_data] = n_river_water; // River water
+					} else {
+						vm->m_data[index_data] = n_air; // Air
+					}
 				}
+
+				VoxelArea::add_y(em, index_data, 1);
+				index_3d += ystride;
 			}
 
-			VoxelArea::add_y(em, index_data, 1);
-			index_3d += ystride;
-		}
+			// Optionally increase humidity around rivers
+			if (spflags & MGVALLEYS_HUMID_RIVERS) {
+				// Compensate to avoid increasing average humidity
+				m_bgen->humidmap[index_2d] *= 0.8f;
+				// Ground height ignoring riverbeds
+				float t_alt = std::fmax(base, (float)column_max_y);
+				float water_depth = (t_alt - base) / 4.0f;
+				m_bgen->humidmap[index_2d] *=
+					1.0f + std::pow(0.5f, std::fmax(water_depth, 1.0f));
+			}
 
-		// Optionally increase humidity around rivers
-		if (spflags & MGVALLEYS_HUMID_RIVERS) {
-			// Compensate to avoid increasing average humidity
-			m_bgen->humidmap[index_2d] *= 0.8f;
-			// Ground height ignoring riverbeds
-			float t_alt = std::fmax(base, (float)column_max_y);
-			float water_depth = (t_alt - base) / 4.0f;
-			m_bgen->humidmap[index_2d] *=
-				1.0f + std::pow(0.5f, std::fmax(water_depth, 1.0f));
-		}
+			// Optionally decrease humidity with altitude
+			if (spflags & MGVALLEYS_ALT_DRY) {
+				// Ground height ignoring riverbeds
+				float t_alt = std::fmax(base, (float)column_max_y);
+				// Only decrease above water_level
+				if (t_alt > water_level)
+					m_bgen->humidmap[index_2d] -=
+						(t_alt - water_level) * 10.0f / altitude_chill;
+			}
 
-		// Optionally decrease humidity with altitude
-		if (spflags & MGVALLEYS_ALT_DRY) {
-			// Ground height ignoring riverbeds
-			float t_alt = std::fmax(base, (float)column_max_y);
-			// Only decrease above water_level
-			if (t_alt > water_level)
-				m_bgen->humidmap[index_2d] -=
-					(t_alt - water_level) * 10.0f / altitude_chill;
+			// Optionally decrease heat with altitude
+			if (spflags & MGVALLEYS_ALT_CHILL) {
+				// Compensate to avoid reducing the average heat
+				m_bgen->heatmap[index_2d] += 5.0f;
+				// Ground height ignoring riverbeds
+				float t_alt = std::fmax(base, (float)column_max_y);
+				// Only decrease above water_level
+				if (t_alt > water_level)
+					m_bgen->heatmap[index_2d] -=
+						(t_alt - water_level) * 20.0f / altitude_chill;
+			}
 		}
 
-		// Optionally decrease heat with altitude
-		if (spflags & MGVALLEYS_ALT_CHILL) {
-			// Compensate to avoid reducing the average heat
-			m_bgen->heatmap[index_2d] += 5.0f;
-			// Ground height ignoring riverbeds
-			float t_alt = std::fmax(base, (float)column_max_y);
-			// Only decrease above water_level
-			if (t_alt > water_level)
-				m_bgen->heatmap[index_2d] -=
-					(t_alt - water_level) * 20.0f / altitude_chill;
-		}
-	}
+		std::lock_guard lock(max_y_mutex);
+		surface_max_y = MYMAX(surface_max_y, slab_max_y);
+	});
 
 	return surface_max_y;
 }
@@ -9,6 +9,7 @@
 #include "server.h"
 #include "nodedef.h"
 #include "settings.h"
+#include "threading/thread_pool.h"
 
 #include <algorithm>
 
@@ -136,6 +137,8 @@ BiomeGenOriginal::BiomeGenOriginal(BiomeManager *biomemgr,
 	values.erase(std::unique(values.begin(), values.end()), values.end());
 
 	m_transitions_y = std::move(values);
+
+	buildBiomeSlabs();
 }
 
 BiomeGenOriginal::~BiomeGenOriginal()
@@ -178,14 +181,21 @@ Biome *BiomeGenOriginal::calcBiomeAtPoint(v3s16 pos) const
 }
 
 
-void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin)
+void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin, ThreadPool *pool)
 {
 	m_pmin = pmin;
 
-	noise_heat->noiseMap2D(pmin.X, pmin.Z);
-	noise_humidity->noiseMap2D(pmin.X, pmin.Z);
-	noise_heat_blend->noiseMap2D(pmin.X, pmin.Z);
-	noise_humidity_blend->noiseMap2D(pmin.X, pmin.Z);
+	Noise *noises[] = {noise_heat, noise_humidity, noise_heat_blend,
+		noise_humidity_blend};
+	auto calc = [&] (size_t i) {
+		noises[i]->noiseMap2D(pmin.X, pmin.Z);
+	};
+	if (pool) {
+		pool->runShared(ARRLEN(noises), calc);
+	} else {
+		for (size_t i = 0; i < ARRLEN(noises); i++)
+			calc(i);
+	}
 
 	for (s32 i = 0; i < m_csize.X * m_csize.Z; i++) {
 		noise_heat->result[i]     += noise_heat_blend->result[i];
@@ -230,35 +240,18 @@ Biome *BiomeGenOriginal::getBiomeAtIndex(size_t index, v3s16 pos) const
 
 Biome *BiomeGenOriginal::calcBiomeFromNoise(float heat, float humidity, v3s16 pos) const
 {
-	Biome *biome_closest = nullptr;
-	Biome *biome_closest_blend = nullptr;
+	// Find the slab containing pos.Y, the first one starts at S16_MIN
+	auto slab = std::upper_bound(m_biome_slabs.begin(), m_biome_slabs.end(), pos.Y,
+		[] (s32 y, const BiomeSlab &slab) { return y < slab.y_min; });
+	assert(slab != m_biome_slabs.begin());
+	--slab;
+
 	float dist_min = FLT_MAX;
 	float dist_min_blend = FLT_MAX;
-
-	for (size_t i = 1; i < m_bmgr->getNumObjects(); i++) {
-		Biome *b = (Biome *)m_bmgr->getRaw(i);
-		if (!b ||
-				pos.Y < b->min_pos.Y || pos.Y > b->max_pos.Y + b->vertical_blend ||
-				pos.X < b->min_pos.X || pos.X > b->max_pos.X ||
-				pos.Z < b->min_pos.Z || pos.Z > b->max_pos.Z)
-			continue;
-
-		float d_heat = heat - b->heat_point;
-		float d_humidity = humidity - b->humidity_point;
-		float dist = ((d_heat * d_heat) + (d_humidity * d_humidity));
-		if (b->weight > 0.f)
-		       dist /= b->weight;
-
-		if (pos.Y <= b->max_pos.Y) { // Within y limits of biome b
-			if (dist < dist_min) {
-				dist_min = dist;
-				biome_closest = b;
-			}
-		} else if (dist < dist_min_blend) { // Blend area above biome b
-			dist_min_blend = dist;
-			biome_closest_blend = b;
-		}
-	}
+	Biome *biome_closest = slab->within.findClosest(*this,
+		heat, humidity, pos, &dist_min);
+	Biome *biome_closest_blend = slab->blend.findClosest(*this,
+		heat, humidity, pos, &dist_min_blend);
 
 	// Carefully tune pseudorandom seed variation to avoid single node dither
 	// and create larger scale blending patterns similar to horizontal biome
@@ -279,6 +272,182 @@ Biome *BiomeGenOriginal::calcBiomeFromNoise(float heat, float humidity, v3s16 po
 }
 
 
+void BiomeGenOriginal::buildBiomeSlabs()
+{
+	std::vector<Biome *> all;
+	for (size_t i = 1; i < m_bmgr->getNumObjects(); i++) {
+		Biome *b = (Biome *)m_bmgr->getRaw(i);
+		if (b)
+			all.push_back(b);
+	}
+
+	// The grid covers the biome points, with room for the noise to go
+	// beyond them. Values outside of it fall back to scanning all biomes.
+	float heat_min = 0.0f, heat_max = 0.0f;
+	float humidity_min = 0.0f, humidity_max = 0.0f;
+	for (size_t i = 0; i < all.size(); i++) {
+		const Biome *b = all[i];
+		heat_min = i ? std::min(heat_min, b->heat_point) : b->heat_point;
+		heat_max = i ? std::max(heat_max, b->heat_point) : b->heat_point;
+		humidity_min = i ? std::min(humidity_min, b->humidity_point) : b->humidity_point;
+		humidity_max = i ? std::max(humidity_max, b->humidity_point) : b->humidity_point;
+	}
+	float heat_margin = std::max((heat_max - heat_min) * 0.5f, 10.0f);
+	float humidity_margin = std::max((humidity_max - humidity_min) * 0.5f, 10.0f);
+	m_grid_heat_min = heat_min - heat_margin;
+	m_grid_humidity_min = humidity_min - humidity_margin;
+	m_grid_cell_heat = (heat_max - heat_min + 2 * heat_margin) / BIOME_GRID_SIZE;
+	m_grid_cell_humidity = (humidity_max - humidity_min + 2 * humidity_margin) /
+		BIOME_GRID_SIZE;
+
+	// The biomes to look at only change at these Y values
+	std::vector<s32> starts{S16_MIN};
+	for (const Biome *b : all) {
+		starts.push_back(b->min_pos.Y);
+		starts.push_back(b->max_pos.Y + 1);
+		starts.push_back(b->max_pos.Y + b->vertical_blend + 1);
+	}
+	std::sort(starts.begin(), starts.end());
+	starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+	m_biome_slabs.clear();
+	for (s32 y : starts) {
+		if (y < S16_MIN || y > S16_MAX)
+			continue;
+		BiomeSlab slab;
+		slab.y_min = y;
+		for (Biome *b : all) {
+			if (y < b->min_pos.Y || y > b->max_pos.Y + b->vertical_blend)
+				continue;
+			if (y <= b->max_pos.Y)
+				slab.within.biomes.push_back(b);
+			else
+				slab.blend.biomes.push_back(b);
+		}
+		if (!m_biome_slabs.empty() &&
+				m_biome_slabs.back().within.biomes == slab.within.biomes &&
+				m_biome_slabs.back().blend.biomes == slab.blend.biomes)
+			continue;
+		slab.within.build(*this);
+		slab.blend.build(*this);
+		m_biome_slabs.push_back(std::move(slab));
+	}
+}
+
+
+s32 BiomeGenOriginal::getBiomeGridCell(float heat, float humidity) const
+{
+	float x = (heat - m_grid_heat_min) / m_grid_cell_heat;
+	float y = (humidity - m_grid_humidity_min) / m_grid_cell_humidity;
+	// also false for NaN
+	if (!(x >= 0 && x < BIOME_GRID_SIZE && y >= 0 && y < BIOME_GRID_SIZE))
+		return -1;
+	return (s32)y * BIOME_GRID_SIZE + (s32)x;
+}
+
+
+static bool biome_covers_map_xz(const Biome *b)
+{
+	return b->min_pos.X <= -MAX_MAP_GENERATION_LIMIT &&
+		b->max_pos.X >= MAX_MAP_GENERATION_LIMIT &&
+		b->min_pos.Z <= -MAX_MAP_GENERATION_LIMIT &&
+		b->max_pos.Z >= MAX_MAP_GENERATION_LIMIT;
+}
+
+
+void BiomeGenOriginal::BiomeCandidates::build(const BiomeGenOriginal &gen)
+{
+	cell_start.clear();
+	cell_biomes.clear();
+	// Scanning a few biomes is as fast as finding the cell
+	if (biomes.size() <= 4)
+		return;
+
+	// Lowest and highest distance of a biome to any point in a rectangle
+	const auto get_bounds = [] (const Biome *b, float h0, float h1,
+			float m0, float m1, float *lower, float *upper) {
+		float dh_min = std::max({0.0f, h0 - b->heat_point, b->heat_point - h1});
+		float dm_min = std::max({0.0f, m0 - b->humidity_point, b->humidity_point - m1});
+		float dh_max = std::max(std::abs(h0 - b->heat_point), std::abs(h1 - b->heat_point));
+		float dm_max = std::max(std::abs(m0 - b->humidity_point),
+			std::abs(m1 - b->humidity_point));
+		float weight = b->weight > 0.f ? b->weight : 1.0f;
+		*lower = (dh_min * dh_min + dm_min * dm_min) / weight;
+		*upper = (dh_max * dh_max + dm_max * dm_max) / weight;
+	};
+
+	for (u32 cy = 0; cy < BIOME_GRID_SIZE; cy++)
+	for (u32 cx = 0; cx < BIOME_GRID_SIZE; cx++) {
+		// Slightly enlarged, so rounding in getBiomeGridCell does not matter
+		float h0 = gen.m_grid_heat_min + (cx - 0.01f) * gen.m_grid_cell_heat;
+		float h1 = gen.m_grid_heat_min + (cx + 1.01f) * gen.m_grid_cell_heat;
+		float m0 = gen.m_grid_humidity_min + (cy - 0.01f) * gen.m_grid_cell_humidity;
+		float m1 = gen.m_grid_humidity_min + (cy + 1.01f) * gen.m_grid_cell_humidity;
+
+		// No biome further away than this can be the closest in the cell.
+		// Biomes limited in X or Z may not be available, so they can not
+		// be used for this.
+		float bound = FLT_MAX;
+		for (const Biome *b : biomes) {
+			if (!biome_covers_map_xz(b))
+				continue;
+			float lower, upper;
+			get_bounds(b, h0, h1, m0, m1, &lower, &upper);
+			bound = std::min(bound, upper);
+		}
+		// leave room for rounding errors
+		bound = bound * 1.001f + 0.001f;
+
+		cell_start.push_back(cell_biomes.size());
+		for (Biome *b : biomes) {
+			float lower, upper;
+			get_bounds(b, h0, h1, m0, m1, &lower, &upper);
+			if (lower <= bound || !biome_covers_map_xz(b))
+				cell_biomes.push_back(b);
+		}
+	}
+	cell_start.push_back(cell_biomes.size());
+}
+
+
+Biome *BiomeGenOriginal::BiomeCandidates::findClosest(const BiomeGenOriginal &gen,
+	float heat, float humidity, v3s16 pos, float *dist_min) const
+{
+	Biome *const *list = biomes.data();
+	size_t count = biomes.size();
+	// The cells were made for positions within the map limits
+	if (!cell_start.empty() &&
+			std::abs(pos.X) <= MAX_MAP_GENERATION_LIMIT &&
+			std::abs(pos.Z) <= MAX_MAP_GENERATION_LIMIT) {
+		s32 cell = gen.getBiomeGridCell(heat, humidity);
+		if (cell >= 0) {
+			list = cell_biomes.data() + cell_start[cell];
+			count = cell_start[cell + 1] - cell_start[cell];
+		}
+	}
+
+	Biome *biome_closest = nullptr;
+	for (size_t i = 0; i < count; i++) {
+		Biome *b = list[i];
+		if (pos.X < b->min_pos.X || pos.X > b->max_pos.X ||
+				pos.Z < b->min_pos.Z || pos.Z > b->max_pos.Z)
+			continue;
+
+		float d_heat = heat - b->heat_point;
+		float d_humidity = humidity - b->humidity_point;
+		float dist = ((d_heat * d_heat) + (d_humidity * d_humidity));
+		if (b->weight > 0.f)
+			dist /= b->weight;
+
+		if (dist < *dist_min) {
+			*dist_min = dist;
+			biome_closest = b;
+		}
+	}
+	return biome_closest;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 
 ObjDef *Biome::clone() const
@@ -14,6 +14,7 @@
 class Server;
 class Settings;
 class BiomeManager;
+class ThreadPool;
 
 ////
 //// Biome
@@ -108,7 +109,8 @@ class BiomeGen {
 	// Computes any intermediate results needed for biome generation.  Must be
 	// called before using any of: getBiomes, getBiomeAtPoint, or getBiomeAtIndex.
 	// Calling this invalidates the previous results stored in biomemap.
-	virtual void calcBiomeNoise(v3s16 pmin) = 0;
+	// The work is spread over `pool` if given and not busy.
+	virtual void calcBiomeNoise(v3s16 pmin, ThreadPool *pool) = 0;
 
 	// Gets all biomes in current chunk using each corresponding element of
 	// heightmap as the y position, then stores the results by biome index in
@@ -179,7 +181,7 @@ class BiomeGenOriginal final : public BiomeGen {
 	float calcHumidityAtPoint(v3s16 pos) const;
 	Biome *calcBiomeAtPoint(v3s16 pos) const;
 
-	void calcBiomeNoise(v3s16 pmin);
+	void calcBiomeNoise(v3s16 pmin, ThreadPool *pool);
 
 	biome_t *getBiomes(s16 *heightmap, v3s16 pmin);
 	Biome *getBiomeAtPoint(v3s16 pos) const;
@@ -202,6 +204,49 @@ class BiomeGenOriginal final : public BiomeGen {
 	/// Y values at which biomes may transition.
 	/// This array may only be used for downwards scanning!
 	std::vector<s16> m_transitions_y;
+
+	/*
+		Lookup structure for calcBiomeFromNoise.
+
+		The Y axis is cut into slabs in which the same biomes are within their
+		Y limits or in their blend area, so only those have to be looked at.
+		Within a slab, the heat/humidity plane is cut into a grid, and each
+		cell only lists the biomes that may be the closest one for some point
+		in it. Biomes keep their order, so ties are resolved like before.
+	*/
+	struct BiomeCandidates {
+		// All biomes, in index order
+		std::vector<Biome *> biomes;
+		// Biomes per grid cell, cell i is [cell_start[i], cell_start[i + 1]).
+		// Empty if there are too few biomes for the grid to help.
+		std::vector<u32> cell_start;
+		std::vector<Biome *> cell_biomes;
+
+		void build(const BiomeGenOriginal &gen);
+		// @param dist_min must be FLT_MAX, set to the distance of the
+		//        returned biome if there is one
+		Biome *findClosest(const BiomeGenOriginal &gen, float heat,
+			float humidity, v3s16 pos, float *dist_min) const;
+	};
+	struct BiomeSlab {
+		// lowest Y of the slab, it ends where the next one starts
+		s32 y_min;
+		// biomes with the slab within their Y limits
+		BiomeCandidates within;
+		// biomes with the slab in their vertical blend area
+		BiomeCandidates blend;
+	};
+
+	static constexpr u32 BIOME_GRID_SIZE = 16;
+
+	void buildBiomeSlabs();
+	// @return index of the grid cell, or -1 if outside the grid
+	s32 getBiomeGridCell(float heat, float humidity) const;
+
+	std::vector<BiomeSlab> m_biome_slabs;
+	// heat and humidity covered by the grid
+	float m_grid_heat_min, m_grid_humidity_min;
+	float m_grid_cell_heat, m_grid_cell_humidity;
 };
 
 
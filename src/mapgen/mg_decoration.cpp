@@ -8,6 +8,8 @@
 #include "mapgen.h"
 #include "noise.h"
 #include "map.h"
+#include "emerge.h"
+#include "profiler.h"
 #include <algorithm>
 #include <vector>
 #include "mapgen/treegen.h"
@@ -37,12 +39,22 @@ DecorationManager::DecorationManager(IGameDef *gamedef) :
 void DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
 	v3s16 nmin, v3s16 nmax)
 {
+	const bool debug = mg->m_emerge && mg->m_emerge->enable_mapgen_debug_info;
+	DecoSurfaceCache surfaces(mg, nmin, nmax);
+
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Decoration *deco = (Decoration *)m_objects[i];
 		if (!deco)
 			continue;
 
-		deco->placeDeco(mg, blockseed, nmin, nmax);
+		if (debug) {
+			ScopeProfiler sp(g_profiler, "Mapgen: decoration " +
+				(deco->name.empty() ? "#" + std::to_string(i) : deco->name),
+				SPT_AVG, PRECISION_MICRO);
+			deco->placeDeco(mg, blockseed, nmin, nmax, surfaces);
+		} else {
+			deco->placeDeco(mg, blockseed, nmin, nmax, surfaces);
+		}
 		blockseed++;
 	}
 }
@@ -58,6 +70,83 @@ DecorationManager *DecorationManager::clone() const
 ///////////////////////////////////////////////////////////////////////////////
 
 
+DecoSurfaceCache::DecoSurfaceCache(Mapgen *mg, v3s16 nmin, v3s16 nmax) :
+	m_mg(mg), m_nmin(nmin), m_nmax(nmax)
+{
+	m_columns.resize(std::max(0, (nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1)));
+}
+
+
+DecoSurfaceCache::Column &DecoSurfaceCache::getColumn(v2s16 p2d)
+{
+	assert(p2d.X >= m_nmin.X && p2d.X <= m_nmax.X);
+	assert(p2d.Y >= m_nmin.Z && p2d.Y <= m_nmax.Z);
+	return m_columns[(p2d.Y - m_nmin.Z) * (m_nmax.X - m_nmin.X + 1) +
+		(p2d.X - m_nmin.X)];
+}
+
+
+void DecoSurfaceCache::getSurfaces(v2s16 p2d, const std::vector<s16> **floors,
+	const std::vector<s16> **ceilings)
+{
+	Column &col = getColumn(p2d);
+	if (col.surfaces_epoch != m_epoch) {
+		col.floors.clear();
+		col.ceilings.clear();
+		m_mg->getSurfaces(p2d, m_nmin.Y, m_nmax.Y, col.floors, col.ceilings);
+		col.surfaces_epoch = m_epoch;
+	}
+	*floors = &col.floors;
+	*ceilings = &col.ceilings;
+}
+
+
+s16 DecoSurfaceCache::findLiquidSurface(v2s16 p2d)
+{
+	Column &col = getColumn(p2d);
+	if (col.liquid_epoch != m_epoch) {
+		col.liquid_surface = m_mg->findLiquidSurface(p2d, m_nmin.Y, m_nmax.Y);
+		col.liquid_epoch = m_epoch;
+	}
+	return col.liquid_surface;
+}
+
+
+s16 DecoSurfaceCache::findGroundLevel(v2s16 p2d)
+{
+	Column &col = getColumn(p2d);
+	if (col.ground_epoch != m_epoch) {
+		col.ground_level = m_mg->findGroundLevel(p2d, m_nmin.Y, m_nmax.Y);
+		col.ground_epoch = m_epoch;
+	}
+	return col.ground_level;
+}
+
+
+void DecoSurfaceCache::invalidate(v2s16 p2d, s16 reach)
+{
+	if (reach < 0) {
+		// 0 marks single invalid columns
+		if (++m_epoch == 0)
+			m_epoch = 1;
+		return;
+	}
+
+	s16 x_min = std::max<s32>(p2d.X - reach, m_nmin.X);
+	s16 x_max = std::min<s32>(p2d.X + reach, m_nmax.X);
+	s16 z_min = std::max<s32>(p2d.Y - reach, m_nmin.Z);
+	s16 z_max = std::min<s32>(p2d.Y + reach, m_nmax.Z);
+	for (s16 z = z_min; z <= z_max; z++)
+	for (s16 x = x_min; x <= x_max; x++) {
+		Column &col = getColumn(v2s16(x, z));
+		col.surfaces_epoch = col.liquid_epoch = col.ground_epoch = 0;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
 void Decoration::resolveNodeNames()
 {
 	getIdsFromNrBacklog(&c_place_on);
@@ -122,7 +211,8 @@ bool Decoration::canPlaceDecoration(MMVManip *vm, v3s16 p)
 }
 
 
-void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+	DecoSurfaceCache &surfaces)
 {
 	// Skip if y ranges do not overlap
 	if (nmax.Y < y_min || y_max < nmin.Y)
@@ -142,6 +232,31 @@ void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 
 	int area = sidelen * sidelen;
 
+	// Biomes by index, instead of a hash lookup per position
+	std::vector<bool> in_biome;
+	if (mg->biomemap && !biomes.empty()) {
+		in_biome.resize(*std::max_element(biomes.begin(), biomes.end()) + 1);
+		for (biome_t b : biomes)
+			in_biome[b] = true;
+	}
+	const auto check_biome = [&] (int mapindex) -> bool {
+		if (in_biome.empty())
+			return true;
+		biome_t b = mg->biomemap[mapindex];
+		return b < in_biome.size() && in_biome[b];
+	};
+
+	const s16 reach = getHorizontalReach();
+	const auto place = [&] (v3s16 pos, bool ceiling) {
+		size_t placed = generate(mg->vm, &ps, pos, ceiling);
+		if (placed)
+			mg->gennotify.addDecorationEvent(pos, index);
+		// Decorations of unknown size may have changed nodes even if they
+		// report nothing placed
+		if (placed || reach < 0)
+			surfaces.invalidate(v2s16(pos.X, pos.Z), reach);
+	};
+
 	for (s16 z0 = 0; z0 < carea_size; z0 += sidelen)
 	for (s16 x0 = 0; x0 < carea_size; x0 += sidelen) {
 		v2s16 p2d_min(nmin.X + x0, nmin.Z + z0);
@@ -190,30 +305,25 @@ void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 					(flags & DECO_ALL_CEILINGS)) {
 				// All-surfaces decorations
 				// Check biome of column
-				if (mg->biomemap && !biomes.empty()) {
-					auto iter = biomes.find(mg->biomemap[mapindex]);
-					if (iter == biomes.end())
-						continue;
-				}
+				if (!check_biome(mapindex))
+					continue;
 
-				// Get all floors and ceilings in node column
-				u16 size = (nmax.Y - nmin.Y + 1) / 2;
-				std::vector<s16> floors;
+				// Get all floors and ceilings in node column.
+				// Copied, as placing decorations may invalidate them.
+				const std::vector<s16> *cached_floors, *cached_ceilings;
+				surfaces.getSurfaces(v2s16(x, z), &cached_floors, &cached_ceilings);
 				std::vector<s16> ceilings;
-				floors.reserve(size);
-				ceilings.reserve(size);
-
-				mg->getSurfaces(v2s16(x, z), nmin.Y, nmax.Y, floors, ceilings);
+				if (flags & DECO_ALL_CEILINGS)
+					ceilings = *cached_ceilings;
 
 				if (flags & DECO_ALL_FLOORS) {
 					// Floor decorations
+					std::vector<s16> floors = *cached_floors;
 					for (const s16 y : floors) {
 						if (y < y_min || y > y_max)
 							continue;
 
-						v3s16 pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, false))
-							mg->gennotify.addDecorationEvent(pos, index);
+						place(v3s16(x, y, z), false);
 					}
 				}
 
@@ -223,32 +333,25 @@ void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 						if (y < y_min || y > y_max)
 							continue;
 
-						v3s16 pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, true))
-							mg->gennotify.addDecorationEvent(pos, index);
+						place(v3s16(x, y, z), true);
 					}
 				}
 			} else { // Heightmap decorations
 				s16 y = -MAX_MAP_GENERATION_LIMIT;
 				if (flags & DECO_LIQUID_SURFACE)
-					y = mg->findLiquidSurface(v2s16(x, z), nmin.Y, nmax.Y);
+					y = surfaces.findLiquidSurface(v2s16(x, z));
 				else if (mg->heightmap)
 					y = mg->heightmap[mapindex];
 				else
-					y = mg->findGroundLevel(v2s16(x, z), nmin.Y, nmax.Y);
+					y = surfaces.findGroundLevel(v2s16(x, z));
 
 				if (y < y_min || y > y_max || y < nmin.Y || y > nmax.Y)
 					continue;
 
-				if (mg->biomemap && !biomes.empty()) {
-					auto iter = biomes.find(mg->biomemap[mapindex]);
-					if (iter == biomes.end())
-						continue;
-				}
+				if (!check_biome(mapindex))
+					continue;
 
-				v3s16 pos(x, y, z);
-				if (generate(mg->vm, &ps, pos, false))
-					mg->gennotify.addDecorationEvent(pos, index);
+				place(v3s16(x, y, z), false);
 			}
 		}
 	}
@@ -450,6 +553,15 @@ size_t DecoSchematic::generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceilin
 	return 1;
 }
 
+
+s16 DecoSchematic::getHorizontalReach() const
+{
+	if (!schematic)
+		return 0;
+	// Centering and rotation keep the schematic within its size of p
+	return std::max(schematic->size.X, schematic->size.Z);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ObjDef *DecoLSystem::clone() const
 {
@@ -14,6 +14,7 @@ typedef u16 biome_t;  // copy from mg_biome.h to avoid an unnecessary include
 
 class Mapgen;
 class MMVManip;
+class DecoSurfaceCache;
 class PcgRandom;
 class Schematic;
 namespace treegen { struct TreeDef; }
@@ -44,10 +45,15 @@ class Decoration : public ObjDef, public NodeResolver {
 	virtual void resolveNodeNames();
 
 	bool canPlaceDecoration(MMVManip *vm, v3s16 p);
-	void placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+	void placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+		DecoSurfaceCache &surfaces);
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling) = 0;
 
+	// Horizontal distance from the position given to generate() within which
+	// it may change nodes, or -1 if unknown
+	virtual s16 getHorizontalReach() const { return -1; }
+
 	u32 flags = 0;
 	int mapseed = 0;
 	std::vector<content_t> c_place_on;
@@ -74,6 +80,7 @@ class DecoSimple : public Decoration {
 
 	virtual void resolveNodeNames();
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling);
+	virtual s16 getHorizontalReach() const { return 0; }
 
 	std::vector<content_t> c_decos;
 	s16 deco_height;
@@ -91,6 +98,7 @@ class DecoSchematic : public Decoration {
 	virtual ~DecoSchematic();
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling);
+	virtual s16 getHorizontalReach() const;
 
 	Rotation rotation;
 	Schematic *schematic = nullptr;
@@ -109,6 +117,46 @@ class DecoLSystem : public Decoration {
 };
 
 
+/*
+	The ground and ceiling surfaces of the columns of a chunk, found on first
+	use and shared by all decorations placed in it. Decorations tell which
+	columns they may have changed, and the surfaces of those are found again.
+*/
+class DecoSurfaceCache {
+public:
+	DecoSurfaceCache(Mapgen *mg, v3s16 nmin, v3s16 nmax);
+	DISABLE_CLASS_COPY(DecoSurfaceCache);
+
+	// Like the Mapgen methods of the same name, for the Y range of the chunk
+	void getSurfaces(v2s16 p2d, const std::vector<s16> **floors,
+		const std::vector<s16> **ceilings);
+	s16 findLiquidSurface(v2s16 p2d);
+	s16 findGroundLevel(v2s16 p2d);
+
+	// Forgets the surfaces of the columns within reach of p2d,
+	// or of all columns if reach is negative
+	void invalidate(v2s16 p2d, s16 reach);
+
+private:
+	struct Column {
+		// The values are valid if their epoch equals m_epoch
+		u32 surfaces_epoch = 0;
+		u32 liquid_epoch = 0;
+		u32 ground_epoch = 0;
+		std::vector<s16> floors, ceilings;
+		s16 liquid_surface;
+		s16 ground_level;
+	};
+
+	Column &getColumn(v2s16 p2d);
+
+	Mapgen *m_mg;
+	v3s16 m_nmin, m_nmax;
+	std::vector<Column> m_columns;
+	u32 m_epoch = 1;
+};
+
+
 class DecorationManager : public ObjDefManager {
 public:
 	DecorationManager(IGameDef *gamedef);
@@ -30,18 +30,61 @@ OreManager::OreManager(IGameDef *gamedef) :
 
 size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 {
-	size_t nplaced = 0;
+	/*
+		Ores only read and write nodes within the Y range they are placed in
+		(see Ore::writesOutsideRange()), so ores with disjoint ranges can be
+		placed in any order. Every ore goes into the first stage after those
+		of the earlier ores it overlaps with, and the ores of a stage are
+		placed concurrently. Each ore still uses the same seed and all nodes
+		it sees are the same as when placing one after another, which keeps
+		the result identical.
+	*/
+	struct Task {
+		Ore *ore;
+		u32 blockseed;
+		s16 y_min, y_max;
+		size_t stage;
+	};
+	std::vector<Task> tasks;
+	tasks.reserve(m_objects.size());
+	size_t num_stages = 0;
 
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Ore *ore = (Ore *)m_objects[i];
-		if (!ore)
+		s16 y_min, y_max;
+		if (!ore || !ore->getPlaceRange(nmin, nmax, y_min, y_max))
 			continue;
+		if (ore->writesOutsideRange()) {
+			y_min = S16_MIN;
+			y_max = S16_MAX;
+		}
 
-		nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
-		blockseed++;
+		size_t stage = 0;
+		for (const Task &other : tasks) {
+			if (other.stage >= stage && y_min <= other.y_max && other.y_min <= y_max)
+				stage = other.stage + 1;
+		}
+		tasks.push_back({ore, blockseed + (u32)i, y_min, y_max, stage});
+		num_stages = std::max(num_stages, stage + 1);
 	}
 
-	return nplaced;
+	std::vector<Ore *> stage_ores;
+	std::vector<u32> stage_seeds;
+	for (size_t stage = 0; stage < num_stages; stage++) {
+		stage_ores.clear();
+		stage_seeds.clear();
+		for (const Task &task : tasks) {
+			if (task.stage == stage) {
+				stage_ores.push_back(task.ore);
+				stage_seeds.push_back(task.blockseed);
+			}
+		}
+		mg->parallelFor(stage_ores.size(), [&] (size_t i) {
+			stage_ores[i]->placeOre(mg, stage_seeds[i], nmin, nmax);
+		});
+	}
+
+	return tasks.size();
 }
 
 
@@ -79,18 +122,22 @@ void Ore::resolveNodeNames()
 }
 
 
-size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+bool Ore::getPlaceRange(v3s16 nmin, v3s16 nmax, s16 &ymin, s16 &ymax) const
 {
 	if (nmin.Y > y_max || nmax.Y < y_min)
-		return 0;
+		return false;
+
+	ymin = MYMAX(nmin.Y, y_min);
+	ymax = MYMIN(nmax.Y, y_max);
+	return clust_size < ymax - ymin + 1;
+}
 
-	int actual_ymin = MYMAX(nmin.Y, y_min);
-	int actual_ymax = MYMIN(nmax.Y, y_max);
-	if (clust_size >= actual_ymax - actual_ymin + 1)
+
+size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+{
+	if (!getPlaceRange(nmin, nmax, nmin.Y, nmax.Y))
 		return 0;
 
-	nmin.Y = actual_ymin;
-	nmax.Y = actual_ymax;
 	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap);
 
 	return 1;
@@ -58,9 +58,14 @@ class Ore : public ObjDef, public NodeResolver {
 
 	virtual void resolveNodeNames();
 
+	/// Clamps the Y range of a mapchunk to the one of the ore.
+	/// @return false if the ore is not placed in that mapchunk
+	bool getPlaceRange(v3s16 nmin, v3s16 nmax, s16 &ymin, s16 &ymax) const;
 	size_t placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
 		v3s16 nmin, v3s16 nmax, biome_t *biomemap) = 0;
+	/// Whether generate() may touch nodes above or below nmin.Y..nmax.Y
+	virtual bool writesOutsideRange() const { return false; }
 
 protected:
 	void cloneTo(Ore *def) const;
@@ -104,6 +109,8 @@ class OrePuff : public Ore {
 
 	void generate(MMVManip *vm, int mapseed, u32 blockseed,
 			v3s16 nmin, v3s16 nmax, biome_t *biomemap) override;
+	// puffs extend from their midpoint without clamping
+	bool writesOutsideRange() const override { return true; }
 };
 
 class OreBlob : public Ore {
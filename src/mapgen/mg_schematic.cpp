@@ -92,6 +92,7 @@ ObjDef *Schematic::clone() const
 
 void Schematic::resolveNodeNames()
 {
+	invalidateCompiled();
 	c_nodes.clear();
 	getIdsFromNrBacklog(&c_nodes, true, CONTENT_AIR);
 
@@ -109,10 +110,19 @@ void Schematic::resolveNodeNames()
 }
 
 
-void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+void Schematic::invalidateCompiled()
 {
-	assert(schemdata && slice_probs);
-	sanity_check(m_ndef != NULL);
+	for (auto &compiled : m_compiled)
+		compiled.reset();
+}
+
+
+const Schematic::CompiledSchematic &Schematic::getCompiled(Rotation rot)
+{
+	std::unique_ptr<CompiledSchematic> &compiled = m_compiled[rot];
+	if (compiled)
+		return *compiled;
+	compiled = std::make_unique<CompiledSchematic>();
 
 	int xstride = 1;
 	int ystride = size.X;
@@ -147,44 +157,110 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 			i_step_z = zstride;
 	}
 
-	s16 y_map = p.Y;
+	std::vector<MapNode> &nodes = compiled->nodes;
+	std::vector<CompiledRun> &runs = compiled->runs;
+	compiled->slice_start.reserve(sy + 1);
+
 	for (s16 y = 0; y != sy; y++) {
-		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
-			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
-			continue;
+		compiled->slice_start.push_back(runs.size());
 
 		for (s16 z = 0; z != sz; z++) {
 			u32 i = z * i_step_z + y * ystride + i_start;
+			bool in_run = false;
 			for (s16 x = 0; x != sx; x++, i += i_step_x) {
-				v3s16 pos(p.X + x, y_map, p.Z + z);
-				if (!vm->m_area.contains(pos))
-					continue;
+				const MapNode &n = schemdata[i];
+				u8 placement_prob = n.param1 & MTSCHEM_PROB_MASK;
 
-				if (schemdata[i].getContent() == CONTENT_IGNORE)
+				if (n.getContent() == CONTENT_IGNORE ||
+						placement_prob == MTSCHEM_PROB_NEVER) {
+					in_run = false;
 					continue;
+				}
 
-				u8 placement_prob     = schemdata[i].param1 & MTSCHEM_PROB_MASK;
-				bool force_place_node = schemdata[i].param1 & MTSCHEM_FORCE_PLACE;
+				CompiledRunType type = RUN_RANDOM;
+				if (placement_prob == MTSCHEM_PROB_ALWAYS)
+					type = (n.param1 & MTSCHEM_FORCE_PLACE) ? RUN_FORCE : RUN_ALWAYS;
 
-				if (placement_prob == MTSCHEM_PROB_NEVER)
-					continue;
+				if (!in_run || runs.back().type != type) {
+					runs.push_back({x, z, 0, type, (u32)nodes.size()});
+					in_run = true;
+				}
+				runs.back().len++;
 
-				u32 vi = vm->m_area.index(pos);
-				if (!force_place && !force_place_node) {
-					content_t c = vm->m_data[vi].getContent();
+				MapNode placed = n;
+				placed.param1 = 0;
+				if (rot)
+					placed.rotateAlongYAxis(m_ndef, rot);
+				nodes.push_back(placed);
+				compiled->params.push_back(n.param1);
+			}
+		}
+	}
+	compiled->slice_start.push_back(runs.size());
+
+	return *compiled;
+}
+
+
+void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+{
+	assert(schemdata && slice_probs);
+	assert(rot >= ROTATE_0 && rot <= ROTATE_270);
+	sanity_check(m_ndef != NULL);
+
+	const CompiledSchematic &compiled = getCompiled(rot);
+	const VoxelArea &area = vm->m_area;
+
+	s16 y_map = p.Y;
+	for (s16 y = 0; y != size.Y; y++) {
+		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
+			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+			continue;
+
+		if (y_map < area.MinEdge.Y || y_map > area.MaxEdge.Y) {
+			y_map++;
+			continue;
+		}
+
+		u32 run_end = compiled.slice_start[y + 1];
+		for (u32 r = compiled.slice_start[y]; r != run_end; r++) {
+			const CompiledRun &run = compiled.runs[r];
+
+			// Clip the run to the voxel area
+			s32 z = p.Z + run.z;
+			if (z < area.MinEdge.Z || z > area.MaxEdge.Z)
+				continue;
+			s32 x_min = p.X + run.x;
+			s32 x_max = x_min + run.len - 1;
+			s32 skip = std::max(0, area.MinEdge.X - x_min);
+			x_min += skip;
+			x_max = std::min<s32>(x_max, area.MaxEdge.X);
+			if (x_min > x_max)
+				continue;
+
+			u32 count = x_max - x_min + 1;
+			const MapNode *src = &compiled.nodes[run.first + skip];
+			const u8 *params = &compiled.params[run.first + skip];
+			MapNode *dst = &vm->m_data[area.index(x_min, y_map, z)];
+
+			if (run.type == RUN_FORCE || (run.type == RUN_ALWAYS && force_place)) {
+				std::copy(src, src + count, dst);
+				continue;
+			}
+
+			for (u32 j = 0; j != count; j++) {
+				if (!force_place && !(params[j] & MTSCHEM_FORCE_PLACE)) {
+					content_t c = dst[j].getContent();
 					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
 						continue;
 				}
 
+				u8 placement_prob = params[j] & MTSCHEM_PROB_MASK;
 				if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
 					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
 					continue;
 
-				vm->m_data[vi] = schemdata[i];
-				vm->m_data[vi].param1 = 0;
-
-				if (rot)
-					vm->m_data[vi].rotateAlongYAxis(m_ndef, rot);
+				dst[j] = src[j];
 			}
 		}
 		y_map++;
@@ -290,6 +366,7 @@ bool Schematic::deserializeFromMts(std::istream *is)
 
 	//// Read size
 	size = readV3S16(ss);
+	invalidateCompiled();
 
 	//// Read Y-slice probability values
 	delete []slice_probs;
@@ -539,6 +616,7 @@ bool Schematic::getSchematicFromMap(Map *map, v3s16 p1, v3s16 p2)
 	vm->initialEmerge(bp1, bp2);
 
 	size = p2 - p1 + 1;
+	invalidateCompiled();
 
 	slice_probs = new u8[size.Y];
 	for (s16 y = 0; y != size.Y; y++)
@@ -569,6 +647,8 @@ void Schematic::applyProbabilities(v3s16 p0,
 	std::vector<std::pair<v3s16, u8> > *plist,
 	std::vector<std::pair<s16, u8> > *splist)
 {
+	invalidateCompiled();
+
 	for (size_t i = 0; i != plist->size(); i++) {
 		v3s16 p = (*plist)[i].first - p0;
 		int index = p.Z * (size.Y * size.X) + p.Y * size.X + p.X;
@@ -597,6 +677,7 @@ void Schematic::condenseContentIds()
 
 	// Reset node resolve fields
 	NodeResolver::reset();
+	invalidateCompiled();
 
 	size_t nodecount = size.X * size.Y * size.Z;
 	for (size_t i = 0; i != nodecount; i++) {
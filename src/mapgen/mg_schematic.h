@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <memory>
 #include "mg_decoration.h"
 #include "util/string.h"
 
@@ -100,6 +101,11 @@ class Schematic : public ObjDef, public NodeResolver {
 		std::vector<std::pair<v3s16, u8> > *plist,
 		std::vector<std::pair<s16, u8> > *splist);
 
+	// Drops the placement data prepared by blitToVManip().
+	// Must be called after changing size, schemdata or slice_probs of a
+	// schematic that may have been placed before.
+	void invalidateCompiled();
+
 	std::vector<content_t> c_nodes;
 	u32 flags = 0;
 	v3s16 size;
@@ -107,8 +113,48 @@ class Schematic : public ObjDef, public NodeResolver {
 	u8 *slice_probs = nullptr;
 
 private:
+	enum CompiledRunType : u8 {
+		// Probability always, force placement bit set: copied as a whole
+		RUN_FORCE,
+		// Probability always: copied as a whole with force_place,
+		// otherwise onto air and ignore only
+		RUN_ALWAYS,
+		// Anything else, checked node by node
+		RUN_RANDOM,
+	};
+
+	// Consecutive nodes along X of the rotated schematic
+	struct CompiledRun {
+		// Position within the rotated schematic
+		s16 x, z;
+		u16 len;
+		CompiledRunType type;
+		// Index of the first node in CompiledSchematic::nodes
+		u32 first;
+	};
+
+	/*
+		The schematic prepared for one rotation: The placeable nodes in
+		placement order, already rotated and with param1 cleared.
+		Nodes that are never placed (CONTENT_IGNORE or probability never)
+		are left out.
+	*/
+	struct CompiledSchematic {
+		std::vector<MapNode> nodes;
+		// Original param1 of each node, for the probability and force bit
+		std::vector<u8> params;
+		std::vector<CompiledRun> runs;
+		// Runs of slice y are [slice_start[y], slice_start[y + 1])
+		std::vector<u32> slice_start;
+	};
+
+	const CompiledSchematic &getCompiled(Rotation rot);
+
 	// Counterpart to the node resolver: Condense content_t to a sequential "m_nodenames" list
 	void condenseContentIds();
+
+	// Built on first use, indexed by rotation
+	std::unique_ptr<CompiledSchematic> m_compiled[ROTATE_RAND];
 };
 
 class SchematicManager : public ObjDefManager {
@@ -156,6 +156,60 @@ SharedBuffer<u8> makeReliablePacket(const SharedBuffer<u8> &data, u16 seqnum)
 	return b;
 }
 
+/*
+	PacketBufferPool
+*/
+
+namespace PacketBufferPool
+{
+
+// free buffers that are kept at most
+constexpr size_t MAX_FREE = 4096;
+
+struct Pool {
+	std::mutex mutex;
+	std::vector<u8 *> free;
+};
+
+static Pool &get_pool()
+{
+	// Never destroyed since packets can outlive static destructors
+	static Pool *pool = new Pool();
+	return *pool;
+}
+
+u8 *allocate(u32 size)
+{
+	if (size > BLOCK_SIZE)
+		return new u8[size];
+
+	Pool &pool = get_pool();
+	{
+		MutexAutoLock lock(pool.mutex);
+		if (!pool.free.empty()) {
+			u8 *data = pool.free.back();
+			pool.free.pop_back();
+			return data;
+		}
+	}
+	return new u8[BLOCK_SIZE];
+}
+
+void release(u8 *data, u32 size)
+{
+	if (size <= BLOCK_SIZE) {
+		Pool &pool = get_pool();
+		MutexAutoLock lock(pool.mutex);
+		if (pool.free.size() < MAX_FREE) {
+			pool.free.push_back(data);
+			return;
+		}
+	}
+	delete[] data;
+}
+
+}
+
 /*
 	ReliablePacketBuffer
 */
@@ -165,7 +219,10 @@ void ReliablePacketBuffer::print()
 	MutexAutoLock listlock(m_list_mutex);
 	LOG(dout_con<<"Dump of ReliablePacketBuffer:" << std::endl);
 	unsigned int index = 0;
-	for (BufferedPacketPtr &packet : m_list) {
+	for (u32 i = 0; i < m_span; i++) {
+		const BufferedPacketPtr &packet = at(i);
+		if (!packet)
+			continue;
 		LOG(dout_con<<index<< ":" << packet->getSeqnum() << std::endl);
 		index++;
 	}
@@ -173,69 +230,103 @@ void ReliablePacketBuffer::print()
 
 bool ReliablePacketBuffer::empty()
 {
-	MutexAutoLock listlock(m_list_mutex);
-	return m_list.empty();
+	return m_size.load(std::memory_order_relaxed) == 0;
 }
 
 u32 ReliablePacketBuffer::size()
 {
-	MutexAutoLock listlock(m_list_mutex);
-	return m_list.size();
+	return m_size.load(std::memory_order_relaxed);
 }
 
-ReliablePacketBuffer::FindResult ReliablePacketBuffer::findPacketNoLock(u16 seqnum)
+void ReliablePacketBuffer::reserveSpan(u32 span)
 {
-	for (auto it = m_list.begin(); it != m_list.end(); ++it) {
-		if ((*it)->getSeqnum() == seqnum)
-			return it;
+	if (span <= m_ring.size())
+		return;
+
+	u32 capacity = std::max<u32>(m_ring.size(), MIN_CAPACITY);
+	while (capacity < span)
+		capacity *= 2;
+	// all seqnums fit into SEQNUM_MAX + 1 slots
+	sanity_check(capacity <= SEQNUM_MAX + 1);
+	resizeRing(capacity);
+}
+
+void ReliablePacketBuffer::resizeRing(u32 capacity)
+{
+	std::vector<BufferedPacketPtr> ring(capacity);
+	for (u32 i = 0; i < m_span; i++) {
+		const u16 seqnum = m_first + i;
+		ring[seqnum & (capacity - 1)] = std::move(at(i));
 	}
-	return m_list.end();
+	m_ring = std::move(ring);
+}
+
+BufferedPacketPtr ReliablePacketBuffer::removeNoLock(u16 seqnum)
+{
+	if (m_count == 0)
+		return nullptr;
+	const u32 offset = (u16)(seqnum - m_first);
+	if (offset >= m_span)
+		return nullptr;
+	BufferedPacketPtr &entry = at(offset);
+	if (!entry)
+		return nullptr;
+
+	BufferedPacketPtr p = std::move(entry);
+	entry = nullptr;
+	m_size = --m_count;
+
+	if (m_count == 0) {
+		m_span = 0;
+	} else if (offset == 0) {
+		// Move on to the next packet
+		do {
+			m_first++;
+			m_span--;
+		} while (!at(0));
+	} else if (offset == m_span - 1) {
+		do {
+			m_span--;
+		} while (!at(m_span - 1));
+	}
+
+	// Give back memory once much less is used than reserved
+	if (m_ring.size() > MIN_CAPACITY && m_span <= m_ring.size() / 4) {
+		u32 capacity = m_ring.size();
+		while (capacity > MIN_CAPACITY && m_span <= capacity / 4)
+			capacity /= 2;
+		resizeRing(capacity);
+	}
+	return p;
 }
 
 bool ReliablePacketBuffer::getFirstSeqnum(u16& result)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	if (m_list.empty())
+	if (m_count == 0)
 		return false;
-	result = m_list.front()->getSeqnum();
+	result = m_first;
 	return true;
 }
 
 BufferedPacketPtr ReliablePacketBuffer::popFirst()
 {
 	MutexAutoLock listlock(m_list_mutex);
-	if (m_list.empty())
+	if (m_count == 0)
 		throw NotFoundException("Buffer is empty");
 
-	BufferedPacketPtr p(m_list.front());
-	m_list.pop_front();
-
-	if (m_list.empty()) {
-		m_oldest_non_answered_ack = 0;
-	} else {
-		m_oldest_non_answered_ack = m_list.front()->getSeqnum();
-	}
-	return p;
+	return removeNoLock(m_first);
 }
 
 BufferedPacketPtr ReliablePacketBuffer::popSeqnum(u16 seqnum)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	auto r = findPacketNoLock(seqnum);
-	if (r == m_list.end()) {
+	BufferedPacketPtr p = removeNoLock(seqnum);
+	if (!p) {
 		LOG(dout_con<<"Sequence number: " << seqnum
 				<< " not found in reliable buffer"<<std::endl);
 		throw NotFoundException("seqnum not found in buffer");
 	}
-
-	BufferedPacketPtr p(*r);
-	m_list.erase(r);
-
-	if (m_list.empty()) {
-		m_oldest_non_answered_ack = 0;
-	} else {
-		m_oldest_non_answered_ack = m_list.front()->getSeqnum();
-	}
 	return p;
 }
 
@@ -268,45 +359,39 @@ void ReliablePacketBuffer::insert(BufferedPacketPtr &p_ptr, u16 next_expected)
 		return;
 	}
 
-	sanity_check(m_list.size() <= SEQNUM_MAX); // FIXME: Handle the error?
-
-	// Find the right place for the packet and insert it there
-	// If list is empty, just add it
-	if (m_list.empty()) {
-		m_list.push_back(p_ptr);
-		m_oldest_non_answered_ack = seqnum;
-		// Done.
-		return;
-	}
-
-	// Otherwise find the right place
-	auto it = m_list.begin();
-	// Find the first packet in the list which has a higher seqnum
-	u16 s = (*it)->getSeqnum();
-
-	/* case seqnum is smaller then next_expected seqnum */
-	/* this is true e.g. on wrap around */
-	if (seqnum < next_expected) {
-		while(((s < seqnum) || (s >= next_expected)) && (it != m_list.end())) {
-			++it;
-			if (it != m_list.end())
-				s = (*it)->getSeqnum();
+	if (m_count == 0) {
+		reserveSpan(1);
+		m_first = seqnum;
+		m_span = 1;
+	} else if ((u16)(seqnum - next_expected) < (u16)(m_first - next_expected)) {
+		// The packet comes before all others
+		const u32 span = (u16)(m_first - seqnum) + m_span;
+		if (span > m_max_span) {
+			errorstream << "ReliablePacketBuffer::insert(): seqnum is too far "
+				"from the buffered ones" << std::endl;
+			return;
 		}
-	}
-	/* non wrap around case (at least for incoming and next_expected */
-	else
-	{
-		while(((s < seqnum) && (s >= next_expected)) && (it != m_list.end())) {
-			++it;
-			if (it != m_list.end())
-				s = (*it)->getSeqnum();
+		reserveSpan(span);
+		m_first = seqnum;
+		m_span = span;
+	} else {
+		const u32 offset = (u16)(seqnum - m_first);
+		if (offset >= m_max_span) {
+			errorstream << "ReliablePacketBuffer::insert(): seqnum is too far "
+				"from the buffered ones" << std::endl;
+			return;
+		}
+		if (offset >= m_span) {
+			reserveSpan(offset + 1);
+			m_span = offset + 1;
 		}
 	}
 
-	if (s == seqnum) {
+	BufferedPacketPtr &entry = m_ring[slot(seqnum)];
+	if (entry) {
 		/* nothing to do this seems to be a resent packet */
 		/* for paranoia reason data should be compared */
-		auto &i = *it;
+		auto &i = entry;
 		if (
 			(i->getSeqnum() != seqnum) ||
 			(i->size() != p.size()) ||
@@ -331,31 +416,30 @@ void ReliablePacketBuffer::insert(BufferedPacketPtr &p_ptr, u16 next_expected)
 			warningstream << buf << std::flush;
 			throw IncomingDataCorruption("duplicated packet isn't same as original one");
 		}
-	}
-	/* insert or push back */
-	else if (it != m_list.end()) {
-		m_list.insert(it, p_ptr);
-	} else {
-		m_list.push_back(p_ptr);
+		return;
 	}
 
-	/* update last packet number */
-	m_oldest_non_answered_ack = m_list.front()->getSeqnum();
+	entry = p_ptr;
+	m_size = ++m_count;
 }
 
 void ReliablePacketBuffer::fixPeerId(session_t new_id)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	for (auto &packet : m_list)
-		packet->setSenderPeerId(new_id);
+	for (u32 i = 0; i < m_span; i++) {
+		if (auto &packet = at(i))
+			packet->setSenderPeerId(new_id);
+	}
 }
 
 void ReliablePacketBuffer::incrementTimeouts(float dtime)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	for (auto &packet : m_list) {
-		packet->time += dtime;
-		packet->totaltime += dtime;
+	for (u32 i = 0; i < m_span; i++) {
+		if (auto &packet = at(i)) {
+			packet->time += dtime;
+			packet->totaltime += dtime;
+		}
 	}
 }
 
@@ -363,8 +447,9 @@ u32 ReliablePacketBuffer::getTimedOuts(float timeout)
 {
 	MutexAutoLock listlock(m_list_mutex);
 	u32 count = 0;
-	for (auto &packet : m_list) {
-		if (packet->totaltime >= timeout)
+	for (u32 i = 0; i < m_span; i++) {
+		auto &packet = at(i);
+		if (packet && packet->totaltime >= timeout)
 			count++;
 	}
 	return count;
@@ -375,7 +460,11 @@ std::vector<ConstSharedPtr<BufferedPacket>>
 {
 	MutexAutoLock listlock(m_list_mutex);
 	std::vector<ConstSharedPtr<BufferedPacket>> timed_outs;
-	for (auto &packet : m_list) {
+	for (u32 i = 0; i < m_span; i++) {
+		auto &packet = at(i);
+		if (!packet)
+			continue;
+
 		// resend time scales exponentially with each cycle
 		const float pkt_timeout = timeout * powf(RESEND_SCALE_BASE, packet->resend_count);
 
@@ -398,42 +487,78 @@ std::vector<ConstSharedPtr<BufferedPacket>>
 	IncomingSplitPacket
 */
 
-bool IncomingSplitPacket::insert(u32 chunk_num, SharedBuffer<u8> &chunkdata)
+void IncomingSplitPacket::checkSize(u32 chunk_num, u32 size)
+{
+	if (chunk_num == chunk_count - 1) {
+		// The last chunk might be smaller
+		if (chunk_size != 0 && size > chunk_size)
+			throw InvalidIncomingDataException("split packet chunk too big");
+		// The command has to be in the first chunk
+		if (chunk_count == 1 && size < 2)
+			throw InvalidIncomingDataException("split packet too small");
+		return;
+	}
+
+	if (chunk_size == 0) {
+		if (size < 2)
+			throw InvalidIncomingDataException("split packet chunk too small");
+		chunk_size = size;
+		auto it = ahead.find(chunk_count - 1);
+		if (it != ahead.end() && it->second.size() > chunk_size)
+			throw InvalidIncomingDataException("split packet chunk too big");
+	} else if (size != chunk_size) {
+		throw InvalidIncomingDataException("split packet chunk sizes differ");
+	}
+}
+
+void IncomingSplitPacket::append(const u8 *src, u32 size)
+{
+	total_size += size;
+	// The command comes first
+	u32 offset = total_size - size;
+	while (offset < 2 && size > 0) {
+		command_bytes[offset++] = *src++;
+		size--;
+	}
+	data.insert(data.end(), src, src + size);
+	appended_count++;
+}
+
+bool IncomingSplitPacket::insert(u32 chunk_num, const u8 *chunkdata, u32 size)
 {
 	sanity_check(chunk_num < chunk_count);
 
 	// If chunk already exists, ignore it.
 	// Sometimes two identical packets may arrive when there is network
 	// lag and the server re-sends stuff.
-	if (chunks.find(chunk_num) != chunks.end())
+	if (received[chunk_num])
 		return false;
 
-	// Set chunk data in buffer
-	chunks[chunk_num] = chunkdata;
+	checkSize(chunk_num, size);
+
+	if (chunk_num == appended_count) {
+		append(chunkdata, size);
+		// Fill in what arrived early
+		for (auto it = ahead.begin(); it != ahead.end() &&
+				it->first == appended_count; it = ahead.erase(it))
+			append(it->second.data(), it->second.size());
+	} else {
+		ahead[chunk_num].assign(chunkdata, chunkdata + size);
+		g_profiler->add("IncomingSplitBuffer: out of order chunks [#]", 1);
+	}
 
+	received[chunk_num] = true;
+	received_count++;
 	return true;
 }
 
-SharedBuffer<u8> IncomingSplitPacket::reassemble()
+std::vector<u8> IncomingSplitPacket::reassemble(u16 &command)
 {
-	sanity_check(allReceived());
+	sanity_check(allReceived() && ahead.empty());
 
-	// Calculate total size
-	u32 totalsize = 0;
-	for (const auto &chunk : chunks)
-		totalsize += chunk.second.getSize();
-
-	SharedBuffer<u8> fulldata(totalsize);
-
-	// Copy chunks to data buffer
-	u32 start = 0;
-	for (u32 chunk_i = 0; chunk_i < chunk_count; chunk_i++) {
-		const SharedBuffer<u8> &buf = chunks[chunk_i];
-		memcpy(&fulldata[start], *buf, buf.getSize());
-		start += buf.getSize();
-	}
-
-	return fulldata;
+	command = readU16(command_bytes);
+	g_profiler->add("IncomingSplitBuffer: reassembled [B]", total_size);
+	return std::move(data);
 }
 
 /*
@@ -448,30 +573,30 @@ IncomingSplitBuffer::~IncomingSplitBuffer()
 	}
 }
 
-SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacketPtr &p_ptr, bool reliable)
+bool IncomingSplitBuffer::insert(const u8 *data, u32 size, bool reliable,
+	u16 &command, std::vector<u8> &result)
 {
 	MutexAutoLock listlock(m_map_mutex);
-	const BufferedPacket &p = *p_ptr;
 
-	u32 headersize = BASE_HEADER_SIZE + 7;
-	if (p.size() < headersize) {
+	u32 headersize = 7;
+	if (size < headersize) {
 		errorstream << "Invalid data size for split packet" << std::endl;
-		return SharedBuffer<u8>();
+		return false;
 	}
-	u8 type = readU8(&p.data[BASE_HEADER_SIZE+0]);
-	u16 seqnum = readU16(&p.data[BASE_HEADER_SIZE+1]);
-	u16 chunk_count = readU16(&p.data[BASE_HEADER_SIZE+3]);
-	u16 chunk_num = readU16(&p.data[BASE_HEADER_SIZE+5]);
+	u8 type = readU8(&data[0]);
+	u16 seqnum = readU16(&data[1]);
+	u16 chunk_count = readU16(&data[3]);
+	u16 chunk_num = readU16(&data[5]);
 
 	if (type != PACKET_TYPE_SPLIT) {
 		errorstream << "IncomingSplitBuffer::insert(): type is not split"
 			<< std::endl;
-		return SharedBuffer<u8>();
+		return false;
 	}
 	if (chunk_num >= chunk_count) {
 		errorstream << "IncomingSplitBuffer::insert(): chunk_num=" << chunk_num
 				<< " >= chunk_count=" << chunk_count << std::endl;
-		return SharedBuffer<u8>();
+		return false;
 	}
 
 	// Add if doesn't exist
@@ -487,32 +612,36 @@ SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacketPtr &p_ptr, bool reli
 		errorstream << "IncomingSplitBuffer::insert(): chunk_count="
 				<< chunk_count << " != sp->chunk_count=" << sp->chunk_count
 				<< std::endl;
-		return SharedBuffer<u8>();
+		return false;
 	}
 	if (reliable != sp->reliable)
 		LOG(derr_con<<"Connection: WARNING: reliable="<<reliable
 				<<" != sp->reliable="<<sp->reliable
 				<<std::endl);
 
-	// Cut chunk data out of packet
-	u32 chunkdatasize = p.size() - headersize;
-	SharedBuffer<u8> chunkdata(chunkdatasize);
-	memcpy(*chunkdata, &(p.data[headersize]), chunkdatasize);
-
-	if (!sp->insert(chunk_num, chunkdata))
-		return SharedBuffer<u8>();
+	// Write the chunk data into place
+	try {
+		if (!sp->insert(chunk_num, &data[headersize], size - headersize))
+			return false;
+	} catch (InvalidIncomingDataException &e) {
+		errorstream << "IncomingSplitBuffer::insert(): " << e.what()
+				<< ", dropping split packet" << std::endl;
+		m_buf.erase(seqnum);
+		delete sp;
+		throw;
+	}
 
-	// If not all chunks are received, return empty buffer
+	// If not all chunks are received, there is nothing to return
 	if (!sp->allReceived())
-		return SharedBuffer<u8>();
+		return false;
 
-	SharedBuffer<u8> fulldata = sp->reassemble();
+	result = sp->reassemble(command);
 
 	// Remove sp from buffer
 	m_buf.erase(seqnum);
 	delete sp;
 
-	return fulldata;
+	return true;
 }
 
 void IncomingSplitBuffer::removeUnreliableTimedOuts(float dtime, float timeout)
@@ -1215,11 +1344,12 @@ void UDPPeer::setNextSplitSequenceNumber(u8 channel, u16 seqnum)
 	channels[channel].setNextSplitSeqNum(seqnum);
 }
 
-SharedBuffer<u8> UDPPeer::addSplitPacket(u8 channel, BufferedPacketPtr &toadd,
-	bool reliable)
+bool UDPPeer::addSplitPacket(u8 channel, const SharedBuffer<u8> &data,
+	bool reliable, u16 &command, std::vector<u8> &result)
 {
 	assert(channel < CHANNEL_COUNT); // Pre-condition
-	return channels[channel].incoming_splits.insert(toadd, reliable);
+	return channels[channel].incoming_splits.insert(*data, data.getSize(),
+		reliable, command, result);
 }
 
 /*
@@ -1249,11 +1379,13 @@ ConnectionEventPtr ConnectionEvent::create(ConnectionEventType type)
 	return std::shared_ptr<ConnectionEvent>(new ConnectionEvent(type));
 }
 
-ConnectionEventPtr ConnectionEvent::dataReceived(session_t peer_id, const Buffer<u8> &data)
+ConnectionEventPtr ConnectionEvent::dataReceived(session_t peer_id, u16 command,
+	std::vector<u8> &&data)
 {
 	auto e = create(CONNEVENT_DATA_RECEIVED);
 	e->peer_id = peer_id;
-	data.copyTo(e->data);
+	e->command = command;
+	e->data = std::move(data);
 	return e;
 }
 
@@ -1416,7 +1548,7 @@ ConnectionEventPtr Connection::waitEvent(u32 timeout_ms)
 void Connection::putCommand(ConnectionCommandPtr c)
 {
 	if (!m_shutting_down) {
-		m_command_queue.push_back(c);
+		m_command_queue.push(std::move(c));
 		m_sendThread->Trigger();
 	}
 }
@@ -1462,7 +1594,7 @@ bool Connection::ReceiveTimeoutMs(NetworkPacket *pkt, u32 timeout_ms)
 	*/
 	for(;;) {
 		ConnectionEventPtr e_ptr = waitEvent(timeout_ms);
-		const ConnectionEvent &e = *e_ptr;
+		ConnectionEvent &e = *e_ptr;
 
 		if (e.type != CONNEVENT_NONE) {
 			LOG(dout_con << getDesc() << ": Receive: got event: "
@@ -1473,12 +1605,7 @@ bool Connection::ReceiveTimeoutMs(NetworkPacket *pkt, u32 timeout_ms)
 		case CONNEVENT_NONE:
 			return false;
 		case CONNEVENT_DATA_RECEIVED:
-			// Data size is lesser than command size, ignoring packet
-			if (e.data.getSize() < 2) {
-				continue;
-			}
-
-			pkt->putRawPacket(*e.data, e.data.getSize(), e.peer_id);
+			pkt->putRawPacket(e.command, std::move(e.data), e.peer_id);
 			return true;
 		case CONNEVENT_PEER_ADDED: {
 			UDPPeer tmp(e.peer_id, e.address, this);
@@ -12,6 +12,7 @@
 #include "porting.h"
 #include "network/address.h"
 #include "network/networkprotocol.h"
+#include "threading/mpsc_queue.h"
 #include <atomic>
 #include <cfloat>
 #include <vector>
@@ -64,7 +65,9 @@ struct ConnectionEvent
 {
 	const ConnectionEventType type;
 	session_t peer_id = 0;
-	Buffer<u8> data;
+	// Received packet, without the command
+	u16 command = 0;
+	std::vector<u8> data;
 	bool timeout = false;
 	Address address;
 
@@ -72,7 +75,8 @@ struct ConnectionEvent
 	DISABLE_CLASS_COPY(ConnectionEvent);
 
 	static ConnectionEventPtr create(ConnectionEventType type);
-	static ConnectionEventPtr dataReceived(session_t peer_id, const Buffer<u8> &data);
+	static ConnectionEventPtr dataReceived(session_t peer_id, u16 command,
+		std::vector<u8> &&data);
 	static ConnectionEventPtr peerAdded(session_t peer_id, Address address);
 	static ConnectionEventPtr peerRemoved(session_t peer_id, bool is_timeout, Address address);
 	static ConnectionEventPtr bindFailed();
@@ -131,8 +135,8 @@ class Peer : public IPeer {
 
 		virtual u16 getNextSplitSequenceNumber(u8 channel) { return 0; };
 		virtual void setNextSplitSequenceNumber(u8 channel, u16 seqnum) {};
-		virtual SharedBuffer<u8> addSplitPacket(u8 channel, BufferedPacketPtr &toadd,
-				bool reliable)
+		virtual bool addSplitPacket(u8 channel, const SharedBuffer<u8> &data,
+				bool reliable, u16 &command, std::vector<u8> &result)
 		{
 			FATAL_ERROR("unimplemented in abstract class");
 		}
@@ -272,8 +276,8 @@ class Connection final : public IConnection
 	u32 getActiveCount();
 
 	UDPSocket m_udpSocket;
-	// Command queue: user -> SendThread
-	MutexedQueue<ConnectionCommandPtr> m_command_queue;
+	// Command queue: user, ReceiveThread -> SendThread
+	MPSCQueue<ConnectionCommandPtr> m_command_queue;
 
 	void putEvent(ConnectionEventPtr e);
 
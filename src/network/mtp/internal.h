@@ -107,6 +107,8 @@ class ConstSharedPtr {
 	std::shared_ptr<T> ptr;
 };
 
+class TestConnection;
+
 namespace con
 {
 
@@ -187,16 +189,34 @@ class IncomingDataCorruption : public BaseException
 };
 
 
+/*
+	Recycles the data buffers of packets, which are allocated and released
+	at a high rate (often by different threads).
+*/
+namespace PacketBufferPool
+{
+	// buffers up to this size come from the pool
+	constexpr u32 BLOCK_SIZE = 1500;
+
+	u8 *allocate(u32 size);
+	void release(u8 *data, u32 size);
+}
+
 /*
 	Struct for all kinds of packets. Includes following data:
 		BASE_HEADER
 		u8[] packet data (usually copied from SharedBuffer<u8>)
 */
 struct BufferedPacket {
-	BufferedPacket(u32 a_size)
+	BufferedPacket(u32 a_size) :
+		m_size(a_size)
 	{
-		m_data.resize(a_size);
-		data = &m_data[0];
+		data = PacketBufferPool::allocate(a_size);
+	}
+
+	~BufferedPacket()
+	{
+		PacketBufferPool::release(data, m_size);
 	}
 
 	DISABLE_CLASS_COPY(BufferedPacket)
@@ -204,7 +224,7 @@ struct BufferedPacket {
 	u16 getSeqnum() const;
 	void setSenderPeerId(session_t id);
 
-	inline size_t size() const { return m_data.size(); }
+	inline size_t size() const { return m_size; }
 
 	u8 *data; // Direct memory access
 	float time = 0.0f; // Seconds from buffering the packet or re-sending
@@ -214,7 +234,7 @@ struct BufferedPacket {
 	Address address; // Sender or destination
 
 private:
-	std::vector<u8> m_data; // Data of the packet, including headers
+	u32 m_size; // of the data, including headers
 };
 
 
@@ -230,10 +250,17 @@ void makeAutoSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max,
 // Add the TYPE_RELIABLE header to the data
 SharedBuffer<u8> makeReliablePacket(const SharedBuffer<u8> &data, u16 seqnum);
 
+/*
+	Chunks are appended to a buffer for the whole packet as they arrive in
+	order, so memory use follows the received data. Chunks that arrive ahead
+	of a missing one are kept aside until the gap is filled.
+	The first two bytes (the command) are kept apart so that the rest can be
+	handed to a NetworkPacket as it is.
+*/
 struct IncomingSplitPacket
 {
 	IncomingSplitPacket(u32 cc, bool r):
-		chunk_count(cc), reliable(r) {}
+		chunk_count(cc), reliable(r), received(cc, false) {}
 
 	IncomingSplitPacket() = delete;
 
@@ -243,24 +270,46 @@ struct IncomingSplitPacket
 
 	bool allReceived() const
 	{
-		return (chunks.size() == chunk_count);
+		return (received_count == chunk_count);
 	}
-	bool insert(u32 chunk_num, SharedBuffer<u8> &chunkdata);
-	SharedBuffer<u8> reassemble();
+	// Returns false if the chunk was received before.
+	// Throws InvalidIncomingDataException if it does not fit the others.
+	bool insert(u32 chunk_num, const u8 *chunkdata, u32 size);
+	// Moves out the data following the command, can only be called once
+	std::vector<u8> reassemble(u16 &command);
 
 private:
-	// Key is chunk number, value is data without headers
-	std::map<u16, SharedBuffer<u8>> chunks;
+	void checkSize(u32 chunk_num, u32 size);
+	void append(const u8 *src, u32 size);
+
+	// Size of every chunk except the last one, 0 while unknown
+	u32 chunk_size = 0;
+	std::vector<bool> received;
+	u32 received_count = 0;
+	// Number of chunks appended to `data`
+	u32 appended_count = 0;
+	u32 total_size = 0;
+	u8 command_bytes[2] = {0, 0};
+	// Packet data after the command
+	std::vector<u8> data;
+	// Chunks received ahead of the next one to append
+	std::map<u32, std::vector<u8>> ahead;
 };
 
 /*
 	A buffer which stores reliable packets and sorts them internally
 	for fast access to the smallest one.
+
+	Packets are kept in a ring indexed by seqnum, so inserting and removing
+	one does not depend on the number of packets in the buffer.
 */
 
 class ReliablePacketBuffer
 {
 public:
+	// Packets more than `max_span` seqnums apart are not buffered together
+	ReliablePacketBuffer(u32 max_span = SEQNUM_MAX + 1) : m_max_span(max_span) {}
+
 	bool getFirstSeqnum(u16 &result);
 
 	BufferedPacketPtr popFirst();
@@ -275,20 +324,40 @@ class ReliablePacketBuffer
 	std::vector<ConstSharedPtr<BufferedPacket>> getResend(float timeout, u32 max_packets);
 
 	void print();
+	// these two don't lock, the result may be outdated by the time it is used
 	bool empty();
 	u32 size();
 
+	// the ring never gets smaller than this
+	static constexpr u32 MIN_CAPACITY = 64;
 
 private:
-	typedef std::list<BufferedPacketPtr>::iterator FindResult;
-
-	FindResult findPacketNoLock(u16 seqnum);
-
-	std::list<BufferedPacketPtr> m_list;
+	inline u32 slot(u16 seqnum) const { return seqnum & (m_ring.size() - 1); }
+	inline BufferedPacketPtr &at(u32 offset)
+	{
+		return m_ring[slot((u16)(m_first + offset))];
+	}
 
-	u16 m_oldest_non_answered_ack;
+	// Grows the ring so that `span` seqnums from m_first fit into it
+	void reserveSpan(u32 span);
+	// Moves the packets into a ring of `capacity` slots
+	void resizeRing(u32 capacity);
+	// @return nullptr if there is no packet with this seqnum
+	BufferedPacketPtr removeNoLock(u16 seqnum);
+
+	// Size is a power of two. Holds all packets, which are within m_span
+	// seqnums starting at m_first (the smallest one).
+	std::vector<BufferedPacketPtr> m_ring;
+	u16 m_first = 0;
+	u32 m_span = 0;
+	u32 m_count = 0;
+	const u32 m_max_span;
 
 	std::mutex m_list_mutex;
+	// copy of m_count for reading without the lock
+	std::atomic<u32> m_size = 0;
+
+	friend class ::TestConnection;
 };
 
 /*
@@ -301,10 +370,12 @@ class IncomingSplitBuffer
 	~IncomingSplitBuffer();
 
 	/*
-		Returns a reference counted buffer of length != 0 when a full split
-		packet is constructed. If not, returns one of length 0.
+		Adds a chunk, `data` starts with the split header. Returns true when
+		this completed a packet, which is then split into its command and
+		the rest in `result`.
 	*/
-	SharedBuffer<u8> insert(BufferedPacketPtr &p_ptr, bool reliable);
+	bool insert(const u8 *data, u32 size, bool reliable,
+		u16 &command, std::vector<u8> &result);
 
 	void removeUnreliableTimedOuts(float dtime, float timeout);
 
@@ -373,6 +444,12 @@ struct ConnectionCommand
 // accept from peers vs. what we use for sending.
 #define MAX_RELIABLE_WINDOW_SIZE 0x8000
 #define MAX_RELIABLE_WINDOW_SIZE_SEND 2048
+/*
+ * Reliable packets are only buffered and acknowledged this far ahead of the
+ * next expected one, which keeps what a peer can make us allocate small.
+ * Packets further ahead are dropped without an ack and get resent later.
+ */
+#define MAX_RELIABLE_BUFFER_SPAN (2 * MAX_RELIABLE_WINDOW_SIZE_SEND)
 /* starting value for window size */
 #define START_RELIABLE_WINDOW_SIZE 64
 /* minimum value for window size */
@@ -394,7 +471,7 @@ class Channel
 
 	// This is for buffering the incoming packets that are coming in
 	// the wrong order
-	ReliablePacketBuffer incoming_reliables;
+	ReliablePacketBuffer incoming_reliables{MAX_RELIABLE_BUFFER_SPAN};
 	// This is for buffering the sent packets so that the sender can
 	// re-send them if no ACK is received
 	ReliablePacketBuffer outgoing_reliables_sent;
@@ -501,8 +578,8 @@ class UDPPeer final : public Peer
 	u16 getNextSplitSequenceNumber(u8 channel) override;
 	void setNextSplitSequenceNumber(u8 channel, u16 seqnum) override;
 
-	SharedBuffer<u8> addSplitPacket(u8 channel, BufferedPacketPtr &toadd,
-		bool reliable) override;
+	bool addSplitPacket(u8 channel, const SharedBuffer<u8> &data, bool reliable,
+		u16 &command, std::vector<u8> &result) override;
 
 	bool isTimedOut(float timeout, std::string &reason) override;
 
@@ -91,6 +91,8 @@ void *ConnectionSendThread::run()
 		/* remove all triggers */
 		while (m_send_sleep_semaphore.wait(0)) {
 		}
+		/* commands queued from now on need a new trigger */
+		m_triggered.exchange(false, std::memory_order_acq_rel);
 
 		lasttime = curtime;
 		curtime = porting::getTimeMs();
@@ -113,19 +115,19 @@ void *ConnectionSendThread::run()
 		}
 
 		/* translate commands to packets */
-		auto c = m_connection->m_command_queue.pop_frontNoEx(0);
-		while (c && c->type != CONNCMD_NONE) {
+		ConnectionCommandPtr c;
+		while (m_connection->m_command_queue.pop(c) && c && c->type != CONNCMD_NONE) {
 			if (c->reliable)
 				processReliableCommand(c);
 			else
 				processNonReliableCommand(c);
-
-			c = m_connection->m_command_queue.pop_frontNoEx(0);
 		}
 
 		/* send queued packets */
 		sendPackets(dtime, calculate_quota());
 
+		flushSendBatch();
+
 		END_DEBUG_EXCEPTION_HANDLER
 	}
 
@@ -135,7 +137,9 @@ void *ConnectionSendThread::run()
 
 void ConnectionSendThread::Trigger()
 {
-	m_send_sleep_semaphore.post();
+	// One wakeup covers everything queued until the thread runs again
+	if (!m_triggered.exchange(true, std::memory_order_acq_rel))
+		m_send_sleep_semaphore.post();
 }
 
 bool ConnectionSendThread::packetsQueued()
@@ -243,7 +247,7 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 				m_iteration_packets_avaialble = 0;
 
 			for (const auto &k : timed_outs)
-				resendReliable(channel, k.get(), resend_timeout);
+				resendReliable(channel, k, resend_timeout);
 
 			auto ws_old = channel.getWindowSize();
 			channel.UpdateTimers(dtime);
@@ -273,9 +277,10 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 	}
 }
 
-void ConnectionSendThread::resendReliable(Channel &channel, const BufferedPacket *k, float resend_timeout)
+void ConnectionSendThread::resendReliable(Channel &channel,
+	const ConstSharedPtr<BufferedPacket> &k, float resend_timeout)
 {
-	assert(k);
+	assert(k.get());
 	u8 channelnum = readChannel(k->data);
 	u16 seqnum = k->getSeqnum();
 
@@ -300,19 +305,35 @@ void ConnectionSendThread::resendReliable(Channel &channel, const BufferedPacket
 	// lost or really takes more time to transmit
 }
 
-void ConnectionSendThread::rawSend(const BufferedPacket *p)
+void ConnectionSendThread::rawSend(const ConstSharedPtr<BufferedPacket> &p)
 {
-	assert(p);
-	try {
-		m_connection->m_udpSocket.Send(p->address, p->data, p->size());
-		//LOG(dout_con << m_connection->getDesc()
-		//	<< " rawSend: " << p->size()
-		//	<< " bytes sent" << std::endl);
-	} catch (SendFailedException &e) {
+	assert(p.get());
+	m_send_batch.push_back(p);
+	if (m_send_batch.size() >= UDPSocket::BATCH_SIZE)
+		flushSendBatch();
+}
+
+void ConnectionSendThread::flushSendBatch()
+{
+	if (m_send_batch.empty())
+		return;
+
+	std::vector<UDPSocket::Datagram> datagrams(m_send_batch.size());
+	for (size_t i = 0; i < m_send_batch.size(); i++) {
+		const BufferedPacket *p = m_send_batch[i].get();
+		datagrams[i].address = p->address;
+		datagrams[i].data = p->data;
+		datagrams[i].size = p->size();
+	}
+
+	int failed = m_connection->m_udpSocket.SendBatch(datagrams.data(),
+		datagrams.size());
+	if (failed > 0) {
 		LOG(derr_con << m_connection->getDesc()
-			<< "SendFailedException: " << e.what() << " to "
-			<< p->address.serializeString() << std::endl);
+			<< "Failed to send " << failed << " of "
+			<< datagrams.size() << " packets" << std::endl);
 	}
+	m_send_batch.clear();
 }
 
 void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *channel)
@@ -332,7 +353,7 @@ void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *c
 	}
 
 	// Send the packet
-	rawSend(p.get());
+	rawSend(p);
 }
 
 bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
@@ -385,7 +406,7 @@ bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
 		channelnum);
 
 	// Send the packet
-	rawSend(p.get());
+	rawSend(p);
 	return true;
 }
 
@@ -432,7 +453,7 @@ void ConnectionSendThread::processReliableCommand(ConnectionCommandPtr &c)
 			auto list = channel.outgoing_reliables_sent.getResend(0, 1);
 
 			if (!list.empty()) {
-				auto *packet = list.front().get();
+				const auto &packet = list.front();
 				// During the init phase, if we want to resend a packet more
 				// often than reasonable (let's say once per second which
 				// the init phase can take), someone is probably flooding us
@@ -857,7 +878,11 @@ void *ConnectionReceiveThread::run()
 	// theoretical reliable upper boundary of a udp packet for all IPv6 enabled
 	// infrastructure
 	const unsigned int packet_maxsize = 1500;
-	SharedBuffer<u8> packetdata(packet_maxsize);
+	// Several datagrams are read per wakeup
+	std::vector<UDPSocket::Datagram> datagrams(UDPSocket::BATCH_SIZE);
+	std::unique_ptr<u8[]> buffers(new u8[packet_maxsize * datagrams.size()]);
+	for (size_t i = 0; i < datagrams.size(); i++)
+		datagrams[i].data = &buffers[packet_maxsize * i];
 
 	bool packet_queued = true;
 
@@ -879,7 +904,7 @@ void *ConnectionReceiveThread::run()
 #endif
 
 		/* receive packets */
-		receive(packetdata, packet_queued);
+		receive(datagrams, packet_maxsize, packet_queued);
 
 #ifdef DEBUG_CONNECTION_KBPS
 		debug_print_timer += dtime;
@@ -939,8 +964,8 @@ void *ConnectionReceiveThread::run()
 }
 
 // Receive packets from the network and buffers and create ConnectionEvents
-void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
-		bool &packet_queued)
+void ConnectionReceiveThread::receive(std::vector<UDPSocket::Datagram> &datagrams,
+		int buffer_size, bool &packet_queued)
 {
 	try {
 		// First, see if there any buffered packets we can process now
@@ -952,7 +977,7 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 					if (!getFromBuffers(peer_id, resultdata))
 						break;
 
-					m_connection->putEvent(ConnectionEvent::dataReceived(peer_id, resultdata));
+					putDataEvent(peer_id, resultdata);
 				}
 				catch (ProcessedSilentlyException &e) {
 					/* try reading again */
@@ -960,14 +985,24 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 			}
 			packet_queued = false;
 		}
+	}
+	catch (InvalidIncomingDataException &e) {
+	}
 
-		// Call Receive() to wait for incoming data
-		Address sender;
-		s32 received_size = m_connection->m_udpSocket.Receive(sender,
-			*packetdata, packetdata.getSize());
-		if (received_size < 0)
-			return;
+	// Wait for incoming data and take everything that is available
+	s32 count = m_connection->m_udpSocket.ReceiveBatch(datagrams.data(),
+		datagrams.size(), buffer_size);
+	for (s32 i = 0; i < count; i++) {
+		const UDPSocket::Datagram &datagram = datagrams[i];
+		handleDatagram(datagram.address,
+			static_cast<const u8 *>(datagram.data), datagram.size, packet_queued);
+	}
+}
 
+void ConnectionReceiveThread::handleDatagram(const Address &sender,
+		const u8 *packetdata, s32 received_size, bool &packet_queued)
+{
+	try {
 		if ((received_size < BASE_HEADER_SIZE) ||
 				(readU32(&packetdata[0]) != m_connection->GetProtocolID())) {
 			LOG(derr_con << m_connection->getDesc()
@@ -979,8 +1014,8 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 			return;
 		}
 
-		session_t peer_id = readPeerId(*packetdata);
-		u8 channelnum = readChannel(*packetdata);
+		session_t peer_id = readPeerId(packetdata);
+		u8 channelnum = readChannel(packetdata);
 
 		if (channelnum >= CHANNEL_COUNT) {
 			LOG(derr_con << m_connection->getDesc()
@@ -1078,7 +1113,7 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 				<< ", channel: " << (u32)channelnum << ", returned "
 				<< resultdata.getSize() << " bytes" << std::endl);
 
-			m_connection->putEvent(ConnectionEvent::dataReceived(peer_id, resultdata));
+			putDataEvent(peer_id, resultdata);
 		}
 		catch (ProcessedSilentlyException &e) {
 		}
@@ -1094,6 +1129,18 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 	}
 }
 
+void ConnectionReceiveThread::putDataEvent(session_t peer_id,
+		const SharedBuffer<u8> &data)
+{
+	// Data size is lesser than command size, ignoring packet
+	if (data.getSize() < 2)
+		return;
+
+	std::vector<u8> rest(*data + 2, *data + data.getSize());
+	m_connection->putEvent(ConnectionEvent::dataReceived(peer_id,
+		readU16(*data), std::move(rest)));
+}
+
 bool ConnectionReceiveThread::getFromBuffers(session_t &peer_id, SharedBuffer<u8> &dst)
 {
 	std::vector<session_t> peerids = m_connection->getPeerIDs();
@@ -1307,22 +1354,18 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Original(Channel *cha
 SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Split(Channel *channel,
 	const SharedBuffer<u8> &packetdata, Peer *peer, u8 channelnum, bool reliable)
 {
-	// We have to create a packet again for buffering
-	// This isn't actually too bad an idea.
-	BufferedPacketPtr packet = con::makePacket(peer->getAddress(),
-		packetdata,
-		m_connection->GetProtocolID(),
-		peer->id,
-		channelnum);
-
-	// Buffer the packet
-	SharedBuffer<u8> data = peer->addSplitPacket(channelnum, packet, reliable);
-
-	if (data.getSize() != 0) {
+	// Buffer the chunk
+	u16 command;
+	std::vector<u8> data;
+	if (peer->addSplitPacket(channelnum, packetdata, reliable, command, data)) {
 		LOG(dout_con << m_connection->getDesc()
 			<< "RETURNING TYPE_SPLIT: Constructed full data, "
-			<< "size=" << data.getSize() << std::endl);
-		return data;
+			<< "size=" << data.size() + 2 << std::endl);
+		// Hand over the reassembled buffer as it is, this happens exactly
+		// where the caller would put the event for returned data.
+		m_connection->putEvent(ConnectionEvent::dataReceived(peer->id,
+			command, std::move(data)));
+		return SharedBuffer<u8>();
 	}
 	LOG(dout_con << m_connection->getDesc() << "BUFFERED TYPE_SPLIT" << std::endl);
 	throw ProcessedSilentlyException("Buffered a split packet chunk");
@@ -1346,7 +1389,7 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Reliable(Channel *cha
 
 	/* packet is within our receive window send ack */
 	if (seqnum_in_window(seqnum,
-		channel->readNextIncomingSeqNum(), MAX_RELIABLE_WINDOW_SIZE)) {
+		channel->readNextIncomingSeqNum(), MAX_RELIABLE_BUFFER_SPAN)) {
 		m_connection->sendAck(peer->id, channelnum, seqnum);
 	} else {
 		is_future_packet = seqnum_higher(seqnum, channel->readNextIncomingSeqNum());
@@ -9,9 +9,12 @@
 /* may only be included from in src/network */
 /********************************************/
 
+#include <atomic>
 #include <cassert>
+#include <vector>
 #include "threading/thread.h"
 #include "network/mtp/internal.h"
+#include "network/socket.h"
 
 namespace con
 {
@@ -59,8 +62,12 @@ class ConnectionSendThread : public Thread
 
 private:
 	void runTimeouts(float dtime, u32 peer_packet_quota);
-	void resendReliable(Channel &channel, const BufferedPacket *k, float resend_timeout);
-	void rawSend(const BufferedPacket *p);
+	void resendReliable(Channel &channel, const ConstSharedPtr<BufferedPacket> &k,
+			float resend_timeout);
+	// Queues the packet for sending, see flushSendBatch()
+	void rawSend(const ConstSharedPtr<BufferedPacket> &p);
+	// Sends all packets queued by rawSend()
+	void flushSendBatch();
 	bool rawSendAsPacket(session_t peer_id, u8 channelnum,
 			const SharedBuffer<u8> &data, bool reliable);
 
@@ -89,7 +96,11 @@ class ConnectionSendThread : public Thread
 	unsigned int m_max_packet_size;
 	float m_timeout;
 	std::queue<OutgoingPacket> m_outgoing_queue;
+	// packets that are sent with the next flushSendBatch()
+	std::vector<ConstSharedPtr<BufferedPacket>> m_send_batch;
 	Semaphore m_send_sleep_semaphore;
+	// whether the semaphore was posted since the thread last woke up
+	std::atomic<bool> m_triggered = false;
 
 	unsigned int m_iteration_packets_avaialble;
 	unsigned int m_max_data_packets_per_iteration;
@@ -110,7 +121,13 @@ class ConnectionReceiveThread : public Thread
 	}
 
 private:
-	void receive(SharedBuffer<u8> &packetdata, bool &packet_queued);
+	void receive(std::vector<UDPSocket::Datagram> &datagrams, int buffer_size,
+			bool &packet_queued);
+	void handleDatagram(const Address &sender, const u8 *packetdata,
+			s32 received_size, bool &packet_queued);
+
+	// Puts an event for the received data, unless it is too short
+	void putDataEvent(session_t peer_id, const SharedBuffer<u8> &data);
 
 	// Returns next data from a buffer if possible
 	// If found, returns true; if not, false.
@@ -127,6 +144,8 @@ class ConnectionReceiveThread : public Thread
 			peer_id: peer id of the sender of the packet in question
 			channelnum: channel on which the packet was sent
 			reliable: true if recursing into a reliable packet
+		Returns the data to deliver. Complete split packets are delivered
+		right away, in that case the result is empty.
 	*/
 	SharedBuffer<u8> processPacket(Channel *channel,
 			const SharedBuffer<u8> &packetdata, session_t peer_id,
@@ -38,6 +38,19 @@ void NetworkPacket::putRawPacket(const u8 *data, u32 datasize, session_t peer_id
 		memcpy(m_data.data(), &data[2], m_datasize);
 }
 
+void NetworkPacket::putRawPacket(u16 command, std::vector<u8> &&data,
+	session_t peer_id)
+{
+	// If a m_command is already set, we are rewriting on same packet
+	// This is not permitted
+	assert(m_command == 0);
+
+	m_command = command;
+	m_peer_id = peer_id;
+	m_data = std::move(data);
+	m_datasize = m_data.size();
+}
+
 void NetworkPacket::clear()
 {
 	m_data.clear();
@@ -30,6 +30,8 @@ class NetworkPacket
 	~NetworkPacket() = default;
 
 	void putRawPacket(const u8 *data, u32 datasize, session_t peer_id);
+	// Takes over `data`, which holds what follows the command
+	void putRawPacket(u16 command, std::vector<u8> &&data, session_t peer_id);
 	void clear();
 
 	// Getters
@@ -33,6 +33,11 @@ typedef int socklen_t;
 #define SOCKET_ERR_STR(e) strerror(e)
 #endif
 
+// recvmmsg() and sendmmsg()
+#ifdef __linux__
+#define HAVE_MMSG 1
+#endif
+
 static bool g_sockets_initialized = false;
 
 // Initialize sockets
@@ -163,89 +168,223 @@ void UDPSocket::Bind(Address addr)
 	}
 }
 
-void UDPSocket::Send(const Address &destination, const void *data, int size)
+// Returns the length of the socket address written to `storage`
+static socklen_t to_sockaddr(const Address &addr, struct sockaddr_storage &storage)
 {
-	bool dumping_packet = false; // for INTERNET_SIMULATOR
+	memset(&storage, 0, sizeof(storage));
+	if (addr.isIPv6()) {
+		auto *address = reinterpret_cast<struct sockaddr_in6 *>(&storage);
+		address->sin6_family = AF_INET6;
+		address->sin6_addr = addr.getAddress6();
+		address->sin6_port = htons(addr.getPort());
+		return sizeof(struct sockaddr_in6);
+	}
+	auto *address = reinterpret_cast<struct sockaddr_in *>(&storage);
+	address->sin_family = AF_INET;
+	address->sin_addr = addr.getAddress();
+	address->sin_port = htons(addr.getPort());
+	return sizeof(struct sockaddr_in);
+}
 
-	if (INTERNET_SIMULATOR)
-		dumping_packet = myrand() % INTERNET_SIMULATOR_PACKET_LOSS == 0;
+static Address from_sockaddr(const struct sockaddr_storage &storage)
+{
+	if (storage.ss_family == AF_INET6) {
+		auto *address = reinterpret_cast<const struct sockaddr_in6 *>(&storage);
+		IPv6AddressBytes bytes;
+		memcpy(bytes.bytes, address->sin6_addr.s6_addr, sizeof(address->sin6_addr.s6_addr));
+		return Address(&bytes, ntohs(address->sin6_port));
+	}
+	auto *address = reinterpret_cast<const struct sockaddr_in *>(&storage);
+	return Address(ntohl(address->sin_addr.s_addr), ntohs(address->sin_port));
+}
 
-	if (dumping_packet) {
+// for INTERNET_SIMULATOR
+static bool dump_packet()
+{
+	if (INTERNET_SIMULATOR && myrand() % INTERNET_SIMULATOR_PACKET_LOSS == 0) {
 		// Lol let's forget it
 		tracestream << "UDPSocket::Send(): INTERNET_SIMULATOR: dumping packet."
 			<< std::endl;
-		return;
+		return true;
 	}
+	return false;
+}
+
+void UDPSocket::Send(const Address &destination, const void *data, int size)
+{
+	if (dump_packet())
+		return;
 
 	if (destination.getFamily() != m_addr_family)
 		throw SendFailedException("Address family mismatch");
 
-	int sent;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address = {};
-		address.sin6_family = AF_INET6;
-		address.sin6_addr = destination.getAddress6();
-		address.sin6_port = htons(destination.getPort());
+	struct sockaddr_storage address;
+	socklen_t address_len = to_sockaddr(destination, address);
 
-		sent = sendto(m_handle, (const char *)data, size, 0,
-				(struct sockaddr *)&address, sizeof(struct sockaddr_in6));
-	} else {
-		struct sockaddr_in address = {};
-		address.sin_family = AF_INET;
-		address.sin_addr = destination.getAddress();
-		address.sin_port = htons(destination.getPort());
-
-		sent = sendto(m_handle, (const char *)data, size, 0,
-				(struct sockaddr *)&address, sizeof(struct sockaddr_in));
-	}
+	int sent = sendto(m_handle, (const char *)data, size, 0,
+			(struct sockaddr *)&address, address_len);
 
 	if (sent != size)
 		throw SendFailedException("Failed to send packet");
 }
 
-int UDPSocket::Receive(Address &sender, void *data, int size)
+#ifdef HAVE_MMSG
+
+int UDPSocket::SendBatch(const Datagram *datagrams, int count)
+{
+	struct mmsghdr msgs[BATCH_SIZE];
+	struct iovec iovecs[BATCH_SIZE];
+	struct sockaddr_storage addresses[BATCH_SIZE];
+
+	int failed = 0;
+	int i = 0;
+	while (i < count) {
+		// Collect the next batch
+		int n = 0;
+		for (; i < count && n < BATCH_SIZE; i++) {
+			const Datagram &datagram = datagrams[i];
+			if (dump_packet())
+				continue;
+			if (datagram.address.getFamily() != m_addr_family) {
+				failed++;
+				continue;
+			}
+			iovecs[n].iov_base = datagram.data;
+			iovecs[n].iov_len = datagram.size;
+			memset(&msgs[n], 0, sizeof(msgs[n]));
+			msgs[n].msg_hdr.msg_name = &addresses[n];
+			msgs[n].msg_hdr.msg_namelen = to_sockaddr(datagram.address, addresses[n]);
+			msgs[n].msg_hdr.msg_iov = &iovecs[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			n++;
+		}
+
+		// sendmmsg() stops at the first datagram that fails
+		int done = 0;
+		int interrupted = 0;
+		while (done < n) {
+			int sent = sendmmsg(m_handle, &msgs[done], n - done, 0);
+			if (sent > 0) {
+				done += sent;
+				interrupted = 0;
+			} else if (sent == 0) {
+				// Nothing was sent and there is no error to go by, give up
+				return failed + (n - done) + (count - i);
+			} else if (LAST_SOCKET_ERR() != EINTR ||
+					++interrupted >= MAX_SEND_INTERRUPTS) {
+				// Skip the failed one
+				failed++;
+				done++;
+				interrupted = 0;
+			}
+		}
+	}
+	return failed;
+}
+
+int UDPSocket::ReceiveBatch(Datagram *datagrams, int count, int buffer_size)
 {
 	// Return on timeout
 	assert(m_timeout_ms >= 0);
 	if (!WaitData(m_timeout_ms))
 		return -1;
 
-	size = MYMAX(size, 0);
+	struct mmsghdr msgs[BATCH_SIZE];
+	struct iovec iovecs[BATCH_SIZE];
+	struct sockaddr_storage addresses[BATCH_SIZE];
+
+	count = rangelim(count, 0, BATCH_SIZE);
+	buffer_size = MYMAX(buffer_size, 0);
+	for (int i = 0; i < count; i++) {
+		iovecs[i].iov_base = datagrams[i].data;
+		iovecs[i].iov_len = buffer_size;
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_name = &addresses[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
 
-	int received;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address;
-		memset(&address, 0, sizeof(address));
-		socklen_t address_len = sizeof(address);
+	// Only take what is already there
+	int received = recvmmsg(m_handle, msgs, count, MSG_DONTWAIT, nullptr);
+	if (received < 0) {
+		int e = LAST_SOCKET_ERR();
+		// e.g. the datagram was dropped for a bad checksum after poll()
+		if (e == EAGAIN || e == EWOULDBLOCK || e == EINTR)
+			return 0;
+		return -1;
+	}
 
-		received = recvfrom(m_handle, (char *)data, size, 0,
-				(struct sockaddr *)&address, &address_len);
+	for (int i = 0; i < received; i++) {
+		datagrams[i].address = from_sockaddr(addresses[i]);
+		datagrams[i].size = msgs[i].msg_len;
+	}
+	return received;
+}
 
-		if (received < 0)
-			return -1;
+#else
 
-		u16 address_port = ntohs(address.sin6_port);
-		IPv6AddressBytes bytes;
-		memcpy(bytes.bytes, address.sin6_addr.s6_addr, sizeof(address.sin6_addr.s6_addr));
-		sender = Address(&bytes, address_port);
-	} else {
-		struct sockaddr_in address;
-		memset(&address, 0, sizeof(address));
+int UDPSocket::SendBatch(const Datagram *datagrams, int count)
+{
+	int failed = 0;
+	for (int i = 0; i < count; i++) {
+		try {
+			Send(datagrams[i].address, datagrams[i].data, datagrams[i].size);
+		} catch (SendFailedException &e) {
+			failed++;
+		}
+	}
+	return failed;
+}
 
-		socklen_t address_len = sizeof(address);
+int UDPSocket::ReceiveBatch(Datagram *datagrams, int count, int buffer_size)
+{
+	// Return on timeout
+	assert(m_timeout_ms >= 0);
+	if (!WaitData(m_timeout_ms))
+		return -1;
 
-		received = recvfrom(m_handle, (char *)data, size, 0,
-				(struct sockaddr *)&address, &address_len);
+	int received = 0;
+	while (received < count) {
+		// Only take what is already there
+		if (received > 0 && !WaitData(0))
+			break;
+		Datagram &datagram = datagrams[received];
+		datagram.size = receiveFrom(datagram.address, datagram.data, buffer_size);
+		if (datagram.size < 0)
+			break;
+		received++;
+	}
+	return received;
+}
+
+#endif
+
+int UDPSocket::Receive(Address &sender, void *data, int size)
+{
+	// Return on timeout
+	assert(m_timeout_ms >= 0);
+	if (!WaitData(m_timeout_ms))
+		return -1;
 
-		if (received < 0)
-			return -1;
+	return receiveFrom(sender, data, size);
+}
 
-		u32 address_ip = ntohl(address.sin_addr.s_addr);
-		u16 address_port = ntohs(address.sin_port);
+int UDPSocket::receiveFrom(Address &sender, void *data, int size)
+{
+	size = MYMAX(size, 0);
 
-		sender = Address(address_ip, address_port);
-	}
+	struct sockaddr_storage address;
+	memset(&address, 0, sizeof(address));
+	socklen_t address_len = sizeof(address);
+
+	int received = recvfrom(m_handle, (char *)data, size, 0,
+			(struct sockaddr *)&address, &address_len);
+
+	if (received < 0)
+		return -1;
 
+	sender = from_sockaddr(address);
 	return received;
 }
 
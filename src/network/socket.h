@@ -5,8 +5,7 @@
 #pragma once
 
 #include "irrlichttypes.h"
-
-class Address;
+#include "address.h"
 
 void sockets_init();
 void sockets_cleanup();
@@ -21,9 +20,29 @@ class UDPSocket
 
 	void Bind(Address addr);
 
+	struct Datagram {
+		Address address;
+		void *data = nullptr;
+		int size = 0;
+	};
+
+	// Maximum number of datagrams handled by one system call
+	static constexpr int BATCH_SIZE = 64;
+	// Interrupted sends of a datagram are retried this often
+	static constexpr int MAX_SEND_INTERRUPTS = 8;
+
 	void Send(const Address &destination, const void *data, int size);
+	// Sends all datagrams, using as few system calls as possible.
+	// Returns the number of datagrams that could not be sent
+	int SendBatch(const Datagram *datagrams, int count);
 	// Returns -1 if there is no data
 	int Receive(Address &sender, void *data, int size);
+	// Waits like Receive(), then reads up to `count` datagrams that are
+	// available. Each `data` must point to `buffer_size` bytes, `address`
+	// and `size` are set for the received datagrams.
+	// Returns the number of datagrams read, which can be 0 if there was
+	// nothing to read after all, or -1 on timeout or error
+	int ReceiveBatch(Datagram *datagrams, int count, int buffer_size);
 	void setTimeoutMs(int timeout_ms);
 	// Returns true if there is data, false if timeout occurred
 	bool WaitData(int timeout_ms);
@@ -32,6 +51,9 @@ class UDPSocket
 	int GetHandle() const { return m_handle; };
 
 private:
+	// Reads one datagram without waiting for it
+	int receiveFrom(Address &sender, void *data, int size);
+
 	int m_handle = -1;
 	int m_timeout_ms = -1;
 	unsigned short m_addr_family = 0;
@@ -9,6 +9,7 @@
 #include "irrlicht_changes/printing.h"
 #include "log.h"
 #include "debug.h"
+#include "profiler.h"
 #include "util/serialize.h"
 #include "constants.h" // MAP_BLOCKSIZE
 
@@ -111,14 +112,7 @@ void NodeMetadataList::serialize(std::ostream &os, u8 blockver, bool disk,
 	writeU8(os, version);
 	writeU16(os, count);
 
-	for (NodeMetadataMap::const_iterator
-			i = m_data.begin();
-			i != m_data.end(); ++i) {
-		v3s16 p = i->first;
-		NodeMetadata *data = i->second;
-		if (!include_empty && data->empty())
-			continue;
-
+	const auto write_pos = [&] (v3s16 p) {
 		if (absolute_pos) {
 			writeS16(os, p.X);
 			writeS16(os, p.Y);
@@ -130,8 +124,48 @@ void NodeMetadataList::serialize(std::ostream &os, u8 blockver, bool disk,
 			u16 p16 = (p.Z * MAP_BLOCKSIZE + p.Y) * MAP_BLOCKSIZE + p.X;
 			writeU16(os, p16);
 		}
+	};
+
+	for (NodeMetadataMap::const_iterator
+			i = m_data.begin();
+			i != m_data.end(); ++i) {
+		v3s16 p = i->first;
+		NodeMetadata *data = i->second;
+		if (!include_empty && data->empty())
+			continue;
+
+		write_pos(p);
 		data->serialize(os, version, disk);
 	}
+
+	for (const auto &it : m_lazy) {
+		const LazyEntry &entry = it.second;
+		if (!include_empty && entry.empty)
+			continue;
+
+		// The stored bytes are what serialize() would write, unless the
+		// format differs or private fields have to be left out
+		if (version == m_lazy_version && (disk || !entry.has_private)) {
+			write_pos(it.first);
+			os.write(&m_lazy_data[entry.offset], entry.size);
+			continue;
+		}
+
+		NodeMetadata data(m_item_def_mgr);
+		try {
+			std::istringstream is(m_lazy_data.substr(entry.offset, entry.size),
+				std::ios_base::binary);
+			data.deSerialize(is, m_lazy_version);
+		} catch (SerializationError &e) {
+			warningstream << "NodeMetadataList::serialize(): "
+				<< "broken data at position " << it.first
+				<< ": " << e.what() << std::endl;
+			// count is already written
+			data.clear();
+		}
+		write_pos(it.first);
+		data.serialize(os, version, disk);
+	}
 }
 
 void NodeMetadataList::deSerialize(std::istream &is,
@@ -155,6 +189,14 @@ void NodeMetadataList::deSerialize(std::istream &is,
 
 	u16 count = readU16(is);
 
+	// Only the lists of MapBlocks are worth it, the others are
+	// read to be used right away
+	const bool lazy = m_is_metadata_owner && !absolute_pos;
+	if (lazy) {
+		m_lazy_version = version;
+		m_item_def_mgr = item_def_mgr;
+	}
+
 	for (u16 i = 0; i < count; i++) {
 		v3s16 p;
 		if (absolute_pos) {
@@ -169,17 +211,116 @@ void NodeMetadataList::deSerialize(std::istream &is,
 			p16 /= MAP_BLOCKSIZE;
 			p.Z = p16;
 		}
-		if (m_data.find(p) != m_data.end()) {
+		if (m_data.find(p) != m_data.end() || m_lazy.find(p) != m_lazy.end()) {
 			warningstream << "NodeMetadataList::deSerialize(): "
 					<< "already set data at position " << p
 					<< ": Ignoring." << std::endl;
 			continue;
 		}
 
+		if (lazy) {
+			m_lazy[p] = readLazy(is, version);
+			continue;
+		}
+
 		NodeMetadata *data = new NodeMetadata(item_def_mgr);
 		data->deSerialize(is, version);
 		m_data[p] = data;
 	}
+
+	if (!m_lazy.empty()) {
+		g_profiler->add("NodeMetadataList: kept serialized [#]", m_lazy.size());
+		g_profiler->add("NodeMetadataList: kept serialized [B]", m_lazy_data.size());
+	}
+}
+
+NodeMetadataList::LazyEntry NodeMetadataList::readLazy(std::istream &is, u8 version)
+{
+	LazyEntry entry;
+	entry.offset = m_lazy_data.size();
+	entry.has_private = false;
+
+	// Appends the next n bytes of the stream to m_lazy_data
+	// @return pointer to them, valid until the next call
+	const auto copy = [&] (u32 n) -> const u8 * {
+		if (n > LONG_STRING_MAX_LEN)
+			throw SerializationError("NodeMetadataList: string too long");
+		const size_t pos = m_lazy_data.size();
+		m_lazy_data.resize(pos + n);
+		is.read(&m_lazy_data[pos], n);
+		if ((u32)is.gcount() != n)
+			throw SerializationError("NodeMetadataList: truncated data");
+		return reinterpret_cast<const u8 *>(&m_lazy_data[pos]);
+	};
+
+	// See NodeMetadata::deSerialize
+	const u32 num_vars = readU32(copy(4));
+	for (u32 i = 0; i < num_vars; i++) {
+		copy(readU16(copy(2)));
+		copy(readU32(copy(4)));
+		if (version >= 2 && readU8(copy(1)) == 1)
+			entry.has_private = true;
+	}
+
+	// See Inventory::deSerialize and InventoryList::deSerialize
+	bool has_lists = false;
+	bool in_list = false;
+	std::string line;
+	for (;;) {
+		if (!std::getline(is, line, '\n'))
+			throw SerializationError("NodeMetadataList: unterminated inventory");
+		m_lazy_data.append(line);
+		m_lazy_data.push_back('\n');
+
+		const std::string name = line.substr(0, line.find(' '));
+		if (in_list) {
+			if (name == "EndInventoryList" || name == "end")
+				in_list = false;
+		} else if (name == "EndInventory" || name == "end") {
+			break;
+		} else if (name == "List") {
+			has_lists = true;
+			in_list = true;
+		}
+	}
+
+	entry.size = m_lazy_data.size() - entry.offset;
+	entry.empty = num_vars == 0 && !has_lists;
+	return entry;
+}
+
+NodeMetadata *NodeMetadataList::parseLazy(v3s16 p, const LazyEntry &entry) const
+{
+	auto data = std::make_unique<NodeMetadata>(m_item_def_mgr);
+	try {
+		std::istringstream is(m_lazy_data.substr(entry.offset, entry.size),
+			std::ios_base::binary);
+		data->deSerialize(is, m_lazy_version);
+	} catch (SerializationError &e) {
+		warningstream << "NodeMetadataList: broken data at position " << p
+			<< ", dropping it: " << e.what() << std::endl;
+		return nullptr;
+	}
+	g_profiler->add("NodeMetadataList: parsed on access [#]", 1);
+	return data.release();
+}
+
+void NodeMetadataList::parseAll() const
+{
+	for (const auto &it : m_lazy) {
+		if (NodeMetadata *data = parseLazy(it.first, it.second))
+			m_data[it.first] = data;
+	}
+	m_lazy.clear();
+	m_lazy_data = std::string();
+}
+
+void NodeMetadataList::clearLazy()
+{
+	if (!m_lazy.empty())
+		g_profiler->add("NodeMetadataList: never parsed [#]", m_lazy.size());
+	m_lazy.clear();
+	m_lazy_data = std::string();
 }
 
 NodeMetadataList::~NodeMetadataList()
@@ -190,9 +331,11 @@ NodeMetadataList::~NodeMetadataList()
 std::vector<v3s16> NodeMetadataList::getAllKeys() const
 {
 	std::vector<v3s16> keys;
-	keys.reserve(m_data.size());
+	keys.reserve(size());
 	for (const auto &it : m_data)
 		keys.push_back(it.first);
+	for (const auto &it : m_lazy)
+		keys.push_back(it.first);
 
 	return keys;
 }
@@ -200,13 +343,27 @@ std::vector<v3s16> NodeMetadataList::getAllKeys() const
 NodeMetadata *NodeMetadataList::get(v3s16 p) const
 {
 	auto n = m_data.find(p);
-	if (n == m_data.end())
+	if (n != m_data.end())
+		return n->second;
+
+	auto lazy_it = m_lazy.find(p);
+	if (lazy_it == m_lazy.end())
 		return nullptr;
-	return n->second;
+	NodeMetadata *data = parseLazy(p, lazy_it->second);
+	m_lazy.erase(lazy_it);
+	if (m_lazy.empty())
+		m_lazy_data = std::string();
+	if (data)
+		m_data[p] = data;
+	return data;
 }
 
 std::unique_ptr<NodeMetadata> NodeMetadataList::remove(v3s16 p)
 {
+	// Nobody can hold a pointer to data that was never parsed
+	if (m_lazy.erase(p) > 0)
+		return nullptr;
+
 	std::unique_ptr<NodeMetadata> ret;
 	NodeMetadata *olddata = get(p);
 	if (olddata) {
@@ -231,6 +388,7 @@ std::unique_ptr<NodeMetadata> NodeMetadataList::set(v3s16 p, NodeMetadata *d)
 
 void NodeMetadataList::clear()
 {
+	clearLazy();
 	if (m_is_metadata_owner) {
 		for (auto it = m_data.begin(); it != m_data.end(); ++it)
 			delete it->second;
@@ -245,5 +403,9 @@ int NodeMetadataList::countNonEmpty() const
 		if (!it.second->empty())
 			n++;
 	}
+	for (const auto &it : m_lazy) {
+		if (!it.second.empty)
+			n++;
+	}
 	return n;
 }
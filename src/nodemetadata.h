@@ -7,6 +7,7 @@
 #include <unordered_set>
 #include <map>
 #include <memory>
+#include <string>
 #include "metadata.h"
 
 /*
@@ -58,6 +59,11 @@ class NodeMetadata : public SimpleMetadata
 
 /*
 	List of metadata of all the nodes of a block
+
+	A list that owns its metadata and uses block-relative positions (i.e.
+	the one of a MapBlock) keeps the entries in serialized form after
+	deSerialize() and only parses one when it's asked for. Entries that
+	were never asked for are written back as they were read.
 */
 
 typedef std::map<v3s16, NodeMetadata *> NodeMetadataMap;
@@ -91,10 +97,12 @@ class NodeMetadataList
 	/// @warning Make sure no pointers are still in use!
 	void clear();
 
-	size_t size() const { return m_data.size(); }
+	size_t size() const { return m_data.size() + m_lazy.size(); }
 
+	// Parses all entries
 	NodeMetadataMap::const_iterator begin() const
 	{
+		parseAll();
 		return m_data.begin();
 	}
 
@@ -104,10 +112,30 @@ class NodeMetadataList
 	}
 
 private:
+	// An entry that is still serialized, located in m_lazy_data
+	struct LazyEntry {
+		u32 offset;
+		u32 size;
+		bool empty;
+		bool has_private;
+	};
+
 	int countNonEmpty() const;
 
+	/// Copies the serialized entry at the stream position into m_lazy_data
+	LazyEntry readLazy(std::istream &is, u8 version);
+	/// @return the parsed entry or nullptr if it is broken
+	NodeMetadata *parseLazy(v3s16 p, const LazyEntry &entry) const;
+	void parseAll() const;
+	void clearLazy();
+
 	// FIXME: having a single class own or not own pointers depending on a variable
 	// is not clean and prevents refactoring this to unique_ptr...
 	const bool m_is_metadata_owner;
-	NodeMetadataMap m_data;
+	// Parsing moves entries from m_lazy to m_data, hence mutable
+	mutable NodeMetadataMap m_data;
+	mutable std::map<v3s16, LazyEntry> m_lazy;
+	mutable std::string m_lazy_data;
+	u8 m_lazy_version = 0;
+	IItemDefManager *m_item_def_mgr = nullptr;
 };
@@ -0,0 +1,137 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "nodepalette.h"
+#include <algorithm>
+
+// smallest supported index width for a palette of `size` entries
+static u8 index_bits_for(size_t size)
+{
+	if (size <= 1)
+		return 0;
+	if (size <= 2)
+		return 1;
+	if (size <= 4)
+		return 2;
+	if (size <= 16)
+		return 4;
+	return 8;
+}
+
+std::unique_ptr<PalettedNodes> PalettedNodes::create(const MapNode *nodes)
+{
+	std::unique_ptr<PalettedNodes> ret(new PalettedNodes());
+	auto &palette = ret->m_palette;
+
+	u8 indices[nodecount];
+	bool param1_uniform = true, param2_uniform = true;
+	content_t last_c = nodes[0].getContent();
+	u8 last_index = 0;
+	palette.push_back(last_c);
+	for (u32 i = 0; i < nodecount; i++) {
+		const MapNode &n = nodes[i];
+		param1_uniform &= n.param1 == nodes[0].param1;
+		param2_uniform &= n.param2 == nodes[0].param2;
+
+		const content_t c = n.getContent();
+		if (c != last_c) {
+			auto it = std::find(palette.begin(), palette.end(), c);
+			if (it == palette.end()) {
+				if (palette.size() == 256)
+					return nullptr;
+				it = palette.insert(it, c);
+			}
+			last_c = c;
+			last_index = it - palette.begin();
+		}
+		indices[i] = last_index;
+	}
+	palette.shrink_to_fit();
+
+	ret->m_index_bits = index_bits_for(palette.size());
+	ret->m_index_mask = (1 << ret->m_index_bits) - 1;
+	ret->m_indices = std::make_unique<u8[]>(indexBytes(ret->m_index_bits));
+	if (ret->m_index_bits > 0) {
+		for (u32 i = 0; i < nodecount; i++)
+			ret->setIndex(i, indices[i]);
+	}
+
+	if (param1_uniform) {
+		ret->m_param1_value = nodes[0].param1;
+	} else {
+		ret->m_param1 = std::make_unique<u8[]>(nodecount);
+		for (u32 i = 0; i < nodecount; i++)
+			ret->m_param1[i] = nodes[i].param1;
+	}
+	if (param2_uniform) {
+		ret->m_param2_value = nodes[0].param2;
+	} else {
+		ret->m_param2 = std::make_unique<u8[]>(nodecount);
+		for (u32 i = 0; i < nodecount; i++)
+			ret->m_param2[i] = nodes[i].param2;
+	}
+
+	return ret;
+}
+
+void PalettedNodes::decode(MapNode *nodes) const
+{
+	for (u32 i = 0; i < nodecount; i++)
+		nodes[i] = get(i);
+}
+
+bool PalettedNodes::set(u32 i, MapNode n)
+{
+	const content_t c = n.getContent();
+	auto it = std::find(m_palette.begin(), m_palette.end(), c);
+	const u8 index = it - m_palette.begin();
+	if (it == m_palette.end()) {
+		if (m_palette.size() == 256)
+			return false;
+		if (m_palette.size() > m_index_mask)
+			setIndexBits(index_bits_for(m_palette.size() + 1));
+		m_palette.push_back(c);
+	}
+	setIndex(i, index);
+
+	if (!m_param1 && n.param1 != m_param1_value) {
+		m_param1 = std::make_unique<u8[]>(nodecount);
+		std::fill_n(m_param1.get(), nodecount, m_param1_value);
+	}
+	if (m_param1)
+		m_param1[i] = n.param1;
+
+	if (!m_param2 && n.param2 != m_param2_value) {
+		m_param2 = std::make_unique<u8[]>(nodecount);
+		std::fill_n(m_param2.get(), nodecount, m_param2_value);
+	}
+	if (m_param2)
+		m_param2[i] = n.param2;
+
+	return true;
+}
+
+void PalettedNodes::setIndexBits(u8 bits)
+{
+	const u8 old_bits = m_index_bits, old_mask = m_index_mask;
+	auto old_indices = std::move(m_indices);
+
+	m_index_bits = bits;
+	m_index_mask = (1 << bits) - 1;
+	m_indices = std::make_unique<u8[]>(indexBytes(bits));
+	if (old_bits == 0)
+		return; // all zero
+
+	for (u32 i = 0; i < nodecount; i++) {
+		const u32 bit = i * old_bits;
+		setIndex(i, (old_indices[bit >> 3] >> (bit & 7)) & old_mask);
+	}
+}
+
+size_t PalettedNodes::getMemoryUsage() const
+{
+	return sizeof(*this) + m_palette.capacity() * sizeof(content_t) +
+		indexBytes(m_index_bits) +
+		(m_param1 ? nodecount : 0) + (m_param2 ? nodecount : 0);
+}
@@ -0,0 +1,78 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include "constants.h"
+#include "mapnode.h"
+#include <memory>
+#include <vector>
+
+/*
+	Compact storage for the nodes of a MapBlock.
+
+	The content ids are stored as 0, 1, 2, 4 or 8 bit indices into a list of
+	the contents present in the block (the palette). param1 and param2 are
+	stored as separate planes which only take a single byte while all nodes
+	have the same value.
+	A block that has up to 16 different contents and uniform param2 takes
+	about 6K instead of 16K this way, 2K if param1 is uniform too.
+*/
+class PalettedNodes
+{
+public:
+	static constexpr u32 nodecount = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+	/// @return nullptr if there are too many different contents (> 256)
+	static std::unique_ptr<PalettedNodes> create(const MapNode *nodes);
+
+	/// Writes all nodes to an array of `nodecount` nodes
+	void decode(MapNode *nodes) const;
+
+	inline MapNode get(u32 i) const
+	{
+		const u32 bit = i * m_index_bits;
+		const u8 index = (m_indices[bit >> 3] >> (bit & 7)) & m_index_mask;
+		return MapNode(m_palette[index],
+			m_param1 ? m_param1[i] : m_param1_value,
+			m_param2 ? m_param2[i] : m_param2_value);
+	}
+
+	/**
+	 * Changes a node in place, growing the indices or param planes as needed.
+	 * @return false if the node can't be stored, caller has to decode
+	 */
+	bool set(u32 i, MapNode n);
+
+	/// Contents that can occur in the block. After set() this may include
+	/// contents that are no longer present.
+	const std::vector<content_t> &getPalette() const { return m_palette; }
+
+	u8 getIndexBits() const { return m_index_bits; }
+
+	/// Approximate heap memory used
+	size_t getMemoryUsage() const;
+
+private:
+	PalettedNodes() = default;
+
+	static size_t indexBytes(u8 bits) { return (nodecount * bits + 7) / 8 + 1; }
+
+	inline void setIndex(u32 i, u8 index)
+	{
+		const u32 bit = i * m_index_bits;
+		u8 &byte = m_indices[bit >> 3];
+		byte = (byte & ~(m_index_mask << (bit & 7))) | (index << (bit & 7));
+	}
+
+	void setIndexBits(u8 bits);
+
+	std::vector<content_t> m_palette;
+	std::unique_ptr<u8[]> m_indices;
+	// nullptr if all nodes have m_paramX_value
+	std::unique_ptr<u8[]> m_param1, m_param2;
+	u8 m_param1_value = 0, m_param2_value = 0;
+	u8 m_index_bits = 0;
+	u8 m_index_mask = 0;
+};
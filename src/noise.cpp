@@ -31,12 +31,12 @@
 #include "util/numeric.h"
 #include "util/string.h"
 #include "exceptions.h"
+#include "noise_kernels.h"
 
-#define NOISE_MAGIC_X    1619
-#define NOISE_MAGIC_Y    31337
-#define NOISE_MAGIC_Z    52591
-// Unsigned magic seed prevents undefined behavior.
-#define NOISE_MAGIC_SEED 1013U
+// Same values on every platform, see CMakeLists.txt
+#ifdef _MSC_VER
+	#pragma fp_contract(off)
+#endif
 
 #define myfloor(x) ((x) < 0 ? (int)(x) - 1 : (int)(x))
 
@@ -491,15 +491,40 @@ void Noise::resizeNoiseBuf(bool is3d)
  * Another optimization that could save half as many noise calls is to carry over
  * values from the previous noise lattice as midpoints in the new lattice for the
  * next octave.
+ *
+ * The interpolation is done row by row: every lattice row is interpolated along
+ * x once, then the result rows are interpolated from those. This gives the same
+ * values as interpolating each point on its own and lets the kernels (see
+ * noise_kernels.h) work on whole rows.
  */
+void Noise::prepareColumns(float u, float step_x, bool eased)
+{
+	col_index.resize(sx);
+	col_weight.resize(sx);
+
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		col_index[i] = noisex;
+		col_weight[i] = eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+}
+
+
 #define idx(x, y) ((y) * nlx + (x))
 void Noise::valueMap2D(
 		float x, float y,
 		float step_x, float step_y,
 		s32 seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	const NoiseKernels &kernels = getNoiseKernels();
+	float u, v;
+	u32 j, noisey, row_y;
 	u32 nlx, nly;
 	s32 x0, y0;
 
@@ -508,42 +533,40 @@ void Noise::valueMap2D(
 	y0 = std::floor(y);
 	u = x - (float)x0;
 	v = y - (float)y0;
-	orig_u = u;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
 	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+		kernels.lattice_row(&noise_buf[idx(0, j)], x0,
+			noise_hash_base(y0 + j, 0, seed), nlx);
+
+	prepareColumns(u, step_x, eased);
+
+	// lattice rows noisey and noisey + 1, interpolated along x
+	row_buf.resize(2 * sx);
+	float *row0 = &row_buf[0], *row1 = &row_buf[sx];
+	auto lerp_lattice_row = [&] (float *out, u32 ny) {
+		kernels.lerp_gather_row(out, &noise_buf[idx(0, ny)],
+			col_index.data(), col_weight.data(), sx);
+	};
 
 	//calculate interpolations
-	index  = 0;
 	noisey = 0;
+	row_y = 0;
+	lerp_lattice_row(row0, 0);
+	lerp_lattice_row(row1, 1);
 	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			value_buf[index++] =
-				biLinearInterpolation(v00, v10, v01, v11, u, v, eased);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
+		if (row_y != noisey) {
+			// noisey only ever advances by one
+			std::swap(row0, row1);
+			lerp_lattice_row(row1, noisey + 1);
+			row_y = noisey;
 		}
 
+		kernels.lerp_row(&value_buf[j * sx], row0, row1,
+			eased ? easeCurve(v) : v, sx);
+
 		v += step_y;
 		if (v >= 1.0) {
 			v -= 1.0;
@@ -560,10 +583,9 @@ void Noise::valueMap3D(
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	const NoiseKernels &kernels = getNoiseKernels();
+	float u, v, w, orig_v;
+	u32 index, j, k, noisey, noisez, plane_z;
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
 
@@ -575,59 +597,52 @@ void Noise::valueMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
-	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
 	for (k = 0; k != nlz; k++)
 		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+			kernels.lattice_row(&noise_buf[idx(0, j, k)], x0,
+				noise_hash_base(y0 + j, z0 + k, seed), nlx);
+
+	prepareColumns(u, step_x, eased);
+
+	// lattice planes noisez and noisez + 1, all rows interpolated along x
+	row_buf.resize(2 * nly * sx);
+	float *plane0 = &row_buf[0], *plane1 = &row_buf[nly * sx];
+	auto lerp_lattice_plane = [&] (float *out, u32 nz) {
+		for (u32 ny = 0; ny != nly; ny++) {
+			kernels.lerp_gather_row(&out[ny * sx], &noise_buf[idx(0, ny, nz)],
+				col_index.data(), col_weight.data(), sx);
+		}
+	};
 
 	//calculate interpolations
 	index  = 0;
-	noisey = 0;
 	noisez = 0;
+	plane_z = 0;
+	lerp_lattice_plane(plane0, 0);
+	lerp_lattice_plane(plane1, 1);
 	for (k = 0; k != sz; k++) {
+		if (plane_z != noisez) {
+			// noisez only ever advances by one
+			std::swap(plane0, plane1);
+			lerp_lattice_plane(plane1, noisez + 1);
+			plane_z = noisez;
+		}
+
+		const float wl = eased ? easeCurve(w) : w;
 		v = orig_v;
 		noisey = 0;
 		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				value_buf[index++] = triLinearInterpolation(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w,
-					eased);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
+			kernels.lerp2_row(&value_buf[index],
+				&plane0[noisey * sx], &plane0[(noisey + 1) * sx],
+				&plane1[noisey * sx], &plane1[(noisey + 1) * sx],
+				eased ? easeCurve(v) : v, wl, sx);
+			index += sx;
 
 			v += step_y;
 			if (v >= 1.0) {
@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include <vector>
 #include "irr_v3d.h"
 #include "exceptions.h"
 #include "util/string.h"
@@ -194,8 +195,15 @@ class Noise {
 	}
 
 private:
+	// Lattice column and x weight per result column (see valueMap2D)
+	std::vector<u32> col_index;
+	std::vector<float> col_weight;
+	// Lattice rows interpolated along x
+	std::vector<float> row_buf;
+
 	void allocBuffers();
 	void resizeNoiseBuf(bool is3d);
+	void prepareColumns(float u, float step_x, bool eased);
 	void updateResults(float g, float *gmap, const float *persistence_map,
 			size_t bufsize);
 
@@ -239,3 +247,21 @@ inline float easeCurve(float t)
 }
 
 float contour(float v);
+
+/*
+	The bulk noise functions (Noise::noiseMap2D/3D) have SIMD implementations
+	that give exactly the same results as the scalar one. The best one
+	supported by the CPU is used by default.
+*/
+enum class NoiseKernelSet {
+	Auto, // best supported
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+/// Selects the implementation used by all Noise objects.
+/// @return false if not supported by this build or CPU
+/// @note Not meant to be called while noise is being generated (tests and benchmarks)
+bool setNoiseKernelSet(NoiseKernelSet set);
+const char *getNoiseKernelSetName();
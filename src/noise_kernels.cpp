@@ -0,0 +1,320 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+/*
+	Note: The results must not depend on the kernel set or the platform, so
+	this file and noise.cpp are compiled without floating point contraction
+	(no FMA), see CMakeLists.txt.
+	All versions do the exact same single precision operations in the same order.
+*/
+
+#include "noise_kernels.h"
+#include "noise.h"
+#include <atomic>
+
+#ifdef _MSC_VER
+	#pragma fp_contract(off)
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define NOISE_HAVE_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+#if defined(NOISE_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__)) && \
+		(defined(__x86_64__) || defined(__i386__))
+	#define NOISE_HAVE_AVX2 1
+	#include <immintrin.h>
+	#define NOISE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+	Scalar
+*/
+
+static inline float lattice_hash(u32 n)
+{
+	n &= 0x7fffffff;
+	n = (n >> 13) ^ n;
+	n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
+	return 1.f - (float)(int)n / 0x40000000;
+}
+
+static inline float lerp(float v0, float v1, float t)
+{
+	return v0 + (v1 - v0) * t;
+}
+
+static void lattice_row_scalar(float *out, s32 x0, u32 hash_base, u32 count)
+{
+	for (u32 i = 0; i < count; i++)
+		out[i] = lattice_hash((u32)NOISE_MAGIC_X * ((u32)x0 + i) + hash_base);
+}
+
+static void lerp_gather_row_scalar(float *out, const float *row,
+	const u32 *col, const float *t, u32 count)
+{
+	for (u32 i = 0; i < count; i++)
+		out[i] = lerp(row[col[i]], row[col[i] + 1], t[i]);
+}
+
+static void lerp_row_scalar(float *out, const float *a, const float *b,
+	float t, u32 count)
+{
+	for (u32 i = 0; i < count; i++)
+		out[i] = lerp(a[i], b[i], t);
+}
+
+static void lerp2_row_scalar(float *out, const float *a0, const float *a1,
+	const float *b0, const float *b1, float t, float t2, u32 count)
+{
+	for (u32 i = 0; i < count; i++)
+		out[i] = lerp(lerp(a0[i], a1[i], t), lerp(b0[i], b1[i], t), t2);
+}
+
+static const NoiseKernels kernels_scalar = {
+	"scalar",
+	lattice_row_scalar,
+	lerp_gather_row_scalar,
+	lerp_row_scalar,
+	lerp2_row_scalar,
+};
+
+/*
+	SSE2
+*/
+
+#ifdef NOISE_HAVE_SSE2
+
+// SSE2 has no 32-bit multiplication keeping the low half
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 lerp_sse2(__m128 v0, __m128 v1, __m128 t)
+{
+	return _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), t));
+}
+
+static void lattice_row_sse2(float *out, s32 x0, u32 hash_base, u32 count)
+{
+	const __m128i mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i magic_x = _mm_set1_epi32(NOISE_MAGIC_X);
+	const __m128i base = _mm_set1_epi32(hash_base);
+	const __m128i c1 = _mm_set1_epi32(60493);
+	const __m128i c2 = _mm_set1_epi32(19990303);
+	const __m128i c3 = _mm_set1_epi32(1376312589);
+	const __m128 scale = _mm_set1_ps(1.f / 0x40000000); // exact
+	const __m128 one = _mm_set1_ps(1.f);
+
+	__m128i x = _mm_add_epi32(_mm_set1_epi32(x0), _mm_setr_epi32(0, 1, 2, 3));
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i n = _mm_add_epi32(mullo_epi32_sse2(x, magic_x), base);
+		n = _mm_and_si128(n, mask);
+		n = _mm_xor_si128(_mm_srli_epi32(n, 13), n);
+		__m128i m = _mm_add_epi32(mullo_epi32_sse2(mullo_epi32_sse2(n, n), c1), c2);
+		n = _mm_and_si128(_mm_add_epi32(mullo_epi32_sse2(n, m), c3), mask);
+		__m128 v = _mm_sub_ps(one, _mm_mul_ps(_mm_cvtepi32_ps(n), scale));
+		_mm_storeu_ps(out + i, v);
+		x = _mm_add_epi32(x, _mm_set1_epi32(4));
+	}
+	for (; i < count; i++)
+		out[i] = lattice_hash((u32)NOISE_MAGIC_X * ((u32)x0 + i) + hash_base);
+}
+
+static void lerp_row_sse2(float *out, const float *a, const float *b,
+	float t, u32 count)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 v = lerp_sse2(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i), vt);
+		_mm_storeu_ps(out + i, v);
+	}
+	for (; i < count; i++)
+		out[i] = lerp(a[i], b[i], t);
+}
+
+static void lerp2_row_sse2(float *out, const float *a0, const float *a1,
+	const float *b0, const float *b1, float t, float t2, u32 count)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	const __m128 vt2 = _mm_set1_ps(t2);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = lerp_sse2(_mm_loadu_ps(a0 + i), _mm_loadu_ps(a1 + i), vt);
+		__m128 b = lerp_sse2(_mm_loadu_ps(b0 + i), _mm_loadu_ps(b1 + i), vt);
+		_mm_storeu_ps(out + i, lerp_sse2(a, b, vt2));
+	}
+	for (; i < count; i++)
+		out[i] = lerp(lerp(a0[i], a1[i], t), lerp(b0[i], b1[i], t), t2);
+}
+
+static const NoiseKernels kernels_sse2 = {
+	"SSE2",
+	lattice_row_sse2,
+	lerp_gather_row_scalar, // needs a gather instruction
+	lerp_row_sse2,
+	lerp2_row_sse2,
+};
+
+#endif
+
+/*
+	AVX2
+*/
+
+#ifdef NOISE_HAVE_AVX2
+
+NOISE_TARGET_AVX2
+static inline __m256 lerp_avx2(__m256 v0, __m256 v1, __m256 t)
+{
+	return _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), t));
+}
+
+NOISE_TARGET_AVX2
+static void lattice_row_avx2(float *out, s32 x0, u32 hash_base, u32 count)
+{
+	const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i magic_x = _mm256_set1_epi32(NOISE_MAGIC_X);
+	const __m256i base = _mm256_set1_epi32(hash_base);
+	const __m256i c1 = _mm256_set1_epi32(60493);
+	const __m256i c2 = _mm256_set1_epi32(19990303);
+	const __m256i c3 = _mm256_set1_epi32(1376312589);
+	const __m256 scale = _mm256_set1_ps(1.f / 0x40000000); // exact
+	const __m256 one = _mm256_set1_ps(1.f);
+
+	__m256i x = _mm256_add_epi32(_mm256_set1_epi32(x0),
+		_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i n = _mm256_add_epi32(_mm256_mullo_epi32(x, magic_x), base);
+		n = _mm256_and_si256(n, mask);
+		n = _mm256_xor_si256(_mm256_srli_epi32(n, 13), n);
+		__m256i m = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_mullo_epi32(n, n), c1), c2);
+		n = _mm256_and_si256(_mm256_add_epi32(_mm256_mullo_epi32(n, m), c3), mask);
+		__m256 v = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_cvtepi32_ps(n), scale));
+		_mm256_storeu_ps(out + i, v);
+		x = _mm256_add_epi32(x, _mm256_set1_epi32(8));
+	}
+	for (; i < count; i++)
+		out[i] = lattice_hash((u32)NOISE_MAGIC_X * ((u32)x0 + i) + hash_base);
+}
+
+NOISE_TARGET_AVX2
+static void lerp_gather_row_avx2(float *out, const float *row,
+	const u32 *col, const float *t, u32 count)
+{
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)(col + i));
+		__m256 v0 = _mm256_i32gather_ps(row, c, 4);
+		__m256 v1 = _mm256_i32gather_ps(row + 1, c, 4);
+		_mm256_storeu_ps(out + i, lerp_avx2(v0, v1, _mm256_loadu_ps(t + i)));
+	}
+	for (; i < count; i++)
+		out[i] = lerp(row[col[i]], row[col[i] + 1], t[i]);
+}
+
+NOISE_TARGET_AVX2
+static void lerp_row_avx2(float *out, const float *a, const float *b,
+	float t, u32 count)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 v = lerp_avx2(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), vt);
+		_mm256_storeu_ps(out + i, v);
+	}
+	for (; i < count; i++)
+		out[i] = lerp(a[i], b[i], t);
+}
+
+NOISE_TARGET_AVX2
+static void lerp2_row_avx2(float *out, const float *a0, const float *a1,
+	const float *b0, const float *b1, float t, float t2, u32 count)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	const __m256 vt2 = _mm256_set1_ps(t2);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 a = lerp_avx2(_mm256_loadu_ps(a0 + i), _mm256_loadu_ps(a1 + i), vt);
+		__m256 b = lerp_avx2(_mm256_loadu_ps(b0 + i), _mm256_loadu_ps(b1 + i), vt);
+		_mm256_storeu_ps(out + i, lerp_avx2(a, b, vt2));
+	}
+	for (; i < count; i++)
+		out[i] = lerp(lerp(a0[i], a1[i], t), lerp(b0[i], b1[i], t), t2);
+}
+
+static const NoiseKernels kernels_avx2 = {
+	"AVX2",
+	lattice_row_avx2,
+	lerp_gather_row_avx2,
+	lerp_row_avx2,
+	lerp2_row_avx2,
+};
+
+#endif
+
+/*
+	Selection
+*/
+
+static const NoiseKernels *getKernelSet(NoiseKernelSet set)
+{
+	switch (set) {
+	case NoiseKernelSet::Auto:
+		for (auto best : {NoiseKernelSet::AVX2, NoiseKernelSet::SSE2}) {
+			if (auto *kernels = getKernelSet(best))
+				return kernels;
+		}
+		return &kernels_scalar;
+	case NoiseKernelSet::Scalar:
+		return &kernels_scalar;
+	case NoiseKernelSet::SSE2:
+#ifdef NOISE_HAVE_SSE2
+		return &kernels_sse2;
+#else
+		return nullptr;
+#endif
+	case NoiseKernelSet::AVX2:
+#ifdef NOISE_HAVE_AVX2
+		if (__builtin_cpu_supports("avx2"))
+			return &kernels_avx2;
+#endif
+		return nullptr;
+	}
+	return nullptr;
+}
+
+static std::atomic<const NoiseKernels *> &currentKernels()
+{
+	static std::atomic<const NoiseKernels *> current{
+		getKernelSet(NoiseKernelSet::Auto)};
+	return current;
+}
+
+const NoiseKernels &getNoiseKernels()
+{
+	return *currentKernels().load(std::memory_order_relaxed);
+}
+
+bool setNoiseKernelSet(NoiseKernelSet set)
+{
+	auto *kernels = getKernelSet(set);
+	if (!kernels)
+		return false;
+	currentKernels().store(kernels);
+	return true;
+}
+
+const char *getNoiseKernelSetName()
+{
+	return getNoiseKernels().name;
+}
@@ -0,0 +1,48 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include "irrlichttypes.h"
+
+/*
+	Inner loops of the bulk noise functions (Noise::valueMap2D/3D).
+	There is a scalar version and SIMD versions of each which give exactly
+	the same results, the best one supported by the CPU is picked at runtime.
+*/
+
+#define NOISE_MAGIC_X    1619
+#define NOISE_MAGIC_Y    31337
+#define NOISE_MAGIC_Z    52591
+// Unsigned magic seed prevents undefined behavior.
+#define NOISE_MAGIC_SEED 1013U
+
+// Part of the lattice hash input that does not depend on x
+inline u32 noise_hash_base(s32 y, s32 z, s32 seed)
+{
+	return (u32)NOISE_MAGIC_Y * (u32)y + (u32)NOISE_MAGIC_Z * (u32)z +
+		NOISE_MAGIC_SEED * (u32)seed;
+}
+
+struct NoiseKernels {
+	const char *name;
+
+	// out[i] = noise value of lattice point x0 + i (same as noise2d/noise3d)
+	void (*lattice_row)(float *out, s32 x0, u32 hash_base, u32 count);
+
+	// out[i] = lerp(row[col[i]], row[col[i] + 1], t[i])
+	void (*lerp_gather_row)(float *out, const float *row,
+		const u32 *col, const float *t, u32 count);
+
+	// out[i] = lerp(a[i], b[i], t)
+	void (*lerp_row)(float *out, const float *a, const float *b,
+		float t, u32 count);
+
+	// out[i] = lerp(lerp(a0[i], a1[i], t), lerp(b0[i], b1[i], t), t2)
+	void (*lerp2_row)(float *out, const float *a0, const float *a1,
+		const float *b0, const float *b1, float t, float t2, u32 count);
+};
+
+// Currently selected kernels (see setNoiseKernelSet())
+const NoiseKernels &getNoiseKernels();
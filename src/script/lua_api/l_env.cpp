@@ -758,14 +758,89 @@ void ModApiEnvBase::collectNodeIds(lua_State *L, int idx, const NodeDefManager *
 	}
 }
 
-template <typename F>
+namespace {
+
+/*
+	Reads nodes from the map for the find_* functions, remembering the last
+	block so that lookups in it are cheap, and whether that block can contain
+	any of the wanted contents at all.
+*/
+class FilteredMapReader {
+public:
+	/// @param area where the nodes will be read, to decide if it is worth
+	///        counting the contents of a block
+	FilteredMapReader(Map &map, const std::vector<content_t> &filter,
+			const VoxelArea &area) :
+		m_map(map), m_filter(filter), m_area(area)
+	{}
+
+	MapNode getNode(v3s16 p)
+	{
+		lookup(p);
+		if (!m_block)
+			return MapNode(CONTENT_IGNORE);
+		return m_block->getNodeNoCheck(p - m_blockpos * MAP_BLOCKSIZE);
+	}
+
+	// false if the node can not be one of the filter contents
+	bool mayMatch(v3s16 p)
+	{
+		lookup(p);
+		return m_may_match;
+	}
+
+private:
+	void lookup(v3s16 p)
+	{
+		v3s16 bp = getNodeBlockPos(p);
+		if (m_valid && bp == m_blockpos)
+			return;
+		m_valid = true;
+		m_blockpos = bp;
+		m_block = m_map.getBlockNoCreateNoEx(bp);
+		// Counting only pays off if much of the block is read
+		v3s16 basep = bp * MAP_BLOCKSIZE;
+		VoxelArea block_area(basep, basep + v3s16(MAP_BLOCKSIZE - 1));
+		bool count = m_area.intersect(block_area).getVolume() >=
+			MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE / 4;
+		m_may_match = Map::blockMayContain(m_block, m_filter, count);
+	}
+
+	Map &m_map;
+	const std::vector<content_t> &m_filter;
+	const VoxelArea m_area;
+
+	bool m_valid = false;
+	v3s16 m_blockpos;
+	MapBlock *m_block = nullptr;
+	bool m_may_match = true;
+};
+
+// Cube around pos, clamped to the map range
+VoxelArea area_around(v3s16 pos, int radius)
+{
+	radius = rangelim(radius, 0, 2 * MAX_MAP_GENERATION_LIMIT);
+	auto clamp = [] (s32 c) -> s16 {
+		return rangelim(c, -MAX_MAP_GENERATION_LIMIT, MAX_MAP_GENERATION_LIMIT);
+	};
+	return VoxelArea(
+		v3s16(clamp(pos.X - radius), clamp(pos.Y - radius), clamp(pos.Z - radius)),
+		v3s16(clamp(pos.X + radius), clamp(pos.Y + radius), clamp(pos.Z + radius)));
+}
+
+}
+
+template <typename F, typename M>
 int ModApiEnvBase::findNodeNear(lua_State *L, v3s16 pos, int radius,
-		const std::vector<content_t> &filter, int start_radius, F &&getNode)
+		const std::vector<content_t> &filter, int start_radius, F &&getNode,
+		M &&mayMatch)
 {
 	for (int d = start_radius; d <= radius; d++) {
 		const std::vector<v3s16> &list = FacePositionCache::getFacePositions(d);
 		for (const v3s16 &i : list) {
 			v3s16 p = pos + i;
+			if (!mayMatch(p))
+				continue;
 			content_t c = getNode(p).getContent();
 			if (CONTAINS(filter, c)) {
 				push_v3s16(L, p);
@@ -796,10 +871,14 @@ int ModApiEnv::l_find_node_near(lua_State *L)
 		radius = client->CSMClampRadius(pos, radius);
 #endif
 
-	auto getNode = [&map] (v3s16 p) -> MapNode {
-		return map.getNode(p);
+	FilteredMapReader reader(map, filter, area_around(pos, radius));
+	auto getNode = [&reader] (v3s16 p) -> MapNode {
+		return reader.getNode(p);
 	};
-	return findNodeNear(L, pos, radius, filter, start_radius, getNode);
+	auto mayMatch = [&reader] (v3s16 p) -> bool {
+		return reader.mayMatch(p);
+	};
+	return findNodeNear(L, pos, radius, filter, start_radius, getNode, mayMatch);
 }
 
 void ModApiEnvBase::checkArea(v3s16 &minp, v3s16 &maxp)
@@ -915,23 +994,30 @@ int ModApiEnv::l_find_nodes_in_area(lua_State *L)
 	bool grouped = lua_isboolean(L, 4) && readParam<bool>(L, 4);
 
 	auto iterate = [&] (auto &&callback) {
-		map.forEachNodeInArea(minp, maxp, callback);
+		map.forEachNodeInArea(minp, maxp, &filter, callback);
 	};
 	return findNodesInArea(L, ndef, filter, grouped, iterate);
 }
 
-template <typename F>
+template <typename F, typename M>
 int ModApiEnvBase::findNodesInAreaUnderAir(lua_State *L, v3s16 minp, v3s16 maxp,
-	const std::vector<content_t> &filter, F &&getNode)
+	const std::vector<content_t> &filter, F &&getNode, M &&mayMatch)
 {
 	lua_newtable(L);
 	u32 i = 0;
 	v3s16 p;
 	for (p.X = minp.X; p.X <= maxp.X; p.X++)
 	for (p.Z = minp.Z; p.Z <= maxp.Z; p.Z++) {
-		p.Y = minp.Y;
-		content_t c = getNode(p).getContent();
-		for (; p.Y <= maxp.Y; p.Y++) {
+		content_t c = CONTENT_IGNORE;
+		// whether c is the content at p
+		bool have_c = false;
+		for (p.Y = minp.Y; p.Y <= maxp.Y; p.Y++) {
+			if (!mayMatch(p)) {
+				have_c = false;
+				continue;
+			}
+			if (!have_c)
+				c = getNode(p).getContent();
 			v3s16 psurf(p.X, p.Y + 1, p.Z);
 			content_t csurf = getNode(psurf).getContent();
 			if (c != CONTENT_AIR && csurf == CONTENT_AIR &&
@@ -940,6 +1026,7 @@ int ModApiEnvBase::findNodesInAreaUnderAir(lua_State *L, v3s16 minp, v3s16 maxp,
 				lua_rawseti(L, -2, ++i);
 			}
 			c = csurf;
+			have_c = true;
 		}
 	}
 	return 1;
@@ -972,10 +1059,14 @@ int ModApiEnv::l_find_nodes_in_area_under_air(lua_State *L)
 	std::vector<content_t> filter;
 	collectNodeIds(L, 3, ndef, filter);
 
-	auto getNode = [&map] (v3s16 p) -> MapNode {
-		return map.getNode(p);
+	FilteredMapReader reader(map, filter, VoxelArea(minp, maxp));
+	auto getNode = [&reader] (v3s16 p) -> MapNode {
+		return reader.getNode(p);
 	};
-	return findNodesInAreaUnderAir(L, minp, maxp, filter, getNode);
+	auto mayMatch = [&reader] (v3s16 p) -> bool {
+		return reader.mayMatch(p);
+	};
+	return findNodesInAreaUnderAir(L, minp, maxp, filter, getNode, mayMatch);
 }
 
 int ModApiEnv::l_get_value_noise(lua_State *L)
@@ -1509,7 +1600,10 @@ int ModApiEnvVM::l_find_node_near(lua_State *L)
 	auto getNode = [&vm] (v3s16 p) -> MapNode {
 		return vm->getNodeNoExNoEmerge(p);
 	};
-	return findNodeNear(L, pos, radius, filter, start_radius, getNode);
+	auto mayMatch = [] (v3s16 p) -> bool {
+		return true;
+	};
+	return findNodeNear(L, pos, radius, filter, start_radius, getNode, mayMatch);
 }
 
 int ModApiEnvVM::l_find_nodes_in_area(lua_State *L)
@@ -1568,7 +1662,10 @@ int ModApiEnvVM::l_find_nodes_in_area_under_air(lua_State *L)
 	auto getNode = [&vm] (v3s16 p) -> MapNode {
 		return vm->getNodeNoExNoEmerge(p);
 	};
-	return findNodesInAreaUnderAir(L, minp, maxp, filter, getNode);
+	auto mayMatch = [] (v3s16 p) -> bool {
+		return true;
+	};
+	return findNodesInAreaUnderAir(L, minp, maxp, filter, getNode, mayMatch);
 }
 
 int ModApiEnvVM::l_spawn_tree(lua_State *L)
@@ -20,9 +20,12 @@ class ModApiEnvBase : public ModApiBase {
 	static void checkArea(v3s16 &minp, v3s16 &maxp);
 
 	// F must be (v3s16 pos) -> MapNode
-	template <typename F>
+	// M must be (v3s16 pos) -> bool, returning false if the node at pos can
+	// not be in the filter
+	template <typename F, typename M>
 	static int findNodeNear(lua_State *L, v3s16 pos, int radius,
-		const std::vector<content_t> &filter, int start_radius, F &&getNode);
+		const std::vector<content_t> &filter, int start_radius, F &&getNode,
+		M &&mayMatch);
 
 	// F must be (G callback) -> void
 	// with G being (v3s16 p, MapNode n) -> bool
@@ -31,10 +34,10 @@ class ModApiEnvBase : public ModApiBase {
 	static int findNodesInArea(lua_State *L,  const NodeDefManager *ndef,
 		const std::vector<content_t> &filter, bool grouped, F &&iterate);
 
-	// F must be (v3s16 pos) -> MapNode
-	template <typename F>
+	// F and M like for findNodeNear
+	template <typename F, typename M>
 	static int findNodesInAreaUnderAir(lua_State *L, v3s16 minp, v3s16 maxp,
-		const std::vector<content_t> &filter, F &&getNode);
+		const std::vector<content_t> &filter, F &&getNode, M &&mayMatch);
 
 	static const EnumString es_ClearObjectsMode[];
 	static const EnumString es_BlockStatusType[];
@@ -1061,6 +1061,7 @@ int ObjectRef::l_set_observers(lua_State *L)
 	// Reset object to "unmanaged" (sent to everyone)?
 	if (lua_isnoneornil(L, 2)) {
 		sao->m_observers.reset();
+		sao->markVisibilityDirty();
 		return 0;
 	}
 
@@ -1082,6 +1083,7 @@ int ObjectRef::l_set_observers(lua_State *L)
 	}
 
 	sao->m_observers = std::move(observer_names);
+	sao->markVisibilityDirty();
 	return 0;
 }
 
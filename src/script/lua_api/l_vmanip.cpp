@@ -13,6 +13,7 @@
 #include "serverenvironment.h"
 #include "servermap.h"
 #include "voxelalgorithms.h"
+#include "util/enum_string.h"
 
 // raises error if the LuaVoxelManip outlived its vm
 LuaVoxelManip *LuaVoxelManip::checkObjectValid(lua_State *L, int narg)
@@ -398,6 +399,27 @@ int LuaVoxelManip::l_close(lua_State *L)
 	return 0;
 }
 
+int LuaVoxelManip::l_get_buffer(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	checkObjectValid(L, 1);
+
+	static const EnumString fields[] = {
+		{LuaVoxelBuffer::FIELD_CONTENT, "content"},
+		{LuaVoxelBuffer::FIELD_PARAM1, "param1"},
+		{LuaVoxelBuffer::FIELD_PARAM2, "param2"},
+		{0, nullptr},
+	};
+	int field = LuaVoxelBuffer::FIELD_CONTENT;
+	if (!lua_isnoneornil(L, 2) &&
+			!string_to_enum(fields, field, luaL_checkstring(L, 2)))
+		throw LuaError("VoxelManip:get_buffer: unknown field");
+
+	LuaVoxelBuffer::create(L, 1, static_cast<LuaVoxelBuffer::Field>(field));
+	return 1;
+}
+
 LuaVoxelManip::LuaVoxelManip(MMVManip *mmvm, bool is_mg_vm) :
 	is_mapgen_vm(is_mg_vm),
 	vm(mmvm)
@@ -514,5 +536,256 @@ const luaL_Reg LuaVoxelManip::methods[] = {
 	luamethod(LuaVoxelManip, was_modified),
 	luamethod(LuaVoxelManip, get_emerged_area),
 	luamethod(LuaVoxelManip, close),
+	luamethod(LuaVoxelManip, get_buffer),
+	{0,0}
+};
+
+/*
+  LuaVoxelBuffer
+ */
+
+namespace {
+
+// Value the tables of get_data() etc. would have
+inline u16 get_field(const MMVManip *vm, u32 i, LuaVoxelBuffer::Field field)
+{
+	const MapNode &n = vm->m_data[i];
+	const bool no_data = vm->m_flags[i] & VOXELFLAG_NO_DATA;
+	switch (field) {
+	case LuaVoxelBuffer::FIELD_CONTENT:
+		return no_data ? CONTENT_IGNORE : n.getContent();
+	case LuaVoxelBuffer::FIELD_PARAM1:
+		return no_data ? 0 : n.getParam1();
+	case LuaVoxelBuffer::FIELD_PARAM2:
+		return no_data ? 0 : n.getParam2();
+	}
+	return 0;
+}
+
+// Like set_data() etc. for a single value
+inline void set_field(MMVManip *vm, u32 i, LuaVoxelBuffer::Field field, u16 value)
+{
+	MapNode &n = vm->m_data[i];
+	switch (field) {
+	case LuaVoxelBuffer::FIELD_CONTENT:
+		n.setContent(value);
+		vm->m_flags[i] &= ~VOXELFLAG_NO_DATA;
+		break;
+	case LuaVoxelBuffer::FIELD_PARAM1:
+		n.setParam1(value);
+		break;
+	case LuaVoxelBuffer::FIELD_PARAM2:
+		n.setParam2(value);
+		break;
+	}
+}
+
+// Calls f(i) for the indices of all voxels of `area` inside the vm
+template <typename F>
+void for_each_index(const MMVManip *vm, const VoxelArea &area, const F &f)
+{
+	const VoxelArea a = vm->m_area.intersect(area);
+	if (a.hasEmptyExtent())
+		return;
+	for (s16 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s16 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
+		const u32 start = vm->m_area.index(a.MinEdge.X, y, z);
+		const u32 end = start + a.getExtent().X;
+		for (u32 i = start; i != end; i++)
+			f(i);
+	}
+}
+
+// Optional area at narg and narg + 1, defaults to the whole vm
+VoxelArea read_area(lua_State *L, int narg, const MMVManip *vm)
+{
+	if (lua_isnoneornil(L, narg))
+		return vm->m_area;
+	v3s16 pmin = check_v3s16(L, narg);
+	v3s16 pmax = check_v3s16(L, narg + 1);
+	sortBoxVerticies(pmin, pmax);
+	return VoxelArea(pmin, pmax);
+}
+
+}
+
+LuaVoxelBuffer::LuaVoxelBuffer(LuaVoxelManip *vmo, int vm_ref, Field field) :
+	vmo(vmo),
+	vm_ref(vm_ref),
+	field(field)
+{
+}
+
+LuaVoxelBuffer *LuaVoxelBuffer::checkObjectValid(lua_State *L, int narg)
+{
+	auto *o = checkObject<LuaVoxelBuffer>(L, narg);
+	if (!o->vmo->vm)
+		luaL_error(L, "LuaVoxelBuffer::checkObjectValid(): vm is null");
+	return o;
+}
+
+u32 LuaVoxelBuffer::checkIndex(lua_State *L, int narg, const MMVManip *vm)
+{
+	lua_Integer i = luaL_checkinteger(L, narg);
+	if (i < 1 || i > (lua_Integer)vm->m_area.getVolume())
+		throw LuaError("VoxelBuffer: index out of range");
+	return i - 1;
+}
+
+int LuaVoxelBuffer::gc_object(lua_State *L)
+{
+	LuaVoxelBuffer *o = takeObjectForGC<LuaVoxelBuffer>(L);
+	luaL_unref(L, LUA_REGISTRYINDEX, o->vm_ref);
+	delete o;
+
+	return 0;
+}
+
+// #buffer
+int LuaVoxelBuffer::l_len(lua_State *L)
+{
+	return l_get_size(L);
+}
+
+int LuaVoxelBuffer::l_get_size(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = checkObjectValid(L, 1);
+	lua_pushinteger(L, o->vmo->vm->m_area.getVolume());
+	return 1;
+}
+
+// get(self, i)
+int LuaVoxelBuffer::l_get(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = checkObjectValid(L, 1);
+	MMVManip *vm = o->vmo->vm;
+	u32 i = checkIndex(L, 2, vm);
+
+	lua_pushinteger(L, get_field(vm, i, o->field));
+	return 1;
+}
+
+// set(self, i, value)
+int LuaVoxelBuffer::l_set(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = checkObjectValid(L, 1);
+	MMVManip *vm = o->vmo->vm;
+	u32 i = checkIndex(L, 2, vm);
+
+	set_field(vm, i, o->field, luaL_checkinteger(L, 3));
+	return 0;
+}
+
+// fill(self, value, [p1, p2])
+int LuaVoxelBuffer::l_fill(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = checkObjectValid(L, 1);
+	MMVManip *vm = o->vmo->vm;
+	const u16 value = luaL_checkinteger(L, 2);
+	const VoxelArea area = read_area(L, 3, vm);
+	const Field field = o->field;
+
+	for_each_index(vm, area, [&] (u32 i) {
+		set_field(vm, i, field, value);
+	});
+	return 0;
+}
+
+// replace(self, old_value, new_value, [p1, p2])
+int LuaVoxelBuffer::l_replace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = checkObjectValid(L, 1);
+	MMVManip *vm = o->vmo->vm;
+	const u16 old_value = luaL_checkinteger(L, 2);
+	const u16 new_value = luaL_checkinteger(L, 3);
+	const VoxelArea area = read_area(L, 4, vm);
+	const Field field = o->field;
+
+	u32 count = 0;
+	for_each_index(vm, area, [&] (u32 i) {
+		if (get_field(vm, i, field) == old_value) {
+			set_field(vm, i, field, new_value);
+			count++;
+		}
+	});
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+// copy_from(self, src)
+int LuaVoxelBuffer::l_copy_from(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelBuffer *o = checkObjectValid(L, 1);
+	LuaVoxelBuffer *src = checkObjectValid(L, 2);
+	if (src->field != o->field)
+		throw LuaError("VoxelBuffer:copy_from: buffers are of different fields");
+
+	MMVManip *vm = o->vmo->vm;
+	const MMVManip *src_vm = src->vmo->vm;
+	if (src_vm == vm)
+		return 0;
+
+	// Same positions, so the rows of both match
+	const VoxelArea a = vm->m_area.intersect(src_vm->m_area);
+	if (a.hasEmptyExtent())
+		return 0;
+	const Field field = o->field;
+	for (s16 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s16 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
+		u32 i = vm->m_area.index(a.MinEdge.X, y, z);
+		u32 src_i = src_vm->m_area.index(a.MinEdge.X, y, z);
+		for (s32 x = 0; x < a.getExtent().X; x++, i++, src_i++) {
+			// Keep what we have where the source knows nothing
+			if (src_vm->m_flags[src_i] & VOXELFLAG_NO_DATA)
+				continue;
+			set_field(vm, i, field, get_field(src_vm, src_i, field));
+		}
+	}
+	return 0;
+}
+
+void LuaVoxelBuffer::create(lua_State *L, int vm_idx, Field field)
+{
+	auto *vmo = checkObject<LuaVoxelManip>(L, vm_idx);
+	lua_pushvalue(L, vm_idx);
+	int vm_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	LuaVoxelBuffer *o = new LuaVoxelBuffer(vmo, vm_ref, field);
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, className);
+	lua_setmetatable(L, -2);
+}
+
+void LuaVoxelBuffer::Register(lua_State *L)
+{
+	static const luaL_Reg metamethods[] = {
+		{"__len", l_len},
+		{"__gc", gc_object},
+		{0, 0}
+	};
+	registerClass<LuaVoxelBuffer>(L, methods, metamethods);
+}
+
+const char LuaVoxelBuffer::className[] = "VoxelBuffer";
+const luaL_Reg LuaVoxelBuffer::methods[] = {
+	luamethod(LuaVoxelBuffer, get_size),
+	luamethod(LuaVoxelBuffer, get),
+	luamethod(LuaVoxelBuffer, set),
+	luamethod(LuaVoxelBuffer, fill),
+	luamethod(LuaVoxelBuffer, replace),
+	luamethod(LuaVoxelBuffer, copy_from),
 	{0,0}
 };
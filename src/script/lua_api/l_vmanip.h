@@ -51,6 +51,8 @@ class LuaVoxelManip : public ModApiBase
 
 	static int l_close(lua_State *L);
 
+	static int l_get_buffer(lua_State *L);
+
 public:
 	MMVManip *vm = nullptr;
 
@@ -72,3 +74,51 @@ class LuaVoxelManip : public ModApiBase
 
 	static const char className[];
 };
+
+/*
+  VoxelBuffer: view of one field of the nodes in a VoxelManip
+ */
+class LuaVoxelBuffer : public ModApiBase
+{
+public:
+	enum Field : u8 {
+		FIELD_CONTENT,
+		FIELD_PARAM1,
+		FIELD_PARAM2,
+	};
+
+private:
+	// The VoxelManip, kept alive by vm_ref
+	LuaVoxelManip *vmo;
+	int vm_ref;
+	Field field;
+
+	static const luaL_Reg methods[];
+
+	// raises error if the VoxelManip has no vm anymore
+	static LuaVoxelBuffer *checkObjectValid(lua_State *L, int narg);
+	static u32 checkIndex(lua_State *L, int narg, const MMVManip *vm);
+
+	static int gc_object(lua_State *L);
+	static int l_len(lua_State *L);
+
+	static int l_get_size(lua_State *L);
+	static int l_get(lua_State *L);
+	static int l_set(lua_State *L);
+	static int l_fill(lua_State *L);
+	static int l_replace(lua_State *L);
+	static int l_copy_from(lua_State *L);
+
+public:
+	LuaVoxelBuffer(LuaVoxelManip *vmo, int vm_ref, Field field);
+	~LuaVoxelBuffer() = default;
+	DISABLE_CLASS_COPY(LuaVoxelBuffer)
+
+	// Not callable from Lua
+	// Creates a buffer of the VoxelManip at vm_idx, leaves it on top of stack
+	static void create(lua_State *L, int vm_idx, Field field);
+
+	static void Register(lua_State *L);
+
+	static const char className[];
+};
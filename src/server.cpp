@@ -29,9 +29,11 @@
 #include "server/player_sao.h"
 #include "server/rollback.h"
 #include "server/serveractiveobject.h"
+#include "server/serialized_block_cache.h"
 #include "server/serverinventorymgr.h"
 #include "server/serverlist.h"
 #include "settings.h"
+#include "threading/thread_pool.h"
 #include "translation.h"
 #include "util/base64.h"
 #include "util/hashing.h"
@@ -71,6 +73,7 @@
 #include "database/database-dummy.h"
 
 #include <iostream>
+#include <map>
 #include <queue>
 #include <algorithm>
 #include <sstream>
@@ -320,6 +323,9 @@ Server::Server(
 	if (!m_metrics_backend)
 		m_metrics_backend = std::make_unique<MetricsBackend>();
 
+	m_worker_pool = std::make_unique<ThreadPool>("ServerWorker",
+		ThreadPool::getAutoThreadCount(g_settings->getS32("server_threads"), 4));
+
 	m_uptime_counter = m_metrics_backend->addCounter("minetest_core_server_uptime", "Server uptime (in seconds)");
 	m_player_gauge = m_metrics_backend->addGauge("minetest_core_player_number", "Number of connected players");
 
@@ -490,6 +496,9 @@ void Server::init()
 	// Create emerge manager
 	m_emerge = std::make_unique<EmergeManager>(this, m_metrics_backend.get());
 
+	m_block_send_cache = std::make_unique<SerializedBlockCache>(
+		(size_t)g_settings->getU32("block_send_cache_size") * 1024 * 1024);
+
 	// Create ban manager
 	std::string ban_path = m_path_world + DIR_DELIM "ipban.txt";
 	m_banmanager = new BanManager(ban_path);
@@ -859,6 +868,7 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		// If we were to update observer sets eagerly in set_observers instead,
 		// the total costs of calls to set_observers could theoretically be higher.
 		m_env->invalidateActiveObjectObserverCaches();
+		m_env->beginActiveObjectVisibilityUpdate();
 
 		{
 			ClientInterface::AutoLock clientlock(m_clients);
@@ -1384,6 +1394,12 @@ void Server::setTimeOfDay(u32 time)
 
 void Server::onMapEditEvent(const MapEditEvent &event)
 {
+	// Events are dispatched with the environment locked
+	if (event.type != MEET_OTHER)
+		m_block_send_cache->invalidate(getNodeBlockPos(event.p));
+	for (v3s16 blockpos : event.modified_blocks)
+		m_block_send_cache->invalidate(blockpos);
+
 	if (m_ignore_map_edit_events_area.contains(event.getArea()))
 		return;
 
@@ -2231,10 +2247,9 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 
 	std::vector<std::pair<bool, u16>> removed_objects;
 	std::vector<u16> added_objects;
-	m_env->getRemovedActiveObjects(playersao, my_radius, player_radius,
-		client->m_known_objects, removed_objects);
-	m_env->getAddedActiveObjects(playersao, my_radius, player_radius,
-		client->m_known_objects, added_objects);
+	m_env->getActiveObjectChanges(playersao, my_radius, player_radius,
+		client->m_known_objects, client->m_known_objects_state,
+		removed_objects, added_objects);
 
 	if (removed_objects.empty() && added_objects.empty())
 		return;
@@ -2545,35 +2560,36 @@ void Server::sendMetadataChanged(const std::unordered_set<v3s16> &positions, flo
 	}
 }
 
-void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache)
+std::string Server::serializeBlockForNetwork(MapBlock *block, u8 ver)
 {
 	thread_local const int net_compression_level = rangelim(g_settings->getS16("map_compression_level_net"), -1, 9);
-	std::string s, *sptr = nullptr;
 
-	if (cache) {
-		auto it = cache->find({block->getPos(), ver});
-		if (it != cache->end())
-			sptr = &it->second;
-	}
+	std::ostringstream os(std::ios_base::binary);
+	block->serialize(os, ver, false, net_compression_level);
+	block->serializeNetworkSpecific(os);
+	return os.str();
+}
 
-	// Serialize the block in the right format
-	if (!sptr) {
-		std::ostringstream os(std::ios_base::binary);
-		block->serialize(os, ver, false, net_compression_level);
-		block->serializeNetworkSpecific(os);
-		s = os.str();
-		sptr = &s;
+void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
+		u16 net_proto_version, const std::string *data)
+{
+	SerializedBlockCache::Data cached;
+
+	if (!data) {
+		const u64 change_id = block->getChangeId();
+		cached = m_block_send_cache->get(block->getPos(), ver, change_id);
+		if (!cached) {
+			cached = std::make_shared<std::string>(
+				serializeBlockForNetwork(block, ver));
+			m_block_send_cache->put(block->getPos(), ver, change_id, cached);
+		}
+		data = cached.get();
 	}
 
-	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + sptr->size(), peer_id);
+	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + data->size(), peer_id);
 	pkt << block->getPos();
-	pkt.putRawString(*sptr);
+	pkt.putRawString(*data);
 	Send(&pkt);
-
-	// Store away in cache
-	if (cache && sptr == &s)
-		(*cache)[{block->getPos(), ver}] = std::move(s);
 }
 
 void Server::SendBlocks(float dtime)
@@ -2582,12 +2598,13 @@ void Server::SendBlocks(float dtime)
 
 	std::vector<PrioritySortedBlockTransfer> queue;
 
-	u32 total_sending = 0, unique_clients = 0;
+	u32 total_sending = 0;
 
 	{
 		ScopeProfiler sp2(g_profiler, "Server::SendBlocks(): Collect list");
 
 		std::vector<session_t> clients = m_clients.getClientIDs();
+		std::vector<EmergeObserver> observers;
 
 		ClientInterface::AutoLock clientlock(m_clients);
 		for (const session_t client_id : clients) {
@@ -2596,11 +2613,23 @@ void Server::SendBlocks(float dtime)
 			if (!client)
 				continue;
 
+			// Let the emerge threads know what this player needs
+			if (PlayerSAO *sao = getPlayerSAO(client_id)) {
+				v3f camera_dir(0, 0, 1);
+				camera_dir.rotateYZBy(sao->getLookPitch());
+				camera_dir.rotateXZBy(sao->getRotation().Y);
+				if (sao->getCameraInverted())
+					camera_dir = -camera_dir;
+				observers.push_back({client_id,
+					sao->getEyePosition() / (BS * MAP_BLOCKSIZE), camera_dir,
+					(s16)(sao->getWantedRange() + 1)});
+			}
+
 			total_sending += client->getSendingCount();
-			const auto old_count = queue.size();
 			client->GetNextBlocks(m_env, m_emerge.get(), dtime, queue);
-			unique_clients += queue.size() > old_count ? 1 : 0;
 		}
+
+		m_emerge->updateObservers(std::move(observers));
 	}
 
 	// Sort.
@@ -2618,11 +2647,26 @@ void Server::SendBlocks(float dtime)
 	ScopeProfiler sp(g_profiler, "Server::SendBlocks(): Send to clients");
 	Map &map = m_env->getMap();
 
-	SerializedBlockCache cache, *cache_ptr = nullptr;
-	if (unique_clients > 1) {
-		// caching is pointless with a single client
-		cache_ptr = &cache;
-	}
+	struct BlockToSend {
+		session_t peer_id;
+		MapBlock *block;
+		RemoteClient *client;
+		SerializedBlockCache::Data *data;
+	};
+	std::vector<BlockToSend> to_send;
+
+	// Every block is serialized only once per format, even if it goes out
+	// to several clients. Unchanged blocks are taken from the cache.
+	// (std::map so that the pointers stay valid)
+	std::map<std::pair<v3s16, u8>, SerializedBlockCache::Data> step_data;
+	struct BlockToSerialize {
+		MapBlock *block;
+		u8 ver;
+		u64 change_id;
+		SerializedBlockCache::Data *out;
+	};
+	std::vector<BlockToSerialize> to_serialize;
+	u32 cache_hits = 0;
 
 	for (const PrioritySortedBlockTransfer &block_to_send : queue) {
 		if (total_sending >= max_blocks_to_send)
@@ -2637,12 +2681,51 @@ void Server::SendBlocks(float dtime)
 		if (!client)
 			continue;
 
-		SendBlockNoLock(block_to_send.peer_id, block, client->serialization_version,
-				client->net_proto_version, cache_ptr);
+		const u8 ver = client->serialization_version;
+		auto [it, is_new] = step_data.try_emplace({block_to_send.pos, ver});
+		if (is_new) {
+			const u64 change_id = block->getChangeId();
+			it->second = m_block_send_cache->get(block_to_send.pos, ver, change_id);
+			if (it->second) {
+				cache_hits++;
+			} else {
+				// isAir() updates a cached value, do it before going parallel
+				block->isAir();
+				to_serialize.push_back({block, ver, change_id, &it->second});
+			}
+		}
 
-		client->SentBlock(block_to_send.pos);
+		to_send.push_back({block_to_send.peer_id, block, client, &it->second});
 		total_sending++;
 	}
+
+	// The environment stays locked, so the blocks can't change meanwhile
+	{
+		ScopeProfiler sp2(g_profiler, "Server::SendBlocks(): Serialize");
+		m_worker_pool->runShared(to_serialize.size(), [&] (size_t i) {
+			const BlockToSerialize &job = to_serialize[i];
+			*job.out = std::make_shared<std::string>(
+				serializeBlockForNetwork(job.block, job.ver));
+		});
+	}
+
+	for (const BlockToSerialize &job : to_serialize)
+		m_block_send_cache->put(job.block->getPos(), job.ver, job.change_id, *job.out);
+
+	if (!step_data.empty()) {
+		g_profiler->avg("Server::SendBlocks(): cache hit rate [%]",
+			100.0f * cache_hits / step_data.size());
+		g_profiler->avg("Server::SendBlocks(): cache size [MB]",
+			m_block_send_cache->getMemoryUsage() / (1024.0f * 1024.0f));
+	}
+
+	// Send in priority order
+	for (const BlockToSend &it : to_send) {
+		SendBlockNoLock(it.peer_id, it.block, it.client->serialization_version,
+				it.client->net_proto_version, it.data->get());
+
+		it.client->SentBlock(it.block->getPos());
+	}
 }
 
 bool Server::SendBlock(session_t peer_id, const v3s16 &blockpos)
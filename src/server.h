@@ -49,6 +49,8 @@ class ServerModManager;
 class ServerScripting;
 class ServerThread;
 class Settings;
+class ThreadPool;
+class SerializedBlockCache;
 
 struct ChatEventChat;
 struct ChatInterface;
@@ -333,6 +335,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	u16 allocateUnknownNodeId(const std::string &name) override;
 	IRollbackManager *getRollbackManager() override { return m_rollback; }
 	EmergeManager *getEmergeManager() { return m_emerge.get(); }
+	// Shared by everything that splits up work on the server
+	ThreadPool *getWorkerPool() { return m_worker_pool.get(); }
 	ModStorageDatabase *getModStorageDatabase() override { return m_mod_storage_database; }
 
 	IWritableItemDefManager* getWritableItemDefManager();
@@ -518,15 +522,6 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		std::unordered_set<session_t> waiting_players;
 	};
 
-	// The standard library does not implement std::hash for pairs so we have this:
-	struct SBCHash {
-		size_t operator() (const std::pair<v3s16, u16> &p) const {
-			return std::hash<v3s16>()(p.first) ^ p.second;
-		}
-	};
-
-	typedef std::unordered_map<std::pair<v3s16, u16>, std::string, SBCHash> SerializedBlockCache;
-
 	void init();
 
 	void SendMovement(session_t peer_id);
@@ -584,9 +579,12 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 			float far_d_nodes = 100);
 
 	// Environment and Connection must be locked when called
-	// `cache` may only be very short lived! (invalidation not handled)
+	// `data` is the serialized block if already known
 	void SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache = nullptr);
+		u16 net_proto_version, const std::string *data = nullptr);
+	// Serialize a block in network format. Only reads from the block, so
+	// different blocks can be serialized concurrently.
+	static std::string serializeBlockForNetwork(MapBlock *block, u8 ver);
 
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
@@ -708,6 +706,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Emerge manager
 	std::unique_ptr<EmergeManager> m_emerge;
 
+	// Workers shared by block sending, liquids, LBMs and mapgen
+	std::unique_ptr<ThreadPool> m_worker_pool;
+	// Blocks serialized for sending, protected by m_env_mutex
+	std::unique_ptr<SerializedBlockCache> m_block_send_cache;
+
 	// Item definition manager
 	IWritableItemDefManager *m_itemdef;
 
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: LGPL-2.1-or-later
 // Copyright (C) 2010-2018 nerzhul, Loic BLOT <loic.blot@unix-experience.fr>
 
+#include <algorithm>
 #include <log.h>
 #include "mapblock.h"
 #include "profiler.h"
@@ -10,6 +11,12 @@
 namespace server
 {
 
+ActiveObjectMgr::ActiveObjectMgr(SpatialIndexType index_type) :
+	m_spatial_index_type(index_type),
+	m_spatial_index(makeSpatialIndex(index_type))
+{
+}
+
 ActiveObjectMgr::~ActiveObjectMgr()
 {
 	if (!m_active_objects.empty()) {
@@ -19,6 +26,45 @@ ActiveObjectMgr::~ActiveObjectMgr()
 	}
 }
 
+std::variant<ActiveObjectMgr::KdTreeIndex, ActiveObjectMgr::HashGridIndex>
+ActiveObjectMgr::makeSpatialIndex(SpatialIndexType index_type)
+{
+	switch (index_type) {
+	case SpatialIndexType::HashGrid:
+		return HashGridIndex(HASH_GRID_CELL_SIZE);
+	case SpatialIndexType::KdTree:
+	default:
+		return KdTreeIndex();
+	}
+}
+
+bool ActiveObjectMgr::parseSpatialIndexType(const std::string &name,
+		SpatialIndexType &index_type)
+{
+	if (name == "kdtree")
+		index_type = SpatialIndexType::KdTree;
+	else if (name == "hashgrid")
+		index_type = SpatialIndexType::HashGrid;
+	else
+		return false;
+	return true;
+}
+
+void ActiveObjectMgr::setSpatialIndexType(SpatialIndexType index_type)
+{
+	if (index_type == m_spatial_index_type)
+		return;
+
+	m_spatial_index_type = index_type;
+	m_spatial_index = makeSpatialIndex(index_type);
+	std::visit([&](auto &index) {
+		for (auto &it : m_active_objects.iter()) {
+			if (it.second)
+				index.insert(it.second->getBasePosition().toArray(), it.first);
+		}
+	}, m_spatial_index);
+}
+
 void ActiveObjectMgr::clearIf(const std::function<bool(ServerActiveObject *, u16)> &cb)
 {
 	for (auto &it : m_active_objects.iter()) {
@@ -78,7 +124,11 @@ bool ActiveObjectMgr::registerObject(std::unique_ptr<ServerActiveObject> obj)
 
 	auto obj_id = obj->getId();
 	m_active_objects.put(obj_id, std::move(obj));
-	m_spatial_index.insert(pos.toArray(), obj_id);
+	std::visit([&](auto &index) {
+		index.insert(pos.toArray(), obj_id);
+	}, m_spatial_index);
+	m_visibility_cells[obj_id] = getVisibilityCell(pos);
+	m_visibility_dirty.insert(obj_id);
 
 	auto new_size = m_active_objects.size();
 	verbosestream << "Server::ActiveObjectMgr::addActiveObjectRaw(): "
@@ -102,7 +152,11 @@ void ActiveObjectMgr::removeObject(u16 id)
 		infostream << "Server::ActiveObjectMgr::removeObject(): "
 				<< "id=" << id << " not found" << std::endl;
 	} else {
-		m_spatial_index.remove(id);
+		std::visit([&](auto &index) {
+			index.remove(id);
+		}, m_spatial_index);
+		m_visibility_cells.erase(id);
+		m_visibility_dirty.insert(id);
 	}
 }
 
@@ -121,8 +175,30 @@ void ActiveObjectMgr::updateObjectPos(u16 id, v3f pos)
 	// HACK defensively only update if we already know the object,
 	// otherwise we're still waiting to be inserted into the index
 	// (or have already been removed).
-	if (m_active_objects.get(id))
-		m_spatial_index.update(pos.toArray(), id);
+	if (!m_active_objects.get(id))
+		return;
+	std::visit([&](auto &index) {
+		index.update(pos.toArray(), id);
+	}, m_spatial_index);
+
+	const v3s16 cell = getVisibilityCell(pos);
+	v3s16 &old_cell = m_visibility_cells[id];
+	if (cell != old_cell) {
+		old_cell = cell;
+		m_visibility_dirty.insert(id);
+	}
+}
+
+v3s16 ActiveObjectMgr::getVisibilityCell(v3f pos)
+{
+	return getNodeBlockPos(floatToInt(pos, BS));
+}
+
+void ActiveObjectMgr::takeVisibilityDirty(std::vector<u16> &ids)
+{
+	ids.assign(m_visibility_dirty.begin(), m_visibility_dirty.end());
+	std::sort(ids.begin(), ids.end());
+	m_visibility_dirty.clear();
 }
 
 void ActiveObjectMgr::getObjectsInsideRadius(v3f pos, float radius,
@@ -130,7 +206,7 @@ void ActiveObjectMgr::getObjectsInsideRadius(v3f pos, float radius,
 		std::function<bool(ServerActiveObject *obj)> include_obj_cb)
 {
 	float r_squared = radius * radius;
-	m_spatial_index.rangeQuery((pos - v3f(radius)).toArray(), (pos + v3f(radius)).toArray(), [&](auto objPos, u16 id) {
+	spatialIndexRangeQuery(pos - v3f(radius), pos + v3f(radius), [&](auto objPos, u16 id) {
 		if (v3f(objPos).getDistanceFromSQ(pos) > r_squared)
 			return;
 
@@ -146,7 +222,7 @@ void ActiveObjectMgr::getObjectsInArea(const aabb3f &box,
 		std::vector<ServerActiveObject *> &result,
 		std::function<bool(ServerActiveObject *obj)> include_obj_cb)
 {
-	m_spatial_index.rangeQuery(box.MinEdge.toArray(), box.MaxEdge.toArray(), [&](auto _, u16 id) {
+	spatialIndexRangeQuery(box.MinEdge, box.MaxEdge, [&](auto _, u16 id) {
 		auto obj = m_active_objects.get(id).get();
 		if (!obj)
 			return;
@@ -162,42 +238,53 @@ void ActiveObjectMgr::getAddedActiveObjectsAroundPos(
 		std::vector<u16> &added_objects)
 {
 	/*
-		Go through the object list,
+		Go through the objects near the player,
 		- discard removed/deactivated objects,
 		- discard objects that are too far away,
 		- discard objects that are found in current_objects,
 		- discard objects that are not observed by the player.
 		- add remaining objects to added_objects
 	*/
-	for (auto &ao_it : m_active_objects.iter()) {
-		u16 id = ao_it.first;
-
-		// Get object
-		ServerActiveObject *object = ao_it.second.get();
+	const auto consider = [&](u16 id, ServerActiveObject *object) {
 		if (!object)
-			continue;
+			return;
 
 		if (object->isGone())
-			continue;
+			return;
 
 		f32 distance_f = object->getBasePosition().getDistanceFrom(player_pos);
 		if (object->getType() == ACTIVEOBJECT_TYPE_PLAYER) {
 			// Discard if too far
 			if (distance_f > player_radius && player_radius != 0)
-				continue;
+				return;
 		} else if (distance_f > radius)
-			continue;
+			return;
 
 		if (!object->isEffectivelyObservedBy(player_name))
-			continue;
+			return;
 
 		// Discard if already on current_objects
 		auto n = current_objects.find(id);
 		if (n != current_objects.end())
-			continue;
+			return;
 		// Add to added_objects
 		added_objects.push_back(id);
+	};
+
+	// Players may be unlimited in range, then everything needs a look
+	if (player_radius == 0) {
+		for (auto &ao_it : m_active_objects.iter())
+			consider(ao_it.first, ao_it.second.get());
+		return;
 	}
+
+	const size_t first_added = added_objects.size();
+	const v3f range(std::max(radius, player_radius));
+	spatialIndexRangeQuery(player_pos - range, player_pos + range, [&](auto _, u16 id) {
+		consider(id, m_active_objects.get(id).get());
+	});
+	// Keep the id order of a full iteration
+	std::sort(added_objects.begin() + first_added, added_objects.end());
 }
 
 } // namespace server
@@ -7,17 +7,37 @@
 #include <functional>
 #include <vector>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
 #include "../activeobjectmgr.h"
+#include "constants.h"
 #include "serveractiveobject.h"
 #include "util/k_d_tree.h"
+#include "util/spatial_hash.h"
 
 namespace server
 {
 class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 {
 public:
+	enum class SpatialIndexType {
+		// Fast queries, moves need to rebuild trees now and then
+		KdTree,
+		// Constant time moves, queries scale with the area covered
+		HashGrid,
+	};
+
+	ActiveObjectMgr(SpatialIndexType index_type = SpatialIndexType::KdTree);
 	~ActiveObjectMgr() override;
 
+	/// Switches to another spatial index, rebuilding it from the objects
+	void setSpatialIndexType(SpatialIndexType index_type);
+	SpatialIndexType getSpatialIndexType() const { return m_spatial_index_type; }
+	/// @return false if the name is unknown
+	static bool parseSpatialIndexType(const std::string &name,
+			SpatialIndexType &index_type);
+
 	// If cb returns true, the obj will be deleted
 	void clearIf(const std::function<bool(ServerActiveObject *, u16)> &cb);
 	void step(float dtime,
@@ -29,6 +49,15 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 
 	void updateObjectPos(u16 id, v3f pos);
 
+	/// Mapblock an object is in, as far as tracking visibility goes
+	static v3s16 getVisibilityCell(v3f pos);
+	/// Remembers that players may have to learn about a change of the object.
+	/// Objects that are added, removed or move to another cell are marked
+	/// automatically.
+	void markVisibilityDirty(u16 id) { m_visibility_dirty.insert(id); }
+	/// Moves the ids marked since the last call into `ids`, sorted
+	void takeVisibilityDirty(std::vector<u16> &ids);
+
 	void getObjectsInsideRadius(v3f pos, float radius,
 			std::vector<ServerActiveObject *> &result,
 			std::function<bool(ServerActiveObject *obj)> include_obj_cb);
@@ -42,6 +71,27 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 			std::vector<u16> &added_objects);
 
 private:
-	k_d_tree::DynamicKdTrees<3, f32, u16> m_spatial_index;
+	using KdTreeIndex = k_d_tree::DynamicKdTrees<3, f32, u16>;
+	using HashGridIndex = spatial_hash::SpatialHashGrid<f32, u16>;
+
+	// Cell size of the hash grid, one mapblock
+	static constexpr f32 HASH_GRID_CELL_SIZE = MAP_BLOCKSIZE * BS;
+
+	static std::variant<KdTreeIndex, HashGridIndex> makeSpatialIndex(
+			SpatialIndexType index_type);
+
+	template<typename F>
+	void spatialIndexRangeQuery(v3f min, v3f max, const F &cb) const
+	{
+		std::visit([&](const auto &index) {
+			index.rangeQuery(min.toArray(), max.toArray(), cb);
+		}, m_spatial_index);
+	}
+
+	SpatialIndexType m_spatial_index_type;
+	std::variant<KdTreeIndex, HashGridIndex> m_spatial_index;
+
+	std::unordered_map<u16, v3s16> m_visibility_cells;
+	std::unordered_set<u16> m_visibility_dirty;
 };
 } // namespace server
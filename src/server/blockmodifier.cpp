@@ -34,8 +34,6 @@ struct ActiveABM
 	s16 min_y, max_y;
 };
 
-#define CONTENT_TYPE_CACHE_MAX 64
-
 ABMHandler::ABMHandler(std::vector<ABMWithState> &abms,
 	float dtime_s, ServerEnvironment *env,
 	bool use_timers):
@@ -135,22 +133,17 @@ void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int
 	if (m_aabms.empty())
 		return;
 
-	// Check the content type cache first
-	// to see whether there are any ABMs
-	// to be run at all for this block.
-	if (!block->contents.empty()) {
-		assert(!block->do_not_cache_contents); // invariant
+	// Look up which contents have ABMs to be run in the content counts,
+	// only those nodes have to be visited.
+	if (block->hasContentCounts())
 		blocks_cached++;
-		bool run_abms = false;
-		for (content_t c : block->contents) {
-			if (c < m_aabms.size() && m_aabms[c]) {
-				run_abms = true;
-				break;
-			}
-		}
-		if (!run_abms)
-			return;
+	u32 trigger_nodes = 0;
+	for (const auto &it : block->getContentCounts()) {
+		if (it.first < m_aabms.size() && m_aabms[it.first])
+			trigger_nodes += it.second;
 	}
+	if (trigger_nodes == 0)
+		return;
 	blocks_scanned++;
 
 	ServerMap *map = &m_env->getServerMap();
@@ -159,31 +152,22 @@ void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int
 	u32 active_object_count = countObjects(block, map, active_object_count_wider);
 	m_env->m_added_objects = 0;
 
-	bool want_contents_cached = block->contents.empty() && !block->do_not_cache_contents;
-
 	v3s16 p0;
 	for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
 	for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
 	for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
 	{
+		// Done if all trigger nodes were visited. This no longer holds
+		// once an ABM ran since it may have placed more.
+		if (trigger_nodes == 0)
+			return;
+
 		MapNode n = block->getNodeNoCheck(p0);
 		content_t c = n.getContent();
 
-		// Cache content types as we go
-		if (want_contents_cached && !CONTAINS(block->contents, c)) {
-			if (block->contents.size() >= CONTENT_TYPE_CACHE_MAX) {
-				// Too many different nodes... don't try to cache
-				want_contents_cached = false;
-				block->do_not_cache_contents = true;
-				decltype(block->contents) empty;
-				std::swap(block->contents, empty);
-			} else {
-				block->contents.push_back(c);
-			}
-		}
-
 		if (c >= m_aabms.size() || !m_aabms[c])
 			continue;
+		trigger_nodes--;
 
 		v3s16 p = p0 + block->getPosRelative();
 		for (ActiveABM &aabm : *m_aabms[c]) {
@@ -238,6 +222,7 @@ void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int
 neighbor_found:
 
 			abms_run++;
+			trigger_nodes = U32_MAX;
 			// Call all the trigger variations
 			aabm.abm->trigger(m_env, p, n);
 			aabm.abm->trigger(m_env, p, n,
@@ -446,33 +431,34 @@ std::unordered_map<std::string, u32>
 	return ret;
 }
 
-namespace {
-	struct LBMToRun {
-		std::unordered_set<v3s16> p; // node positions
-		std::vector<LoadingBlockModifierDef*> l; // ordered list of LBMs
-
-		template <typename C>
-		void insertLBMs(const C &container) {
-			for (auto &it : container) {
-				if (!CONTAINS(l, it))
-					l.push_back(it);
-			}
-		}
-	};
-}
-
 void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block,
 		const u32 stamp, const float dtime_s)
+{
+	LBMRunList to_run;
+	collectLBMs(block, stamp, to_run);
+	runLBMs(env, block, to_run, dtime_s);
+}
+
+void LBMManager::collectLBMs(MapBlock *block, const u32 stamp,
+		LBMRunList &to_run) const
 {
 	// Precondition, we need m_lbm_lookup to be initialized
 	FATAL_ERROR_IF(!m_query_mode,
 		"attempted to query on non fully set up LBMManager");
 
-	// Collect a list of all LBMs and associated positions
-	std::unordered_map<content_t, LBMToRun> to_run;
-
 	// Note: the iteration count of this outer loop is typically very low, so it's ok.
 	for (auto it = getLBMsIntroducedAfter(stamp); it != m_lbm_lookup.end(); ++it) {
+		// Most blocks contain none of the trigger contents, don't scan those
+		bool any = false;
+		for (auto &cc : block->getContentCounts()) {
+			if (it->second.lookup(cc.first)) {
+				any = true;
+				break;
+			}
+		}
+		if (!any)
+			continue;
+
 		v3s16 pos;
 		content_t c;
 
@@ -506,9 +492,11 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block,
 			}
 		}
 	}
+}
 
-	// Actually run them
-	bool first = true;
+void LBMManager::runLBMs(ServerEnvironment *env, MapBlock *block,
+		LBMRunList &to_run, const float dtime_s)
+{
 	for (auto &[c, batch] : to_run) {
 		if (tracestream) {
 			tracestream << "Running " << batch.l.size() << " LBMs for node "
@@ -516,21 +504,17 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block,
 				<< batch.p.size() << "x) in block " << block->getPos() << std::endl;
 		}
 		for (auto &lbm_def : batch.l) {
-			if (!first) {
-				// The fun part: since any LBM call can change the nodes inside of the
-				// block, we have to recheck the positions to see if the wanted node
-				// is still there.
-				// Note that we don't rescan the whole block, we don't want to include new changes.
-				for (auto it2 = batch.p.begin(); it2 != batch.p.end(); ) {
-					if (block->getNodeNoCheck(*it2).getContent() != c)
-						it2 = batch.p.erase(it2);
-					else
-						++it2;
-				}
-			} else {
-				assert(!batch.p.empty());
+			// The fun part: since any LBM call (or anything else since the
+			// positions were collected) can change the nodes inside of the
+			// block, we have to recheck the positions to see if the wanted node
+			// is still there.
+			// Note that we don't rescan the whole block, we don't want to include new changes.
+			for (auto it2 = batch.p.begin(); it2 != batch.p.end(); ) {
+				if (block->getNodeNoCheck(*it2).getContent() != c)
+					it2 = batch.p.erase(it2);
+				else
+					++it2;
 			}
-			first = false;
 
 			if (batch.p.empty())
 				break;
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
@@ -129,6 +130,22 @@ class LBMContentMapping
 	lbm_map map;
 };
 
+// LBMs to run for one content and the positions of that content in a block
+struct LBMToRun {
+	std::unordered_set<v3s16> p; // node positions (block-relative)
+	std::vector<LoadingBlockModifierDef*> l; // ordered list of LBMs
+
+	template <typename C>
+	void insertLBMs(const C &container) {
+		for (auto &it : container) {
+			if (!CONTAINS(l, it))
+				l.push_back(it);
+		}
+	}
+};
+
+typedef std::unordered_map<content_t, LBMToRun> LBMRunList;
+
 class LBMManager
 {
 public:
@@ -149,6 +166,21 @@ class LBMManager
 	void applyLBMs(ServerEnvironment *env, MapBlock *block,
 			u32 stamp, float dtime_s);
 
+	/**
+	 * First half of applyLBMs(): finds the LBMs to run on a block and where.
+	 * Does not call into Lua, so it may run on any thread as long as no one
+	 * else uses the block. Don't call this before loadIntroductionTimes() ran.
+	 * @param stamp timestamp of the block before it was activated
+	 */
+	void collectLBMs(MapBlock *block, u32 stamp, LBMRunList &to_run) const;
+
+	/**
+	 * Second half of applyLBMs(): runs what collectLBMs() found. Positions
+	 * where the content changed in the meantime are skipped.
+	 */
+	static void runLBMs(ServerEnvironment *env, MapBlock *block,
+			LBMRunList &to_run, float dtime_s);
+
 	// Warning: do not make this std::unordered_map, order is relevant here
 	typedef std::map<u32, LBMContentMapping> lbm_lookup_map;
 
@@ -172,6 +204,6 @@ class LBMManager
 	// Returns an iterator to the LBMs that were introduced
 	// after the given time. This is guaranteed to return
 	// valid values for everything
-	lbm_lookup_map::const_iterator getLBMsIntroducedAfter(u32 time)
+	lbm_lookup_map::const_iterator getLBMsIntroducedAfter(u32 time) const
 	{ return m_lbm_lookup.lower_bound(time); }
 };
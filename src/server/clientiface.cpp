@@ -10,6 +10,7 @@
 #include "network/networkpacket.h"
 #include "network/serveropcodes.h"
 #include "porting.h" // porting::getTimeS
+#include "profiler.h"
 #include "remoteplayer.h"
 #include "serialization.h" // SER_FMT_VER_INVALID
 #include "settings.h"
@@ -105,6 +106,7 @@ void RemoteClient::GetNextBlocks (
 				<< std::endl;
 		m_map_send_completion_timer = 0.0f;
 		m_nearest_unsent_d = 0;
+		m_nearest_unsent_index = 0;
 	}
 
 	if (m_nothing_to_send_pause_timer >= 0)
@@ -190,6 +192,7 @@ void RemoteClient::GetNextBlocks (
 	*/
 	if (m_last_center != center) {
 		m_nearest_unsent_d = 0;
+		m_nearest_unsent_index = 0;
 		m_last_center = center;
 		m_map_send_completion_timer = 0.0f;
 	}
@@ -197,6 +200,7 @@ void RemoteClient::GetNextBlocks (
 	// (this matches isBlockInSight which allows for an extra 10%)
 	if (camera_dir.dotProduct(m_last_camera_dir) < std::cos(camera_fov * 0.1f)) {
 		m_nearest_unsent_d = 0;
+		m_nearest_unsent_index = 0;
 		m_last_camera_dir = camera_dir;
 		m_map_send_completion_timer = 0.0f;
 	}
@@ -243,9 +247,40 @@ void RemoteClient::GetNextBlocks (
 		camera_fov = camera_fov / (1 + dot / 300.0f);
 	}
 
+	/*
+		Positions skipped earlier in the current shell might qualify now if
+		the view turned or got wider or the distance limits went up, so look
+		at the whole shell again.
+		Turns below the threshold above don't restart at d = 0, but they can
+		still bring positions of the current shell into sight. Turning less
+		than ~10 degrees is ignored here too, the camera direction changes
+		on almost every update.
+	*/
+	constexpr f32 INDEX_TURN_THRESHOLD = 0.985f;
+	if (camera_dir.dotProduct(m_index_camera_dir) < INDEX_TURN_THRESHOLD ||
+			camera_fov > m_last_camera_fov * 1.01f ||
+			d_opt > m_last_d_opt || d_max_gen > m_last_d_max_gen)
+		m_nearest_unsent_index = 0;
+	if (m_nearest_unsent_index == 0) {
+		m_index_camera_dir = camera_dir;
+		m_last_camera_fov = camera_fov;
+	} else {
+		// The narrowest view any of the skipped positions were checked with
+		m_last_camera_fov = std::min(m_last_camera_fov, camera_fov);
+	}
+	m_last_d_opt = d_opt;
+	m_last_d_max_gen = d_max_gen;
+
+	// Where to continue next time: the first position that was selected
+	// (it might not actually get sent) or queued for emerging
 	s32 nearest_emerged_d = -1;
+	u32 nearest_emerged_index = 0;
 	s32 nearest_sent_d = -1;
-	//bool queue_is_full = false;
+	u32 nearest_sent_index = 0;
+	u32 full_index = 0;
+
+	u32 num_examined = 0;
+	u32 num_selected_now = 0;
 
 	const v3s16 cam_pos_nodes = floatToInt(camera_pos, BS);
 
@@ -257,8 +292,10 @@ void RemoteClient::GetNextBlocks (
 		*/
 		const auto &list = FacePositionCache::getFacePositions(d);
 
-		for (auto li = list.begin(); li != list.end(); ++li) {
-			v3s16 p = *li + center;
+		const u32 index_start = d == d_start ? m_nearest_unsent_index : 0;
+		for (u32 i = index_start; i < list.size(); i++) {
+			v3s16 p = list[i] + center;
+			num_examined++;
 
 			/*
 				Send throttling
@@ -310,7 +347,7 @@ void RemoteClient::GetNextBlocks (
 
 			// Don't select too many blocks for sending
 			if (num_blocks_selected >= max_simul_dynamic) {
-				//queue_is_full = true;
+				full_index = i;
 				goto queue_full_break;
 			}
 
@@ -364,16 +401,22 @@ void RemoteClient::GetNextBlocks (
 				Add inexistent block to emerge queue.
 			*/
 			if (want_emerge) {
-				if (nearest_emerged_d == -1)
+				if (nearest_emerged_d == -1) {
 					nearest_emerged_d = d;
-				if (emerge->enqueueBlockEmerge(peer_id, p, generate))
+					nearest_emerged_index = i;
+				}
+				if (emerge->enqueueBlockEmerge(peer_id, p, generate)) {
 					continue;
-				else
+				} else {
+					full_index = i;
 					goto queue_full_break;
+				}
 			}
 
-			if (nearest_sent_d == -1)
+			if (nearest_sent_d == -1) {
 				nearest_sent_d = d;
+				nearest_sent_index = i;
+			}
 
 			/*
 				Add block to send queue
@@ -381,14 +424,20 @@ void RemoteClient::GetNextBlocks (
 			dest.emplace_back((float)dist, p, peer_id);
 
 			num_blocks_selected += 1;
+			num_selected_now += 1;
 		}
 	}
 queue_full_break:
 
+	g_profiler->add("RemoteClient::GetNextBlocks(): candidates examined", num_examined);
+	g_profiler->add("RemoteClient::GetNextBlocks(): candidates selected", num_selected_now);
+
 	// If nothing was found for sending and nothing was queued for
 	// emerging, continue next time browsing from here
+	u32 new_nearest_unsent_index = 0;
 	if (nearest_emerged_d != -1) {
 		new_nearest_unsent_d = nearest_emerged_d;
+		new_nearest_unsent_index = nearest_emerged_index;
 	} else {
 		if (d > full_d_max) {
 			new_nearest_unsent_d = 0;
@@ -398,17 +447,24 @@ void RemoteClient::GetNextBlocks (
 				<< m_map_send_completion_timer << "s, restarting" << std::endl;
 			m_map_send_completion_timer = 0.0f;
 		} else {
-			if (nearest_sent_d != -1)
+			if (nearest_sent_d != -1) {
 				new_nearest_unsent_d = nearest_sent_d;
-			else
+				new_nearest_unsent_index = nearest_sent_index;
+			} else {
+				// either stopped in the middle of shell d or it's a new one
 				new_nearest_unsent_d = d;
+				new_nearest_unsent_index = full_index;
+			}
 		}
 	}
 
-	if (new_nearest_unsent_d != -1 && m_nearest_unsent_d != new_nearest_unsent_d) {
-		m_nearest_unsent_d = new_nearest_unsent_d;
-		// if the distance has changed, clear the occlusion cache
-		m_blocks_occ.clear();
+	if (new_nearest_unsent_d != -1) {
+		if (m_nearest_unsent_d != new_nearest_unsent_d) {
+			m_nearest_unsent_d = new_nearest_unsent_d;
+			// if the distance has changed, clear the occlusion cache
+			m_blocks_occ.clear();
+		}
+		m_nearest_unsent_index = new_nearest_unsent_index;
 	}
 }
 
@@ -449,8 +505,11 @@ void RemoteClient::SetBlockNotSent(v3s16 p, bool low_priority)
 
 		// If this is a low priority event (and not close), do not reset m_nearest_unsent_d.
 		// Instead, the send loop will get to the block in the next full loop iteration.
-		if (!low_priority || this_d < m_block_cull_optimize_distance) {
-			m_nearest_unsent_d = std::min(m_nearest_unsent_d, this_d);
+		if ((!low_priority || this_d < m_block_cull_optimize_distance) &&
+				this_d <= m_nearest_unsent_d) {
+			m_nearest_unsent_d = this_d;
+			// the block may be anywhere in that shell
+			m_nearest_unsent_index = 0;
 		}
 	}
 }
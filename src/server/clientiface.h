@@ -25,6 +25,22 @@ class MapBlock;
 class NetworkPacket;
 class ServerEnvironment;
 
+/*
+	What RemoteClient::m_known_objects was last brought up to date for,
+	see ServerEnvironment::getActiveObjectChanges
+*/
+struct KnownObjectsState {
+	// Visibility update round, 0 = never
+	u32 round = 0;
+	// Player position at the last full recomputation
+	v3f pos;
+	s16 radius = 0;
+	s16 player_radius = 0;
+	// Objects whose mapblock reaches across the edge of the range,
+	// these are rechecked every round
+	std::unordered_set<u16> border;
+};
+
 /*
  * State Transitions
 
@@ -279,6 +295,7 @@ class RemoteClient
 			<<"blocks_sent=" << m_blocks_sent.size()
 			<<", blocks_sending=" << m_blocks_sending.size()
 			<<", nearest_unsent_d=" << m_nearest_unsent_d
+			<<", nearest_unsent_index=" << m_nearest_unsent_index
 			<<", map_send_completion_timer=" << (int)(m_map_send_completion_timer + 0.5f)
 			<<", excess_gotblocks=" << m_excess_gotblocks;
 		m_excess_gotblocks = 0;
@@ -291,6 +308,7 @@ class RemoteClient
 		List of active objects that the client knows of.
 	*/
 	std::set<u16> m_known_objects;
+	KnownObjectsState m_known_objects_state;
 
 	ClientState getState() const { return m_state; }
 
@@ -363,9 +381,22 @@ class RemoteClient
 	 */
 	std::unordered_set<v3s16> m_blocks_occ;
 
+	/*
+		Where GetNextBlocks continues scanning: the distance (cube shell) and
+		the position within that shell's face position list.
+		Everything before it has been handled for the current center and
+		camera direction, so it is not examined again.
+	*/
 	s16 m_nearest_unsent_d = 0;
+	u32 m_nearest_unsent_index = 0;
 	v3s16 m_last_center;
 	v3f m_last_camera_dir;
+	// Parameters the skipped positions depend on, the camera direction
+	// is that of the last time the index was reset
+	v3f m_index_camera_dir;
+	f32 m_last_camera_fov = 0;
+	s16 m_last_d_opt = 0;
+	s16 m_last_d_max_gen = 0;
 
 	const u16 m_max_simul_sends;
 	const float m_min_time_from_building;
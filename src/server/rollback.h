@@ -10,12 +10,10 @@
 #include <list>
 #include <vector>
 #include <deque>
-#include "sqlite3.h"
+#include <memory>
 
 class IGameDef;
-
-struct ActionRow;
-struct Entity;
+class RollbackLog;
 
 class RollbackManager final : public IRollbackManager
 {
@@ -38,27 +36,8 @@ class RollbackManager final : public IRollbackManager
 			const std::string & actor_filter, time_t seconds);
 
 private:
-	void registerNewActor(const int id, const std::string & name);
-	void registerNewNode(const int id, const std::string & name);
-	int getActorId(const std::string & name);
-	int getNodeId(const std::string & name);
-	const char * getActorName(const int id);
-	const char * getNodeName(const int id);
-	bool createTables();
-	bool initDatabase();
-	bool registerRow(const ActionRow & row);
-	const std::list<ActionRow> actionRowsFromSelect(sqlite3_stmt * stmt);
-	ActionRow actionRowFromRollbackAction(const RollbackAction & action);
-	const std::list<RollbackAction> rollbackActionsFromActionRows(
-			const std::list<ActionRow> & rows);
-	const std::list<ActionRow> getRowsSince(time_t firstTime,
-			const std::string & actor);
-	const std::list<ActionRow> getRowsSince_range(time_t firstTime, v3s16 p,
-			int range, int limit);
-	const std::list<RollbackAction> getActionsSince_range(time_t firstTime, v3s16 p,
-			int range, int limit);
-	const std::list<RollbackAction> getActionsSince(time_t firstTime,
-			const std::string & actor = "");
+	// Moves the actions of a rollback.sqlite from older versions to the log
+	void importDatabase(const std::string &path);
 	static float getSuspectNearness(bool is_guess, v3s16 suspect_p,
 		time_t suspect_t, v3s16 action_p, time_t action_t);
 
@@ -71,18 +50,5 @@ class RollbackManager final : public IRollbackManager
 	std::vector<RollbackAction> action_todisk_buffer;
 	std::deque<RollbackAction> action_latest_buffer;
 
-	std::string database_path;
-	sqlite3 *db = nullptr;
-	sqlite3_stmt *stmt_insert = nullptr;
-	sqlite3_stmt *stmt_replace = nullptr;
-	sqlite3_stmt *stmt_select = nullptr;
-	sqlite3_stmt *stmt_select_range = nullptr;
-	sqlite3_stmt *stmt_select_withActor = nullptr;
-	sqlite3_stmt *stmt_knownActor_select = nullptr;
-	sqlite3_stmt *stmt_knownActor_insert = nullptr;
-	sqlite3_stmt *stmt_knownNode_select = nullptr;
-	sqlite3_stmt *stmt_knownNode_insert = nullptr;
-
-	std::vector<Entity> knownActors;
-	std::vector<Entity> knownNodes;
+	std::unique_ptr<RollbackLog> log;
 };
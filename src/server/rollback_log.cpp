@@ -0,0 +1,625 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "rollback_log.h"
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <tuple>
+#include "debug.h"
+#include "exceptions.h"
+#include "filesys.h"
+#include "log.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+#include "util/string.h"
+
+/*
+	Segment file (<start>.bin, or <start>_<n>.bin for the n-th further
+	segment starting in the same second):
+		u32 SEGMENT_MAGIC, u8 version, s64 start time
+		batches: u32 length, records
+
+	Records:
+		u8 RECORD_NAME, string16 name
+			adds a name (actor or item/node) to the table of the segment
+		u8 RECORD_ACTION, s32 time - start, u16 actor, u8 type, u8 flags,
+			[v3s16 position if FLAG_POSITION]
+			TYPE_SET_NODE: old and new node as
+				u16 name, u8 param1, u8 param2, string32 metadata
+			TYPE_MODIFY_INVENTORY_STACK: string16 location, string16 list,
+				u32 index, u8 add, string32 item string
+
+	Index file (same name with .idx), written once the segment is complete:
+		u32 INDEX_MAGIC, u8 version, u32 segment size,
+		s64 min time, s64 max time,
+		u16 count, string16 actors[count], u32 count, v3s16 cells[count]
+*/
+
+static constexpr u32 SEGMENT_MAGIC = 0x52424c47; // "RBLG"
+static constexpr u32 INDEX_MAGIC = 0x52424958; // "RBIX"
+static constexpr u8 FORMAT_VERSION = 1;
+static constexpr u32 SEGMENT_HEADER_SIZE = 4 + 1 + 8;
+
+enum : u8 {
+	RECORD_NAME,
+	RECORD_ACTION,
+};
+
+enum : u8 {
+	FLAG_GUESSED = 0x01,
+	FLAG_POSITION = 0x02,
+};
+
+static inline v3s16 get_cell(v3s16 p)
+{
+	return getContainerPos(p, RollbackLog::CELL_SIZE);
+}
+
+static std::string segment_path(const std::string &dir, time_t start, u32 seq,
+	const char *ext)
+{
+	std::string name = std::to_string((s64)start);
+	if (seq > 0)
+		name += "_" + std::to_string(seq);
+	return dir + DIR_DELIM + name + ext;
+}
+
+/*
+	Reads the actions of the segment at `path`, up to `max_size` bytes.
+	A batch that was not written completely ends the segment.
+	@param size set to the size of the valid data
+	@return false if the file is not a segment
+*/
+template <typename F>
+static bool read_segment(const std::string &path, u32 max_size, time_t *start,
+		u32 *size, F on_action)
+{
+	std::string data;
+	if (!fs::ReadFile(path, data, true))
+		return false;
+	if (data.size() > max_size)
+		data.resize(max_size);
+
+	std::istringstream is(data, std::ios::binary);
+	try {
+		if (readU32(is) != SEGMENT_MAGIC || readU8(is) != FORMAT_VERSION)
+			return false;
+		*start = readS64(is);
+	} catch (SerializationError &) {
+		return false;
+	}
+	*size = SEGMENT_HEADER_SIZE;
+
+	std::vector<std::string> names;
+	const auto get_name = [&] (u16 id) -> const std::string & {
+		if (id >= names.size())
+			throw SerializationError("unknown name");
+		return names[id];
+	};
+
+	while (*size + 4 <= data.size()) {
+		u32 length = readU32((const u8 *)&data[*size]);
+		if (*size + 4 + length > data.size())
+			break;
+
+		std::istringstream batch(data.substr(*size + 4, length), std::ios::binary);
+		const size_t names_before = names.size();
+		std::vector<RollbackAction> actions;
+		try {
+			while (batch.peek() != EOF) {
+				u8 kind = readU8(batch);
+				if (kind == RECORD_NAME) {
+					names.push_back(deSerializeString16(batch));
+					continue;
+				}
+				if (kind != RECORD_ACTION)
+					throw SerializationError("unknown record");
+
+				RollbackAction &action = actions.emplace_back();
+				action.unix_time = *start + readS32(batch);
+				action.actor = get_name(readU16(batch));
+				action.type = static_cast<RollbackAction::Type>(readU8(batch));
+				u8 flags = readU8(batch);
+				action.actor_is_guess = flags & FLAG_GUESSED;
+				v3s16 p;
+				if (flags & FLAG_POSITION)
+					p = readV3S16(batch);
+
+				if (action.type == RollbackAction::TYPE_SET_NODE) {
+					action.p = p;
+					for (RollbackNode *n : {&action.n_old, &action.n_new}) {
+						n->name = get_name(readU16(batch));
+						n->param1 = readU8(batch);
+						n->param2 = readU8(batch);
+						n->meta = deSerializeString32(batch);
+					}
+				} else if (action.type == RollbackAction::TYPE_MODIFY_INVENTORY_STACK) {
+					action.inventory_location = deSerializeString16(batch);
+					action.inventory_list = deSerializeString16(batch);
+					action.inventory_index = readU32(batch);
+					action.inventory_add = readU8(batch);
+					action.inventory_stack.deSerialize(deSerializeString32(batch));
+				} else {
+					throw SerializationError("unknown action type");
+				}
+			}
+		} catch (SerializationError &e) {
+			warningstream << "RollbackLog: " << path << " is corrupted: "
+				<< e.what() << std::endl;
+			names.resize(names_before);
+			break;
+		}
+
+		for (auto &action : actions)
+			on_action(std::move(action));
+		*size += 4 + length;
+	}
+	return true;
+}
+
+RollbackLog::RollbackLog(const std::string &dir) :
+	Thread("RollbackLog"),
+	m_dir(dir)
+{
+	if (!fs::CreateAllDirs(m_dir))
+		throw FileNotGoodException("RollbackLog: failed to create " + m_dir);
+
+	loadSegments();
+	start();
+}
+
+RollbackLog::~RollbackLog()
+{
+	stop();
+	wait();
+	closeSegment();
+}
+
+void RollbackLog::stop()
+{
+	Thread::stop();
+	m_queue_cv.notify_all();
+}
+
+void RollbackLog::loadSegments()
+{
+	for (const auto &entry : fs::GetDirListing(m_dir)) {
+		if (entry.dir || !str_ends_with(entry.name, ".bin"))
+			continue;
+		const std::string path = m_dir + DIR_DELIM + entry.name;
+		const std::string stem = entry.name.substr(0, entry.name.size() - 4);
+		const size_t sep = stem.find('_');
+		auto segment = std::make_shared<Segment>();
+		segment->path = path;
+		segment->start = stoi64(stem.substr(0, sep));
+		if (sep != std::string::npos)
+			segment->seq = mystoi(stem.substr(sep + 1));
+		if (!loadIndex(*segment)) {
+			// Not completed before shutdown, rebuild the index
+			const u32 seq = segment->seq;
+			segment = scanSegment(path, segment->start);
+			if (!segment)
+				continue;
+			segment->seq = seq;
+			writeIndex(*segment);
+		}
+		m_segments.push_back(std::move(segment));
+	}
+
+	std::sort(m_segments.begin(), m_segments.end(), [] (auto &a, auto &b) {
+		return std::tie(a->start, a->seq) < std::tie(b->start, b->seq);
+	});
+
+	verbosestream << "RollbackLog: " << m_segments.size() << " segments in "
+		<< m_dir << std::endl;
+}
+
+std::shared_ptr<RollbackLog::Segment> RollbackLog::scanSegment(
+		const std::string &path, time_t start)
+{
+	auto segment = std::make_shared<Segment>();
+	segment->path = path;
+	segment->min_time = std::numeric_limits<time_t>::max();
+	segment->max_time = std::numeric_limits<time_t>::min();
+	bool ok = read_segment(path, U32_MAX, &segment->start, &segment->size,
+		[&] (RollbackAction &&action) {
+			segment->min_time = std::min(segment->min_time, action.unix_time);
+			segment->max_time = std::max(segment->max_time, action.unix_time);
+			segment->actors.insert(action.actor);
+			v3s16 p;
+			if (action.getPosition(&p))
+				segment->cells.insert(get_cell(p));
+		});
+	if (!ok || segment->start != start) {
+		warningstream << "RollbackLog: ignoring " << path << std::endl;
+		return nullptr;
+	}
+	return segment;
+}
+
+bool RollbackLog::loadIndex(Segment &segment)
+{
+	std::string data;
+	if (!fs::ReadFile(segment_path(m_dir, segment.start, segment.seq, ".idx"), data))
+		return false;
+
+	std::istringstream is(data, std::ios::binary);
+	try {
+		if (readU32(is) != INDEX_MAGIC || readU8(is) != FORMAT_VERSION)
+			return false;
+		segment.size = readU32(is);
+		segment.min_time = readS64(is);
+		segment.max_time = readS64(is);
+		for (u16 n = readU16(is); n > 0; n--)
+			segment.actors.insert(deSerializeString16(is));
+		for (u32 n = readU32(is); n > 0; n--)
+			segment.cells.insert(readV3S16(is));
+	} catch (SerializationError &) {
+		return false;
+	}
+	return true;
+}
+
+void RollbackLog::writeIndex(const Segment &segment)
+{
+	std::ostringstream os(std::ios::binary);
+	writeU32(os, INDEX_MAGIC);
+	writeU8(os, FORMAT_VERSION);
+	writeU32(os, segment.size);
+	writeS64(os, segment.min_time);
+	writeS64(os, segment.max_time);
+	writeU16(os, segment.actors.size());
+	for (const auto &actor : segment.actors)
+		os << serializeString16(actor);
+	writeU32(os, segment.cells.size());
+	for (v3s16 cell : segment.cells)
+		writeV3S16(os, cell);
+
+	if (!fs::safeWriteToFile(segment_path(m_dir, segment.start, segment.seq, ".idx"), os.str()))
+		errorstream << "RollbackLog: failed to write index of "
+			<< segment.path << std::endl;
+}
+
+void RollbackLog::openSegment(time_t start)
+{
+	closeSegment();
+
+	// Never append to an existing file. Don't move the start time either,
+	// actions before it would not fit into the segment.
+	u32 seq = 0;
+	while (fs::PathExists(segment_path(m_dir, start, seq, ".bin")))
+		seq++;
+
+	auto segment = std::make_shared<Segment>();
+	segment->start = start;
+	segment->seq = seq;
+	segment->path = segment_path(m_dir, start, seq, ".bin");
+	segment->min_time = std::numeric_limits<time_t>::max();
+	segment->max_time = std::numeric_limits<time_t>::min();
+
+	m_writer.file = open_ofstream(segment->path.c_str(), true);
+	writeU32(m_writer.file, SEGMENT_MAGIC);
+	writeU8(m_writer.file, FORMAT_VERSION);
+	writeS64(m_writer.file, start);
+	m_writer.file.flush();
+	if (!m_writer.file.good()) {
+		m_writer.file.close();
+		return;
+	}
+	segment->size = SEGMENT_HEADER_SIZE;
+
+	m_writer.segment = segment;
+	MutexAutoLock lock(m_segments_mutex);
+	m_segments.push_back(std::move(segment));
+}
+
+void RollbackLog::closeSegment()
+{
+	if (!m_writer.segment)
+		return;
+
+	m_writer.file.close();
+	{
+		MutexAutoLock lock(m_segments_mutex);
+		writeIndex(*m_writer.segment);
+	}
+	m_writer.segment.reset();
+	m_writer.name_ids.clear();
+}
+
+void RollbackLog::serializeAction(std::ostream &os, const RollbackAction &action)
+{
+	const auto name_id = [&] (const std::string &name) {
+		auto it = m_writer.name_ids.find(name);
+		if (it != m_writer.name_ids.end())
+			return it->second;
+		u16 id = m_writer.name_ids.size();
+		m_writer.name_ids.emplace(name, id);
+		writeU8(os, RECORD_NAME);
+		os << serializeString16(name);
+		return id;
+	};
+
+	u16 actor = name_id(action.actor);
+	u16 old_name = 0, new_name = 0;
+	if (action.type == RollbackAction::TYPE_SET_NODE) {
+		old_name = name_id(action.n_old.name);
+		new_name = name_id(action.n_new.name);
+	}
+
+	v3s16 p;
+	const bool has_pos = action.getPosition(&p);
+	u8 flags = (action.actor_is_guess ? FLAG_GUESSED : 0) |
+		(has_pos ? FLAG_POSITION : 0);
+
+	writeU8(os, RECORD_ACTION);
+	writeS32(os, action.unix_time - m_writer.segment->start);
+	writeU16(os, actor);
+	writeU8(os, action.type);
+	writeU8(os, flags);
+	if (has_pos)
+		writeV3S16(os, p);
+
+	if (action.type == RollbackAction::TYPE_SET_NODE) {
+		for (auto &it : {std::make_pair(old_name, &action.n_old),
+				std::make_pair(new_name, &action.n_new)}) {
+			writeU16(os, it.first);
+			writeU8(os, it.second->param1);
+			writeU8(os, it.second->param2);
+			os << serializeString32(it.second->meta);
+		}
+	} else {
+		os << serializeString16(action.inventory_location);
+		os << serializeString16(action.inventory_list);
+		writeU32(os, action.inventory_index);
+		writeU8(os, action.inventory_add);
+		os << serializeString32(action.inventory_stack.getItemString());
+	}
+}
+
+void RollbackLog::writeBatch(const std::vector<RollbackAction> &actions)
+{
+	std::ostringstream os(std::ios::binary);
+	std::vector<const RollbackAction *> pending;
+
+	const auto write_pending = [&] () {
+		if (pending.empty())
+			return;
+		Segment &segment = *m_writer.segment;
+		const std::string payload = os.str();
+		writeU32(m_writer.file, payload.size());
+		m_writer.file << payload;
+		m_writer.file.flush();
+		if (!m_writer.file.good()) {
+			errorstream << "RollbackLog: failed to write to " << segment.path
+				<< ", " << pending.size() << " actions lost" << std::endl;
+			// The name table of the file is unknown now
+			closeSegment();
+		} else {
+			MutexAutoLock lock(m_segments_mutex);
+			segment.size += 4 + payload.size();
+			for (auto *action : pending) {
+				segment.min_time = std::min(segment.min_time, action->unix_time);
+				segment.max_time = std::max(segment.max_time, action->unix_time);
+				segment.actors.insert(action->actor);
+				v3s16 p;
+				if (action->getPosition(&p))
+					segment.cells.insert(get_cell(p));
+			}
+		}
+		os.str("");
+		pending.clear();
+	};
+
+	for (const auto &action : actions) {
+		if (action.actor.empty() || (action.type != RollbackAction::TYPE_SET_NODE &&
+				action.type != RollbackAction::TYPE_MODIFY_INVENTORY_STACK))
+			continue;
+
+		// Leave room for the three names an action can add
+		Segment *segment = m_writer.segment.get();
+		if (!segment || action.unix_time >= segment->start + SEGMENT_DURATION ||
+				action.unix_time < segment->start ||
+				segment->size + (u32)os.tellp() >= SEGMENT_MAX_SIZE ||
+				m_writer.name_ids.size() > U16_MAX - 3) {
+			write_pending();
+			openSegment(action.unix_time);
+			if (!m_writer.segment)
+				return;
+		}
+
+		serializeAction(os, action);
+		pending.push_back(&action);
+	}
+	write_pending();
+}
+
+void RollbackLog::append(std::vector<RollbackAction> &&actions)
+{
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		if (m_queue.empty())
+			m_queue = std::move(actions);
+		else
+			m_queue.insert(m_queue.end(), actions.begin(), actions.end());
+	}
+	m_queue_cv.notify_all();
+}
+
+void RollbackLog::sync()
+{
+	std::unique_lock lock(m_queue_mutex);
+	m_queue_cv.wait(lock, [&] { return m_queue.empty() && !m_writing; });
+}
+
+void *RollbackLog::run()
+{
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	std::vector<RollbackAction> batch;
+	while (true) {
+		{
+			std::unique_lock lock(m_queue_mutex);
+			m_queue_cv.wait(lock, [&] { return !m_queue.empty() || stopRequested(); });
+			// Only exit once everything is written
+			if (m_queue.empty())
+				break;
+			// Everything that was queued meanwhile is written at once
+			batch.swap(m_queue);
+			m_writing = true;
+		}
+
+		writeBatch(batch);
+		batch.clear();
+
+		{
+			MutexAutoLock lock(m_queue_mutex);
+			m_writing = false;
+		}
+		m_queue_cv.notify_all();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+
+	return nullptr;
+}
+
+template <typename S, typename A, typename D>
+std::vector<RollbackAction> RollbackLog::collect(S match_segment, A match_action,
+		D done)
+{
+	sync();
+
+	struct Candidate {
+		std::string path;
+		u32 size;
+		time_t max_time;
+	};
+	std::vector<Candidate> candidates;
+	{
+		MutexAutoLock lock(m_segments_mutex);
+		for (auto it = m_segments.rbegin(); it != m_segments.rend(); ++it) {
+			const Segment &segment = **it;
+			if (segment.size > SEGMENT_HEADER_SIZE && match_segment(segment))
+				candidates.push_back({segment.path, segment.size, segment.max_time});
+		}
+	}
+
+	std::vector<RollbackAction> ret, found;
+	for (const auto &candidate : candidates) {
+		if (done(ret, candidate.max_time))
+			break;
+
+		time_t start;
+		u32 size;
+		read_segment(candidate.path, candidate.size, &start, &size,
+			[&] (RollbackAction &&action) {
+				if (match_action(action))
+					found.push_back(std::move(action));
+			});
+		// newer actions first
+		std::move(found.rbegin(), found.rend(), std::back_inserter(ret));
+		found.clear();
+	}
+
+	std::stable_sort(ret.begin(), ret.end(), [] (auto &a, auto &b) {
+		return a.unix_time > b.unix_time;
+	});
+	return ret;
+}
+
+std::list<RollbackAction> RollbackLog::getActionsNear(time_t first_time,
+		v3s16 p, int range, int limit)
+{
+	const size_t max_count = limit < 0 ? SIZE_MAX : limit;
+	// range comes from Lua, keep the box inside what v3s16 can hold
+	range = rangelim(range, 0, U16_MAX);
+	const auto clamp_s16 = [] (s32 v) -> s16 {
+		return rangelim(v, S16_MIN, S16_MAX);
+	};
+	const v3s16 pmin(clamp_s16(p.X - range), clamp_s16(p.Y - range),
+		clamp_s16(p.Z - range));
+	const v3s16 pmax(clamp_s16(p.X + range), clamp_s16(p.Y + range),
+		clamp_s16(p.Z + range));
+	const v3s16 cmin = get_cell(pmin), cmax = get_cell(pmax);
+	const u64 cell_count = (u64)(cmax.X - cmin.X + 1) *
+		(cmax.Y - cmin.Y + 1) * (cmax.Z - cmin.Z + 1);
+
+	const auto match_segment = [&] (const Segment &segment) {
+		if (segment.max_time < first_time)
+			return false;
+		if (cell_count > segment.cells.size()) {
+			for (v3s16 cell : segment.cells) {
+				if (cell.X >= cmin.X && cell.X <= cmax.X &&
+						cell.Y >= cmin.Y && cell.Y <= cmax.Y &&
+						cell.Z >= cmin.Z && cell.Z <= cmax.Z)
+					return true;
+			}
+			return false;
+		}
+		for (s16 z = cmin.Z; z <= cmax.Z; z++)
+		for (s16 y = cmin.Y; y <= cmax.Y; y++)
+		for (s16 x = cmin.X; x <= cmax.X; x++) {
+			if (segment.cells.count(v3s16(x, y, z)))
+				return true;
+		}
+		return false;
+	};
+	const auto match_action = [&] (const RollbackAction &action) {
+		v3s16 ap;
+		return action.unix_time >= first_time && action.getPosition(&ap) &&
+			ap.X >= pmin.X && ap.X <= pmax.X &&
+			ap.Y >= pmin.Y && ap.Y <= pmax.Y &&
+			ap.Z >= pmin.Z && ap.Z <= pmax.Z;
+	};
+	// Older segments can't contain anything newer than what was found
+	std::vector<time_t> times;
+	const auto done = [&] (const std::vector<RollbackAction> &found, time_t max_time) {
+		if (found.size() < max_count)
+			return false;
+		times.clear();
+		for (const auto &action : found)
+			times.push_back(action.unix_time);
+		auto nth = times.begin() + (max_count - 1);
+		std::nth_element(times.begin(), nth, times.end(), std::greater<time_t>());
+		return max_time < *nth;
+	};
+
+	if (max_count == 0)
+		return {};
+	auto actions = collect(match_segment, match_action, done);
+	if (actions.size() > max_count)
+		actions.resize(max_count);
+	return std::list<RollbackAction>(std::make_move_iterator(actions.begin()),
+		std::make_move_iterator(actions.end()));
+}
+
+std::list<RollbackAction> RollbackLog::getActionsSince(time_t first_time,
+		const std::string &actor)
+{
+	const auto match_segment = [&] (const Segment &segment) {
+		return segment.max_time >= first_time &&
+			(actor.empty() || segment.actors.count(actor));
+	};
+	const auto match_action = [&] (const RollbackAction &action) {
+		return action.unix_time >= first_time &&
+			(actor.empty() || action.actor == actor);
+	};
+	const auto done = [] (const std::vector<RollbackAction> &, time_t) {
+		return false;
+	};
+
+	auto actions = collect(match_segment, match_action, done);
+	return std::list<RollbackAction>(std::make_move_iterator(actions.begin()),
+		std::make_move_iterator(actions.end()));
+}
+
+size_t RollbackLog::getSegmentCount()
+{
+	MutexAutoLock lock(m_segments_mutex);
+	return m_segments.size();
+}
@@ -0,0 +1,118 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include <condition_variable>
+#include <ctime>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "irr_v3d.h"
+#include "rollback_interface.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/thread.h"
+
+/*
+	Append-only storage for rollback actions.
+
+	Actions are written to segment files that each cover a limited span of
+	time. For every segment the time span, the actors and the areas that were
+	touched are kept in memory (and in an index file next to the segment once
+	it is complete), so queries only read segments that can contain matches.
+	Writing happens in batches on a background thread.
+*/
+class RollbackLog : public Thread
+{
+public:
+	/// @param dir directory of the segment files, created if needed
+	RollbackLog(const std::string &dir);
+	~RollbackLog();
+
+	/// Queue actions for writing, in the order they happened.
+	void append(std::vector<RollbackAction> &&actions);
+	/// Wait until all actions queued so far have been written.
+	void sync();
+
+	/// Actions since `first_time` at most `range` nodes (per axis) away from
+	/// `p`, newest first, at most `limit` of them.
+	std::list<RollbackAction> getActionsNear(time_t first_time, v3s16 p,
+		int range, int limit);
+	/// Actions since `first_time`, newest first. If `actor` is not empty,
+	/// only those of that actor.
+	std::list<RollbackAction> getActionsSince(time_t first_time,
+		const std::string &actor);
+
+	/// @return number of segments, for testing
+	size_t getSegmentCount();
+
+	// a segment is complete after this many seconds...
+	static constexpr time_t SEGMENT_DURATION = 3600;
+	// ...or once it has this many bytes
+	static constexpr u32 SEGMENT_MAX_SIZE = 16 * 1024 * 1024;
+	// edge length of the areas tracked by the segment index
+	static constexpr s16 CELL_SIZE = 64;
+
+protected:
+	void *run();
+
+private:
+	struct Segment {
+		time_t start;
+		// tells apart segments with the same start time
+		u32 seq = 0;
+		std::string path;
+		// bytes of completely written batches
+		u32 size = 0;
+		time_t min_time = 0, max_time = 0;
+		std::set<std::string> actors;
+		std::unordered_set<v3s16> cells;
+	};
+
+	// Name table of the segment that is written to
+	struct SegmentWriter {
+		std::shared_ptr<Segment> segment;
+		std::ofstream file;
+		std::unordered_map<std::string, u16> name_ids;
+	};
+
+	void stop();
+
+	void loadSegments();
+	std::shared_ptr<Segment> scanSegment(const std::string &path, time_t start);
+	bool loadIndex(Segment &segment);
+	void writeIndex(const Segment &segment);
+
+	void writeBatch(const std::vector<RollbackAction> &actions);
+	void openSegment(time_t start);
+	void closeSegment();
+	void serializeAction(std::ostream &os, const RollbackAction &action);
+
+	/// Collects the actions of the segments for which `match_segment` returns
+	/// true, newest segment first, until `done` returns true
+	template <typename S, typename A, typename D>
+	std::vector<RollbackAction> collect(S match_segment, A match_action, D done);
+
+	const std::string m_dir;
+
+	// protects the queue
+	std::mutex m_queue_mutex;
+	std::condition_variable m_queue_cv;
+	std::vector<RollbackAction> m_queue;
+	bool m_writing = false;
+
+	// protects the segment list and index data
+	std::mutex m_segments_mutex;
+	// oldest first
+	std::vector<std::shared_ptr<Segment>> m_segments;
+
+	// only used by the thread
+	SegmentWriter m_writer;
+};
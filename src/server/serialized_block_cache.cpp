@@ -0,0 +1,69 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "serialized_block_cache.h"
+#include "serialization.h"
+
+SerializedBlockCache::Data SerializedBlockCache::get(v3s16 pos, u8 ver, u64 change_id)
+{
+	auto it = m_entries.find({pos, ver});
+	if (it == m_entries.end())
+		return nullptr;
+
+	auto lru_it = it->second;
+	if (lru_it->change_id != change_id) {
+		// block was modified since
+		erase(lru_it);
+		return nullptr;
+	}
+
+	m_lru.splice(m_lru.begin(), m_lru, lru_it);
+	return lru_it->data;
+}
+
+void SerializedBlockCache::put(v3s16 pos, u8 ver, u64 change_id, Data data)
+{
+	const Key key(pos, ver);
+	auto it = m_entries.find(key);
+	if (it != m_entries.end())
+		erase(it->second);
+
+	Entry entry{key, change_id, std::move(data)};
+	const size_t size = entrySize(entry);
+	if (size > m_max_bytes)
+		return;
+
+	while (m_bytes + size > m_max_bytes)
+		erase(std::prev(m_lru.end()));
+
+	m_lru.push_front(std::move(entry));
+	m_entries.emplace(key, m_lru.begin());
+	m_bytes += size;
+}
+
+void SerializedBlockCache::invalidate(v3s16 pos)
+{
+	if (m_entries.empty())
+		return;
+
+	for (u8 ver = SER_FMT_VER_LOWEST_WRITE; ver <= SER_FMT_VER_HIGHEST_WRITE; ver++) {
+		auto it = m_entries.find({pos, ver});
+		if (it != m_entries.end())
+			erase(it->second);
+	}
+}
+
+void SerializedBlockCache::clear()
+{
+	m_entries.clear();
+	m_lru.clear();
+	m_bytes = 0;
+}
+
+void SerializedBlockCache::erase(std::list<Entry>::iterator it)
+{
+	m_bytes -= entrySize(*it);
+	m_entries.erase(it->key);
+	m_lru.erase(it);
+}
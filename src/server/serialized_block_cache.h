@@ -0,0 +1,75 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "irr_v3d.h"
+
+/*
+	Size-bounded LRU cache of mapblocks serialized for the network, so that
+	unchanged blocks don't have to be compressed again when they are sent
+	to another client or resent later.
+
+	Entries are tagged with MapBlock::getChangeId() and are only returned
+	while it matches. Additionally they are dropped through invalidate()
+	when a map edit event touches the block.
+*/
+class SerializedBlockCache
+{
+public:
+	typedef std::shared_ptr<const std::string> Data;
+
+	/// @param max_bytes memory limit, 0 disables the cache
+	SerializedBlockCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+	/// @return cached data or nullptr if missing or outdated
+	Data get(v3s16 pos, u8 ver, u64 change_id);
+
+	/// Adds or replaces an entry, evicting the least recently used ones as needed
+	void put(v3s16 pos, u8 ver, u64 change_id, Data data);
+
+	/// Drops the entries of a block (in all formats)
+	void invalidate(v3s16 pos);
+
+	void clear();
+
+	size_t size() const { return m_entries.size(); }
+	size_t getMemoryUsage() const { return m_bytes; }
+	size_t getMaxMemoryUsage() const { return m_max_bytes; }
+
+private:
+	typedef std::pair<v3s16, u8> Key;
+
+	// The standard library does not implement std::hash for pairs so we have this:
+	struct KeyHash {
+		size_t operator() (const Key &k) const {
+			return std::hash<v3s16>()(k.first) ^ k.second;
+		}
+	};
+
+	struct Entry {
+		Key key;
+		u64 change_id;
+		Data data;
+	};
+
+	// approximate memory used by an entry
+	static size_t entrySize(const Entry &e)
+	{
+		return e.data->size() + sizeof(Entry) + sizeof(std::string) + 64;
+	}
+
+	void erase(std::list<Entry>::iterator it);
+
+	const size_t m_max_bytes;
+	size_t m_bytes = 0;
+
+	// most recently used first
+	std::list<Entry> m_lru;
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_entries;
+};
@@ -76,6 +76,8 @@ void ServerActiveObject::markForRemoval()
 	if (!m_pending_removal) {
 		onMarkedForRemoval();
 		m_pending_removal = true;
+		if (m_env)
+			m_env->markObjectVisibilityDirty(m_id);
 	}
 }
 
@@ -84,6 +86,8 @@ void ServerActiveObject::markForDeactivation()
 	if (!m_pending_deactivation) {
 		onMarkedForDeactivation();
 		m_pending_deactivation = true;
+		if (m_env)
+			m_env->markObjectVisibilityDirty(m_id);
 	}
 }
 
@@ -131,6 +135,18 @@ const Observers& ServerActiveObject::recalculateEffectiveObservers()
 	return getEffectiveObservers();
 }
 
+void ServerActiveObject::markVisibilityDirty()
+{
+	if (!m_env)
+		return;
+	m_env->markObjectVisibilityDirty(m_id);
+	// Children inherit our observers
+	for (object_t child_id : getAttachmentChildIds()) {
+		if (auto *child = m_env->getActiveObject(child_id))
+			child->markVisibilityDirty();
+	}
+}
+
 bool ServerActiveObject::isEffectivelyObservedBy(const std::string &player_name)
 {
 	auto effective_observers = getEffectiveObservers();
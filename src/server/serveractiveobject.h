@@ -249,6 +249,10 @@ class ServerActiveObject : public ActiveObject
 	const Observers &recalculateEffectiveObservers();
 	/// Whether the object is sent to `player_name`
 	bool isEffectivelyObservedBy(const std::string &player_name);
+	/// Tell the environment that players may see this object and its
+	/// attachment children differently now. This needs to be done whenever
+	/// the observers or the parent change.
+	void markVisibilityDirty();
 
 protected:
 	// Cached intersection of m_observers of this object and all its parents.
@@ -195,6 +195,8 @@ void UnitSAO::setAttachment(const object_t new_parent, const std::string &bone,
 	const auto old_parent = m_attachment_parent_id;
 	m_attachment_parent_id = 0;
 	m_attachment_sent = false;
+	if (old_parent != new_parent)
+		markVisibilityDirty(); // observers are inherited from the parent
 
 	if (old_parent && old_parent != new_parent) {
 		auto *parent = m_env->getActiveObject(old_parent);
@@ -3,6 +3,7 @@
 // Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
 
 #include <algorithm>
+#include <iterator>
 #include <stack>
 #include <utility>
 #include "serverenvironment.h"
@@ -36,6 +37,7 @@
 #endif
 #include "server/luaentity_sao.h"
 #include "server/player_sao.h"
+#include "threading/thread_pool.h"
 
 // A number that is much smaller than the timeout for particle spawners should/could ever be
 #define PARTICLE_SPAWNER_NO_EXPIRY -1024.f
@@ -44,6 +46,9 @@ static constexpr s16 ACTIVE_OBJECT_RESAVE_DISTANCE_SQ = sqr(3);
 
 static constexpr u32 BLOCK_RESAVE_TIMESTAMP_DIFF = 60; // in units of game time
 
+// How far a player may move before its known objects are fully recomputed
+static constexpr f32 ACTIVE_OBJECT_MAX_DRIFT = 4 * BS;
+
 
 /*
 	ActiveBlockList
@@ -187,6 +192,16 @@ ServerEnvironment::ServerEnvironment(std::unique_ptr<ServerMap> map,
 	m_cache_abm_interval = rangelim(g_settings->getFloat("abm_interval"), 0.1f, 30);
 	m_cache_nodetimer_interval = rangelim(g_settings->getFloat("nodetimer_interval"), 0.1f, 1);
 	m_cache_abm_time_budget = g_settings->getFloat("abm_time_budget");
+	m_cache_lbm_time_budget = g_settings->getFloat("lbm_time_budget");
+
+	server::ActiveObjectMgr::SpatialIndexType index_type;
+	const std::string index_name = g_settings->get("active_object_index");
+	if (!server::ActiveObjectMgr::parseSpatialIndexType(index_name, index_type)) {
+		warningstream << "ServerEnvironment: unknown active_object_index \""
+			<< index_name << "\", using kdtree" << std::endl;
+		index_type = server::ActiveObjectMgr::SpatialIndexType::KdTree;
+	}
+	m_ao_manager.setSpatialIndexType(index_type);
 
 	m_step_time_counter = mb->addCounter(
 		"minetest_env_step_time", "Time spent in environment step (in microseconds)");
@@ -280,6 +295,10 @@ void ServerEnvironment::deactivateBlocksAndObjects()
 	// try to add new objects.
 	m_shutting_down = true;
 
+	// LBMs that did not get to run yet would never run on these blocks
+	collectPendingLBMs();
+	runPendingActivations(U32_MAX);
+
 	// Clear active block list.
 	// This makes the next code delete all active objects.
 	m_active_blocks.clear();
@@ -541,7 +560,7 @@ void ServerEnvironment::forceActivateBlock(MapBlock *block)
 	m_active_block_gauge->set(m_active_blocks.size());
 }
 
-void ServerEnvironment::activateBlock(MapBlock *block)
+void ServerEnvironment::activateBlock(MapBlock *block, bool defer)
 {
 	// Reset usage timer immediately, otherwise a block that becomes active
 	// again at around the same time as it would normally be unloaded will
@@ -572,6 +591,13 @@ void ServerEnvironment::activateBlock(MapBlock *block)
 	if (block->isOrphan())
 		return;
 
+	if (defer) {
+		// Many blocks get activated at once when players join or move fast
+		m_pending_activations.push_back({block->getPos(), stamp, dtime_s, false, {}});
+		m_pending_activation_blocks.insert(block->getPos());
+		return;
+	}
+
 	/* Handle LoadingBlockModifiers */
 	m_lbm_mgr.applyLBMs(this, block, stamp, (float)dtime_s);
 	if (block->isOrphan())
@@ -583,6 +609,79 @@ void ServerEnvironment::activateBlock(MapBlock *block)
 	});
 }
 
+void ServerEnvironment::collectPendingLBMs()
+{
+	// New entries are only ever added at the end
+	auto first = m_pending_activations.end();
+	while (first != m_pending_activations.begin() && !std::prev(first)->collected)
+		--first;
+	const size_t count = m_pending_activations.end() - first;
+	if (count == 0)
+		return;
+
+	ScopeProfiler sp(g_profiler, "ServerEnv: collect LBMs", SPT_AVG);
+
+	std::vector<MapBlock *> blocks(count);
+	for (size_t i = 0; i < count; i++)
+		blocks[i] = m_map->getBlockNoCreateNoEx(first[i].blockpos);
+
+	// Nothing else runs on the server thread meanwhile, so the blocks stay
+	m_server->getWorkerPool()->runShared(count, [&] (size_t i) {
+		PendingActivation &pending = first[i];
+		if (blocks[i])
+			m_lbm_mgr.collectLBMs(blocks[i], pending.stamp, pending.lbms);
+		pending.collected = true;
+	});
+}
+
+void ServerEnvironment::runPendingActivations(u32 max_time_ms,
+	const std::set<v3s16> *only_blocks)
+{
+	TimeTaker timer("run pending block activations");
+	size_t n_run = 0;
+
+	std::deque<PendingActivation> selected;
+	std::deque<PendingActivation> *queue = &m_pending_activations;
+	if (only_blocks) {
+		auto it = std::stable_partition(m_pending_activations.begin(),
+			m_pending_activations.end(), [&] (const PendingActivation &pending) {
+				return only_blocks->count(pending.blockpos) == 0;
+			});
+		std::move(it, m_pending_activations.end(), std::back_inserter(selected));
+		m_pending_activations.erase(it, m_pending_activations.end());
+		queue = &selected;
+		max_time_ms = U32_MAX;
+	}
+
+	while (!queue->empty()) {
+		if (n_run > 0 && timer.getTimerTime() >= max_time_ms)
+			break;
+
+		PendingActivation pending = std::move(queue->front());
+		queue->pop_front();
+		m_pending_activation_blocks.erase(
+			m_pending_activation_blocks.find(pending.blockpos));
+		n_run++;
+		assert(pending.collected);
+
+		MapBlock *block = m_map->getBlockNoCreateNoEx(pending.blockpos);
+		if (!block)
+			continue;
+
+		LBMManager::runLBMs(this, block, pending.lbms, (float)pending.dtime_s);
+		if (block->isOrphan())
+			continue;
+
+		// Run node timers
+		block->step((float)pending.dtime_s, [&](v3s16 p, MapNode n, NodeTimer t) -> bool {
+			return m_script->node_on_timer(p, n, t.elapsed, t.timeout);
+		});
+	}
+
+	timer.stop(true);
+	g_profiler->avg("ServerEnv: pending block activations", m_pending_activations.size());
+}
+
 void ServerEnvironment::addActiveBlockModifier(ActiveBlockModifier *abm)
 {
 	m_abms.emplace_back(abm);
@@ -918,6 +1017,9 @@ void ServerEnvironment::step(float dtime)
 		// Convert active objects that are no more in active blocks to static
 		deactivateFarObjects(false);
 
+		// Their LBMs must not be skipped if they get unloaded
+		runPendingActivations(0, &blocks_removed);
+
 		for (const v3s16 &p: blocks_removed) {
 			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
 			if (!block)
@@ -942,7 +1044,7 @@ void ServerEnvironment::step(float dtime)
 				continue;
 			}
 
-			activateBlock(block);
+			activateBlock(block, true);
 		}
 
 		for (const v3s16 &p: extra_blocks_added) {
@@ -953,9 +1055,11 @@ void ServerEnvironment::step(float dtime)
 				continue;
 			}
 
-			activateBlock(block);
+			activateBlock(block, true);
 		}
 
+		collectPendingLBMs();
+
 		// Some blocks may be removed again by the code above so do this here
 		m_active_block_gauge->set(m_active_blocks.size());
 
@@ -993,6 +1097,10 @@ void ServerEnvironment::step(float dtime)
 					MOD_REASON_BLOCK_EXPIRED);
 			}
 
+			// Elapsed timers are caught up on in runPendingActivations() first
+			if (m_pending_activation_blocks.count(p))
+				continue;
+
 			// Run node timers
 			block->step(dtime, [&](v3s16 p, MapNode n, NodeTimer t) -> bool {
 				return m_script->node_on_timer(p, n, t.elapsed, t.timeout);
@@ -1000,6 +1108,14 @@ void ServerEnvironment::step(float dtime)
 		}
 	}
 
+	/*
+		Run LBMs and node timers of newly activated blocks
+	*/
+	if (!m_pending_activations.empty()) {
+		ScopeProfiler sp(g_profiler, "ServerEnv: run LBMs of activated blocks", SPT_AVG);
+		runPendingActivations(m_cache_lbm_time_budget * 1000);
+	}
+
 	if (m_active_block_modifier_interval.step(dtime, m_cache_abm_interval)) {
 		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per interval", SPT_AVG);
 		TimeTaker timer("modify in active blocks per interval");
@@ -1035,6 +1151,10 @@ void ServerEnvironment::step(float dtime)
 			// Set current time as timestamp
 			block->setTimestampNoChangedFlag(m_game_time);
 
+			// LBMs go first
+			if (m_pending_activation_blocks.count(p))
+				continue;
+
 			/* Handle ActiveBlockModifiers */
 			abmhandler.apply(block, blocks_scanned, abms_run, blocks_cached);
 
@@ -1218,6 +1338,135 @@ void ServerEnvironment::invalidateActiveObjectObserverCaches()
 	m_ao_manager.invalidateActiveObjectObserverCaches();
 }
 
+void ServerEnvironment::beginActiveObjectVisibilityUpdate()
+{
+	m_ao_manager.takeVisibilityDirty(m_ao_visibility_changed);
+	m_ao_visibility_round++;
+	// Never hand out 0, clients that were never updated use it
+	if (m_ao_visibility_round == 0)
+		m_ao_visibility_round++;
+}
+
+/*
+	Whether an object somewhere inside the mapblock `cell` can be on either side
+	of `range` around a player that stays within ACTIVE_OBJECT_MAX_DRIFT of `pos`
+*/
+static bool reaches_across_range(v3s16 cell, v3f pos, f32 range)
+{
+	const v3f cell_min = intToFloat(cell * MAP_BLOCKSIZE, BS) - v3f(BS / 2);
+	const v3f cell_max = cell_min + v3f(MAP_BLOCKSIZE * BS);
+	const v3f nearest(
+		rangelim(pos.X, cell_min.X, cell_max.X),
+		rangelim(pos.Y, cell_min.Y, cell_max.Y),
+		rangelim(pos.Z, cell_min.Z, cell_max.Z));
+	const v3f farthest(
+		pos.X * 2 < cell_min.X + cell_max.X ? cell_max.X : cell_min.X,
+		pos.Y * 2 < cell_min.Y + cell_max.Y ? cell_max.Y : cell_min.Y,
+		pos.Z * 2 < cell_min.Z + cell_max.Z ? cell_max.Z : cell_min.Z);
+	return nearest.getDistanceFrom(pos) - ACTIVE_OBJECT_MAX_DRIFT <= range &&
+		farthest.getDistanceFrom(pos) + ACTIVE_OBJECT_MAX_DRIFT > range;
+}
+
+void ServerEnvironment::getActiveObjectChanges(PlayerSAO *playersao, s16 radius,
+	s16 player_radius,
+	const std::set<u16> &current_objects,
+	KnownObjectsState &state,
+	std::vector<std::pair<bool /* gone? */, u16>> &removed_objects,
+	std::vector<u16> &added_objects)
+{
+	const v3f player_pos = playersao->getBasePosition();
+	const bool incremental = state.round != 0 &&
+		state.round + 1 == m_ao_visibility_round &&
+		state.radius == radius && state.player_radius == player_radius &&
+		player_pos.getDistanceFrom(state.pos) <= ACTIVE_OBJECT_MAX_DRIFT;
+
+	state.round = m_ao_visibility_round;
+	state.radius = radius;
+	state.player_radius = player_radius;
+
+	f32 radius_f = radius * BS;
+	f32 player_radius_f = player_radius * BS;
+
+	if (player_radius_f < 0)
+		player_radius_f = 0;
+
+	// Objects in the same mapblock until they are marked dirty may
+	// still cross the range, so they need a look every round
+	const auto update_border = [&](ServerActiveObject *object) {
+		const u16 id = object->getId();
+		bool border;
+		if (object->getType() == ACTIVEOBJECT_TYPE_PLAYER && player_radius_f == 0) {
+			border = false;
+		} else {
+			f32 range = object->getType() == ACTIVEOBJECT_TYPE_PLAYER
+				? player_radius_f : radius_f;
+			border = reaches_across_range(
+				server::ActiveObjectMgr::getVisibilityCell(object->getBasePosition()),
+				state.pos, range);
+		}
+		if (border)
+			state.border.insert(id);
+		else
+			state.border.erase(id);
+	};
+
+	if (!incremental) {
+		state.pos = player_pos;
+		state.border.clear();
+
+		getRemovedActiveObjects(playersao, radius, player_radius,
+			current_objects, removed_objects);
+		getAddedActiveObjects(playersao, radius, player_radius,
+			current_objects, added_objects);
+
+		std::vector<ServerActiveObject *> objects;
+		m_ao_manager.getObjectsInsideRadius(player_pos,
+			std::max(radius_f, player_radius_f) + ACTIVE_OBJECT_MAX_DRIFT +
+				MAP_BLOCKSIZE * BS * std::sqrt(3.0f),
+			objects, nullptr);
+		for (ServerActiveObject *object : objects)
+			update_border(object);
+		return;
+	}
+
+	const std::string &player_name = playersao->getPlayer()->getName();
+
+	if (!playersao->isEffectivelyObservedBy(player_name))
+		throw ModError("Player does not observe itself");
+
+	std::vector<u16> ids(state.border.begin(), state.border.end());
+	ids.insert(ids.end(), m_ao_visibility_changed.begin(),
+		m_ao_visibility_changed.end());
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	// Same rules as getRemovedActiveObjects and getAddedActiveObjects
+	for (u16 id : ids) {
+		const bool known = current_objects.find(id) != current_objects.end();
+		ServerActiveObject *object = getActiveObject(id);
+
+		if (!object || object->isGone()) {
+			state.border.erase(id);
+			if (known)
+				removed_objects.emplace_back(true, id);
+			continue;
+		}
+
+		update_border(object);
+
+		f32 distance_f = object->getBasePosition().getDistanceFrom(player_pos);
+		bool in_range = object->getType() == ACTIVEOBJECT_TYPE_PLAYER
+			? distance_f <= player_radius_f || player_radius_f == 0
+			: distance_f <= radius_f;
+		bool visible = in_range && object->isEffectivelyObservedBy(player_name);
+
+		if (known && !visible)
+			removed_objects.emplace_back(false, id);
+		else if (!known && visible)
+			added_objects.push_back(id);
+	}
+}
+
 /*
 	Finds out what new objects have been added to
 	inside a radius around a position
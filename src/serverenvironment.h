@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include <deque>
 #include <memory> // std::unique_ptr
 #include <set>
+#include <unordered_set>
 #include <unordered_map>
 #include <utility> // std::function
 #include <vector>
@@ -31,6 +33,7 @@ class ServerScripting;
 class Settings;
 struct ActiveObjectMessage;
 struct GameParams;
+struct KnownObjectsState;
 struct StaticObject;
 
 class ServerMap;
@@ -174,6 +177,26 @@ class ServerEnvironment final : public Environment
 
 	void invalidateActiveObjectObserverCaches();
 
+	/*
+		Start a round of getActiveObjectChanges() for all players,
+		taking the objects that changed since the previous round.
+	*/
+	void beginActiveObjectVisibilityUpdate();
+
+	/*
+		Find out what objects a player has to be told about or to forget.
+		Only the objects changed since the previous round and those whose
+		mapblock reaches across the edge of the range are looked at, unless
+		the player has moved more than a few nodes, the ranges have changed
+		or the player missed the previous round.
+	*/
+	void getActiveObjectChanges(PlayerSAO *playersao, s16 radius,
+		s16 player_radius,
+		const std::set<u16> &current_objects,
+		KnownObjectsState &state,
+		std::vector<std::pair<bool /* gone? */, u16>> &removed_objects,
+		std::vector<u16> &added_objects);
+
 	/*
 		Find out what new objects have been added to
 		inside a radius around a position
@@ -236,6 +259,11 @@ class ServerEnvironment final : public Environment
 		return m_ao_manager.updateObjectPos(id, pos);
 	}
 
+	void markObjectVisibilityDirty(u16 id)
+	{
+		m_ao_manager.markVisibilityDirty(id);
+	}
+
 	// Find all active objects inside a radius around a point
 	void getObjectsInsideRadius(std::vector<ServerActiveObject *> &objects, const v3f &pos, float radius,
 			std::function<bool(ServerActiveObject *obj)> include_obj_cb)
@@ -307,7 +335,22 @@ class ServerEnvironment final : public Environment
 	static AuthDatabase *openAuthDatabase(const std::string &name,
 			const std::string &savedir, const Settings &conf);
 
-	void activateBlock(MapBlock *block);
+	/**
+	 * @param defer leave LBMs and node timers to runPendingActivations()
+	 */
+	void activateBlock(MapBlock *block, bool defer = false);
+
+	// Finds the LBMs to run for all pending activations that were not
+	// looked at yet, spread over the server's worker pool
+	void collectPendingLBMs();
+	/**
+	 * Runs LBMs and node timers of pending activations.
+	 * @param max_time_ms stop after this much time, at least one is run
+	 * @param only_blocks if not NULL, all of those of these blocks and no
+	 *                    others are run, regardless of the time
+	 */
+	void runPendingActivations(u32 max_time_ms,
+		const std::set<v3s16> *only_blocks = nullptr);
 
 	/*
 		Internal ActiveObject interface
@@ -376,6 +419,9 @@ class ServerEnvironment final : public Environment
 	Server *m_server = nullptr;
 	// Active Object Manager
 	server::ActiveObjectMgr m_ao_manager;
+	// Objects that changed before the current visibility update round
+	std::vector<u16> m_ao_visibility_changed;
+	u32 m_ao_visibility_round = 0;
 	// on_mapblocks_changed map event receiver
 	OnMapblocksChangedReceiver m_on_mapblocks_changed_receiver;
 	GUIDGenerator m_guid_generator;
@@ -405,6 +451,18 @@ class ServerEnvironment final : public Environment
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
 	LBMManager m_lbm_mgr;
+	// Block activations whose LBMs and node timers are still to be run
+	struct PendingActivation {
+		v3s16 blockpos;
+		// timestamp of the block before it was activated
+		u32 stamp;
+		u32 dtime_s;
+		bool collected = false;
+		LBMRunList lbms;
+	};
+	std::deque<PendingActivation> m_pending_activations;
+	// Positions in m_pending_activations, ABMs and node timers skip these
+	std::unordered_multiset<v3s16> m_pending_activation_blocks;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval = 0.1f;
 	// Estimate for general maximum lag as determined by server.
@@ -420,6 +478,7 @@ class ServerEnvironment final : public Environment
 	float m_cache_abm_interval;
 	float m_cache_nodetimer_interval;
 	float m_cache_abm_time_budget;
+	float m_cache_lbm_time_budget;
 
 	// peer_ids in here should be unique, except that there may be many 0s
 	std::vector<RemotePlayer*> m_players;
@@ -4,6 +4,7 @@
 
 #include "servermap.h"
 
+#include <algorithm>
 #include "map.h"
 #include "mapsector.h"
 #include "filesys.h"
@@ -17,8 +18,11 @@
 #include "gamedef.h"
 #include "util/directiontables.h"
 #include "util/serialize.h"
+#include "util/timetaker.h"
 #include "rollback_interface.h"
 #include "reflowscan.h"
+#include "liquidtransform.h"
+#include "threading/thread_pool.h"
 #include "emerge.h"
 #include "mapgen/mg_biome.h"
 #include "config.h"
@@ -45,9 +49,318 @@
 void MapDatabaseAccessor::loadBlock(v3s16 blockpos, std::string &ret)
 {
 	ret.clear();
-	dbase->loadBlock(blockpos, &ret);
-	if (ret.empty() && dbase_ro)
-		dbase_ro->loadBlock(blockpos, &ret);
+	MapSaveThread::Snapshot queued;
+	{
+		MutexAutoLock dblock(mutex);
+		if (saver)
+			queued = saver->getQueued(blockpos);
+		if (!queued) {
+			dbase->loadBlock(blockpos, &ret);
+			if (ret.empty() && dbase_ro)
+				dbase_ro->loadBlock(blockpos, &ret);
+			return;
+		}
+	}
+	// Don't hold up the database while compressing
+	ret = saver->compressBlock(*queued);
+}
+
+void MapDatabaseAccessor::loadBlocks(const std::vector<v3s16> &blockpos,
+	std::vector<std::string> &ret)
+{
+	// Blocks waiting to be written are newer than what is on disk
+	std::vector<MapSaveThread::Snapshot> queued(blockpos.size());
+	{
+		MutexAutoLock dblock(mutex);
+		dbase->loadBlocks(blockpos, ret);
+
+		if (saver) {
+			for (size_t i = 0; i < blockpos.size(); i++)
+				queued[i] = saver->getQueued(blockpos[i]);
+		}
+
+		std::vector<v3s16> missing;
+		if (dbase_ro) {
+			for (size_t i = 0; i < blockpos.size(); i++) {
+				if (ret[i].empty() && !queued[i])
+					missing.push_back(blockpos[i]);
+			}
+		}
+		if (!missing.empty()) {
+			std::vector<std::string> ret_ro;
+			dbase_ro->loadBlocks(missing, ret_ro);
+			for (size_t i = 0, j = 0; i < blockpos.size(); i++) {
+				if (ret[i].empty() && !queued[i])
+					ret[i] = std::move(ret_ro[j++]);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < blockpos.size(); i++) {
+		if (queued[i])
+			ret[i] = saver->compressBlock(*queued[i]);
+	}
+}
+
+/*
+	MapSaveThread
+*/
+
+MapSaveThread::MapSaveThread(MapDatabaseAccessor *db, int compression_level,
+		size_t max_queued, u32 retry_delay_ms):
+	Thread("MapSave"),
+	m_db(db),
+	m_compression_level(compression_level),
+	m_max_queued(max_queued),
+	m_retry_delay_ms(retry_delay_ms)
+{
+}
+
+void MapSaveThread::enqueue(v3s16 pos, std::string &&data)
+{
+	auto ptr = std::make_shared<const std::string>(std::move(data));
+
+	std::unique_lock lock(m_mutex);
+	auto it = m_queued.find(pos);
+	if (it != m_queued.end() && it->second.in_order) {
+		// Still waiting, replace the data in place
+		it->second.seq = m_next_seq++;
+		it->second.data = std::move(ptr);
+		return;
+	}
+
+	// Backpressure: don't let the server thread run away from the disk
+	m_cv.wait(lock, [&] { return m_order.size() < m_max_queued; });
+
+	QueuedBlock &block = m_queued[pos];
+	block.seq = m_next_seq++;
+	block.data = std::move(ptr);
+	block.in_order = true;
+	block.failed = false;
+	block.failures = 0;
+	m_order.push_back(pos);
+	lock.unlock();
+	m_cv.notify_all();
+}
+
+MapSaveThread::Snapshot MapSaveThread::getQueued(v3s16 pos)
+{
+	MutexAutoLock lock(m_mutex);
+	auto it = m_queued.find(pos);
+	if (it == m_queued.end())
+		return nullptr;
+	return it->second.data;
+}
+
+void MapSaveThread::discard(v3s16 pos)
+{
+	MutexAutoLock lock(m_mutex);
+	auto it = m_queued.find(pos);
+	if (it == m_queued.end())
+		return;
+	if (it->second.in_order)
+		m_order.erase(std::find(m_order.begin(), m_order.end(), pos));
+	m_queued.erase(it);
+}
+
+void MapSaveThread::flush()
+{
+	std::unique_lock lock(m_mutex);
+	m_cv.wait(lock, [&] { return m_order.empty() && m_in_flight == 0; });
+}
+
+std::vector<v3s16> MapSaveThread::takeFailed()
+{
+	std::vector<v3s16> ret;
+	MutexAutoLock lock(m_mutex);
+	for (v3s16 pos : m_failed) {
+		// may have been queued again or discarded meanwhile
+		auto it = m_queued.find(pos);
+		if (it != m_queued.end() && it->second.failed)
+			ret.push_back(pos);
+	}
+	m_failed.clear();
+	return ret;
+}
+
+void MapSaveThread::retry(v3s16 pos)
+{
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_queued.find(pos);
+		if (it == m_queued.end() || !it->second.failed)
+			return;
+		it->second.failed = false;
+		it->second.failures = 0;
+		it->second.in_order = true;
+		m_order.push_back(pos);
+	}
+	m_cv.notify_all();
+}
+
+void MapSaveThread::stop()
+{
+	{
+		// so that the thread can't miss the wakeup
+		MutexAutoLock lock(m_mutex);
+		Thread::stop();
+		// Nobody is going to pick these up anymore, so give every block
+		// a full set of attempts before it is lost.
+		for (auto &it : m_queued) {
+			QueuedBlock &block = it.second;
+			block.failures = 0;
+			if (block.failed) {
+				block.failed = false;
+				block.in_order = true;
+				m_order.push_back(it.first);
+			}
+		}
+		m_failed.clear();
+	}
+	m_cv.notify_all();
+}
+
+std::string MapSaveThread::compressBlock(const std::string &data) const
+{
+	// Same layout as ServerMap::saveBlock():
+	// [0] u8 serialization version
+	// [1] data
+	const u8 version = SER_FMT_VER_HIGHEST_WRITE;
+	std::ostringstream o(std::ios_base::binary);
+	o.write((char*) &version, 1);
+	compress(data, o, version, m_compression_level);
+	return o.str();
+}
+
+void *MapSaveThread::run()
+{
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	struct Item {
+		v3s16 pos;
+		u64 seq;
+		std::shared_ptr<const std::string> data;
+	};
+	std::vector<Item> batch;
+	std::vector<std::pair<v3s16, std::string>> compressed;
+
+	while (true) {
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [&] { return !m_order.empty() || stopRequested(); });
+			// Only exit once everything is written
+			if (m_order.empty())
+				break;
+
+			while (!m_order.empty() && batch.size() < BATCH_SIZE) {
+				v3s16 pos = m_order.front();
+				m_order.pop_front();
+				QueuedBlock &block = m_queued.at(pos);
+				block.in_order = false;
+				batch.push_back({pos, block.seq, block.data});
+			}
+			m_in_flight = batch.size();
+		}
+		// there is room in the queue now
+		m_cv.notify_all();
+
+		TimeTaker tt("", nullptr, PRECISION_MICRO);
+
+		for (auto &item : batch)
+			compressed.emplace_back(item.pos, compressBlock(*item.data));
+
+		bool ok = true;
+		size_t n_failed = 0;
+		std::vector<v3s16> lost;
+		{
+			MutexAutoLock dblock(m_db->mutex);
+
+			{
+				// Skip blocks that were discarded or queued again meanwhile
+				MutexAutoLock lock(m_mutex);
+				size_t n = 0;
+				for (size_t i = 0; i < batch.size(); i++) {
+					auto it = m_queued.find(batch[i].pos);
+					if (it == m_queued.end() || it->second.seq != batch[i].seq)
+						continue;
+					if (n != i) {
+						batch[n] = std::move(batch[i]);
+						compressed[n] = std::move(compressed[i]);
+					}
+					n++;
+				}
+				batch.resize(n);
+				compressed.resize(n);
+			}
+
+			if (!compressed.empty()) {
+				m_db->dbase->beginSave();
+				ok = m_db->dbase->saveBlocks(compressed);
+				m_db->dbase->endSave();
+			}
+
+			MutexAutoLock lock(m_mutex);
+			for (auto &item : batch) {
+				auto it = m_queued.find(item.pos);
+				if (it == m_queued.end() || it->second.seq != item.seq)
+					continue;
+				if (!ok) {
+					// Stop retrying eventually, otherwise a broken database
+					// blocks flush() and stop(). The snapshot is kept unless
+					// there is nobody left to hand it back to.
+					if (++it->second.failures >= MAX_WRITE_ATTEMPTS) {
+						if (stopRequested()) {
+							lost.push_back(item.pos);
+							m_queued.erase(it);
+						} else {
+							it->second.failed = true;
+							m_failed.push_back(item.pos);
+							n_failed++;
+						}
+						continue;
+					}
+					// try again later
+					if (!it->second.in_order) {
+						it->second.in_order = true;
+						m_order.push_back(item.pos);
+					}
+					continue;
+				}
+				m_queued.erase(it);
+			}
+			m_in_flight = 0;
+		}
+		m_cv.notify_all();
+
+		g_profiler->avg("MapSave: blocks per batch", compressed.size());
+		g_profiler->avg("MapSave: write time [us]", tt.stop(true));
+
+		batch.clear();
+		compressed.clear();
+
+		if (n_failed > 0) {
+			errorstream << "MapSaveThread: failed to write " << n_failed
+				<< " blocks " << (int)MAX_WRITE_ATTEMPTS << " times, "
+				"handing them back to the map" << std::endl;
+		}
+		for (v3s16 pos : lost) {
+			errorstream << "MapSaveThread: giving up on writing block "
+				<< pos << " while shutting down, its changes are lost" << std::endl;
+		}
+		if (!ok) {
+			errorstream << "MapSaveThread: failed to write blocks, "
+				"retrying later" << std::endl;
+			// A stop request only cuts the wait short once
+			std::unique_lock lock(m_mutex);
+			const bool stopping = stopRequested();
+			m_cv.wait_for(lock, std::chrono::milliseconds(m_retry_delay_ms),
+				[&] { return stopRequested() != stopping; });
+		}
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+
+	return nullptr;
 }
 
 /*
@@ -99,6 +412,13 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 
 	m_map_compression_level = rangelim(g_settings->getS16("map_compression_level_disk"), -1, 9);
 
+	if (u16 queue_size = g_settings->getU16("map_save_queue_size")) {
+		m_saver = std::make_unique<MapSaveThread>(&m_db,
+			m_map_compression_level, queue_size);
+		m_db.saver = m_saver.get();
+		m_saver->start();
+	}
+
 	try {
 		// If directory exists, check contents and load if possible
 		if (fs::PathExists(m_savedir)) {
@@ -159,6 +479,15 @@ ServerMap::~ServerMap()
 				 << ", exception: " << e.what() << std::endl;
 	}
 
+	if (m_saver) {
+		// Writes out whatever is still queued
+		m_saver->stop();
+		m_saver->wait();
+		MutexAutoLock dblock(m_db.mutex);
+		m_db.saver = nullptr;
+		m_saver.reset();
+	}
+
 	m_emerge->resetMap();
 
 	{
@@ -515,6 +844,17 @@ void ServerMap::save(ModifiedState save_level)
 
 	const auto start_time = porting::getTimeUs();
 
+	// Blocks the save thread gave up on are saved again. Loaded ones get a
+	// fresh snapshot below, the snapshot is all that is left of the others.
+	if (m_saver) {
+		for (v3s16 pos : m_saver->takeFailed()) {
+			if (MapBlock *block = getBlockNoCreateNoEx(pos))
+				block->raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_UNKNOWN);
+			else
+				m_saver->retry(pos);
+		}
+	}
+
 	if(save_level == MOD_STATE_CLEAN)
 		infostream<<"ServerMap: Saving whole map, this can take time."
 				<<std::endl;
@@ -533,6 +873,10 @@ void ServerMap::save(ModifiedState save_level)
 	// Don't do anything with sqlite unless something is really saved
 	bool save_started = false;
 
+	// Blocks are written to the database in batches
+	std::vector<MapBlock*> save_queue;
+	save_queue.reserve(SAVE_BATCH_SIZE);
+
 	for (auto &sector_it : m_sectors) {
 		MapSector *sector = sector_it.second;
 
@@ -551,15 +895,28 @@ void ServerMap::save(ModifiedState save_level)
 
 				modprofiler.add(block->getModifiedReasonString(), 1);
 
-				saveBlock(block);
 				block_count++;
+				if (m_saver) {
+					queueBlockSave(block);
+					continue;
+				}
+				save_queue.push_back(block);
+				if (save_queue.size() >= SAVE_BATCH_SIZE)
+					saveBlocks(save_queue);
 			}
 		}
 	}
 
+	if (!save_queue.empty())
+		saveBlocks(save_queue);
+
 	if(save_started)
 		endSave();
 
+	// A full save is expected to be on disk once we return
+	if (m_saver && save_level == MOD_STATE_CLEAN)
+		m_saver->flush();
+
 	/*
 		Only print if something happened or saved whole map
 	*/
@@ -580,6 +937,10 @@ void ServerMap::save(ModifiedState save_level)
 
 void ServerMap::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
+	// queued blocks may not exist in the database yet
+	if (m_saver)
+		m_saver->flush();
+
 	MutexAutoLock dblock(m_db.mutex);
 	m_db.dbase->listAllLoadableBlocks(dst);
 	if (m_db.dbase_ro)
@@ -665,27 +1026,47 @@ MapDatabase *ServerMap::createDatabase(
 
 void ServerMap::beginSave()
 {
+	// the save thread manages transactions on its own
+	if (m_saver)
+		return;
 	MutexAutoLock dblock(m_db.mutex);
 	m_db.dbase->beginSave();
 }
 
 void ServerMap::endSave()
 {
+	if (m_saver)
+		return;
 	MutexAutoLock dblock(m_db.mutex);
 	m_db.dbase->endSave();
 }
 
 bool ServerMap::saveBlock(MapBlock *block)
 {
+	if (m_saver) {
+		queueBlockSave(block);
+		return true;
+	}
 	// FIXME: serialization happens under mutex
 	MutexAutoLock dblock(m_db.mutex);
-	return saveBlock(block, m_db.dbase, m_map_compression_level);
+	bool ret = saveBlock(block, m_db.dbase, m_map_compression_level);
+	m_db.write_count++;
+	return ret;
 }
 
-bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level)
+void ServerMap::queueBlockSave(MapBlock *block)
 {
-	v3s16 p3d = block->getPos();
+	std::ostringstream o(std::ios_base::binary);
+	block->serializeUncompressed(o, SER_FMT_VER_HIGHEST_WRITE, true);
+	// The snapshot is what will end up on disk. It stays queued until it is
+	// written, and save() marks the block modified again if that fails.
+	block->resetModified();
+	m_saver->enqueue(block->getPos(), o.str());
+	m_db.write_count++;
+}
 
+static std::string serializeBlockForDisk(MapBlock *block, int compression_level)
+{
 	// Format used for writing
 	u8 version = SER_FMT_VER_HIGHEST_WRITE;
 
@@ -698,7 +1079,13 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 	block->serialize(o, version, true, compression_level);
 
 	// FIXME: zero copy possible in c++20 or with custom rdbuf
-	bool ret = db->saveBlock(p3d, o.str());
+	return o.str();
+}
+
+bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level)
+{
+	bool ret = db->saveBlock(block->getPos(),
+		serializeBlockForDisk(block, compression_level));
 	if (ret) {
 		// We just wrote it to the disk so clear modified flag
 		block->resetModified();
@@ -706,6 +1093,27 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 	return ret;
 }
 
+void ServerMap::saveBlocks(std::vector<MapBlock*> &blocks)
+{
+	std::vector<std::pair<v3s16, std::string>> data;
+	data.reserve(blocks.size());
+	for (MapBlock *block : blocks)
+		data.emplace_back(block->getPos(),
+			serializeBlockForDisk(block, m_map_compression_level));
+
+	bool ret;
+	{
+		MutexAutoLock dblock(m_db.mutex);
+		ret = m_db.dbase->saveBlocks(data);
+		m_db.write_count++;
+	}
+	if (ret) {
+		for (MapBlock *block : blocks)
+			block->resetModified();
+	}
+	blocks.clear();
+}
+
 void ServerMap::deSerializeBlock(MapBlock *block, std::istream &is)
 {
 	ScopeProfiler sp(g_profiler, "ServerMap: deSer block", SPT_AVG, PRECISION_MICRO);
@@ -792,7 +1200,6 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 	std::string data;
 	{
 		ScopeProfiler sp(g_profiler, "ServerMap: load block - sync (sum)");
-		MutexAutoLock dblock(m_db.mutex);
 		m_db.loadBlock(blockpos, data);
 	}
 
@@ -804,7 +1211,11 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 bool ServerMap::deleteBlock(v3s16 blockpos)
 {
 	MutexAutoLock dblock(m_db.mutex);
-	if (!m_db.dbase->deleteBlock(blockpos))
+	if (m_saver)
+		m_saver->discard(blockpos);
+	bool deleted = m_db.dbase->deleteBlock(blockpos);
+	m_db.write_count++;
+	if (!deleted)
 		return false;
 
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
@@ -857,63 +1268,55 @@ bool ServerMap::repairBlockLight(v3s16 blockpos,
 	Liquids
 */
 
-#define WATER_DROP_BOOST 4
-
-const static v3s16 liquid_6dirs[6] = {
-	// order: upper before same level before lower
-	v3s16( 0, 1, 0),
-	v3s16( 0, 0, 1),
-	v3s16( 1, 0, 0),
-	v3s16( 0, 0,-1),
-	v3s16(-1, 0, 0),
-	v3s16( 0,-1, 0)
-};
+namespace {
 
-enum NeighborType : u8 {
-	NEIGHBOR_UPPER,
-	NEIGHBOR_SAME_LEVEL,
-	NEIGHBOR_LOWER
-};
+// Runs on_flood() and records changes for rollback
+class ServerLiquidTransform : public LiquidTransform
+{
+public:
+	ServerLiquidTransform(ServerMap *map, ServerEnvironment *env,
+			UniqueQueue<v3s16> *queue, LiquidTransformResult *result) :
+		LiquidTransform(map, queue, result),
+		m_env(env),
+		m_gamedef(env->getGameDef())
+	{}
+
+protected:
+	void setNode(v3s16 p, MapNode n) override
+	{
+		// Find out whether there is a suspect for this action
+		std::string suspect;
+		if (m_gamedef->rollback())
+			suspect = m_gamedef->rollback()->getSuspect(p, 83, 1);
 
-struct NodeNeighbor {
-	MapNode n;
-	NeighborType t;
-	v3s16 p;
+		if (m_gamedef->rollback() && !suspect.empty()) {
+			// Blame suspect
+			RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
+			// Get old node for rollback
+			RollbackNode rollback_oldnode(m_map, p, m_gamedef);
+			// Set node
+			m_map->setNode(p, n);
+			// Report
+			RollbackNode rollback_newnode(m_map, p, m_gamedef);
+			RollbackAction action;
+			action.setSetNode(p, rollback_oldnode, rollback_newnode);
+			m_gamedef->rollback()->reportAction(action);
+		} else {
+			// Set node
+			m_map->setNode(p, n);
+		}
+	}
 
-	NodeNeighbor()
-		: n(CONTENT_AIR), t(NEIGHBOR_SAME_LEVEL)
-	{ }
+	bool onFlood(v3s16 p, MapNode oldnode, MapNode newnode) override
+	{
+		return m_env->getScriptIface()->node_on_flood(p, oldnode, newnode);
+	}
 
-	NodeNeighbor(const MapNode &node, NeighborType n_type, const v3s16 &pos)
-		: n(node),
-		  t(n_type),
-		  p(pos)
-	{ }
+private:
+	ServerEnvironment *m_env;
+	IGameDef *m_gamedef;
 };
 
-static s8 get_max_liquid_level(NodeNeighbor nb, s8 current_max_node_level)
-{
-	s8 max_node_level = current_max_node_level;
-	u8 nb_liquid_level = (nb.n.param2 & LIQUID_LEVEL_MASK);
-	switch (nb.t) {
-		case NEIGHBOR_UPPER:
-			if (nb_liquid_level + WATER_DROP_BOOST > current_max_node_level) {
-				max_node_level = LIQUID_LEVEL_MAX;
-				if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
-					max_node_level = nb_liquid_level + WATER_DROP_BOOST;
-			} else if (nb_liquid_level > current_max_node_level) {
-				max_node_level = nb_liquid_level;
-			}
-			break;
-		case NEIGHBOR_LOWER:
-			break;
-		case NEIGHBOR_SAME_LEVEL:
-			if ((nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
-					nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
-				max_node_level = nb_liquid_level - 1;
-			break;
-	}
-	return max_node_level;
 }
 
 void ServerMap::transforming_liquid_add(v3s16 p)
@@ -924,326 +1327,37 @@ void ServerMap::transforming_liquid_add(v3s16 p)
 void ServerMap::transformLiquidsLocal(std::map<v3s16, MapBlock*> &modified_blocks, UniqueQueue<v3s16> &liquid_queue,
 		ServerEnvironment *env, u32 liquid_loop_max)
 {
-	u32 loopcount = 0;
-
-	/*if(initial_size != 0)
-		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
-
-	// list of nodes that due to viscosity have not reached their max level height
-	std::vector<v3s16> must_reflow;
-
-	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
-
-	std::vector<v3s16> check_for_falling;
-
-	while (!liquid_queue.empty())
-	{
-		// This should be done here so that it is done when continue is used
-		if (loopcount >= liquid_loop_max)
-			break;
-		loopcount++;
+	LiquidTransformResult result;
+	ServerLiquidTransform transform(this, env, &liquid_queue, &result);
 
+	for (u32 loopcount = 0; loopcount < liquid_loop_max && !liquid_queue.empty(); loopcount++) {
 		/*
 			Get a queued transforming liquid node
 		*/
 		v3s16 p0 = liquid_queue.front();
 		liquid_queue.pop_front();
 
-		MapNode n0 = getNode(p0);
-
-		/*
-			Collect information about current node
-		 */
-		s8 liquid_level = -1;
-		// The liquid node which will be placed there if
-		// the liquid flows into this node.
-		content_t liquid_kind = CONTENT_IGNORE;
-		// The node which will be placed there if liquid
-		// can't flow into this node.
-		content_t floodable_node = CONTENT_AIR;
-		const ContentFeatures &cf = m_nodedef->get(n0);
-		LiquidType liquid_type = cf.liquid_type;
-		switch (liquid_type) {
-			case LIQUID_SOURCE:
-				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = cf.liquid_alternative_flowing_id;
-				break;
-			case LIQUID_FLOWING:
-				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
-				liquid_kind = n0.getContent();
-				break;
-			case LIQUID_NONE:
-				// if this node is 'floodable', it *could* be transformed
-				// into a liquid, otherwise, continue with the next node.
-				if (!cf.floodable)
-					continue;
-				floodable_node = n0.getContent();
-				liquid_kind = CONTENT_AIR;
-				break;
-			case LiquidType_END:
-				break;
-		}
-
-		/*
-			Collect information about the environment
-		 */
-		NodeNeighbor sources[6]; // surrounding sources
-		int num_sources = 0;
-		NodeNeighbor flows[6]; // surrounding flowing liquid nodes
-		int num_flows = 0;
-		NodeNeighbor airs[6]; // surrounding air
-		int num_airs = 0;
-		NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
-		int num_neutrals = 0;
-		bool flowing_down = false;
-		bool ignored_sources = false;
-		bool floating_node_above = false;
-		for (u16 i = 0; i < 6; i++) {
-			NeighborType nt = NEIGHBOR_SAME_LEVEL;
-			switch (i) {
-				case 0:
-					nt = NEIGHBOR_UPPER;
-					break;
-				case 5:
-					nt = NEIGHBOR_LOWER;
-					break;
-				default:
-					break;
-			}
-			v3s16 npos = p0 + liquid_6dirs[i];
-			NodeNeighbor nb(getNode(npos), nt, npos);
-			const ContentFeatures &cfnb = m_nodedef->get(nb.n);
-			if (nt == NEIGHBOR_UPPER && cfnb.floats)
-				floating_node_above = true;
-			switch (cfnb.liquid_type) {
-				case LIQUID_NONE:
-					if (cfnb.floodable) {
-						airs[num_airs++] = nb;
-						// if the current node is a water source the neighbor
-						// should be enqueued for transformation regardless of whether the
-						// current node changes or not.
-						if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
-							liquid_queue.push_back(npos);
-						// if the current node happens to be a flowing node, it will start to flow down here.
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					} else {
-						neutrals[num_neutrals++] = nb;
-						if (nb.n.getContent() == CONTENT_IGNORE) {
-							// If node below is ignore prevent water from
-							// spreading outwards and otherwise prevent from
-							// flowing away as ignore node might be the source
-							if (nb.t == NEIGHBOR_LOWER)
-								flowing_down = true;
-							else
-								ignored_sources = true;
-						}
-					}
-					break;
-				case LIQUID_SOURCE:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = cfnb.liquid_alternative_flowing_id;
-					if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						// Do not count bottom source, it will screw things up
-						if(nt != NEIGHBOR_LOWER)
-							sources[num_sources++] = nb;
-					}
-					break;
-				case LIQUID_FLOWING:
-					if (nb.t != NEIGHBOR_SAME_LEVEL ||
-						(nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK) {
-						// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-						// but exclude falling liquids on the same level, they cannot flow here anyway
-
-						// used to determine if the neighbor can even flow into this node
-						s8 max_level_from_neighbor = get_max_liquid_level(nb, -1);
-						u8 range = m_nodedef->get(cfnb.liquid_alternative_flowing_id).liquid_range;
-
-						if (liquid_kind == CONTENT_AIR &&
-								max_level_from_neighbor >= (LIQUID_LEVEL_MAX + 1 - range))
-							liquid_kind = cfnb.liquid_alternative_flowing_id;
-					}
-					if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						flows[num_flows++] = nb;
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					}
-					break;
-				case LiquidType_END:
-					break;
-			}
-		}
-
-		/*
-			decide on the type (and possibly level) of the current node
-		 */
-		content_t new_node_content;
-		s8 new_node_level = -1;
-		s8 max_node_level = -1;
-
-		u8 range = m_nodedef->get(liquid_kind).liquid_range;
-		if (range > LIQUID_LEVEL_MAX + 1)
-			range = LIQUID_LEVEL_MAX + 1;
-
-		if ((num_sources >= 2 && m_nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
-			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
-			// or the flowing alternative of the first of the surrounding sources (if it's air), so
-			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = m_nodedef->get(liquid_kind).liquid_alternative_source_id;
-		} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
-			// liquid_kind is set properly, see above
-			max_node_level = new_node_level = LIQUID_LEVEL_MAX;
-			if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-		} else if (ignored_sources && liquid_level >= 0) {
-			// Maybe there are neighboring sources that aren't loaded yet
-			// so prevent flowing away.
-			new_node_level = liquid_level;
-			new_node_content = liquid_kind;
-		} else {
-			// no surrounding sources, so get the maximum level that can flow into this node
-			for (u16 i = 0; i < num_flows; i++) {
-				max_node_level = get_max_liquid_level(flows[i], max_node_level);
-			}
-
-			u8 viscosity = m_nodedef->get(liquid_kind).liquid_viscosity;
-			if (viscosity > 1 && max_node_level != liquid_level) {
-				// amount to gain, limited by viscosity
-				// must be at least 1 in absolute value
-				s8 level_inc = max_node_level - liquid_level;
-				if (level_inc < -viscosity || level_inc > viscosity)
-					new_node_level = liquid_level + level_inc/viscosity;
-				else if (level_inc < 0)
-					new_node_level = liquid_level - 1;
-				else if (level_inc > 0)
-					new_node_level = liquid_level + 1;
-				if (new_node_level != max_node_level)
-					must_reflow.push_back(p0);
-			} else {
-				new_node_level = max_node_level;
-			}
-
-			if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-
-		}
-
-		/*
-			check if anything has changed. if not, just continue with the next node.
-		 */
-		if (new_node_content == n0.getContent() &&
-				(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
-				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
-				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
-				== flowing_down)))
-			continue;
-
-		/*
-			check if there is a floating node above that needs to be updated.
-		 */
-		if (floating_node_above && new_node_content == CONTENT_AIR)
-			check_for_falling.push_back(p0);
-
-		/*
-			update the current node
-		 */
-		MapNode n00 = n0;
-		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
-			// set level to last 3 bits, flowing down bit to 4th bit
-			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
-		} else {
-			// set the liquid level and flow bits to 0
-			n0.param2 &= ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
-		}
-
-		// change the node.
-		n0.setContent(new_node_content);
-
-		// on_flood() the node
-		if (floodable_node != CONTENT_AIR) {
-			if (env->getScriptIface()->node_on_flood(p0, n00, n0))
-				continue;
-		}
-
-		// Ignore light (because calling voxalgo::update_lighting_nodes)
-		ContentLightingFlags f0 = m_nodedef->getLightingFlags(n0);
-		n0.setLight(LIGHTBANK_DAY, 0, f0);
-		n0.setLight(LIGHTBANK_NIGHT, 0, f0);
-
-		// Find out whether there is a suspect for this action
-		std::string suspect;
-		if (m_gamedef->rollback())
-			suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
-
-		if (m_gamedef->rollback() && !suspect.empty()) {
-			// Blame suspect
-			RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
-			// Get old node for rollback
-			RollbackNode rollback_oldnode(this, p0, m_gamedef);
-			// Set node
-			setNode(p0, n0);
-			// Report
-			RollbackNode rollback_newnode(this, p0, m_gamedef);
-			RollbackAction action;
-			action.setSetNode(p0, rollback_oldnode, rollback_newnode);
-			m_gamedef->rollback()->reportAction(action);
-		} else {
-			// Set node
-			setNode(p0, n0);
-		}
-
-		v3s16 blockpos = getNodeBlockPos(p0);
-		MapBlock *block = getBlockNoCreateNoEx(blockpos);
-		if (block != NULL) {
-			modified_blocks[blockpos] =  block;
-			changed_nodes.emplace_back(p0, n00);
-		}
-
-		/*
-			enqueue neighbors for update if necessary
-		 */
-		switch (m_nodedef->get(n0.getContent()).liquid_type) {
-			case LIQUID_SOURCE:
-			case LIQUID_FLOWING:
-				// make sure source flows into all neighboring nodes
-				for (u16 i = 0; i < num_flows; i++)
-					if (flows[i].t != NEIGHBOR_UPPER)
-						liquid_queue.push_back(flows[i].p);
-				for (u16 i = 0; i < num_airs; i++)
-					if (airs[i].t != NEIGHBOR_UPPER)
-						liquid_queue.push_back(airs[i].p);
-				break;
-			case LIQUID_NONE:
-				// this flow has turned to air; neighboring flows might need to do the same
-				for (u16 i = 0; i < num_flows; i++)
-					liquid_queue.push_back(flows[i].p);
-				break;
-			case LiquidType_END:
-				break;
-		}
+		transform.transformNode(p0);
 	}
-	//infostream<<"Map::transformLiquids(): loopcount="<<loopcount<<std::endl;
 
-	for (const auto &iter : must_reflow)
+	finishLiquidTransform(modified_blocks, liquid_queue, env, result);
+}
+
+void ServerMap::finishLiquidTransform(std::map<v3s16, MapBlock*> &modified_blocks,
+		UniqueQueue<v3s16> &liquid_queue, ServerEnvironment *env,
+		LiquidTransformResult &result)
+{
+	for (const auto &iter : result.must_reflow)
 		liquid_queue.push_back(iter);
 
-	voxalgo::update_lighting_nodes(this, changed_nodes, modified_blocks);
+	modified_blocks.insert(result.modified_blocks.begin(), result.modified_blocks.end());
+	voxalgo::update_lighting_nodes(this, result.changed_nodes, modified_blocks);
 
-	for (const v3s16 &p : check_for_falling) {
+	for (const v3s16 &p : result.check_for_falling) {
 		env->getScriptIface()->check_for_falling(p);
 	}
 
-	env->getScriptIface()->on_liquid_transformed(changed_nodes);
+	env->getScriptIface()->on_liquid_transformed(result.changed_nodes);
 }
 
 void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
@@ -1252,7 +1366,36 @@ void ServerMap::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 	// process the whole queue at most once, to rate-limit
 	u32 liquid_loop_max = std::min<u32>(m_transforming_liquid.size(), g_settings->getS32("liquid_loop_max"));
 
-	transformLiquidsLocal(modified_blocks, m_transforming_liquid, env, liquid_loop_max);
+	ThreadPool *pool = env->getServer()->getWorkerPool();
+
+	// Rollback needs to know the actor of each change, so it stays serial
+	if (liquid_loop_max >= LIQUID_PARALLEL_MIN && !m_gamedef->rollback() &&
+			pool->getConcurrency() > 1) {
+		std::vector<v3s16> nodes;
+		nodes.reserve(liquid_loop_max);
+		for (u32 i = 0; i < liquid_loop_max; i++) {
+			nodes.push_back(m_transforming_liquid.front());
+			m_transforming_liquid.pop_front();
+		}
+
+		LiquidTransformResult result;
+		std::vector<v3s16> deferred;
+		{
+			ScopeProfiler sp(g_profiler, "ServerMap: liquid transform parallel", SPT_AVG);
+			LiquidTransform::transformParallel(this, pool, nodes,
+				m_transforming_liquid, deferred, result);
+		}
+		g_profiler->avg("ServerMap: liquid nodes deferred", deferred.size());
+
+		// Nodes with on_flood callbacks
+		ServerLiquidTransform transform(this, env, &m_transforming_liquid, &result);
+		for (v3s16 p : deferred)
+			transform.transformNode(p);
+
+		finishLiquidTransform(modified_blocks, m_transforming_liquid, env, result);
+	} else {
+		transformLiquidsLocal(modified_blocks, m_transforming_liquid, env, liquid_loop_max);
+	}
 
 	/* ----------------------------------------------------------------------
 	 * Manage the queue so that it does not grow indefinitely
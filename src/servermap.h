@@ -4,10 +4,15 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 #include "map.h"
+#include "threading/thread.h"
 #include "util/container.h" // UniqueQueue
 #include "util/metricsbackend.h" // ptr typedefs
 #include "map_settings_manager.h"
@@ -18,6 +23,9 @@ class EmergeManager;
 class ServerEnvironment;
 struct BlockMakeData;
 class MetricsBackend;
+class MapSaveThread;
+class TestMapDatabase;
+struct LiquidTransformResult;
 
 // TODO: this could wrap all calls to MapDatabase, including locking
 struct MapDatabaseAccessor {
@@ -27,10 +35,101 @@ struct MapDatabaseAccessor {
 	MapDatabase *dbase = nullptr;
 	/// Fallback database for read operations
 	MapDatabase *dbase_ro = nullptr;
+	/// Background writer, optional. Blocks queued there are not in dbase yet.
+	MapSaveThread *saver = nullptr;
+	/// Incremented after blocks were written or deleted, so that anything
+	/// caching loaded data can tell whether it may have become stale.
+	/// Read it before loading: data loaded afterwards is current as of it.
+	std::atomic<u64> write_count{0};
 
 	/// Load a block, taking dbase_ro into account.
-	/// @note call locked
+	/// @note takes the lock itself
 	void loadBlock(v3s16 blockpos, std::string &ret);
+	/// Load multiple blocks at once, taking dbase_ro into account.
+	/// `ret` receives one entry per position (empty if not found).
+	/// @note takes the lock itself
+	void loadBlocks(const std::vector<v3s16> &blockpos, std::vector<std::string> &ret);
+};
+
+/*
+	Write-behind saving of map blocks.
+
+	The server thread hands over uncompressed snapshots of modified blocks,
+	which are then compressed and written to the database in batches on this
+	thread. Reads through MapDatabaseAccessor see queued blocks right away.
+
+	A snapshot is only let go of once it is written. Blocks that fail to be
+	written too often are handed back with takeFailed(), and stop() keeps
+	trying for a while before it gives up with an error.
+*/
+class MapSaveThread : public Thread
+{
+public:
+	typedef std::shared_ptr<const std::string> Snapshot;
+
+	/// @param retry_delay_ms time to wait after a failed write
+	MapSaveThread(MapDatabaseAccessor *db, int compression_level, size_t max_queued,
+		u32 retry_delay_ms = 1000);
+
+	/// Queue a snapshot made by MapBlock::serializeUncompressed(), replacing
+	/// an older one of the same block. Waits while the queue is full.
+	void enqueue(v3s16 pos, std::string &&data);
+	/// Get the snapshot of a queued block, see compressBlock().
+	/// @note call with the database mutex held
+	/// @return nullptr if the block is not queued
+	Snapshot getQueued(v3s16 pos);
+	/// Turn a snapshot into the format stored in the database.
+	std::string compressBlock(const std::string &data) const;
+	/// Drop a queued block so that it won't be written.
+	/// @note call with the database mutex held
+	void discard(v3s16 pos);
+	/// Wait until all blocks queued so far have been written, or handed
+	/// back because writing them failed too often.
+	void flush();
+	/// @return blocks that failed to be written MAX_WRITE_ATTEMPTS times
+	/// since the last call. Their snapshots stay queued but are not retried
+	/// until they are queued again or retry() is called.
+	std::vector<v3s16> takeFailed();
+	/// Try to write a block returned by takeFailed() again.
+	void retry(v3s16 pos);
+
+	void stop();
+
+protected:
+	void *run();
+
+private:
+	friend class TestMapDatabase;
+
+	struct QueuedBlock {
+		u64 seq;
+		Snapshot data;
+		bool in_order; // whether the position is in m_order
+		bool failed; // whether it is waiting in m_failed
+		u8 failures; // failed attempts to write this snapshot
+	};
+
+	// number of blocks written per database transaction
+	static constexpr size_t BATCH_SIZE = 256;
+	// a block is handed back after failing to be written this many times,
+	// or dropped if that happens while stopping
+	static constexpr u8 MAX_WRITE_ATTEMPTS = 10;
+
+	MapDatabaseAccessor *m_db;
+	const int m_compression_level;
+	const size_t m_max_queued;
+	const u32 m_retry_delay_ms;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::unordered_map<v3s16, QueuedBlock> m_queued;
+	// order in which blocks are written
+	std::deque<v3s16> m_order;
+	// blocks to be picked up by takeFailed()
+	std::vector<v3s16> m_failed;
+	u64 m_next_seq = 0;
+	// number of blocks taken from m_order but not written yet
+	size_t m_in_flight = 0;
 };
 
 /*
@@ -174,6 +273,24 @@ class ServerMap : public Map
 	// extra border area during mapgen (in blocks)
 	constexpr static v3s16 EMERGE_EXTRA_BORDER{1, 1, 1};
 
+	// number of blocks written to the database at once by save()
+	constexpr static size_t SAVE_BATCH_SIZE = 256;
+
+	/// Serialize and write the given blocks to the database in one go,
+	/// then clear the vector.
+	void saveBlocks(std::vector<MapBlock*> &blocks);
+	/// Hand a snapshot of the block over to m_saver, which keeps it until
+	/// it is written.
+	void queueBlockSave(MapBlock *block);
+
+	// minimum number of queued liquid nodes to use the server's worker pool
+	constexpr static u32 LIQUID_PARALLEL_MIN = 1024;
+
+	/// Lighting and callbacks after liquid nodes were transformed
+	void finishLiquidTransform(std::map<v3s16, MapBlock*> &modified_blocks,
+		UniqueQueue<v3s16> &liquid_queue, ServerEnvironment *env,
+		LiquidTransformResult &result);
+
 	// Emerge manager
 	EmergeManager *m_emerge;
 
@@ -201,6 +318,7 @@ class ServerMap : public Map
 	bool m_map_metadata_changed = true;
 
 	MapDatabaseAccessor m_db;
+	std::unique_ptr<MapSaveThread> m_saver;
 
 	// Map metrics
 	MetricGaugePtr m_loaded_blocks_gauge;
@@ -23,6 +23,11 @@ class TestServerActiveObjectMgr {
 
 	u16 getFreeId() const { return saomgr.getFreeId(); }
 
+	void setSpatialIndexType(server::ActiveObjectMgr::SpatialIndexType type)
+	{
+		saomgr.setSpatialIndexType(type);
+	}
+
 	bool registerObject(std::unique_ptr<ServerActiveObject> obj)
 	{
 		auto *ptr = obj.get();
@@ -277,8 +282,41 @@ SECTION("get added active objects around pos") {
 	saomgr.clear();
 }
 
+SECTION("visibility dirty") {
+	server::ActiveObjectMgr saomgr;
+	std::vector<u16> dirty;
+
+	auto obj = std::make_unique<MockServerActiveObject>(nullptr, v3f(1, 2, 3));
+	auto *ptr = obj.get();
+	saomgr.registerObject(std::move(obj));
+	const u16 id = ptr->getId();
+	saomgr.takeVisibilityDirty(dirty);
+	CHECK(dirty == std::vector<u16>{id});
+
+	// Moving inside the mapblock is not interesting
+	saomgr.updateObjectPos(id, v3f(5 * BS, 2, 3));
+	saomgr.takeVisibilityDirty(dirty);
+	CHECK(dirty.empty());
+
+	saomgr.updateObjectPos(id, v3f(20 * BS, 2, 3));
+	saomgr.takeVisibilityDirty(dirty);
+	CHECK(dirty == std::vector<u16>{id});
+
+	saomgr.markVisibilityDirty(id);
+	saomgr.markVisibilityDirty(id);
+	saomgr.takeVisibilityDirty(dirty);
+	CHECK(dirty == std::vector<u16>{id});
+
+	saomgr.removeObject(id);
+	saomgr.takeVisibilityDirty(dirty);
+	CHECK(dirty == std::vector<u16>{id});
+}
+
 SECTION("spatial index") {
+	using SpatialIndexType = server::ActiveObjectMgr::SpatialIndexType;
+	const auto index_type = GENERATE(SpatialIndexType::KdTree, SpatialIndexType::HashGrid);
 	TestServerActiveObjectMgr saomgr;
+	saomgr.setSpatialIndexType(index_type);
 	std::mt19937 gen(0xABCDEF);
 	std::uniform_int_distribution<s32> coordinate(-1000, 1000);
 	const auto random_pos = [&]() {
@@ -320,6 +358,12 @@ SECTION("spatial index") {
 		test_queries();
 	}
 
+	// Switch: The other index is rebuilt from the objects
+	saomgr.setSpatialIndexType(index_type == SpatialIndexType::KdTree ?
+			SpatialIndexType::HashGrid : SpatialIndexType::KdTree);
+	for (u32 i = 0; i < 100; ++i)
+		test_queries();
+
 	// Shrink: Deletion twice as likely as insertion
 	while (!saomgr.empty()) {
 		modify(25, 50, 25);
@@ -0,0 +1,125 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "catch.h"
+#include "irrTypes.h"
+#include "noise.h"
+#include "util/spatial_hash.h"
+
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+using Grid = spatial_hash::SpatialHashGrid<f32, u16>;
+
+static std::unordered_set<u16> query(const Grid &grid,
+	const Grid::Point &min, const Grid::Point &max)
+{
+	std::unordered_set<u16> ret;
+	grid.rangeQuery(min, max, [&](const Grid::Point &, u16 id) {
+		CHECK(ret.count(id) == 0);
+		ret.insert(id);
+	});
+	return ret;
+}
+
+TEST_CASE("spatial hash grid") {
+
+SECTION("negative coordinates") {
+	Grid grid(16);
+	grid.insert({-1, -1, -1}, 1);
+	grid.insert({0, 0, 0}, 2);
+	grid.insert({-16, 5, -17}, 3);
+	grid.insert({-32.5f, -100, 40}, 4);
+
+	CHECK(query(grid, {-1, -1, -1}, {-1, -1, -1}) == std::unordered_set<u16>{1});
+	CHECK(query(grid, {-1, -1, -1}, {0, 0, 0}) == std::unordered_set<u16>{1, 2});
+	CHECK(query(grid, {-17, 0, -17}, {-16, 5, -17}) == std::unordered_set<u16>{3});
+	CHECK(query(grid, {-33, -101, 39}, {-32, -99, 41}) == std::unordered_set<u16>{4});
+	CHECK(query(grid, {-15, -15, -15}, {-2, -2, -2}).empty());
+
+	// across cell borders, in both directions
+	grid.update({1, 1, 1}, 1);
+	grid.update({-100, 0, 0}, 2);
+	CHECK(query(grid, {0, 0, 0}, {2, 2, 2}) == std::unordered_set<u16>{1});
+	CHECK(query(grid, {-101, -1, -1}, {-99, 1, 1}) == std::unordered_set<u16>{2});
+}
+
+SECTION("infinite and huge boxes") {
+	constexpr f32 inf = std::numeric_limits<f32>::infinity();
+	constexpr f32 huge = 1e30f;
+	Grid grid(16);
+	grid.insert({0, 0, 0}, 1);
+	grid.insert({-5000, 200, 31000}, 2);
+	grid.insert({1e20f, -1e20f, 0}, 3);
+	const std::unordered_set<u16> all{1, 2, 3};
+
+	// like get_objects_inside_radius(pos, math.huge)
+	CHECK(query(grid, {-inf, -inf, -inf}, {inf, inf, inf}) == all);
+	CHECK(query(grid, {-huge, -huge, -huge}, {huge, huge, huge}) == all);
+	CHECK(query(grid, {0, -inf, -inf}, {inf, inf, inf}) == std::unordered_set<u16>{1, 3});
+	CHECK(query(grid, {-inf, -1, -1}, {1, 1, 1}) == std::unordered_set<u16>{1});
+	// points far outside keep working
+	CHECK(query(grid, {1e19f, -inf, -1}, {inf, 0, 1}) == std::unordered_set<u16>{3});
+	grid.update({-1e20f, 1e20f, 0}, 3);
+	CHECK(query(grid, {1e19f, -inf, -1}, {inf, 0, 1}).empty());
+	CHECK(query(grid, {-inf, 1e19f, -1}, {0, inf, 1}) == std::unordered_set<u16>{3});
+	grid.remove(3);
+	CHECK(query(grid, {-inf, -inf, -inf}, {inf, inf, inf}) == std::unordered_set<u16>{1, 2});
+
+	// empty and NaN boxes find nothing
+	CHECK(query(grid, {1, 1, 1}, {-1, -1, -1}).empty());
+	const f32 nan = std::numeric_limits<f32>::quiet_NaN();
+	CHECK(query(grid, {nan, nan, nan}, {nan, nan, nan}).empty());
+}
+
+SECTION("random operations") {
+	PseudoRandom pr(Catch::getSeed());
+	Grid grid(16);
+	std::unordered_map<u16, Grid::Point> points;
+
+	const auto randPos = [&]() {
+		Grid::Point point;
+		for (int d = 0; d < 3; ++d)
+			point[d] = pr.range(-1000, 1000);
+		return point;
+	};
+	const auto testRandomQuery = [&]() {
+		Grid::Point min, max;
+		for (int d = 0; d < 3; ++d) {
+			min[d] = pr.range(-1100, 1100);
+			max[d] = min[d] + pr.range(0, 300);
+		}
+		std::unordered_set<u16> expected;
+		for (const auto &it : points) {
+			bool in = true;
+			for (int d = 0; d < 3; ++d)
+				in = in && it.second[d] >= min[d] && it.second[d] <= max[d];
+			if (in)
+				expected.insert(it.first);
+		}
+		CHECK(query(grid, min, max) == expected);
+	};
+
+	for (u16 id = 1; id < 1000; ++id) {
+		points[id] = randPos();
+		grid.insert(points[id], id);
+	}
+	for (int i = 0; i < 200; ++i)
+		testRandomQuery();
+
+	for (u16 id = 1; id < 500; ++id) {
+		points.erase(id);
+		grid.remove(id);
+	}
+	for (u16 id = 500; id < 1000; ++id) {
+		points[id] = randPos();
+		grid.update(points[id], id);
+	}
+	CHECK(grid.size() == points.size());
+	for (int i = 0; i < 200; ++i)
+		testRandomQuery();
+}
+
+}
@@ -0,0 +1,83 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include "util/basic_macros.h"
+
+/*
+	Unbounded FIFO queue that any number of threads can push to without
+	locking, while a single thread pops.
+
+	A push that is still in progress can hide the elements pushed after it
+	from pop() for a moment, so consumers should be woken up *after* push()
+	returns (e.g. by posting a semaphore).
+*/
+template <typename T>
+class MPSCQueue
+{
+public:
+	MPSCQueue() = default;
+
+	~MPSCQueue()
+	{
+		Node *node = m_tail;
+		while (node) {
+			Node *next = node->next.load(std::memory_order_relaxed);
+			if (node != &m_stub)
+				delete node;
+			node = next;
+		}
+	}
+
+	DISABLE_CLASS_COPY(MPSCQueue);
+
+	/// Can be called from any thread.
+	void push(T value)
+	{
+		Node *node = new Node(std::move(value));
+		Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	/// Must only be called from the consumer thread.
+	/// @return false if the queue is empty
+	bool pop(T &value)
+	{
+		Node *tail = m_tail;
+		Node *next = tail->next.load(std::memory_order_acquire);
+		if (!next)
+			return false;
+		// `next` becomes the new (empty) front node
+		value = std::move(next->value);
+		next->value = T();
+		m_tail = next;
+		if (tail != &m_stub)
+			delete tail;
+		return true;
+	}
+
+	/// Must only be called from the consumer thread.
+	bool empty() const
+	{
+		return !m_tail->next.load(std::memory_order_acquire);
+	}
+
+private:
+	struct Node {
+		Node() = default;
+		Node(T &&v) : value(std::move(v)) {}
+
+		T value;
+		std::atomic<Node *> next = nullptr;
+	};
+
+	Node m_stub;
+	// last pushed node, written by producers
+	std::atomic<Node *> m_head = &m_stub;
+	// node before the front element, only used by the consumer
+	Node *m_tail = &m_stub;
+};
@@ -0,0 +1,167 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "threading/thread_pool.h"
+
+#include <algorithm>
+#include "threading/thread.h"
+#include "util/string.h"
+
+class ThreadPoolWorker : public Thread
+{
+public:
+	ThreadPoolWorker(const std::string &name, ThreadPool *pool) :
+		Thread(name), m_pool(pool)
+	{}
+
+protected:
+	void *run() override
+	{
+		ThreadPool &pool = *m_pool;
+		u64 last_job = 0;
+
+		while (true) {
+			const std::function<void(size_t)> *func;
+			size_t count;
+			{
+				std::unique_lock lock(pool.m_mutex);
+				pool.m_job_cv.wait(lock, [&] {
+					return pool.m_stop || pool.m_job_id != last_job;
+				});
+				if (pool.m_stop)
+					break;
+				last_job = pool.m_job_id;
+				// the job may already be over
+				if (!pool.m_func)
+					continue;
+				func = pool.m_func;
+				count = pool.m_count;
+				pool.m_busy++;
+			}
+
+			pool.work(*func, count);
+
+			{
+				std::lock_guard lock(pool.m_mutex);
+				pool.m_busy--;
+			}
+			pool.m_done_cv.notify_all();
+		}
+
+		return nullptr;
+	}
+
+private:
+	ThreadPool *m_pool;
+};
+
+
+ThreadPool::ThreadPool(const std::string &name, u32 num_threads)
+{
+	for (u32 i = 0; i < num_threads; i++) {
+		auto worker = std::make_unique<ThreadPoolWorker>(
+			name + "-" + itos(i), this);
+		worker->start();
+		m_workers.push_back(std::move(worker));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_stop = true;
+	}
+	m_job_cv.notify_all();
+
+	for (auto &worker : m_workers)
+		worker->wait();
+}
+
+u32 ThreadPool::getAutoThreadCount(s32 setting, u32 max_auto)
+{
+	if (setting > 0)
+		return setting;
+	u32 concurrency = Thread::getNumberOfProcessors();
+	// Leave 2 cores for main thread and whatever else.
+	return std::min(max_auto, concurrency > 2 ? concurrency - 2 : 0);
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &func)
+{
+	if (m_workers.empty() || count <= 1) {
+		for (size_t i = 0; i < count; i++)
+			func(i);
+		return;
+	}
+
+	std::lock_guard run_lock(m_run_mutex);
+	runJob(count, func);
+}
+
+bool ThreadPool::tryRun(size_t count, const std::function<void(size_t)> &func)
+{
+	if (m_workers.empty() || count <= 1) {
+		for (size_t i = 0; i < count; i++)
+			func(i);
+		return true;
+	}
+
+	std::unique_lock run_lock(m_run_mutex, std::try_to_lock);
+	if (!run_lock.owns_lock())
+		return false;
+	runJob(count, func);
+	return true;
+}
+
+void ThreadPool::runShared(size_t count, const std::function<void(size_t)> &func)
+{
+	if (tryRun(count, func))
+		return;
+	for (size_t i = 0; i < count; i++)
+		func(i);
+}
+
+void ThreadPool::runJob(size_t count, const std::function<void(size_t)> &func)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_func = &func;
+		m_count = count;
+		m_next = 0;
+		m_job_id++;
+	}
+	m_job_cv.notify_all();
+
+	work(func, count);
+
+	std::exception_ptr error;
+	{
+		std::unique_lock lock(m_mutex);
+		m_done_cv.wait(lock, [&] { return m_busy == 0; });
+		m_func = nullptr;
+		m_count = 0;
+		std::swap(error, m_error);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void ThreadPool::work(const std::function<void(size_t)> &func, size_t count)
+{
+	while (true) {
+		size_t i = m_next.fetch_add(1, std::memory_order_relaxed);
+		if (i >= count)
+			break;
+		try {
+			func(i);
+		} catch (...) {
+			std::lock_guard lock(m_mutex);
+			if (!m_error)
+				m_error = std::current_exception();
+			// skip the rest
+			m_next = count;
+		}
+	}
+}
@@ -0,0 +1,93 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "irrlichttypes.h"
+#include "util/basic_macros.h"
+
+class ThreadPoolWorker;
+
+/*
+	A fixed set of worker threads for splitting up a piece of work.
+
+	The calling thread takes part in the work and run() only returns once
+	all of it is done, so the caller can use the results without any further
+	synchronization. With zero worker threads everything runs on the caller.
+*/
+class ThreadPool
+{
+public:
+	/// @param name prefix for the thread names
+	/// @param num_threads number of worker threads (in addition to the caller)
+	ThreadPool(const std::string &name, u32 num_threads);
+	~ThreadPool();
+
+	DISABLE_CLASS_COPY(ThreadPool)
+
+	/// @return number of threads taking part in run(), including the caller
+	u32 getConcurrency() const { return m_workers.size() + 1; }
+
+	/**
+	 * Calls `func(i)` for every i in [0, count) and waits for completion.
+	 * Indices are handed out in ascending order but may run concurrently.
+	 * If a call throws the remaining indices are skipped and the first
+	 * exception is rethrown here.
+	 * @note Calls from several threads are serialized.
+	 */
+	void run(size_t count, const std::function<void(size_t)> &func);
+
+	/**
+	 * Like run(), but returns false right away without calling `func` if
+	 * another thread is using the pool. For pools that are shared between
+	 * threads which can just as well do the work themselves.
+	 */
+	bool tryRun(size_t count, const std::function<void(size_t)> &func);
+
+	/**
+	 * Like tryRun(), but if the pool is busy the caller does all the work
+	 * itself instead of waiting for it to become free.
+	 */
+	void runShared(size_t count, const std::function<void(size_t)> &func);
+
+	/// Picks the number of worker threads from a setting value.
+	/// 0 means automatic, which leaves two cores for other threads.
+	static u32 getAutoThreadCount(s32 setting, u32 max_auto);
+
+private:
+	friend class ThreadPoolWorker;
+
+	// Posts a job to the workers and takes part in it, m_run_mutex must be held
+	void runJob(size_t count, const std::function<void(size_t)> &func);
+	// Runs tasks of the current job until there are none left
+	void work(const std::function<void(size_t)> &func, size_t count);
+
+	std::vector<std::unique_ptr<ThreadPoolWorker>> m_workers;
+
+	// held by the thread that runs a job
+	std::mutex m_run_mutex;
+	std::mutex m_mutex;
+	// signalled when a job is posted or the pool shuts down
+	std::condition_variable m_job_cv;
+	// signalled when a worker leaves a job
+	std::condition_variable m_done_cv;
+	bool m_stop = false;
+
+	// Current job (guarded by m_mutex, except for m_next)
+	u64 m_job_id = 0;
+	const std::function<void(size_t)> *m_func = nullptr;
+	size_t m_count = 0;
+	std::atomic<size_t> m_next{0};
+	// number of workers inside work()
+	u32 m_busy = 0;
+	std::exception_ptr m_error;
+};
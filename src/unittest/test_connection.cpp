@@ -27,6 +27,8 @@ class TestConnection : public TestBase {
 
 	void testNetworkPacketSerialize();
 	void testHelpers();
+	void testReliablePacketBuffer();
+	void testIncomingSplitBuffer();
 	void testConnectSendReceive();
 };
 
@@ -36,6 +38,8 @@ void TestConnection::runTests(IGameDef *gamedef)
 {
 	TEST(testNetworkPacketSerialize);
 	TEST(testHelpers);
+	TEST(testReliablePacketBuffer);
+	TEST(testIncomingSplitBuffer);
 	TEST(testConnectSendReceive);
 }
 
@@ -149,6 +153,141 @@ void TestConnection::testHelpers()
 	UASSERT(readU8(&p2[3]) == data1[0]);
 }
 
+static con::BufferedPacketPtr make_reliable(u16 seqnum)
+{
+	SharedBuffer<u8> data(1);
+	data[0] = seqnum & 0xFF;
+	return con::makePacket(Address(127,0,0,1, 10),
+		con::makeReliablePacket(data, seqnum), 0x12345678, 123, 0);
+}
+
+void TestConnection::testReliablePacketBuffer()
+{
+	con::ReliablePacketBuffer buf;
+	u16 seqnum;
+	UASSERT(buf.empty());
+	UASSERT(!buf.getFirstSeqnum(seqnum));
+
+	// Out of order and across the wrap-around
+	const u16 next_expected = 65530;
+	for (u16 s : {65533, 65531, 2, 65535, 0, 1}) {
+		auto p = make_reliable(s);
+		buf.insert(p, next_expected);
+	}
+	UASSERTEQ(u32, buf.size(), 6);
+	UASSERT(buf.getFirstSeqnum(seqnum));
+	UASSERTEQ(u16, seqnum, 65531);
+
+	// A resent packet is only stored once
+	{
+		auto p = make_reliable(2);
+		buf.insert(p, next_expected);
+		UASSERTEQ(u32, buf.size(), 6);
+	}
+
+	UASSERTEQ(u16, buf.popSeqnum(0)->getSeqnum(), 0);
+	EXCEPTION_CHECK(con::NotFoundException, buf.popSeqnum(0));
+	UASSERTEQ(u16, buf.popSeqnum(2)->getSeqnum(), 2);
+	for (u16 s : {65531, 65533, 65535, 1})
+		UASSERTEQ(u16, buf.popFirst()->getSeqnum(), s);
+	UASSERT(buf.empty());
+	EXCEPTION_CHECK(con::NotFoundException, buf.popFirst());
+
+	// More packets than the initial capacity, inserted in reverse
+	const u32 count = 10 * con::ReliablePacketBuffer::MIN_CAPACITY;
+	for (u32 i = count; i > 0; i--) {
+		auto p = make_reliable(60000 + i);
+		buf.insert(p, 60000);
+	}
+	UASSERTEQ(u32, buf.size(), count);
+	// Every other one is acknowledged
+	for (u32 i = 2; i <= count; i += 2)
+		buf.popSeqnum(60000 + i);
+
+	buf.incrementTimeouts(1.0f);
+	auto resend = buf.getResend(0.5f, 10);
+	UASSERTEQ(size_t, resend.size(), 10);
+	for (u32 i = 0; i < 10; i++)
+		UASSERTEQ(u16, resend[i]->getSeqnum(), 60001 + 2 * i);
+	UASSERTEQ(u32, buf.getTimedOuts(0.5f), count / 2);
+
+	for (u32 i = 1; i <= count; i += 2)
+		UASSERTEQ(u16, buf.popFirst()->getSeqnum(), 60000 + i);
+	UASSERT(buf.empty());
+	UASSERTEQ(size_t, buf.m_ring.size(), con::ReliablePacketBuffer::MIN_CAPACITY);
+
+	// Packets too far ahead of the others are not buffered
+	con::ReliablePacketBuffer limited(MAX_RELIABLE_BUFFER_SPAN);
+	for (u32 offset : {1, MAX_RELIABLE_BUFFER_SPAN + 1, MAX_RELIABLE_BUFFER_SPAN}) {
+		auto p = make_reliable(100 + offset);
+		limited.insert(p, 100);
+	}
+	UASSERTEQ(u32, limited.size(), 2);
+	UASSERTEQ(size_t, limited.m_ring.size(), MAX_RELIABLE_BUFFER_SPAN);
+	// The ring shrinks with what is left in it
+	limited.popSeqnum(100 + MAX_RELIABLE_BUFFER_SPAN);
+	UASSERTEQ(size_t, limited.m_ring.size(), con::ReliablePacketBuffer::MIN_CAPACITY);
+	UASSERTEQ(u16, limited.popFirst()->getSeqnum(), 101);
+}
+
+void TestConnection::testIncomingSplitBuffer()
+{
+	SharedBuffer<u8> data(2000);
+	for (u32 i = 0; i < data.getSize(); i++)
+		data[i] = i * 7;
+	u16 split_seqnum = 100;
+	std::list<SharedBuffer<u8>> list;
+	con::makeAutoSplitPacket(data, 512, split_seqnum, &list);
+	std::vector<SharedBuffer<u8>> chunks(list.begin(), list.end());
+	UASSERTEQ(size_t, chunks.size(), 4);
+
+	con::IncomingSplitBuffer buf;
+	u16 command = 0;
+	std::vector<u8> result;
+	const auto insert = [&] (const SharedBuffer<u8> &chunk) {
+		return buf.insert(*chunk, chunk.getSize(), true, command, result);
+	};
+
+	// The last chunk comes first, so its position is not known yet
+	UASSERT(!insert(chunks[3]));
+	UASSERT(!insert(chunks[1]));
+	UASSERT(!insert(chunks[1]));
+	UASSERT(!insert(chunks[0]));
+	UASSERT(insert(chunks[2]));
+	UASSERTEQ(u16, command, readU16(*data));
+	UASSERTEQ(size_t, result.size(), data.getSize() - 2);
+	UASSERT(!memcmp(result.data(), &data[2], result.size()));
+
+	// Chunks that do not fit together drop the packet
+	list.clear();
+	con::makeAutoSplitPacket(data, 512, split_seqnum, &list);
+	chunks.assign(list.begin(), list.end());
+	UASSERT(!insert(chunks[0]));
+	SharedBuffer<u8> shorter(*chunks[1], chunks[1].getSize() - 1);
+	EXCEPTION_CHECK(con::InvalidIncomingDataException, insert(shorter));
+	// ...so it starts over
+	UASSERT(!insert(chunks[1]));
+	UASSERT(!insert(chunks[2]));
+	UASSERT(!insert(chunks[3]));
+	UASSERT(insert(chunks[0]));
+	UASSERT(!memcmp(result.data(), &data[2], result.size()));
+
+	// Large packets work, in any order
+	SharedBuffer<u8> big(20 * 1024 * 1024);
+	for (u32 i = 0; i < big.getSize(); i++)
+		big[i] = i * 13;
+	list.clear();
+	con::makeAutoSplitPacket(big, 512, ++split_seqnum, &list);
+	chunks.assign(list.begin(), list.end());
+	UASSERT(chunks.size() > 40000);
+	UASSERT(!insert(chunks.back()));
+	for (size_t i = 0; i < chunks.size() - 2; i++)
+		UASSERT(!insert(chunks[i]));
+	UASSERT(insert(chunks[chunks.size() - 2]));
+	UASSERTEQ(size_t, result.size(), big.getSize() - 2);
+	UASSERT(!memcmp(result.data(), &big[2], result.size()));
+}
+
 
 void TestConnection::testConnectSendReceive()
 {
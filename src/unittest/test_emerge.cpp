@@ -0,0 +1,231 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "test.h"
+
+#include "emerge_internal.h"
+#include "mock_server.h"
+#include "util/metricsbackend.h"
+
+class TestEmerge : public TestBase
+{
+public:
+	TestEmerge() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestEmerge"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBlockPriority(Server *server);
+	void testQueueOrder(Server *server);
+	void testDropping(Server *server);
+	void testObserverUpdates(Server *server);
+	void testHistogram();
+
+private:
+	static EmergeThread *addThread(EmergeManager &emerge, Server *server);
+	static std::vector<v3s16> popAll(EmergeThread *thread);
+};
+
+static TestEmerge g_test_instance;
+
+void TestEmerge::runTests(IGameDef *gamedef)
+{
+	MockServer server(getTestTempDirectory());
+
+	TEST(testBlockPriority, &server);
+	TEST(testQueueOrder, &server);
+	TEST(testDropping, &server);
+	TEST(testObserverUpdates, &server);
+	TEST(testHistogram);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A thread that is never started, only its queue is used
+EmergeThread *TestEmerge::addThread(EmergeManager &emerge, Server *server)
+{
+	auto *thread = new EmergeThread(server, emerge.m_threads.size());
+	thread->m_emerge = &emerge;
+	emerge.m_threads.push_back(thread);
+	return thread;
+}
+
+std::vector<v3s16> TestEmerge::popAll(EmergeThread *thread)
+{
+	std::vector<v3s16> ret;
+	v3s16 pos;
+	BlockEmergeData bedata;
+	while (thread->popBlockEmerge(&pos, &bedata))
+		ret.push_back(pos);
+	return ret;
+}
+
+static void dummy_callback(v3s16 blockpos, EmergeAction action, void *param)
+{
+}
+
+void TestEmerge::testBlockPriority(Server *server)
+{
+	MetricsBackend mb;
+	EmergeManager emerge(server, &mb);
+	emerge.m_observers = {{1, v3f(0, 0, 0), v3f(0, 0, 1), 10}};
+
+	BlockEmergeData bedata{};
+	bedata.peer_requested = 1;
+	bedata.flags = BLOCK_EMERGE_ALLOW_GEN;
+	bedata.queued_time = emerge.m_start_time;
+
+	// closer and in front of the camera goes first
+	double near, far, behind;
+	UASSERT(emerge.getBlockPriority({0, 0, 2}, bedata, &near));
+	UASSERT(emerge.getBlockPriority({0, 0, 5}, bedata, &far));
+	UASSERT(emerge.getBlockPriority({0, 0, -3}, bedata, &behind));
+	UASSERT(near < far);
+	UASSERT(near < behind);
+
+	// out of range of the player that requested it
+	double p;
+	UASSERT(!emerge.getBlockPriority({0, 0, 30}, bedata, &p));
+	// ...unless it has to be processed anyway
+	bedata.flags |= BLOCK_EMERGE_FORCE_QUEUE;
+	UASSERT(emerge.getBlockPriority({0, 0, 30}, bedata, &p));
+	bedata.flags = BLOCK_EMERGE_ALLOW_GEN;
+	bedata.callbacks.emplace_back(dummy_callback, nullptr);
+	UASSERT(emerge.getBlockPriority({0, 0, 30}, bedata, &p));
+	bedata.callbacks.clear();
+
+	// another player doesn't count
+	bedata.peer_requested = 2;
+	UASSERT(!emerge.getBlockPriority({0, 0, 2}, bedata, &p));
+	// requests not made by a player are kept
+	bedata.peer_requested = PEER_ID_INEXISTENT;
+	UASSERT(emerge.getBlockPriority({0, 0, 30}, bedata, &p));
+	UASSERT(emerge.getBlockPriority({0, 0, 2}, bedata, &p));
+	UASSERT(p == near);
+	bedata.peer_requested = 1;
+
+	// blocks that waited longer eventually go first
+	BlockEmergeData later = bedata;
+	later.queued_time = bedata.queued_time + 10 * 1000;
+	UASSERT(emerge.getBlockPriority({0, 0, 5}, bedata, &far));
+	UASSERT(emerge.getBlockPriority({0, 0, 2}, later, &near));
+	UASSERT(far < near);
+
+	// the distance still matters after a long uptime
+	bedata.queued_time = emerge.m_start_time + 60ULL * 24 * 3600 * 1000;
+	UASSERT(emerge.getBlockPriority({0, 0, 2}, bedata, &near));
+	UASSERT(emerge.getBlockPriority({0, 0, 3}, bedata, &far));
+	UASSERT(near < far);
+}
+
+void TestEmerge::testQueueOrder(Server *server)
+{
+	MetricsBackend mb;
+	EmergeManager emerge(server, &mb);
+	EmergeThread *thread = addThread(emerge, server);
+	emerge.updateObservers({{1, v3f(0, 0, 0), v3f(0, 0, 1), 10}});
+
+	const v3s16 queued[] = {{0, 0, 5}, {0, 0, 1}, {1, 0, 1}, {0, 0, 3}, {-2, 0, 1}};
+	for (v3s16 pos : queued)
+		UASSERT(emerge.enqueueBlockEmerge(1, pos, true));
+	// queued twice, kept once
+	UASSERT(emerge.enqueueBlockEmerge(1, queued[0], true));
+	UASSERTEQ(size_t, emerge.getQueueSize(), 5);
+
+	// by distance, then in the order they were queued
+	auto popped = popAll(thread);
+	const std::vector<v3s16> expected{{0, 0, 1}, {1, 0, 1}, {-2, 0, 1}, {0, 0, 3}, {0, 0, 5}};
+	UASSERT(popped == expected);
+	UASSERTEQ(size_t, emerge.getQueueSize(), 0);
+
+	// the wait time of each of them was recorded
+	UASSERTEQ(double, emerge.m_queue_wait_histogram[1]->getCount(), 5);
+	UASSERTEQ(double, emerge.m_queue_wait_histogram[0]->getCount(), 0);
+}
+
+void TestEmerge::testDropping(Server *server)
+{
+	MetricsBackend mb;
+	EmergeManager emerge(server, &mb);
+	EmergeThread *thread = addThread(emerge, server);
+	emerge.updateObservers({{1, v3f(0, 0, 0), v3f(0, 0, 1), 4}});
+
+	UASSERT(emerge.enqueueBlockEmerge(1, {0, 0, 1}, true));
+	UASSERT(emerge.enqueueBlockEmerge(1, {0, 0, 2}, true));
+	UASSERT(emerge.enqueueBlockEmerge(PEER_ID_INEXISTENT, {0, 0, 3}, true));
+	UASSERT(emerge.enqueueBlockEmergeEx({0, 0, 4}, 1, BLOCK_EMERGE_ALLOW_GEN,
+		dummy_callback, nullptr));
+
+	// the player went far away, the blocks that are kept are now sorted
+	// the other way around
+	emerge.updateObservers({{1, v3f(0, 0, 100), v3f(0, 0, 1), 4}});
+	auto popped = popAll(thread);
+	const std::vector<v3s16> expected{{0, 0, 4}, {0, 0, 3}};
+	UASSERT(popped == expected);
+	UASSERTEQ(size_t, emerge.getQueueSize(), 0);
+	UASSERTEQ(double, emerge.m_dropped_emerge_counter->get(), 2);
+
+	// the player left
+	UASSERT(emerge.enqueueBlockEmerge(1, {0, 0, 1}, true));
+	emerge.updateObservers({});
+	UASSERT(popAll(thread).empty());
+	UASSERTEQ(size_t, emerge.getQueueSize(), 0);
+}
+
+void TestEmerge::testObserverUpdates(Server *server)
+{
+	MetricsBackend mb;
+	EmergeManager emerge(server, &mb);
+	const EmergeObserver observer{1, v3f(0, 0, 0), v3f(0, 0, 1), 10};
+
+	emerge.updateObservers({observer});
+	const u32 version = emerge.m_observers_version;
+
+	// nothing or hardly anything changed
+	emerge.updateObservers({observer});
+	UASSERTEQ(u32, emerge.m_observers_version, version);
+	EmergeObserver o = observer;
+	o.pos.X += 0.1f;
+	emerge.updateObservers({o});
+	UASSERTEQ(u32, emerge.m_observers_version, version);
+	// small movements don't add up
+	o.pos.X += 0.1f;
+	emerge.updateObservers({o});
+	o.pos.X += 0.1f;
+	emerge.updateObservers({o});
+	UASSERTEQ(u32, emerge.m_observers_version, version + 1);
+
+	// turning
+	o = observer;
+	o.dir = v3f(0, 0.5f, 1).normalize();
+	emerge.updateObservers({o});
+	UASSERTEQ(u32, emerge.m_observers_version, version + 2);
+
+	// view range
+	o.range = 5;
+	emerge.updateObservers({o});
+	UASSERTEQ(u32, emerge.m_observers_version, version + 3);
+
+	// players joining and leaving
+	EmergeObserver o2 = observer;
+	o2.peer_id = 2;
+	emerge.updateObservers({o, o2});
+	UASSERTEQ(u32, emerge.m_observers_version, version + 4);
+	emerge.updateObservers({o2});
+	UASSERTEQ(u32, emerge.m_observers_version, version + 5);
+}
+
+void TestEmerge::testHistogram()
+{
+	MetricsBackend mb;
+	auto histogram = mb.addHistogram("test_histogram", "help", {0.1, 1, 10});
+	UASSERTEQ(double, histogram->getCount(), 0);
+	UASSERTEQ(double, histogram->getSum(), 0);
+
+	// within, on and beyond the bounds
+	for (double value : {0.05, 0.1, 0.5, 10.0, 100.0})
+		histogram->observe(value);
+	UASSERTEQ(double, histogram->getCount(), 5);
+	UASSERT(std::abs(histogram->getSum() - 110.65) < 0.0001);
+}
@@ -7,6 +7,7 @@
 #include <sstream>
 
 #include "server/blockmodifier.h"
+#include "mapblock.h"
 
 class TestLBMManager : public TestBase
 {
@@ -19,6 +20,7 @@ class TestLBMManager : public TestBase
 	void testNew(IGameDef *gamedef);
 	void testExisting(IGameDef *gamedef);
 	void testDiscard(IGameDef *gamedef);
+	void testCollectAndRun(IGameDef *gamedef);
 };
 
 static TestLBMManager g_test_instance;
@@ -28,6 +30,7 @@ void TestLBMManager::runTests(IGameDef *gamedef)
 	TEST(testNew, gamedef);
 	TEST(testExisting, gamedef);
 	TEST(testDiscard, gamedef);
+	TEST(testCollectAndRun, gamedef);
 }
 
 namespace {
@@ -37,6 +40,13 @@ namespace {
 			this->run_at_every_load = every_load;
 			trigger_contents.emplace_back("air");
 		}
+
+		void trigger(ServerEnvironment *env, MapBlock *block,
+				const std::unordered_set<v3s16> &positions, float dtime_s) override {
+			triggered += positions.size();
+		}
+
+		size_t triggered = 0;
 	};
 }
 
@@ -79,4 +89,35 @@ void TestLBMManager::testDiscard(IGameDef *gamedef)
 	UASSERTEQ(auto, str, "");
 }
 
-// We should also test LBMManager::applyLBMs in the future.
+void TestLBMManager::testCollectAndRun(IGameDef *gamedef)
+{
+	LBMManager mgr;
+
+	auto *lbm = new FakeLBM("foo:bar", false);
+	mgr.addLBMDef(lbm);
+	mgr.loadIntroductionTimes("foo:bar~100;", gamedef, 1234);
+
+	constexpr size_t nodecount = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+	MapBlock block({}, gamedef);
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		block.setNodeNoCheck(x, y, z, MapNode(CONTENT_AIR));
+	block.setNodeNoCheck(1, 2, 3, MapNode(t_CONTENT_STONE));
+
+	// the block was last active before the LBM was introduced
+	LBMRunList to_run;
+	mgr.collectLBMs(&block, 50, to_run);
+	UASSERTEQ(size_t, to_run.size(), 1);
+	UASSERTEQ(size_t, to_run[CONTENT_AIR].p.size(), nodecount - 1);
+
+	// nodes that changed until the LBM runs are skipped
+	block.setNodeNoCheck(0, 0, 0, MapNode(t_CONTENT_STONE));
+	LBMManager::runLBMs(nullptr, &block, to_run, 0);
+	UASSERTEQ(size_t, lbm->triggered, nodecount - 2);
+
+	// and afterwards
+	to_run.clear();
+	mgr.collectLBMs(&block, 200, to_run);
+	UASSERT(to_run.empty());
+}
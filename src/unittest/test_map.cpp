@@ -22,6 +22,10 @@ with this program; if not, see <https://www.gnu.org/licenses/>.
 #include <unordered_map>
 #include "mapblock.h"
 #include "dummymap.h"
+#include "dummygamedef.h"
+#include "liquidtransform.h"
+#include "nodedef.h"
+#include "threading/thread_pool.h"
 
 class TestMap : public TestBase
 {
@@ -35,6 +39,8 @@ class TestMap : public TestBase
 	void testForEachNodeInArea(IGameDef *gamedef);
 	void testForEachNodeInAreaBlank(IGameDef *gamedef);
 	void testForEachNodeInAreaEmpty(IGameDef *gamedef);
+	void testForEachNodeInAreaFiltered(IGameDef *gamedef);
+	void testLiquidTransformParallel();
 };
 
 static TestMap g_test_instance;
@@ -45,6 +51,8 @@ void TestMap::runTests(IGameDef *gamedef)
 	TEST(testForEachNodeInArea, gamedef);
 	TEST(testForEachNodeInAreaBlank, gamedef);
 	TEST(testForEachNodeInAreaEmpty, gamedef);
+	TEST(testForEachNodeInAreaFiltered, gamedef);
+	TEST(testLiquidTransformParallel);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -168,3 +176,147 @@ void TestMap::testForEachNodeInAreaEmpty(IGameDef *gamedef)
 		return true;
 	});
 }
+
+void TestMap::testForEachNodeInAreaFiltered(IGameDef *gamedef)
+{
+	// blocks from (-1,-1,-1) to (1,1,1), all ignore
+	DummyMap map(gamedef, v3s16(-1, -1, -1), v3s16(1, 1, 1));
+	const std::vector<content_t> stone{t_CONTENT_STONE};
+	const std::vector<content_t> ignore{CONTENT_IGNORE};
+
+	MapBlock *block = map.getBlockNoCreateNoEx(v3s16(0, 0, 0));
+	UASSERT(!Map::blockMayContain(nullptr, stone, true));
+	UASSERT(Map::blockMayContain(nullptr, ignore, true));
+	// not counted yet
+	UASSERT(Map::blockMayContain(block, stone, false));
+	UASSERT(!Map::blockMayContain(block, stone, true));
+
+	map.setNode(v3s16(3, 4, 5), MapNode(t_CONTENT_STONE));
+	map.setNode(v3s16(-10, 7, 1), MapNode(t_CONTENT_STONE));
+	map.setNode(v3s16(-10, 8, 1), MapNode(t_CONTENT_TORCH));
+	map.setNode(v3s16(10, -3, 15), MapNode(t_CONTENT_LAVA));
+	// counts are kept up to date
+	UASSERT(Map::blockMayContain(block, stone, false));
+
+	// the area reaches out of the loaded blocks
+	const v3s16 minp(-30, -20, -5), maxp(40, 15, 17);
+	const auto collect = [&] (const std::vector<content_t> *contents) {
+		std::vector<std::pair<v3s16, content_t>> found;
+		u32 visited = 0;
+		map.forEachNodeInArea(minp, maxp, contents, [&](v3s16 p, MapNode n) -> bool {
+			visited++;
+			content_t c = n.getContent();
+			if (!contents || CONTAINS(*contents, c))
+				found.emplace_back(p, c);
+			return true;
+		});
+		return std::make_pair(found, visited);
+	};
+	const auto all = collect(nullptr).first;
+
+	for (const auto &filter : std::vector<std::vector<content_t>>{
+			{}, stone, ignore, {t_CONTENT_TORCH, t_CONTENT_LAVA},
+			{CONTENT_AIR, t_CONTENT_WATER}}) {
+		std::vector<std::pair<v3s16, content_t>> expect;
+		for (const auto &it : all) {
+			if (CONTAINS(filter, it.second))
+				expect.push_back(it);
+		}
+		const auto result = collect(&filter);
+		// same nodes in the same order
+		UASSERT(result.first == expect);
+		if (filter.empty())
+			UASSERTEQ(u32, result.second, 0);
+	}
+	// only the two blocks with stone are visited, plus the six slices of
+	// z = 16..17 that are too thin to be worth counting
+	UASSERTEQ(u32, collect(&stone).second, 2 * MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+		6 * MAP_BLOCKSIZE * MAP_BLOCKSIZE * 2);
+}
+
+void TestMap::testLiquidTransformParallel()
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	content_t c_source = CONTENT_IGNORE, c_flowing = CONTENT_IGNORE;
+	const auto add_water = [&] (const std::string &name, LiquidType type) {
+		ContentFeatures f;
+		f.name = name;
+		f.liquid_type = type;
+		f.liquid_alternative_source_id = c_source;
+		f.liquid_alternative_flowing_id = c_flowing;
+		return ndef->set(f.name, std::move(f));
+	};
+	// twice so that the alternative ids are known
+	for (int i = 0; i < 2; i++) {
+		c_source = add_water("water_source", LIQUID_SOURCE);
+		c_flowing = add_water("water_flowing", LIQUID_FLOWING);
+	}
+
+	content_t c_stone;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, std::move(f));
+	}
+
+	// water spreading on the floor of an area that spans several regions
+	const v3s16 bpmin(-3, -1, -3), bpmax(2, 0, 2);
+	const auto make_map = [&] (UniqueQueue<v3s16> &queue) {
+		auto map = std::make_unique<DummyMap>(&gamedef, bpmin, bpmax);
+		map->fill(bpmin, v3s16(bpmax.X, -1, bpmax.Z), MapNode(c_stone));
+		map->fill(v3s16(bpmin.X, 0, bpmin.Z), bpmax, MapNode(CONTENT_AIR));
+		for (v3s16 p : {v3s16(-40, 0, -40), v3s16(-1, 0, 0), v3s16(0, 5, 0),
+				v3s16(15, 0, 30), v3s16(31, 0, -17)}) {
+			map->setNode(p, MapNode(c_source));
+			queue.push_back(p);
+		}
+		return map;
+	};
+	const auto run = [&] (Map *map, UniqueQueue<v3s16> &queue, ThreadPool *pool) {
+		for (int step = 0; step < 100 && !queue.empty(); step++) {
+			LiquidTransformResult result;
+			if (pool) {
+				std::vector<v3s16> nodes, deferred;
+				while (!queue.empty()) {
+					nodes.push_back(queue.front());
+					queue.pop_front();
+				}
+				LiquidTransform::transformParallel(map, pool, nodes, queue,
+					deferred, result);
+				UASSERT(deferred.empty());
+			} else {
+				LiquidTransform transform(map, &queue, &result);
+				for (size_t n = queue.size(); n > 0; n--) {
+					v3s16 p = queue.front();
+					queue.pop_front();
+					transform.transformNode(p);
+				}
+			}
+			for (v3s16 p : result.must_reflow)
+				queue.push_back(p);
+		}
+		UASSERT(queue.empty());
+	};
+
+	UniqueQueue<v3s16> queue1, queue2, queue3;
+	auto map1 = make_map(queue1), map2 = make_map(queue2), map3 = make_map(queue3);
+	ThreadPool pool1("Test", 0), pool3("Test", 2);
+	run(map1.get(), queue1, nullptr);
+	run(map2.get(), queue2, &pool1);
+	run(map3.get(), queue3, &pool3);
+
+	// the flow ends up the same
+	u32 flowing = 0;
+	v3s16 p;
+	for (p.Z = bpmin.Z * MAP_BLOCKSIZE; p.Z < (bpmax.Z + 1) * MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = bpmin.Y * MAP_BLOCKSIZE; p.Y < (bpmax.Y + 1) * MAP_BLOCKSIZE; p.Y++)
+	for (p.X = bpmin.X * MAP_BLOCKSIZE; p.X < (bpmax.X + 1) * MAP_BLOCKSIZE; p.X++) {
+		MapNode n = map1->getNode(p);
+		UASSERT(map2->getNode(p) == n);
+		UASSERT(map3->getNode(p) == n);
+		if (n.getContent() == c_flowing)
+			flowing++;
+	}
+	UASSERT(flowing > 500);
+}
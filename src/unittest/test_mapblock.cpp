@@ -3,6 +3,7 @@
 
 #include "test.h"
 
+#include <map>
 #include <sstream>
 #include "gamedef.h"
 #include "nodedef.h"
@@ -12,6 +13,7 @@
 #include "inventory.h"
 #include "util/serialize.h"
 #include "voxel.h"
+#include "server/serialized_block_cache.h"
 
 class TestMapBlock : public TestBase
 {
@@ -38,6 +40,18 @@ class TestMapBlock : public TestBase
 
 	// Tests blocks with a single recurring node
 	void testMonoblock(IGameDef *gamedef);
+
+	// Tests blocks with palette storage
+	void testPalettedNodes();
+	void testPaletteBlock(IGameDef *gamedef);
+
+	void testChangeId(IGameDef *gamedef);
+
+	void testContentCounts(IGameDef *gamedef);
+
+	void testSerializedBlockCache();
+
+	void testLazyNodeMetadata(IGameDef *gamedef);
 };
 
 static TestMapBlock g_test_instance;
@@ -51,10 +65,193 @@ void TestMapBlock::runTests(IGameDef *gamedef)
 	TEST(testLoad20, gamedef);
 	TEST(testLoadNonStd, gamedef);
 	TEST(testMonoblock, gamedef);
+	TEST(testPalettedNodes);
+	TEST(testPaletteBlock, gamedef);
+	TEST(testChangeId, gamedef);
+	TEST(testContentCounts, gamedef);
+	TEST(testSerializedBlockCache);
+	TEST(testLazyNodeMetadata, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+void TestMapBlock::testChangeId(IGameDef *gamedef)
+{
+	MapBlock block({}, gamedef), block2({}, gamedef);
+
+	const u64 id = block.getChangeId();
+	UASSERT(id != 0);
+	UASSERTEQ(u64, block.getChangeId(), id);
+	UASSERT(block2.getChangeId() != id);
+
+	block.setNode({1, 2, 3}, MapNode(CONTENT_AIR));
+	const u64 id2 = block.getChangeId();
+	UASSERT(id2 != id);
+	UASSERTEQ(u64, block.getChangeId(), id2);
+
+	// saving does not count as a change
+	block.resetModified();
+	UASSERTEQ(u64, block.getChangeId(), id2);
+
+	block.setNode({1, 2, 3}, MapNode(CONTENT_AIR));
+	UASSERT(block.getChangeId() != id2);
+}
+
+static MapBlock::ContentCounts count_contents(MapBlock &block)
+{
+	std::map<content_t, u16> counts;
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		counts[block.getNodeNoCheck(x, y, z).getContent()]++;
+	return MapBlock::ContentCounts(counts.begin(), counts.end());
+}
+
+void TestMapBlock::testContentCounts(IGameDef *gamedef)
+{
+	MapBlock block({}, gamedef);
+	UASSERT(!block.hasContentCounts());
+	UASSERT(block.getContentCounts() == count_contents(block));
+	UASSERTEQ(size_t, block.getContentCounts().size(), 1);
+	UASSERT(block.hasContentCounts());
+
+	// kept up to date
+	PcgRandom r(42);
+	for (int i = 0; i < 3000; i++) {
+		u32 rval = r.next();
+		block.setNode(rval % 16, (rval >> 4) % 16, (rval >> 8) % 16,
+			MapNode((rval >> 12) % 20));
+	}
+	UASSERT(block.hasContentCounts());
+	UASSERT(block.getContentCounts() == count_contents(block));
+
+	// bulk changes
+	VoxelManipulator vmm;
+	vmm.addArea(VoxelArea(block.getPosRelative(),
+		block.getPosRelative() + v3s16(MAP_BLOCKSIZE - 1)));
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		vmm.setNode({x, y, z}, MapNode(y < 4 ? 3 : CONTENT_AIR));
+	block.copyFrom(vmm);
+	UASSERT(!block.hasContentCounts());
+	MapBlock::ContentCounts expect{{3, 1024}, {CONTENT_AIR, 3072}};
+	UASSERT(block.getContentCounts() == expect);
+
+	block.setNode(0, 0, 0, MapNode(CONTENT_AIR));
+	expect = {{3, 1023}, {CONTENT_AIR, 3073}};
+	UASSERT(block.getContentCounts() == expect);
+
+	// stale counts are thrown away
+	block.m_content_counts = {{CONTENT_AIR, 4096}};
+	block.setNode(0, 1, 0, MapNode(CONTENT_AIR));
+	UASSERT(!block.hasContentCounts());
+	expect = {{3, 1022}, {CONTENT_AIR, 3074}};
+	UASSERT(block.getContentCounts() == expect);
+}
+
+void TestMapBlock::testLazyNodeMetadata(IGameDef *gamedef)
+{
+	auto *idef = gamedef->idef();
+	const auto serialize = [] (const NodeMetadataList &list, bool disk) {
+		std::ostringstream os(std::ios_base::binary);
+		list.serialize(os, SER_FMT_VER_HIGHEST_WRITE, disk);
+		return os.str();
+	};
+
+	NodeMetadataList orig;
+	{
+		auto *meta = new NodeMetadata(idef);
+		meta->setString("infotext", "Chest");
+		meta->setString("owner", "singleplayer");
+		meta->markPrivate("owner", true);
+		meta->getInventory()->addList("main", 8)->addItem(2, ItemStack("default:stone", 5, 0, idef));
+		orig.set({1, 2, 3}, meta);
+		meta = new NodeMetadata(idef);
+		meta->setString("formspec", "size[1,1]");
+		orig.set({4, 5, 6}, meta);
+	}
+	const std::string disk_data = serialize(orig, true);
+
+	NodeMetadataList list;
+	std::istringstream is(disk_data, std::ios_base::binary);
+	list.deSerialize(is, idef);
+	UASSERTEQ(size_t, list.size(), 2);
+	UASSERT(list.getAllKeys() == orig.getAllKeys());
+
+	// untouched entries are written like they were read
+	UASSERT(serialize(list, true) == disk_data);
+	{
+		// but private fields still don't go over the network
+		NodeMetadataList net_list;
+		std::istringstream is2(serialize(list, false), std::ios_base::binary);
+		net_list.deSerialize(is2, idef);
+		auto *meta = net_list.get({1, 2, 3});
+		UASSERT(meta);
+		UASSERTEQ(auto, meta->getString("infotext"), "Chest");
+		UASSERTEQ(auto, meta->getString("owner"), "");
+		UASSERT(net_list.get({4, 5, 6}));
+	}
+
+	// parsed on access
+	auto *meta = list.get({1, 2, 3});
+	UASSERT(meta);
+	UASSERTEQ(auto, meta->getString("owner"), "singleplayer");
+	UASSERT(meta->isPrivate("owner"));
+	auto *ilist = meta->getInventory()->getList("main");
+	UASSERT(ilist);
+	UASSERTEQ(auto, ilist->getItem(2).name, "default:stone");
+	UASSERTEQ(size_t, list.size(), 2);
+
+	list.remove({4, 5, 6});
+	UASSERTEQ(size_t, list.size(), 1);
+	UASSERT(list.get({4, 5, 6}) == nullptr);
+}
+
+void TestMapBlock::testSerializedBlockCache()
+{
+	const auto make_data = [] (char c) {
+		return std::make_shared<std::string>(1000, c);
+	};
+	const u8 ver = SER_FMT_VER_HIGHEST_WRITE;
+	// room for about two entries
+	SerializedBlockCache cache(2500);
+
+	cache.put({0, 0, 0}, ver, 1, make_data('a'));
+	cache.put({1, 0, 0}, ver, 1, make_data('b'));
+	UASSERTEQ(size_t, cache.size(), 2);
+
+	auto data = cache.get({0, 0, 0}, ver, 1);
+	UASSERT(data && (*data)[0] == 'a');
+	// wrong format or outdated
+	UASSERT(!cache.get({0, 0, 0}, ver - 1, 1));
+	UASSERT(!cache.get({1, 0, 0}, ver, 2));
+	UASSERTEQ(size_t, cache.size(), 1);
+
+	cache.put({1, 0, 0}, ver, 2, make_data('c'));
+	cache.get({0, 0, 0}, ver, 1);
+	// evicts the least recently used one
+	cache.put({2, 0, 0}, ver, 1, make_data('d'));
+	UASSERTEQ(size_t, cache.size(), 2);
+	UASSERT(!cache.get({1, 0, 0}, ver, 2));
+	UASSERT(cache.get({0, 0, 0}, ver, 1));
+	UASSERT(cache.getMemoryUsage() <= cache.getMaxMemoryUsage());
+
+	// data in use stays valid
+	cache.invalidate({0, 0, 0});
+	UASSERT(!cache.get({0, 0, 0}, ver, 1));
+	UASSERT((*data)[0] == 'a');
+
+	cache.clear();
+	UASSERTEQ(size_t, cache.size(), 0);
+	UASSERTEQ(size_t, cache.getMemoryUsage(), 0);
+
+	// disabled
+	SerializedBlockCache cache2(0);
+	cache2.put({0, 0, 0}, ver, 1, make_data('a'));
+	UASSERT(!cache2.get({0, 0, 0}, ver, 1));
+}
+
 void TestMapBlock::testMonoblock(IGameDef *gamedef)
 {
 	MapBlock block({}, gamedef);
@@ -99,6 +296,7 @@ void TestMapBlock::testMonoblock(IGameDef *gamedef)
 	UASSERT(!block.m_is_mono_block);
 
 	// set all nodes to 42
+	block.expandNodesIfNeeded();
 	for (size_t i = 0; i < MapBlock::nodecount; ++i) {
 		block.data[i] = MapNode(42);
 	}
@@ -154,6 +352,117 @@ void TestMapBlock::testMonoblock(IGameDef *gamedef)
 	UASSERT(block.m_is_mono_block);
 }
 
+void TestMapBlock::testPalettedNodes()
+{
+	const u32 count = PalettedNodes::nodecount;
+	std::vector<MapNode> nodes(count, MapNode(CONTENT_AIR, 15));
+	for (u32 i = 0; i < count; i += 7)
+		nodes[i] = MapNode(100 + i % 3);
+
+	auto packed = PalettedNodes::create(nodes.data());
+	UASSERT(packed);
+	UASSERTEQ(int, packed->getIndexBits(), 2);
+	UASSERTEQ(size_t, packed->getPalette().size(), 4);
+	// param1 differs, param2 is uniform
+	UASSERT(packed->getMemoryUsage() < count * 2);
+
+	std::vector<MapNode> decoded(count);
+	packed->decode(decoded.data());
+	UASSERT(decoded == nodes);
+
+	// changes in place, growing the index width and the param2 plane
+	for (u32 i = 0; i < count; i += 5) {
+		nodes[i] = MapNode(200 + i % 13, 3, i % 4);
+		UASSERT(packed->set(i, nodes[i]));
+		UASSERT(packed->get(i) == nodes[i]);
+	}
+	UASSERTEQ(int, packed->getIndexBits(), 8);
+	packed->decode(decoded.data());
+	UASSERT(decoded == nodes);
+
+	// no more than 256 contents
+	for (u32 i = 0; i < count; i++)
+		nodes[i] = MapNode(i % 256);
+	packed = PalettedNodes::create(nodes.data());
+	UASSERT(packed);
+	UASSERT(!packed->set(0, MapNode(1000)));
+	UASSERT(packed->get(0) == MapNode(0));
+	nodes[0] = MapNode(1000);
+	UASSERT(!PalettedNodes::create(nodes.data()));
+
+	// uniform content
+	for (u32 i = 0; i < count; i++)
+		nodes[i] = MapNode(CONTENT_AIR, i % 16);
+	packed = PalettedNodes::create(nodes.data());
+	UASSERTEQ(int, packed->getIndexBits(), 0);
+	UASSERT(packed->set(10, MapNode(5)));
+	UASSERTEQ(int, packed->getIndexBits(), 1);
+	UASSERT(packed->get(10) == MapNode(5));
+	UASSERT(packed->get(11) == MapNode(CONTENT_AIR, 11));
+}
+
+void TestMapBlock::testPaletteBlock(IGameDef *gamedef)
+{
+	// node ids 0 and 1 are valid for serialization, see testSaveLoad()
+	MapBlock block({}, gamedef);
+	VoxelManipulator vmm;
+	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
+	vmm.addArea(VoxelArea(block.getPosRelative(), block.getPosRelative() + data_size - v3s16(1,1,1)));
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		vmm.setNode({x, y, z}, MapNode(y < 8 ? CONTENT_AIR : 0, x));
+
+	block.copyFrom(vmm);
+	UASSERT(block.m_packed && !block.data);
+	UASSERT(block.getNodeNoCheck(3, 4, 5) == MapNode(CONTENT_AIR, 3));
+	UASSERT(block.getNodeNoCheck(3, 9, 5) == MapNode(0, 3));
+	UASSERT(!block.isAir());
+
+	// fits
+	block.setNode(1, 1, 1, MapNode(1));
+	UASSERT(block.m_packed);
+	UASSERT(block.getNodeNoCheck(1, 1, 1) == MapNode(1));
+
+	// round trip through the voxel manipulator and serialization
+	VoxelManipulator vmm2;
+	vmm2.addArea(vmm.m_area);
+	block.copyTo(vmm2);
+	UASSERT(vmm2.getNode({1, 1, 1}) == MapNode(1));
+	UASSERT(vmm2.getNode({7, 12, 0}) == MapNode(0, 7));
+
+	std::ostringstream oss(std::ios_base::binary);
+	block.serialize(oss, SER_FMT_VER_HIGHEST_WRITE, true, -1);
+	MapBlock block2({}, gamedef);
+	std::istringstream iss(oss.str(), std::ios_base::binary);
+	block2.deSerialize(iss, SER_FMT_VER_HIGHEST_WRITE, true);
+	UASSERT(block2.m_packed);
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		v3s16 p(i % 16, (i / 16) % 16, i / 256);
+		UASSERT(block2.getNodeNoCheck(p) == block.getNodeNoCheck(p));
+	}
+
+	// too many contents, expands
+	for (u16 i = 0; i < 300; i++)
+		block.setNode(i % 16, (i / 16) % 16, 15, MapNode(100 + i));
+	UASSERT(!block.m_packed && block.data);
+	UASSERT(block.getNodeNoCheck(3, 4, 5) == MapNode(CONTENT_AIR, 3));
+	UASSERT(block.getNodeNoCheck(4, 6, 15) == MapNode(100 + 100));
+
+	// becomes a monoblock again
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		vmm.setNode({x, y, z}, MapNode(CONTENT_AIR));
+	vmm.setNode({0, 0, 0}, MapNode(42));
+	block.copyFrom(vmm);
+	UASSERT(block.m_packed);
+	block.setNode(0, 0, 0, MapNode(CONTENT_AIR));
+	block.tryShrinkNodes();
+	UASSERT(!block.m_packed && block.m_is_mono_block);
+	UASSERT(block.isAir());
+}
+
 void TestMapBlock::testSaveLoad(IGameDef *gamedef, const u8 version)
 {
 	// Use the bottom node ids for this test
@@ -6,11 +6,14 @@
 
 #include "test.h"
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <optional>
 #include "database/database-dummy.h"
 #include "database/database-sqlite3.h"
+#include "servermap.h"
 #if USE_LEVELDB
 #include "database/database-leveldb.h"
 #endif
@@ -57,6 +60,25 @@ class MapDatabaseProvider
 	MapDatabase *m_db = nullptr;
 };
 
+// Fails a given number of writes, or all of them if negative
+class FailingDatabase : public Database_Dummy
+{
+public:
+	bool saveBlock(const v3s16 &pos, std::string_view data) override
+	{
+		attempts++;
+		if (failures != 0) {
+			if (failures > 0)
+				failures--;
+			return false;
+		}
+		return Database_Dummy::saveBlock(pos, data);
+	}
+
+	std::atomic<int> failures{0};
+	std::atomic<int> attempts{0};
+};
+
 }
 
 class TestMapDatabase : public TestBase
@@ -72,7 +94,11 @@ class TestMapDatabase : public TestBase
 	void testLoad();
 	void testList(int expect);
 	void testRemove();
+	void testBatch();
 	void testPositionEncoding();
+	void testSaveThread();
+	void testSaveThreadFailing();
+	void testSaveThreadStop();
 
 private:
 	MapDatabaseProvider *provider = nullptr;
@@ -92,6 +118,9 @@ void TestMapDatabase::runTests(IGameDef *gamedef)
 	sanity_check(!test_data.empty());
 
 	TEST(testPositionEncoding);
+	TEST(testSaveThread);
+	TEST(testSaveThreadFailing);
+	TEST(testSaveThreadStop);
 
 	rawstream << "-------- Dummy" << std::endl;
 
@@ -145,6 +174,7 @@ void TestMapDatabase::runTestsForCurrentDB()
 	TEST(testList, 1);
 	TEST(testRemove);
 	TEST(testList, 0);
+	TEST(testBatch);
 }
 
 void TestMapDatabase::testSave()
@@ -197,6 +227,38 @@ void TestMapDatabase::testRemove()
 	//UASSERT(!db->deleteBlock({1, 2, 4}));
 }
 
+void TestMapDatabase::testBatch()
+{
+	auto *db = provider->get();
+
+	// enough to exercise both full batches and the remainder
+	std::vector<std::pair<v3s16, std::string>> blocks;
+	for (s16 i = 0; i < 45; i++)
+		blocks.emplace_back(v3s16(i, -i, 2 * i), test_data + itos(i));
+	UASSERT(db->saveBlocks(blocks));
+
+	std::vector<v3s16> pos;
+	for (auto &it : blocks)
+		pos.push_back(it.first);
+	// missing blocks in between
+	pos.insert(pos.begin() + 10, v3s16(1, 2, 4));
+	pos.push_back(v3s16(-1, -2, -3));
+
+	std::vector<std::string> dest;
+	db->loadBlocks(pos, dest);
+	UASSERTEQ(size_t, dest.size(), pos.size());
+	for (size_t i = 0; i < pos.size(); i++) {
+		if (pos[i] == v3s16(1, 2, 4) || pos[i] == v3s16(-1, -2, -3)) {
+			UASSERT(dest[i].empty());
+		} else {
+			UASSERT(dest[i] == test_data + itos(pos[i].X));
+		}
+	}
+
+	for (auto &it : blocks)
+		UASSERT(db->deleteBlock(it.first));
+}
+
 void TestMapDatabase::testPositionEncoding()
 {
 	auto db = std::make_unique<Database_Dummy>();
@@ -224,3 +286,117 @@ void TestMapDatabase::testPositionEncoding()
 	UASSERT(db->getIntegerAsBlock(-0x800800800) == v3s16(-2048, -2048, -2048))
 	UASSERT(db->getIntegerAsBlock(-0x314e3807b) == v3s16(-123, 456, -789))
 }
+
+void TestMapDatabase::testSaveThread()
+{
+	FailingDatabase db;
+	db.failures = 2;
+	MapDatabaseAccessor acc;
+	acc.dbase = &db;
+	MapSaveThread saver(&acc, -1, 4, 1);
+	acc.saver = &saver;
+	saver.start();
+
+	saver.enqueue({1, 2, 3}, std::string(test_data));
+	// visible before it is written
+	std::string dest;
+	acc.loadBlock({1, 2, 3}, dest);
+	UASSERT(dest == saver.compressBlock(test_data));
+
+	// written once the failures are over
+	saver.flush();
+	UASSERT(!saver.getQueued({1, 2, 3}));
+	UASSERTEQ(int, db.attempts, 3);
+	dest.clear();
+	db.loadBlock({1, 2, 3}, &dest);
+	UASSERT(dest == saver.compressBlock(test_data));
+
+	saver.stop();
+	saver.wait();
+}
+
+void TestMapDatabase::testSaveThreadFailing()
+{
+	FailingDatabase db;
+	db.failures = -1;
+	MapDatabaseAccessor acc;
+	acc.dbase = &db;
+	MapSaveThread saver(&acc, -1, 4, 1);
+	acc.saver = &saver;
+	saver.start();
+
+	for (s16 i = 0; i < 3; i++)
+		saver.enqueue({i, 0, 0}, std::string(test_data));
+
+	// must stop retrying at some point instead of waiting forever
+	saver.flush();
+	UASSERT(db.attempts >= MapSaveThread::MAX_WRITE_ATTEMPTS);
+	// but the data is kept and handed back
+	std::vector<v3s16> failed = saver.takeFailed();
+	std::sort(failed.begin(), failed.end());
+	UASSERT(failed == std::vector<v3s16>({{0, 0, 0}, {1, 0, 0}, {2, 0, 0}}));
+	UASSERT(saver.takeFailed().empty());
+	std::string dest;
+	acc.loadBlock({0, 0, 0}, dest);
+	UASSERT(dest == saver.compressBlock(test_data));
+
+	// written once the database works again
+	db.failures = 0;
+	saver.retry({0, 0, 0});
+	saver.enqueue({1, 0, 0}, std::string(test_data));
+	saver.flush();
+	UASSERT(!saver.getQueued({0, 0, 0}));
+	UASSERT(!saver.getQueued({1, 0, 0}));
+	UASSERT(saver.getQueued({2, 0, 0}));
+	dest.clear();
+	db.loadBlock({1, 0, 0}, &dest);
+	UASSERT(dest == saver.compressBlock(test_data));
+
+	// stopping writes the rest
+	saver.stop();
+	saver.wait();
+	UASSERT(!saver.getQueued({2, 0, 0}));
+	dest.clear();
+	db.loadBlock({2, 0, 0}, &dest);
+	UASSERT(dest == saver.compressBlock(test_data));
+}
+
+void TestMapDatabase::testSaveThreadStop()
+{
+	// keeps retrying when stopped
+	{
+		FailingDatabase db;
+		db.failures = 3;
+		MapDatabaseAccessor acc;
+		acc.dbase = &db;
+		MapSaveThread saver(&acc, -1, 4, 1);
+		acc.saver = &saver;
+		saver.start();
+
+		saver.enqueue({1, 2, 3}, std::string(test_data));
+		saver.stop();
+		saver.wait();
+		UASSERTEQ(int, db.attempts, 4);
+		std::string dest;
+		db.loadBlock({1, 2, 3}, &dest);
+		UASSERT(dest == saver.compressBlock(test_data));
+	}
+
+	// but gives up on a database that stays broken
+	{
+		FailingDatabase db;
+		db.failures = -1;
+		MapDatabaseAccessor acc;
+		acc.dbase = &db;
+		MapSaveThread saver(&acc, -1, 4, 1);
+		acc.saver = &saver;
+		saver.start();
+
+		saver.enqueue({1, 2, 3}, std::string(test_data));
+		saver.stop();
+		saver.wait();
+		UASSERT(db.attempts >= MapSaveThread::MAX_WRITE_ATTEMPTS);
+		UASSERT(!saver.getQueued({1, 2, 3}));
+		saver.flush();
+	}
+}
@@ -4,11 +4,15 @@
 
 #include "test.h"
 
+#include "dummymap.h"
 #include "emerge.h"
 #include "mapgen/mapgen.h"
 #include "mapgen/mg_biome.h"
+#include "mapgen/mg_decoration.h"
+#include "mapgen/mg_ore.h"
 #include "irrlicht_changes/printing.h"
 #include "mock_server.h"
+#include "threading/thread_pool.h"
 
 class TestMapgen : public TestBase
 {
@@ -19,7 +23,10 @@ class TestMapgen : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testBiomeGen(IGameDef *gamedef);
+	void testBiomeLookup(IGameDef *gamedef);
 	void testMapgenEdges();
+	void testPlaceOresParallel(IGameDef *gamedef);
+	void testPlaceDecorations(IGameDef *gamedef);
 };
 
 static TestMapgen g_test_instance;
@@ -39,7 +46,10 @@ namespace {
 void TestMapgen::runTests(IGameDef *gamedef)
 {
 	TEST(testBiomeGen, gamedef);
+	TEST(testBiomeLookup, gamedef);
 	TEST(testMapgenEdges);
+	TEST(testPlaceOresParallel, gamedef);
+	TEST(testPlaceDecorations, gamedef);
 }
 
 void TestMapgen::testBiomeGen(IGameDef *gamedef)
@@ -126,6 +136,103 @@ void TestMapgen::testBiomeGen(IGameDef *gamedef)
 	}
 }
 
+// The plain search over all biomes that calcBiomeFromNoise must agree with
+static Biome *calc_biome_reference(const BiomeManager &bmgr, float heat,
+	float humidity, v3s16 pos)
+{
+	Biome *biome_closest = nullptr;
+	Biome *biome_closest_blend = nullptr;
+	float dist_min = FLT_MAX;
+	float dist_min_blend = FLT_MAX;
+
+	for (size_t i = 1; i < bmgr.getNumObjects(); i++) {
+		Biome *b = (Biome *)bmgr.getRaw(i);
+		if (!b ||
+				pos.Y < b->min_pos.Y || pos.Y > b->max_pos.Y + b->vertical_blend ||
+				pos.X < b->min_pos.X || pos.X > b->max_pos.X ||
+				pos.Z < b->min_pos.Z || pos.Z > b->max_pos.Z)
+			continue;
+
+		float d_heat = heat - b->heat_point;
+		float d_humidity = humidity - b->humidity_point;
+		float dist = ((d_heat * d_heat) + (d_humidity * d_humidity));
+		if (b->weight > 0.f)
+			dist /= b->weight;
+
+		if (pos.Y <= b->max_pos.Y) {
+			if (dist < dist_min) {
+				dist_min = dist;
+				biome_closest = b;
+			}
+		} else if (dist < dist_min_blend) {
+			dist_min_blend = dist;
+			biome_closest_blend = b;
+		}
+	}
+
+	const u64 seed = static_cast<s64>(pos.Y + (heat + humidity) * 0.9f);
+	PcgRandom rng(seed);
+
+	if (biome_closest_blend && dist_min_blend <= dist_min &&
+			rng.range(0, biome_closest_blend->vertical_blend) >=
+			pos.Y - biome_closest_blend->max_pos.Y)
+		return biome_closest_blend;
+
+	return (biome_closest) ? biome_closest : (Biome *)bmgr.getRaw(BIOME_NONE);
+}
+
+void TestMapgen::testBiomeLookup(IGameDef *gamedef)
+{
+	MockServer server(getTestTempDirectory());
+	MockBiomeManager bmgr(&server);
+	bmgr.setNodeDefManager(gamedef->getNodeDefManager());
+
+	PcgRandom pr(1234);
+	// Layered biomes like games have, plus some odd ones
+	const s16 layers[][2] = {{-31000, -256}, {-255, -1}, {0, 4}, {5, 31000}};
+	for (int i = 0; i < 120; i++) {
+		Biome *b = BiomeManager::create(BIOMETYPE_NORMAL);
+		b->name = "biome" + std::to_string(i);
+		const auto &layer = layers[i % ARRLEN(layers)];
+		b->min_pos.Y = layer[0];
+		b->max_pos.Y = layer[1];
+		// several biomes share a point, as layers of one biome do
+		b->heat_point = pr.range(0, 100) / (i % 3 + 1);
+		b->humidity_point = pr.range(0, 100);
+		if (i % 5 == 0)
+			b->vertical_blend = pr.range(1, 8);
+		if (i % 7 == 0)
+			b->weight = pr.range(0, 30) / 10.0f;
+		if (i % 11 == 0) {
+			b->min_pos.X = pr.range(-500, 0);
+			b->max_pos.Z = pr.range(0, 500);
+		}
+		if (i % 13 == 0) {
+			b->min_pos.Y = pr.range(-100, 100);
+			b->max_pos.Y = b->min_pos.Y + pr.range(0, 50);
+		}
+		UASSERT(bmgr.add(b) != OBJDEF_INVALID_HANDLE);
+	}
+
+	std::unique_ptr<BiomeParams> params(BiomeManager::createBiomeParams(BIOMEGEN_ORIGINAL));
+	std::unique_ptr<BiomeGen> biomegen(
+		bmgr.createBiomeGen(BIOMEGEN_ORIGINAL, params.get(), v3s16(16, 16, 16)));
+	auto *gen = dynamic_cast<BiomeGenOriginal *>(biomegen.get());
+	UASSERT(gen);
+
+	for (int i = 0; i < 100000; i++) {
+		// also outside of the biome points and the map limits
+		float heat = pr.range(-10000, 20000) / 100.0f;
+		float humidity = pr.range(-10000, 20000) / 100.0f;
+		v3s16 pos(pr.range(-32000, 32000), pr.range(-300, 300), pr.range(-1000, 1000));
+		if (i % 10 == 0)
+			pos.Y = pr.range(-32768, 32767);
+		Biome *expect = calc_biome_reference(bmgr, heat, humidity, pos);
+		Biome *biome = gen->calcBiomeFromNoise(heat, humidity, pos);
+		UASSERTEQ(biome_t, biome->index, expect->index);
+	}
+}
+
 void TestMapgen::testMapgenEdges()
 {
 	v3s16 emin, emax;
@@ -138,3 +245,132 @@ void TestMapgen::testMapgenEdges()
 	UASSERTEQ(auto, emin, v3s16(-8016));
 	UASSERTEQ(auto, emax, v3s16(8031, 8015, 8031));
 }
+
+void TestMapgen::testPlaceOresParallel(IGameDef *gamedef)
+{
+	OreManager oremgr(gamedef);
+	const NoiseParams np(0, 1, v3f(20, 20, 20), 4711, 3, 0.6f, 2.0f);
+
+	const auto add_ore = [&] (OreType type, content_t c, s16 y_min, s16 y_max) {
+		Ore *ore = OreManager::create(type);
+		ore->c_ore = c;
+		ore->c_wherein = {t_CONTENT_STONE, t_CONTENT_BRICK};
+		ore->clust_scarcity = 8 * 8 * 8;
+		ore->clust_num_ores = 8;
+		ore->clust_size = 3;
+		ore->y_min = y_min;
+		ore->y_max = y_max;
+		ore->ore_param2 = 0;
+		ore->nthresh = 0.2f;
+		ore->np = np;
+		if (ore->needs_noise)
+			ore->flags |= OREFLAG_USE_NOISE;
+		UASSERT(oremgr.add(ore) != OBJDEF_INVALID_HANDLE);
+		return ore;
+	};
+
+	add_ore(ORE_SCATTER, t_CONTENT_BRICK, -40, -10);
+	// overlaps with the one before
+	auto sheet = static_cast<OreSheet *>(add_ore(ORE_SHEET, t_CONTENT_GRASS, -20, 10));
+	sheet->column_height_min = 1;
+	sheet->column_height_max = 4;
+	sheet->column_midpoint_factor = 0.5f;
+	add_ore(ORE_BLOB, t_CONTENT_TORCH, 20, 39);
+	auto puff = static_cast<OrePuff *>(add_ore(ORE_PUFF, t_CONTENT_WATER, 0, 5));
+	puff->np_puff_top = NoiseParams(40, 10, v3f(20, 20, 20), 1, 2, 0.5f, 2.0f);
+	puff->np_puff_bottom = puff->np_puff_top;
+	auto stratum = static_cast<OreStratum *>(add_ore(ORE_STRATUM, t_CONTENT_LAVA, 30, 35));
+	stratum->clust_scarcity = 4;
+	add_ore(ORE_SCATTER, t_CONTENT_BRICK, -5, 15);
+
+	// a mapchunk with the usual margin
+	const v3s16 nmin(-40, -40, -40), nmax(39, 39, 39);
+	DummyMap map(gamedef, v3s16(-4), v3s16(3));
+	const auto place = [&] (MMVManip &vm, ThreadPool *pool) {
+		vm.addArea(VoxelArea(nmin - v3s16(16), nmax + v3s16(16)));
+		for (u32 i = 0; i < vm.m_area.getVolume(); i++)
+			vm.m_data[i] = MapNode(t_CONTENT_STONE);
+
+		Mapgen mg;
+		mg.vm = &vm;
+		mg.seed = 1234;
+		mg.pool = pool;
+		UASSERTEQ(size_t, oremgr.placeAllOres(&mg, 42, nmin, nmax), 6);
+	};
+
+	MMVManip vm1(&map), vm2(&map);
+	ThreadPool pool("Test", 2);
+	place(vm1, nullptr);
+	place(vm2, &pool);
+
+	std::unordered_map<content_t, u32> counts;
+	for (u32 i = 0; i < vm1.m_area.getVolume(); i++) {
+		UASSERT(vm1.m_data[i] == vm2.m_data[i]);
+		counts[vm1.m_data[i].getContent()]++;
+	}
+	// every ore placed something
+	for (content_t c : {t_CONTENT_BRICK, t_CONTENT_GRASS, t_CONTENT_TORCH,
+			t_CONTENT_WATER, t_CONTENT_LAVA})
+		UASSERT(counts[c] > 0);
+}
+
+void TestMapgen::testPlaceDecorations(IGameDef *gamedef)
+{
+	DecorationManager decomgr(gamedef);
+
+	const auto add_deco = [&] (u32 flags, content_t c_place_on, content_t c_deco) {
+		auto deco = static_cast<DecoSimple *>(DecorationManager::create(DECO_SIMPLE));
+		deco->flags = flags;
+		deco->c_place_on = {c_place_on};
+		deco->sidelen = 16;
+		deco->y_min = -40;
+		deco->y_max = 39;
+		// covers every column
+		deco->fill_ratio = 10.0f;
+		deco->nspawnby = -1;
+		deco->c_decos = {c_deco};
+		deco->deco_height = 1;
+		deco->deco_height_max = 0;
+		deco->deco_param2 = 0;
+		deco->deco_param2_max = 0;
+		UASSERT(decomgr.add(deco) != OBJDEF_INVALID_HANDLE);
+	};
+	// Each one is placed on the surfaces the one before made
+	add_deco(DECO_ALL_FLOORS, t_CONTENT_STONE, t_CONTENT_BRICK);
+	add_deco(DECO_ALL_FLOORS, t_CONTENT_BRICK, t_CONTENT_GRASS);
+	add_deco(0, t_CONTENT_GRASS, t_CONTENT_TORCH);
+
+	// Ground below y = 0, and a floating slab over half of the chunk
+	const v3s16 nmin(-40, -40, -40), nmax(39, 39, 39);
+	DummyMap map(gamedef, v3s16(-4), v3s16(3));
+	MMVManip vm(&map);
+	vm.addArea(VoxelArea(nmin - v3s16(16), nmax + v3s16(16)));
+	for (s16 z = vm.m_area.MinEdge.Z; z <= vm.m_area.MaxEdge.Z; z++)
+	for (s16 y = vm.m_area.MinEdge.Y; y <= vm.m_area.MaxEdge.Y; y++)
+	for (s16 x = vm.m_area.MinEdge.X; x <= vm.m_area.MaxEdge.X; x++) {
+		bool solid = y < 0 || (x < 0 && y >= 20 && y <= 22);
+		vm.m_data[vm.m_area.index(x, y, z)] =
+			MapNode(solid ? t_CONTENT_STONE : CONTENT_AIR);
+	}
+
+	// no heightmap, so the ground level is searched for
+	Mapgen mg;
+	mg.vm = &vm;
+	mg.ndef = gamedef->getNodeDefManager();
+	mg.seed = 1234;
+	decomgr.placeAllDecos(&mg, 42, nmin, nmax);
+
+	const auto count = [&] (content_t c) {
+		u32 n = 0;
+		for (u32 i = 0; i < vm.m_area.getVolume(); i++)
+			n += vm.m_data[i].getContent() == c;
+		return n;
+	};
+	const u32 columns = 80 * 80;
+	UASSERTEQ(u32, count(t_CONTENT_BRICK), columns + columns / 2);
+	UASSERTEQ(u32, count(t_CONTENT_GRASS), columns + columns / 2);
+	UASSERTEQ(u32, count(t_CONTENT_TORCH), columns);
+	// the nodes were written without clearing VOXELFLAG_NO_DATA, so read them directly
+	UASSERT(vm.m_data[vm.m_area.index(-5, 25, 7)].getContent() == t_CONTENT_TORCH);
+	UASSERT(vm.m_data[vm.m_area.index(5, 2, 7)].getContent() == t_CONTENT_TORCH);
+}
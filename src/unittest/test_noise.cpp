@@ -5,6 +5,7 @@
 #include "test.h"
 
 #include <cmath>
+#include <cstring>
 #include "exceptions.h"
 #include "noise.h"
 
@@ -26,9 +27,14 @@ class TestNoise : public TestBase {
 	void testNoise3dPoint();
 	void testNoise3dBulk();
 	void testNoiseInvalidParams();
+	void testNoiseKernels();
+	void testNoiseMapsRecorded();
 
 	static const float expected_2d_results[10 * 10];
 	static const float expected_3d_results[10 * 10 * 10];
+	static const float recorded_2d_map[8 * 4];
+	static const float recorded_3d_map[4 * 4 * 2];
+	static const float recorded_3d_eased_map[4 * 4 * 2];
 };
 
 static TestNoise g_test_instance;
@@ -46,6 +52,8 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
 	TEST(testNoiseInvalidParams);
+	TEST(testNoiseKernels);
+	TEST(testNoiseMapsRecorded);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -145,6 +153,74 @@ void TestNoise::testNoise3dBulk()
 	}
 }
 
+void TestNoise::testNoiseKernels()
+{
+	// all implementations must give exactly the same values
+	std::vector<NoiseParams> params = {
+		NoiseParams(20, 40, v3f(50, 50, 50), 9, 5, 0.6, 2.0),
+		NoiseParams(0, 1, v3f(3, 5, 7), 77, 2, 0.5, 2.0),
+		NoiseParams(-0.6, 1, v3f(250, 350, 250), 5333, 5, 0.63, 2.0),
+		NoiseParams(0, 0.7, v3f(384, 96, 384), 1009, 4, 0.75, 1.618),
+	};
+	params[1].flags = NOISE_FLAG_EASED | NOISE_FLAG_ABSVALUE;
+	params[2].flags = NOISE_FLAG_EASED;
+	params[3].flags = 0;
+
+	const auto compute = [&] (std::vector<float> &out) {
+		out.clear();
+		for (auto &np : params) {
+			// odd sizes to exercise the remainder loops
+			Noise noise2d(&np, 1337, 37, 21);
+			float *vals = noise2d.noiseMap2D(-123.4f, 456.7f);
+			out.insert(out.end(), vals, vals + 37 * 21);
+
+			Noise noise3d(&np, 1337, 19, 13, 11);
+			vals = noise3d.noiseMap3D(789.1f, -23.4f, -567.8f);
+			out.insert(out.end(), vals, vals + 19 * 13 * 11);
+		}
+	};
+
+	std::vector<float> reference, actual;
+	UASSERT(setNoiseKernelSet(NoiseKernelSet::Scalar));
+	compute(reference);
+
+	for (auto set : {NoiseKernelSet::SSE2, NoiseKernelSet::AVX2}) {
+		if (!setNoiseKernelSet(set))
+			continue;
+		compute(actual);
+		UASSERTEQ(size_t, actual.size(), reference.size());
+		UASSERT(!memcmp(actual.data(), reference.data(),
+			reference.size() * sizeof(float)));
+	}
+
+	UASSERT(setNoiseKernelSet(NoiseKernelSet::Auto));
+}
+
+void TestNoise::testNoiseMapsRecorded()
+{
+	// Exact values of the implementation before the kernels were added, as
+	// built for x86. Terrain at the borders of existing chunks depends on them.
+	NoiseParams np(0.5f, 2.f, v3f(23.7f, 17.3f, 31.1f), 1234, 3, 0.6f, 2.0f);
+
+	for (auto set : {NoiseKernelSet::Scalar, NoiseKernelSet::SSE2, NoiseKernelSet::AVX2}) {
+		if (!setNoiseKernelSet(set))
+			continue;
+
+		Noise noise2d(&np, 99, 8, 4);
+		float *vals = noise2d.noiseMap2D(-35.25f, 12.5f);
+		UASSERT(!memcmp(vals, recorded_2d_map, sizeof(recorded_2d_map)));
+
+		Noise noise3d(&np, 99, 4, 4, 2);
+		vals = noise3d.noiseMap3D(7.75f, -3.5f, 101.25f);
+		UASSERT(!memcmp(vals, recorded_3d_map, sizeof(recorded_3d_map)));
+		noise3d.np.flags = NOISE_FLAG_EASED;
+		vals = noise3d.noiseMap3D(7.75f, -3.5f, 101.25f);
+		UASSERT(!memcmp(vals, recorded_3d_eased_map, sizeof(recorded_3d_eased_map)));
+	}
+
+	UASSERT(setNoiseKernelSet(NoiseKernelSet::Auto));
+}
+
 void TestNoise::testNoiseInvalidParams()
 {
 	bool exception_thrown = false;
@@ -323,3 +399,36 @@ const float TestNoise::expected_3d_results[10 * 10 * 10] = {
 	24.76337, 25.94205, 27.12073, 18.80933, 18.35777, 17.90622, 17.45466,
 	18.91445, 20.64729, 22.38013, 24.32880, 26.34941, 28.37003,
 };
+
+const float TestNoise::recorded_2d_map[8 * 4] = {
+	-0x1.26ba4p-3f, 0x1.55beap-5f, 0x1.7983f4p-3f, 0x1.5075eep-2f,
+	0x1.13e104p-1f, 0x1.b29fb4p-1f, 0x1.36ed2cp+0f, 0x1.994fecp+0f,
+	-0x1.2812p-2f, -0x1.a0172p-4f, 0x1.86ca2p-5f, 0x1.9f672cp-3f,
+	0x1.b3fb46p-2f, 0x1.7ee904p-1f, 0x1.1fdec4p+0f, 0x1.8521cp+0f,
+	-0x1.158f48p-1f, -0x1.54517p-2f, -0x1.d3935p-4f, 0x1.19f80cp-3f,
+	0x1.c8db8ep-2f, 0x1.a0494p-1f, 0x1.33bc4p+0f, 0x1.9a1a9ap+0f,
+	-0x1.c4f6ccp-1f, -0x1.44e2fp-1f, -0x1.2ae4fcp-2f, 0x1.105968p-3f,
+	0x1.2eafa6p-1f, 0x1.07d478p+0f, 0x1.6e721cp+0f, 0x1.d420b2p+0f,
+};
+
+const float TestNoise::recorded_3d_map[4 * 4 * 2] = {
+	0x1.289554p-2f, 0x1.29d8eep-2f, 0x1.2b1c88p-2f, 0x1.2c6024p-2f,
+	0x1.70eadep-2f, 0x1.951888p-2f, 0x1.b9463ep-2f, 0x1.dd73e6p-2f,
+	0x1.b94066p-2f, 0x1.002c18p-1f, 0x1.23b7f8p-1f, 0x1.4743d6p-1f,
+	0x1.00caf8p-1f, 0x1.35cbe4p-1f, 0x1.6accdp-1f, 0x1.9fcdb8p-1f,
+	0x1.afef18p-3f, 0x1.a64304p-3f, 0x1.9c96e8p-3f, 0x1.92eadp-3f,
+	0x1.0e7p-2f, 0x1.32eeep-2f, 0x1.576dc4p-2f, 0x1.7beca4p-2f,
+	0x1.44e876p-2f, 0x1.92bc4ap-2f, 0x1.e09012p-2f, 0x1.1731ecp-1f,
+	0x1.7b60f4p-2f, 0x1.f289acp-2f, 0x1.34d93p-1f, 0x1.706d8ap-1f,
+};
+
+const float TestNoise::recorded_3d_eased_map[4 * 4 * 2] = {
+	0x1.1e171cp-3f, 0x1.17d3dcp-3f, 0x1.fef12p-4f, 0x1.1836c8p-3f,
+	0x1.906044p-3f, 0x1.0c5958p-2f, 0x1.42e3bep-2f, 0x1.790e12p-2f,
+	0x1.204432p-2f, 0x1.b1bad2p-2f, 0x1.1a75ccp-1f, 0x1.4dd1e4p-1f,
+	0x1.504128p-2f, 0x1.03b73ep-1f, 0x1.586ae8p-1f, 0x1.97efbp-1f,
+	0x1.4a07c8p-4f, 0x1.043068p-4f, 0x1.5186cp-5f, 0x1.82d35p-5f,
+	0x1.e4723p-4f, 0x1.66f904p-3f, 0x1.c6c9d8p-3f, 0x1.15a298p-2f,
+	0x1.836f64p-3f, 0x1.4e5332p-2f, 0x1.cfa54cp-2f, 0x1.1aa99p-1f,
+	0x1.d61efp-3f, 0x1.9fc87p-2f, 0x1.24da76p-1f, 0x1.649778p-1f,
+};
@@ -0,0 +1,213 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#include "test.h"
+
+#include "filesys.h"
+#include "gamedef.h"
+#include "server/rollback_log.h"
+
+#include <climits>
+
+class TestRollback : public TestBase
+{
+public:
+	TestRollback() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestRollback"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testNodeActions();
+	void testInventoryActions(IGameDef *gamedef);
+	void testSegments();
+	void testSameStartTime();
+
+private:
+	std::string m_dir;
+	void reinitTestEnv();
+};
+
+static TestRollback g_test_instance;
+
+void TestRollback::runTests(IGameDef *gamedef)
+{
+	reinitTestEnv();
+	TEST(testNodeActions);
+
+	reinitTestEnv();
+	TEST(testInventoryActions, gamedef);
+
+	reinitTestEnv();
+	TEST(testSegments);
+
+	reinitTestEnv();
+	TEST(testSameStartTime);
+}
+
+void TestRollback::reinitTestEnv()
+{
+	m_dir = getTestTempDirectory().append(DIR_DELIM "rollback");
+	fs::RecursiveDelete(m_dir);
+}
+
+static RollbackAction make_set_node(time_t t, const std::string &actor,
+	v3s16 p, const std::string &name)
+{
+	RollbackAction action;
+	action.unix_time = t;
+	action.actor = actor;
+	RollbackNode n_old, n_new;
+	n_old.name = "air";
+	n_new.name = name;
+	n_new.param2 = 3;
+	n_new.meta = "meta of " + name;
+	action.setSetNode(p, n_old, n_new);
+	return action;
+}
+
+void TestRollback::testNodeActions()
+{
+	RollbackLog log(m_dir);
+	std::vector<RollbackAction> actions;
+	actions.push_back(make_set_node(1000, "player:a", v3s16(0, 0, 0), "stone"));
+	actions.push_back(make_set_node(1001, "player:b", v3s16(1, 0, 0), "dirt"));
+	actions.push_back(make_set_node(1001, "player:a", v3s16(300, 0, 0), "sand"));
+	actions.push_back(make_set_node(1002, "player:b", v3s16(0, 2, 0), "wood"));
+	log.append(std::move(actions));
+
+	auto near = log.getActionsNear(0, v3s16(0, 0, 0), 2, 10);
+	UASSERTEQ(size_t, near.size(), 3);
+	// newest first
+	auto it = near.begin();
+	UASSERTEQ(std::string, it->n_new.name, "wood");
+	UASSERT(it->p == v3s16(0, 2, 0));
+	UASSERTEQ(time_t, it->unix_time, 1002);
+	it++;
+	UASSERTEQ(std::string, it->n_new.name, "dirt");
+	UASSERTEQ(std::string, it->n_new.meta, "meta of dirt");
+	UASSERTEQ(int, it->n_new.param2, 3);
+	UASSERTEQ(std::string, it->n_old.name, "air");
+	UASSERTEQ(std::string, it->actor, "player:b");
+	it++;
+	UASSERTEQ(std::string, it->n_new.name, "stone");
+
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(0, 0, 0), 2, 1).size(), 1);
+	UASSERTEQ(size_t, log.getActionsNear(1001, v3s16(0, 0, 0), 2, 10).size(), 2);
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(0, 0, 0), 1, 10).size(), 2);
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(300, 0, 0), 0, 10).size(), 1);
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(-300, 0, 0), 5, 10).size(), 0);
+	// ranges reaching past the edge of the map
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(S16_MAX, 0, 0), S16_MAX - 1, 10).size(), 2);
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(S16_MIN, 0, 0), INT_MAX, 10).size(), 4);
+	// negative ranges count as 0
+	UASSERTEQ(size_t, log.getActionsNear(0, v3s16(0, 0, 0), -1, 10).size(), 1);
+
+	auto since = log.getActionsSince(1001, "player:a");
+	UASSERTEQ(size_t, since.size(), 1);
+	UASSERTEQ(std::string, since.front().n_new.name, "sand");
+	UASSERTEQ(size_t, log.getActionsSince(0, "").size(), 4);
+	UASSERTEQ(size_t, log.getActionsSince(0, "player:c").size(), 0);
+}
+
+void TestRollback::testInventoryActions(IGameDef *gamedef)
+{
+	{
+		RollbackLog log(m_dir);
+		RollbackAction action;
+		action.unix_time = 5000;
+		action.actor = "player:a";
+		action.setModifyInventoryStack("nodemeta:10,20,30", "main", 7, true,
+			ItemStack("default:dirt", 5, 0, gamedef->idef()));
+		RollbackAction action2 = action;
+		action2.inventory_location = "player:a";
+		log.append({action, action2});
+	}
+
+	// read back after reopening
+	RollbackLog log(m_dir);
+	auto near = log.getActionsNear(0, v3s16(10, 20, 30), 0, 10);
+	UASSERTEQ(size_t, near.size(), 1);
+	const RollbackAction &action = near.front();
+	UASSERT(action.type == RollbackAction::TYPE_MODIFY_INVENTORY_STACK);
+	UASSERTEQ(std::string, action.inventory_location, "nodemeta:10,20,30");
+	UASSERTEQ(std::string, action.inventory_list, "main");
+	UASSERTEQ(u32, action.inventory_index, 7);
+	UASSERT(action.inventory_add);
+	UASSERTEQ(std::string, action.inventory_stack.name, "default:dirt");
+	UASSERTEQ(u16, action.inventory_stack.count, 5);
+
+	UASSERTEQ(size_t, log.getActionsSince(0, "player:a").size(), 2);
+}
+
+void TestRollback::testSegments()
+{
+	const time_t t0 = 100000;
+	const time_t d = RollbackLog::SEGMENT_DURATION;
+	{
+		RollbackLog log(m_dir);
+		for (int i = 0; i < 3; i++) {
+			std::vector<RollbackAction> actions;
+			for (int j = 0; j < 10; j++) {
+				actions.push_back(make_set_node(t0 + i * d + j,
+					"player:" + std::to_string(i), v3s16(i * 1000, 0, j), "stone"));
+			}
+			log.append(std::move(actions));
+		}
+		log.sync();
+		UASSERTEQ(size_t, log.getSegmentCount(), 3);
+	}
+
+	// the index of an incomplete segment is rebuilt
+	fs::DeleteSingleFileOrEmptyDirectory(m_dir + DIR_DELIM + std::to_string(t0 + d) + ".idx");
+
+	RollbackLog log(m_dir);
+	UASSERTEQ(size_t, log.getSegmentCount(), 3);
+
+	auto since = log.getActionsSince(0, "");
+	UASSERTEQ(size_t, since.size(), 30);
+	UASSERTEQ(time_t, since.front().unix_time, t0 + 2 * d + 9);
+	UASSERTEQ(time_t, since.back().unix_time, t0);
+
+	UASSERTEQ(size_t, log.getActionsSince(0, "player:1").size(), 10);
+	UASSERTEQ(size_t, log.getActionsSince(t0 + d + 5, "player:1").size(), 5);
+	auto near = log.getActionsNear(0, v3s16(1000, 0, 0), 3, 100);
+	UASSERTEQ(size_t, near.size(), 4);
+	UASSERTEQ(std::string, near.front().actor, "player:1");
+
+	// new actions go to a new segment
+	log.append({make_set_node(t0 + 2 * d + 20, "player:2", v3s16(0, 0, 0), "dirt")});
+	log.sync();
+	UASSERTEQ(size_t, log.getSegmentCount(), 4);
+	near = log.getActionsNear(0, v3s16(0, 0, 0), 0, 1);
+	UASSERTEQ(size_t, near.size(), 1);
+	UASSERTEQ(std::string, near.front().n_new.name, "dirt");
+}
+
+void TestRollback::testSameStartTime()
+{
+	const time_t t0 = 100000;
+	{
+		RollbackLog log(m_dir);
+		log.append({make_set_node(t0, "player:a", v3s16(0, 0, 0), "stone")});
+	}
+
+	// the second segment starts in the same second as the first one
+	{
+		RollbackLog log(m_dir);
+		std::vector<RollbackAction> actions;
+		for (int i = 0; i < 5; i++)
+			actions.push_back(make_set_node(t0 + i / 2, "player:b", v3s16(i, 0, 0), "dirt"));
+		log.append(std::move(actions));
+		log.sync();
+		UASSERTEQ(size_t, log.getSegmentCount(), 2);
+	}
+
+	RollbackLog log(m_dir);
+	UASSERTEQ(size_t, log.getSegmentCount(), 2);
+	auto since = log.getActionsSince(0, "");
+	UASSERTEQ(size_t, since.size(), 6);
+	UASSERTEQ(time_t, since.front().unix_time, t0 + 2);
+	UASSERTEQ(std::string, since.back().n_new.name, "stone");
+	UASSERTEQ(size_t, log.getActionsSince(0, "player:b").size(), 5);
+}
@@ -6,10 +6,15 @@
 
 #include "mock_server.h"
 #include "server/luaentity_sao.h"
+#include "server/player_sao.h"
+#include "server/clientiface.h"
+#include "remoteplayer.h"
 #include "serverenvironment.h"
 #include "servermap.h"
 #include "emerge.h"
 
+#include <random>
+
 /*
  * Tests how SAOs behave in the server environment.
  * See also test_serveractiveobjectmgr.cpp and test_activeobject.cpp for other tests.
@@ -28,6 +33,7 @@ class TestSAO : public TestBase
 	void testActivate(ServerEnvironment *env);
 	void testStaticToFalse(ServerEnvironment *env);
 	void testStaticToTrue(ServerEnvironment *env);
+	void testVisibilityUpdate(ServerEnvironment *env, IGameDef *gamedef);
 
 private:
 	// enough for both removeRemovedObjects and deactivateFarObjects to be called
@@ -87,6 +93,7 @@ void TestSAO::runTests(IGameDef *gamedef)
 	TEST(testActivate, &env);
 	TEST(testStaticToFalse, &env);
 	TEST(testStaticToTrue, &env);
+	TEST(testVisibilityUpdate, &env, gamedef);
 
 	env.deactivateBlocksAndObjects();
 }
@@ -300,3 +307,58 @@ void TestSAO::testStaticToTrue(ServerEnvironment *env)
 	UASSERTEQ(size_t, block->m_static_objects.getStoredSize(), 1);
 	UASSERTEQ(size_t, block->m_static_objects.getActiveSize(), 0);
 }
+
+void TestSAO::testVisibilityUpdate(ServerEnvironment *env, IGameDef *gamedef)
+{
+	const v3f center(500 * BS, 0, 0);
+	const s16 radius = 2 * MAP_BLOCKSIZE;
+
+	RemotePlayer player("visibility", gamedef->idef());
+	PlayerSAO playersao(env, &player, 1, false);
+	playersao.setBasePosition(center);
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<f32> spread(-48 * BS, 48 * BS);
+	std::uniform_real_distribution<f32> step(-3 * BS, 3 * BS);
+	std::uniform_real_distribution<f32> player_step(-1.5f * BS, 1.5f * BS);
+
+	std::vector<LuaEntitySAO *> objects;
+	for (int i = 0; i < 200; i++) {
+		auto obj = add_entity(env, center + v3f(spread(rng), spread(rng), spread(rng)),
+			"test:non_static");
+		UASSERT(obj);
+		objects.push_back(obj);
+	}
+
+	std::set<u16> known;
+	KnownObjectsState state;
+	for (int round = 0; round < 100; round++) {
+		env->beginActiveObjectVisibilityUpdate();
+
+		std::vector<std::pair<bool, u16>> removed;
+		std::vector<u16> added;
+		env->getActiveObjectChanges(&playersao, radius, radius, known, state,
+			removed, added);
+		for (auto &it : removed)
+			known.erase(it.second);
+		known.insert(added.begin(), added.end());
+
+		// Must match what a client that is new in this round would get
+		KnownObjectsState fresh_state;
+		std::vector<std::pair<bool, u16>> fresh_removed;
+		std::vector<u16> fresh_added;
+		env->getActiveObjectChanges(&playersao, radius, radius, {}, fresh_state,
+			fresh_removed, fresh_added);
+		UASSERT(fresh_removed.empty());
+		UASSERT(known == std::set<u16>(fresh_added.begin(), fresh_added.end()));
+
+		for (auto *obj : objects)
+			obj->setBasePosition(obj->getBasePosition() + v3f(step(rng), step(rng), step(rng)));
+		playersao.setBasePosition(playersao.getBasePosition() +
+			v3f(player_step(rng), player_step(rng), player_step(rng)));
+	}
+
+	for (auto *obj : objects)
+		obj->markForRemoval();
+	env->step(m_step_interval);
+}
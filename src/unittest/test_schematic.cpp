@@ -5,8 +5,11 @@
 #include "test.h"
 
 #include "mapgen/mg_schematic.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
 #include "gamedef.h"
 #include "nodedef.h"
+#include "util/numeric.h"
 
 class TestSchematic : public TestBase {
 public:
@@ -18,6 +21,7 @@ class TestSchematic : public TestBase {
 	void testMtsSerializeDeserialize(const NodeDefManager *ndef);
 	void testLuaTableSerialize(const NodeDefManager *ndef);
 	void testFileSerializeDeserialize(const NodeDefManager *ndef);
+	void testBlitToVManip();
 
 	static const content_t test_schem1_data[7 * 6 * 4];
 	static const content_t test_schem2_data[3 * 3 * 3];
@@ -39,6 +43,8 @@ void TestSchematic::runTests(IGameDef *gamedef)
 	TEST(testFileSerializeDeserialize, ndef);
 
 	ndef->resetNodeResolveState();
+
+	TEST(testBlitToVManip);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -172,6 +178,160 @@ void TestSchematic::testFileSerializeDeserialize(const NodeDefManager *ndef)
 }
 
 
+// Placement as done before schematics were compiled, node by node
+static void blit_reference(const Schematic &schem, const NodeDefManager *ndef,
+	MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+{
+	const v3s16 size = schem.size;
+	int ystride = size.X;
+	int zstride = size.X * size.Y;
+
+	s16 sx = size.X, sy = size.Y, sz = size.Z;
+	int i_start = 0, i_step_x = 1, i_step_z = zstride;
+	if (rot == ROTATE_90) {
+		i_start = sx - 1;
+		i_step_x = zstride;
+		i_step_z = -1;
+		std::swap(sx, sz);
+	} else if (rot == ROTATE_180) {
+		i_start = zstride * (sz - 1) + sx - 1;
+		i_step_x = -1;
+		i_step_z = -zstride;
+	} else if (rot == ROTATE_270) {
+		i_start = zstride * (sz - 1);
+		i_step_x = -zstride;
+		i_step_z = 1;
+		std::swap(sx, sz);
+	}
+
+	s16 y_map = p.Y;
+	for (s16 y = 0; y != sy; y++) {
+		if ((schem.slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
+			(schem.slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+			continue;
+
+		for (s16 z = 0; z != sz; z++) {
+			u32 i = z * i_step_z + y * ystride + i_start;
+			for (s16 x = 0; x != sx; x++, i += i_step_x) {
+				v3s16 pos(p.X + x, y_map, p.Z + z);
+				const MapNode &n = schem.schemdata[i];
+				u8 placement_prob = n.param1 & MTSCHEM_PROB_MASK;
+				if (!vm->m_area.contains(pos) ||
+						n.getContent() == CONTENT_IGNORE ||
+						placement_prob == MTSCHEM_PROB_NEVER)
+					continue;
+
+				u32 vi = vm->m_area.index(pos);
+				if (!force_place && !(n.param1 & MTSCHEM_FORCE_PLACE)) {
+					content_t c = vm->m_data[vi].getContent();
+					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
+						continue;
+				}
+
+				if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
+					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+					continue;
+
+				vm->m_data[vi] = n;
+				vm->m_data[vi].param1 = 0;
+				if (rot)
+					vm->m_data[vi].rotateAlongYAxis(ndef, rot);
+			}
+		}
+		y_map++;
+	}
+}
+
+
+void TestSchematic::testBlitToVManip()
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t c_stone, c_stairs;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, std::move(f));
+	}
+	{
+		ContentFeatures f;
+		f.name = "stairs";
+		f.param_type_2 = CPT2_FACEDIR;
+		c_stairs = ndef->set(f.name, std::move(f));
+	}
+
+	const v3s16 bpmin(-1, -1, -1), bpmax(0, 0, 0);
+	DummyMap map(&gamedef, bpmin, bpmax);
+
+	static const v3s16 size(7, 5, 4);
+	static const u32 volume = size.X * size.Y * size.Z;
+	static const content_t contents[] = {CONTENT_IGNORE, CONTENT_AIR, 0, 0};
+	static const u8 probs[] = {
+		MTSCHEM_PROB_NEVER, MTSCHEM_PROB_ALWAYS, MTSCHEM_PROB_ALWAYS, 0x3F,
+	};
+
+	Schematic schem;
+	schem.m_ndef      = ndef;
+	schem.size        = size;
+	schem.schemdata   = new MapNode[volume];
+	schem.slice_probs = new u8[size.Y];
+
+	const auto fill_schematic = [&] () {
+		for (u32 i = 0; i != volume; i++) {
+			content_t c = contents[myrand_range(0, 3)];
+			if (c == 0)
+				c = myrand_range(0, 1) ? c_stone : c_stairs;
+			u8 param1 = probs[myrand_range(0, 3)];
+			if (myrand_range(0, 3) == 0)
+				param1 |= MTSCHEM_FORCE_PLACE;
+			schem.schemdata[i] = MapNode(c, param1, myrand_range(0, 23));
+		}
+		for (s16 y = 0; y != size.Y; y++)
+			schem.slice_probs[y] = probs[myrand_range(1, 3)];
+	};
+
+	const auto fill_vmanip = [&] (MMVManip &vm) {
+		static const content_t existing[] = {CONTENT_AIR, CONTENT_IGNORE};
+		vm.addArea(VoxelArea(v3s16(-10, -10, -10), v3s16(10, 10, 10)));
+		for (u32 i = 0; i != vm.m_area.getVolume(); i++) {
+			int r = myrand_range(0, 2);
+			vm.m_data[i] = MapNode(r == 2 ? c_stone : existing[r]);
+		}
+	};
+
+	mysrand(42);
+	for (int round = 0; round != 2; round++) {
+		fill_schematic();
+		schem.invalidateCompiled();
+
+		// Fully inside, and sticking out of each side of the area
+		for (v3s16 p : {v3s16(-3, -2, -3), v3s16(-13, -2, -3), v3s16(6, -2, -3),
+				v3s16(-3, -13, -3), v3s16(-3, 8, -3), v3s16(-3, -2, -12),
+				v3s16(-3, -2, 8), v3s16(-20, -20, -20)})
+		for (int rot = ROTATE_0; rot <= ROTATE_270; rot++)
+		for (bool force_place : {false, true}) {
+			u64 seed = myrand();
+			MMVManip vm1(&map), vm2(&map);
+
+			mysrand(seed);
+			fill_vmanip(vm1);
+			blit_reference(schem, ndef, &vm1, p, (Rotation)rot, force_place);
+			u32 after_reference = myrand();
+
+			mysrand(seed);
+			fill_vmanip(vm2);
+			schem.blitToVManip(&vm2, p, (Rotation)rot, force_place);
+			// Random numbers were drawn in the same order
+			UASSERTEQ(u32, myrand(), after_reference);
+
+			for (u32 i = 0; i != vm1.m_area.getVolume(); i++)
+				UASSERT(vm1.m_data[i] == vm2.m_data[i]);
+		}
+	}
+}
+
+
 // Should form a cross-shaped-thing...?
 const content_t TestSchematic::test_schem1_data[7 * 6 * 4] = {
 	3, 3, 1, 1, 1, 3, 3, // Y=0, Z=0
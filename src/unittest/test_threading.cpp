@@ -6,8 +6,11 @@
 
 #include <atomic>
 #include <iostream>
+#include <thread>
 #include "threading/semaphore.h"
 #include "threading/thread.h"
+#include "threading/thread_pool.h"
+#include "exceptions.h"
 
 
 class TestThreading : public TestBase {
@@ -19,6 +22,7 @@ class TestThreading : public TestBase {
 	void testStartStopWait();
 	void testAtomicSemaphoreThread();
 	void testTLS();
+	void testThreadPool();
 };
 
 static TestThreading g_test_instance;
@@ -28,6 +32,7 @@ void TestThreading::runTests(IGameDef *gamedef)
 	TEST(testStartStopWait);
 	TEST(testAtomicSemaphoreThread);
 	TEST(testTLS);
+	TEST(testThreadPool);
 }
 
 class SimpleTestThread : public Thread {
@@ -227,3 +232,72 @@ void TestThreading::testTLS()
 		}
 	}
 }
+
+
+void TestThreading::testThreadPool()
+{
+	ThreadPool pool("TestPool", 3);
+	UASSERTEQ(u32, pool.getConcurrency(), 4);
+
+	// every index is visited exactly once, also across repeated jobs
+	std::vector<std::atomic<u32>> visited(1000);
+	for (int j = 0; j < 10; j++) {
+		pool.run(visited.size(), [&] (size_t i) {
+			visited[i]++;
+		});
+	}
+	for (auto &v : visited)
+		UASSERTEQ(u32, v, 10);
+
+	// exceptions end up on the calling thread
+	bool caught = false;
+	try {
+		pool.run(100, [] (size_t i) {
+			if (i == 42)
+				throw BaseException("test");
+		});
+	} catch (BaseException &e) {
+		caught = true;
+	}
+	UASSERT(caught);
+
+	// still usable afterwards
+	std::atomic<u32> sum{0};
+	pool.run(10, [&] (size_t i) { sum += i; });
+	UASSERTEQ(u32, sum, 45);
+
+	// tryRun() refuses while another thread runs a job
+	std::atomic<bool> ran_nested{false};
+	bool nested_result = true;
+	pool.run(2, [&] (size_t i) {
+		if (i != 0)
+			return;
+		std::thread other([&] {
+			nested_result = pool.tryRun(10, [&] (size_t) { ran_nested = true; });
+		});
+		other.join();
+	});
+	UASSERT(!nested_result);
+	UASSERT(!ran_nested);
+
+	// runShared() does the work on the caller instead
+	sum = 0;
+	pool.run(2, [&] (size_t i) {
+		if (i != 0)
+			return;
+		std::thread other([&] {
+			pool.runShared(10, [&] (size_t j) { sum += j; });
+		});
+		other.join();
+	});
+	UASSERTEQ(u32, sum, 45);
+	sum = 0;
+	UASSERT(pool.tryRun(10, [&] (size_t i) { sum += i; }));
+	UASSERTEQ(u32, sum, 45);
+
+	// no workers at all
+	ThreadPool serial("TestPool", 0);
+	sum = 0;
+	serial.run(10, [&] (size_t i) { sum += i; });
+	UASSERTEQ(u32, sum, 45);
+}
@@ -9,6 +9,7 @@
 #include <prometheus/registry.h>
 #include <prometheus/counter.h>
 #include <prometheus/gauge.h>
+#include <prometheus/histogram.h>
 #include "log.h"
 #include "settings.h"
 #include "exceptions.h"
@@ -72,6 +73,45 @@ class SimpleMetricGauge : public MetricGauge
 	double m_gauge;
 };
 
+class SimpleMetricHistogram : public MetricHistogram
+{
+public:
+	SimpleMetricHistogram(const std::vector<double> &buckets) :
+		MetricHistogram(), m_bounds(buckets), m_counts(buckets.size() + 1, 0)
+	{}
+
+	virtual ~SimpleMetricHistogram() {}
+
+	void observe(double value) override
+	{
+		size_t i = 0;
+		while (i < m_bounds.size() && value > m_bounds[i])
+			i++;
+		MutexAutoLock lock(m_mutex);
+		m_counts[i]++;
+		m_count += 1.0;
+		m_sum += value;
+	}
+	double getCount() const override
+	{
+		MutexAutoLock lock(m_mutex);
+		return m_count;
+	}
+	double getSum() const override
+	{
+		MutexAutoLock lock(m_mutex);
+		return m_sum;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	const std::vector<double> m_bounds;
+	// last one counts the values above all bounds
+	std::vector<u64> m_counts;
+	double m_count = 0.0;
+	double m_sum = 0.0;
+};
+
 MetricCounterPtr MetricsBackend::addCounter(
 		const std::string &name, const std::string &help_str, Labels labels)
 {
@@ -84,6 +124,13 @@ MetricGaugePtr MetricsBackend::addGauge(
 	return std::make_shared<SimpleMetricGauge>();
 }
 
+MetricHistogramPtr MetricsBackend::addHistogram(
+		const std::string &name, const std::string &help_str,
+		const std::vector<double> &buckets, Labels labels)
+{
+	return std::make_shared<SimpleMetricHistogram>(buckets);
+}
+
 /* Prometheus backend */
 
 #if USE_PROMETHEUS
@@ -144,6 +191,40 @@ class PrometheusMetricGauge : public MetricGauge
 	prometheus::Gauge &m_gauge;
 };
 
+class PrometheusMetricHistogram : public MetricHistogram
+{
+public:
+	PrometheusMetricHistogram() = delete;
+
+	PrometheusMetricHistogram(const std::string &name, const std::string &help_str,
+			const std::vector<double> &buckets, MetricsBackend::Labels labels,
+			std::shared_ptr<prometheus::Registry> registry) :
+			MetricHistogram(),
+			m_family(prometheus::BuildHistogram()
+							.Name(name)
+							.Help(help_str)
+							.Register(*registry)),
+			m_histogram(m_family.Add(labels, buckets))
+	{
+	}
+
+	virtual ~PrometheusMetricHistogram() {}
+
+	virtual void observe(double value) { m_histogram.Observe(value); }
+	virtual double getCount() const
+	{
+		return m_histogram.Collect().histogram.sample_count;
+	}
+	virtual double getSum() const
+	{
+		return m_histogram.Collect().histogram.sample_sum;
+	}
+
+private:
+	prometheus::Family<prometheus::Histogram> &m_family;
+	prometheus::Histogram &m_histogram;
+};
+
 class PrometheusMetricsBackend : public MetricsBackend
 {
 public:
@@ -162,6 +243,9 @@ class PrometheusMetricsBackend : public MetricsBackend
 	MetricGaugePtr addGauge(
 			const std::string &name, const std::string &help_str,
 			Labels labels = {}) override;
+	MetricHistogramPtr addHistogram(
+			const std::string &name, const std::string &help_str,
+			const std::vector<double> &buckets, Labels labels = {}) override;
 
 private:
 	std::unique_ptr<prometheus::Exposer> m_exposer;
@@ -180,6 +264,14 @@ MetricGaugePtr PrometheusMetricsBackend::addGauge(
 	return std::make_shared<PrometheusMetricGauge>(name, help_str, labels, m_registry);
 }
 
+MetricHistogramPtr PrometheusMetricsBackend::addHistogram(
+		const std::string &name, const std::string &help_str,
+		const std::vector<double> &buckets, Labels labels)
+{
+	return std::make_shared<PrometheusMetricHistogram>(name, help_str,
+		buckets, labels, m_registry);
+}
+
 MetricsBackend *createPrometheusMetricsBackend()
 {
 	std::string addr;
@@ -0,0 +1,192 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti Authors
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*
+This implements a uniform spatial hash grid of 3D points.
+
+Space is divided into cubic cells of a fixed size, and each non-empty cell
+keeps the points inside it in a small vector. A second map finds the cell and
+slot of a point by its id, so removing a point is a swap with the last one of
+its cell, and moving a point within its cell only overwrites the position.
+Moving to another cell is a remove plus an insert, still O(1).
+
+Range queries visit the cells overlapping the box, or all non-empty cells if
+there are fewer of those. This is fast if the cell size is about the size of
+typical queries, and the points are spread over many cells.
+
+The interface matches k_d_tree::DynamicKdTrees.
+*/
+
+namespace spatial_hash
+{
+
+template<class Component, class Id>
+class SpatialHashGrid
+{
+public:
+	using Point = std::array<Component, 3>;
+
+	/// @param cell_size edge length of the cells
+	SpatialHashGrid(Component cell_size) : cell_size(cell_size)
+	{
+		assert(cell_size > 0);
+	}
+
+	void insert(const Point &point, Id id)
+	{
+		assert(locations.find(id) == locations.end());
+		const u64 key = cellKey(point);
+		auto &cell = cells[key];
+		locations[id] = {key, cell.size()};
+		cell.push_back({point, id});
+	}
+
+	void remove(Id id)
+	{
+		const auto it = locations.find(id);
+		assert(it != locations.end());
+		removeFromCell(it->second);
+		locations.erase(it);
+	}
+
+	void update(const Point &newPos, Id id)
+	{
+		const auto it = locations.find(id);
+		assert(it != locations.end());
+		Location &loc = it->second;
+		const u64 key = cellKey(newPos);
+		if (key == loc.cell) {
+			cells[key][loc.slot].point = newPos;
+			return;
+		}
+		removeFromCell(loc);
+		auto &cell = cells[key];
+		loc = {key, cell.size()};
+		cell.push_back({newPos, id});
+	}
+
+	template<typename F>
+	void rangeQuery(const Point &min, const Point &max,
+			const F &cb) const
+	{
+		std::array<s32, 3> cmin, cmax;
+		double n_cells = 1;
+		for (int d = 0; d < 3; d++) {
+			cmin[d] = cellCoord(min[d]);
+			cmax[d] = cellCoord(max[d]);
+			if (cmax[d] < cmin[d])
+				return;
+			n_cells *= (double)cmax[d] - cmin[d] + 1;
+		}
+
+		const auto visit = [&] (const std::vector<Entry> &cell) {
+			for (const Entry &e : cell) {
+				if (inside(e.point, min, max))
+					cb(e.point, e.id);
+			}
+		};
+
+		if (n_cells > cells.size()) {
+			for (const auto &it : cells)
+				visit(it.second);
+			return;
+		}
+
+		for (s32 z = cmin[2]; z <= cmax[2]; z++)
+		for (s32 y = cmin[1]; y <= cmax[1]; y++)
+		for (s32 x = cmin[0]; x <= cmax[0]; x++) {
+			const auto it = cells.find(packKey(x, y, z));
+			if (it != cells.end())
+				visit(it->second);
+		}
+	}
+
+	size_t size() const
+	{
+		return locations.size();
+	}
+
+private:
+	using u64 = std::uint64_t;
+	using s32 = std::int32_t;
+
+	struct Entry {
+		Point point;
+		Id id;
+	};
+	struct Location {
+		u64 cell;
+		size_t slot;
+	};
+
+	// 21 bits per axis (signed) are plenty for any sane cell size
+	static constexpr int KEY_BITS = 21;
+	static constexpr u64 KEY_MASK = (u64(1) << KEY_BITS) - 1;
+
+	static u64 packKey(s32 x, s32 y, s32 z)
+	{
+		return ((u64)x & KEY_MASK) |
+			(((u64)y & KEY_MASK) << KEY_BITS) |
+			(((u64)z & KEY_MASK) << (2 * KEY_BITS));
+	}
+
+	// Coordinates beyond what the key can hold, including infinities, are
+	// clamped to the outermost cells. Their points are still checked against
+	// the query box, so this only makes those cells more crowded.
+	s32 cellCoord(Component c) const
+	{
+		constexpr double lo = -(double)(1 << (KEY_BITS - 1));
+		constexpr double hi = (double)((1 << (KEY_BITS - 1)) - 1);
+		const double v = std::floor((double)c / cell_size);
+		if (!(v >= lo)) // also NaN
+			return (s32)lo;
+		if (v > hi)
+			return (s32)hi;
+		return (s32)v;
+	}
+
+	u64 cellKey(const Point &p) const
+	{
+		return packKey(cellCoord(p[0]), cellCoord(p[1]), cellCoord(p[2]));
+	}
+
+	static bool inside(const Point &p, const Point &min, const Point &max)
+	{
+		for (int d = 0; d < 3; d++) {
+			if (p[d] < min[d] || p[d] > max[d])
+				return false;
+		}
+		return true;
+	}
+
+	// Takes a point out of its cell, the location is not erased
+	void removeFromCell(const Location &loc)
+	{
+		const auto cell_it = cells.find(loc.cell);
+		assert(cell_it != cells.end());
+		auto &cell = cell_it->second;
+		if (loc.slot != cell.size() - 1) {
+			cell[loc.slot] = cell.back();
+			locations[cell[loc.slot].id].slot = loc.slot;
+		}
+		cell.pop_back();
+		if (cell.empty())
+			cells.erase(cell_it);
+	}
+
+	Component cell_size;
+	std::unordered_map<u64, std::vector<Entry>> cells;
+	std::unordered_map<Id, Location> locations;
+};
+
+} // namespace spatial_hash